@@ -37,6 +37,18 @@ typedef double f64;
 typedef unsigned char u8;
 typedef unsigned int u32;
 
+/* 64 bit integers are not part of C89 */
+#if defined(_MSC_VER)
+typedef __int64 s64;
+typedef unsigned __int64 u64;
+#elif defined(__GNUC__) || defined(__clang__)
+__extension__ typedef long long s64;
+__extension__ typedef unsigned long long u64;
+#else
+typedef long s64;
+typedef unsigned long u64;
+#endif
+
 ARITLEX_API ARITLEX_INLINE u32 aritlex_is_digit(s8 c)
 {
   return c >= '0' && c <= '9';
@@ -159,7 +171,7 @@ ARITLEX_API s32 aritlex_strtol(s8 *str, s8 **endptr, int base)
   return sign * result;
 }
 
-ARITLEX_API f64 aritlex_strtod(s8 *str, s8 **endptr)
+ARITLEX_API ARITLEX_INLINE f64 aritlex_strtod(s8 *str, s8 **endptr)
 {
   f64 result = 0.0;
   f64 sign = 1.0;
@@ -248,11 +260,205 @@ ARITLEX_API f64 aritlex_strtod(s8 *str, s8 **endptr)
   return sign * result;
 }
 
-ARITLEX_API f32 aritlex_strtof(s8 *str, s8 **endptr)
+ARITLEX_API ARITLEX_INLINE f32 aritlex_strtof(s8 *str, s8 **endptr)
 {
   return (f32)aritlex_strtod(str, endptr);
 }
 
+/* #############################################################################
+ * # FIXED POINT NUMBERS
+ * #############################################################################
+ *
+ * Qm.n numbers stored in s32 with n = ARITLEX_FIXED_FRACTION_BITS fraction
+ * bits and m = 31 - n integer bits, for targets without a FPU where f64 is
+ * emulated in software. Defining ARITLEX_FIXED_POINT makes the tokenizer
+ * parse TOK_NUM_FLOAT literals with aritlex_fixed_parse only, into the
+ * number_fixed field, with no f64 math. val.number_floating is set to the
+ * exact f64 value of that Qm.n number, so every evaluator sees the literals
+ * with Qm.n precision: the f64 evaluators, the JIT and the code generator
+ * keep working on the same programs and aritlex_eval_fixed reads its
+ * literals without converting f64 at run time. aritlex_specialize keeps the
+ * Qm.n value of literals, only bound variables and folded constants are
+ * rounded from f64.
+ *
+ * Results outside of the Qm.n range saturate to ARITLEX_FIXED_MIN/MAX and
+ * results between two fixed point values round to the nearest one, ties
+ * away from zero.
+ */
+#ifndef ARITLEX_FIXED_FRACTION_BITS
+#define ARITLEX_FIXED_FRACTION_BITS 16 /* 1 to 30 */
+#endif
+
+#define ARITLEX_FIXED_ONE ((s32)1 << ARITLEX_FIXED_FRACTION_BITS)
+#define ARITLEX_FIXED_MAX ((s32)0x7FFFFFFF)
+#define ARITLEX_FIXED_MIN (-ARITLEX_FIXED_MAX - 1)
+
+typedef s32 aritlex_fixed;
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_saturate(s64 x)
+{
+  return x > ARITLEX_FIXED_MAX ? ARITLEX_FIXED_MAX : (x < ARITLEX_FIXED_MIN ? ARITLEX_FIXED_MIN : (aritlex_fixed)x);
+}
+
+/* Applies the sign to a magnitude in fixed point units, magnitude must be below 2^63 */
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_signed(u64 magnitude, u32 negative)
+{
+  return aritlex_fixed_saturate(negative ? -(s64)magnitude : (s64)magnitude);
+}
+
+/* Same syntax as aritlex_strtod but only uses integer arithmetic */
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_parse(s8 *str, s8 **endptr)
+{
+  u64 mantissa = 0; /* first 18 significant digits */
+  u64 scale = 1;
+  u64 quotient, remainder;
+  u32 digits = 0, negative = 0, i;
+  s32 exponent = 0; /* value = mantissa * 10^exponent */
+  s32 exp_value = 0, exp_sign = 1;
+
+  if (*str == '-')
+  {
+    negative = 1;
+    str++;
+  }
+  else if (*str == '+')
+  {
+    str++;
+  }
+
+  /* Integer part */
+  while (aritlex_is_digit(*str) || *str == '_')
+  {
+    if (*str != '_')
+    {
+      if (digits < 18)
+      {
+        mantissa = mantissa * 10 + (u64)(*str - '0');
+        digits += mantissa != 0;
+      }
+      else
+      {
+        exponent++;
+      }
+    }
+    str++;
+  }
+
+  /* Fraction, digits beyond the 18th are below the resolution of any Qm.n format */
+  if (*str == '.')
+  {
+    str++;
+    while (aritlex_is_digit(*str) || *str == '_')
+    {
+      if (*str != '_' && digits < 18)
+      {
+        mantissa = mantissa * 10 + (u64)(*str - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+      str++;
+    }
+  }
+
+  /* Exponent */
+  if (*str == 'e' || *str == 'E')
+  {
+    str++;
+    if (*str == '-')
+    {
+      exp_sign = -1;
+      str++;
+    }
+    else if (*str == '+')
+    {
+      str++;
+    }
+
+    while (aritlex_is_digit(*str) || *str == '_')
+    {
+      if (*str != '_' && exp_value < 10000)
+      {
+        exp_value = exp_value * 10 + (*str - '0');
+      }
+      str++;
+    }
+  }
+
+  if (endptr)
+    *endptr = (s8 *)str;
+
+  exponent += exp_sign * exp_value;
+
+  /* Positive exponents only need to be applied until the value saturates */
+  while (exponent > 0 && mantissa != 0 && mantissa <= 0xFFFFFFFFu)
+  {
+    mantissa *= 10;
+    exponent--;
+  }
+
+  /* Keep 10^-exponent (and twice the remainder below) within u64 */
+  while (exponent < -18)
+  {
+    mantissa /= 10;
+    exponent++;
+  }
+
+  while (exponent < 0)
+  {
+    scale *= 10;
+    exponent++;
+  }
+
+  quotient = mantissa / scale;
+  remainder = mantissa % scale;
+
+  if (quotient > 0xFFFFFFFFu)
+  {
+    return negative ? ARITLEX_FIXED_MIN : ARITLEX_FIXED_MAX;
+  }
+
+  /* Long division of the fraction, one bit at a time */
+  for (i = 0; i < ARITLEX_FIXED_FRACTION_BITS; ++i)
+  {
+    remainder *= 2;
+    quotient = quotient * 2 + (remainder >= scale);
+    remainder -= remainder >= scale ? scale : 0;
+  }
+
+  return aritlex_fixed_signed(quotient + (remainder * 2 >= scale && remainder != 0), negative);
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_from_s32(s32 x)
+{
+  return aritlex_fixed_saturate((s64)x * ARITLEX_FIXED_ONE);
+}
+
+/* Truncates toward zero like a f64 to s32 conversion */
+ARITLEX_API ARITLEX_INLINE s32 aritlex_fixed_to_s32(aritlex_fixed x)
+{
+  return x >= 0 ? x >> ARITLEX_FIXED_FRACTION_BITS : -(s32)((-(s64)x) >> ARITLEX_FIXED_FRACTION_BITS);
+}
+
+/* Conversions for hosts with a FPU, NaN maps to 0 */
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_from_f64(f64 x)
+{
+  f64 scaled = x * (f64)ARITLEX_FIXED_ONE;
+
+  if (scaled != scaled)
+  {
+    return 0;
+  }
+
+  scaled += scaled < 0.0 ? -0.5 : 0.5;
+
+  return scaled >= 2147483647.0 ? ARITLEX_FIXED_MAX : (scaled <= -2147483648.0 ? ARITLEX_FIXED_MIN : (aritlex_fixed)scaled);
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_fixed_to_f64(aritlex_fixed x)
+{
+  return (f64)x / (f64)ARITLEX_FIXED_ONE;
+}
+
 typedef enum aritlex_token_type
 {
   TOK_NUM_INTEGER,
@@ -314,6 +520,10 @@ typedef struct aritlex_token
 
   } val;
 
+#ifdef ARITLEX_FIXED_POINT
+  s32 number_fixed; /* Qm.n value of a TOK_NUM_FLOAT, val.number_floating holds the f64 one */
+#endif
+
 } aritlex_token;
 
 ARITLEX_API ARITLEX_INLINE u32 aritlex_tokenize(
@@ -433,6 +643,17 @@ ARITLEX_API ARITLEX_INLINE u32 aritlex_tokenize(
       }
 
       /* Suffix f/F means float, otherwise double */
+#ifdef ARITLEX_FIXED_POINT
+      /* Only parsed into Qm.n, the f64 value is its exact conversion */
+      if (*code == 'f' || *code == 'F' || is_float)
+      {
+        aritlex_fixed val = aritlex_fixed_parse(start, (void *)0);
+        tokens[*tokens_size].type = TOK_NUM_FLOAT;
+        tokens[*tokens_size].number_fixed = val;
+        tokens[(*tokens_size)++].val.number_floating = aritlex_fixed_to_f64(val);
+        code += *code == 'f' || *code == 'F';
+      }
+#else
       if (*code == 'f' || *code == 'F')
       {
         f32 val = aritlex_strtof(start, (void *)0);
@@ -446,6 +667,7 @@ ARITLEX_API ARITLEX_INLINE u32 aritlex_tokenize(
         tokens[*tokens_size].type = TOK_NUM_FLOAT;
         tokens[(*tokens_size)++].val.number_floating = val;
       }
+#endif
       else
       {
         s32 val = aritlex_strtol(start, (char **)&code, 10);
@@ -514,10 +736,15 @@ ARITLEX_API ARITLEX_INLINE u32 aritlex_tokenize(
 
       while (aritlex_is_alpha(*code) || aritlex_is_digit(*code) || (*code) == '_')
       {
-        tokens[*tokens_size].val.name[i++] = *code;
+        /* Names longer than the token buffer are truncated */
+        if (i < (int)sizeof(tokens[*tokens_size].val.name) - 1)
+        {
+          tokens[*tokens_size].val.name[i++] = *code;
+        }
         code++;
       }
 
+      tokens[*tokens_size].val.name[i] = '\0'; /* null terminate */
       tokens[(*tokens_size)++].type = TOK_VAR;
 
       break;
@@ -827,6 +1054,6000 @@ ARITLEX_API ARITLEX_INLINE u32 aritlex_tokenize(
   return 1;
 }
 
+/* #############################################################################
+ * # EXPRESSION COMPILER
+ * #############################################################################
+ *
+ * Compiles the tokens of aritlex_tokenize into a postfix (RPN) instruction
+ * stream. Operators keep their aritlex_token_type so every evaluator below
+ * switches on the same enum the lexer produces.
+ *
+ * Values follow C semantics for the two literal types:
+ *   - integer op integer stays s32 (wrapping), anything involving a float is f64
+ *   - %, &, |, ^, ~, <<, >> truncate float operands to s32
+ *   - comparisons, !, && and || yield s32 0 or 1
+ *   - integer division or modulo by zero yields 0
+ *   - variables are f64
+ * Expressions have no side effects, so ?:, && and || evaluate all operands.
+ * This is what allows the branch free (mask and blend) batch evaluation.
+ */
+#ifndef ARITLEX_PROGRAM_CAPACITY
+#define ARITLEX_PROGRAM_CAPACITY 256 /* Max instructions per compiled expression */
+#endif
+
+#ifndef ARITLEX_VARS_CAPACITY
+#define ARITLEX_VARS_CAPACITY 32 /* Max distinct variables per compiled expression */
+#endif
+
+#ifndef ARITLEX_STACK_CAPACITY
+#define ARITLEX_STACK_CAPACITY 32 /* Max evaluation stack depth */
+#endif
+
+#ifndef ARITLEX_NESTING_MAX
+#define ARITLEX_NESTING_MAX 64 /* Max parser recursion (parentheses, unary and ternary chains) */
+#endif
+
+#define ARITLEX_SLOT_INVALID 0xFFFFFFFFu
+#define ARITLEX_TOKEN_TYPE_COUNT (TOK_XOR_EQ + 1)
+
+typedef enum aritlex_type
+{
+  ARITLEX_TYPE_S32,
+  ARITLEX_TYPE_F64,
+  ARITLEX_TYPE_S64 /* only for variables declared as s64, see aritlex_infer */
+
+} aritlex_type;
+
+typedef struct aritlex_value
+{
+  aritlex_type type;
+
+  union
+  {
+    s32 number_integer;  /* valid if ARITLEX_TYPE_S32 */
+    f64 number_floating; /* valid if ARITLEX_TYPE_F64 */
+
+  } val;
+
+} aritlex_value;
+
+typedef struct aritlex_instruction
+{
+  aritlex_token_type type; /* TOK_NUM_* pushes a constant, TOK_VAR loads a slot, everything else is an operator */
+  u32 arity;               /* 0 for constants and loads, 1 for unary -, !, ~, 2 for binary, 3 for ?: (TOK_QMARK) */
+
+  union
+  {
+    s32 number_integer;  /* valid if TOK_NUM_INTEGER */
+    f64 number_floating; /* valid if TOK_NUM_FLOAT   */
+    u32 slot;            /* valid if TOK_VAR         */
+
+  } val;
+
+#ifdef ARITLEX_FIXED_POINT
+  s32 number_fixed; /* Qm.n value of a TOK_NUM_FLOAT */
+#endif
+
+} aritlex_instruction;
+
+typedef struct aritlex_program
+{
+  aritlex_instruction code[ARITLEX_PROGRAM_CAPACITY];
+  u32 code_size;
+  u32 stack_size; /* Max stack depth needed to evaluate code */
+
+  s8 vars[ARITLEX_VARS_CAPACITY][32]; /* Slot -> variable name, in order of first use */
+  u32 vars_size;
+
+} aritlex_program;
+
+typedef struct aritlex_parser
+{
+  aritlex_token *tokens;
+  u32 tokens_size;
+  u32 pos;
+  u32 depth;   /* Stack depth after the code emitted so far */
+  u32 nesting; /* Current recursion depth */
+  aritlex_program *program;
+
+} aritlex_parser;
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_name_equals(s8 *a, s8 *b)
+{
+  while (*a && *a == *b)
+  {
+    a++;
+    b++;
+  }
+
+  return *a == *b;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_program_slot(aritlex_program *program, s8 *name)
+{
+  u32 i;
+
+  for (i = 0; i < program->vars_size; ++i)
+  {
+    if (aritlex_name_equals(program->vars[i], name))
+    {
+      return i;
+    }
+  }
+
+  return ARITLEX_SLOT_INVALID;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_binary_precedence(aritlex_token_type type)
+{
+  switch (type)
+  {
+  case TOK_OR_OR:
+    return 1;
+  case TOK_AND_AND:
+    return 2;
+  case TOK_OR:
+    return 3;
+  case TOK_XOR:
+    return 4;
+  case TOK_AND:
+    return 5;
+  case TOK_EQ:
+  case TOK_NEQ:
+    return 6;
+  case TOK_LT:
+  case TOK_LE:
+  case TOK_GT:
+  case TOK_GE:
+    return 7;
+  case TOK_SHL:
+  case TOK_SHR:
+    return 8;
+  case TOK_PLUS:
+  case TOK_MINUS:
+    return 9;
+  case TOK_MUL:
+  case TOK_DIV:
+  case TOK_MOD:
+    return 10;
+  default:
+    return 0; /* Not a binary operator */
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_token_type aritlex_parser_peek(aritlex_parser *p)
+{
+  return p->pos < p->tokens_size ? p->tokens[p->pos].type : TOK_EOF;
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_instruction *aritlex_parser_emit(aritlex_parser *p, aritlex_token_type type, u32 arity)
+{
+  aritlex_program *program = p->program;
+  aritlex_instruction *instruction;
+
+  if (program->code_size >= ARITLEX_PROGRAM_CAPACITY)
+  {
+    return 0;
+  }
+
+  /* Constants and loads push one value, operators pop arity values and push one */
+  p->depth = p->depth + 1 - arity;
+
+  if (p->depth > ARITLEX_STACK_CAPACITY)
+  {
+    return 0;
+  }
+
+  if (p->depth > program->stack_size)
+  {
+    program->stack_size = p->depth;
+  }
+
+  instruction = &program->code[program->code_size++];
+  instruction->type = type;
+  instruction->arity = arity;
+
+  return instruction;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parser_emit_var(aritlex_parser *p, s8 *name)
+{
+  aritlex_program *program = p->program;
+  aritlex_instruction *instruction;
+  u32 slot = aritlex_program_slot(program, name);
+
+  if (slot == ARITLEX_SLOT_INVALID)
+  {
+    u32 i = 0;
+
+    if (program->vars_size >= ARITLEX_VARS_CAPACITY)
+    {
+      return 0;
+    }
+
+    slot = program->vars_size++;
+
+    while (name[i] && i < sizeof(program->vars[slot]) - 1)
+    {
+      program->vars[slot][i] = name[i];
+      i++;
+    }
+
+    program->vars[slot][i] = '\0';
+  }
+
+  instruction = aritlex_parser_emit(p, TOK_VAR, 0);
+
+  if (!instruction)
+  {
+    return 0;
+  }
+
+  instruction->val.slot = slot;
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parse_ternary(aritlex_parser *p);
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parse_unary(aritlex_parser *p)
+{
+  aritlex_token *token;
+  aritlex_instruction *instruction;
+  u32 result = 0;
+
+  if (p->pos >= p->tokens_size || ++p->nesting > ARITLEX_NESTING_MAX)
+  {
+    return 0;
+  }
+
+  token = &p->tokens[p->pos++];
+
+  switch (token->type)
+  {
+  case TOK_NUM_INTEGER:
+  {
+    instruction = aritlex_parser_emit(p, TOK_NUM_INTEGER, 0);
+    if (instruction)
+    {
+      instruction->val.number_integer = token->val.number_integer;
+      result = 1;
+    }
+    break;
+  }
+  case TOK_NUM_FLOAT:
+  {
+    instruction = aritlex_parser_emit(p, TOK_NUM_FLOAT, 0);
+    if (instruction)
+    {
+      instruction->val.number_floating = token->val.number_floating;
+#ifdef ARITLEX_FIXED_POINT
+      instruction->number_fixed = token->number_fixed; /* parsed from the source, not rounded through f64 */
+#endif
+      result = 1;
+    }
+    break;
+  }
+  case TOK_VAR:
+  {
+    result = aritlex_parser_emit_var(p, token->val.name);
+    break;
+  }
+  case TOK_LPAREN:
+  {
+    if (aritlex_parse_ternary(p) && aritlex_parser_peek(p) == TOK_RPAREN)
+    {
+      p->pos++;
+      result = 1;
+    }
+    break;
+  }
+  case TOK_PLUS:
+  {
+    /* Unary plus does not change the value */
+    result = aritlex_parse_unary(p);
+    break;
+  }
+  case TOK_MINUS:
+  case TOK_NOT:
+  case TOK_NOT_BIT:
+  {
+    result = aritlex_parse_unary(p) && aritlex_parser_emit(p, token->type, 1) != 0;
+    break;
+  }
+  default:
+    break;
+  }
+
+  p->nesting--;
+
+  return result;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parse_binary(aritlex_parser *p, u32 min_precedence)
+{
+  if (!aritlex_parse_unary(p))
+  {
+    return 0;
+  }
+
+  for (;;)
+  {
+    aritlex_token_type op = aritlex_parser_peek(p);
+    u32 precedence = aritlex_binary_precedence(op);
+
+    if (precedence == 0 || precedence < min_precedence)
+    {
+      return 1;
+    }
+
+    p->pos++;
+
+    /* All binary operators are left associative */
+    if (!aritlex_parse_binary(p, precedence + 1) || !aritlex_parser_emit(p, op, 2))
+    {
+      return 0;
+    }
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parse_ternary(aritlex_parser *p)
+{
+  u32 result = 0;
+
+  if (++p->nesting > ARITLEX_NESTING_MAX)
+  {
+    return 0;
+  }
+
+  if (aritlex_parse_binary(p, 1))
+  {
+    if (aritlex_parser_peek(p) != TOK_QMARK)
+    {
+      result = 1;
+    }
+    else
+    {
+      p->pos++;
+
+      /* Right associative: a ? b : c ? d : e is a ? b : (c ? d : e) */
+      if (aritlex_parse_ternary(p) && aritlex_parser_peek(p) == TOK_COLON)
+      {
+        p->pos++;
+        result = aritlex_parse_ternary(p) && aritlex_parser_emit(p, TOK_QMARK, 3) != 0;
+      }
+    }
+  }
+
+  p->nesting--;
+
+  return result;
+}
+
+/* Compiles one expression (up to TOK_EOF) into program. Returns 0 on syntax errors or exceeded capacities. */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_compile(
+    aritlex_token *tokens,
+    u32 tokens_size,
+    aritlex_program *program)
+{
+  aritlex_parser parser;
+
+  if (!tokens || tokens_size <= 0 || !program)
+  {
+    return 0;
+  }
+
+  program->code_size = 0;
+  program->stack_size = 0;
+  program->vars_size = 0;
+
+  parser.tokens = tokens;
+  parser.tokens_size = tokens_size;
+  parser.pos = 0;
+  parser.depth = 0;
+  parser.nesting = 0;
+  parser.program = program;
+
+  if (!aritlex_parse_ternary(&parser) || aritlex_parser_peek(&parser) != TOK_EOF)
+  {
+    program->code_size = 0;
+    return 0;
+  }
+
+  return 1;
+}
+
+/* #############################################################################
+ * # EXPRESSION EVALUATOR
+ * #############################################################################
+ */
+ARITLEX_API ARITLEX_INLINE s32 aritlex_f64_to_s32(f64 x)
+{
+  /* NaN and out of range values map to INT_MIN like the x86 cvttsd2si "integer indefinite" */
+  return (x > -2147483649.0 && x < 2147483648.0) ? (s32)x : (s32)(-2147483647 - 1);
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_value_to_f64(aritlex_value v)
+{
+  return v.type == ARITLEX_TYPE_S32 ? (f64)v.val.number_integer : v.val.number_floating;
+}
+
+ARITLEX_API ARITLEX_INLINE s32 aritlex_value_to_s32(aritlex_value v)
+{
+  return v.type == ARITLEX_TYPE_S32 ? v.val.number_integer : aritlex_f64_to_s32(v.val.number_floating);
+}
+
+ARITLEX_API ARITLEX_INLINE s32 aritlex_value_truth(aritlex_value v)
+{
+  return v.type == ARITLEX_TYPE_S32 ? v.val.number_integer != 0 : v.val.number_floating != 0.0;
+}
+
+/* Static result type of an instruction given its operand types (a is the condition for ?:) */
+ARITLEX_API ARITLEX_INLINE aritlex_type aritlex_result_type(aritlex_token_type op, u32 arity, aritlex_type a, aritlex_type b, aritlex_type c)
+{
+  switch (op)
+  {
+  case TOK_NUM_INTEGER:
+    return ARITLEX_TYPE_S32;
+  case TOK_NUM_FLOAT:
+  case TOK_VAR:
+    return ARITLEX_TYPE_F64;
+  case TOK_PLUS:
+  case TOK_MINUS:
+  case TOK_MUL:
+  case TOK_DIV:
+    if (arity == 1)
+    {
+      return a;
+    }
+    return (a == ARITLEX_TYPE_S32 && b == ARITLEX_TYPE_S32) ? ARITLEX_TYPE_S32 : ARITLEX_TYPE_F64;
+  case TOK_QMARK:
+    return (b == ARITLEX_TYPE_S32 && c == ARITLEX_TYPE_S32) ? ARITLEX_TYPE_S32 : ARITLEX_TYPE_F64;
+  default:
+    return ARITLEX_TYPE_S32; /* comparison, logical, bitwise, shift and modulo operators */
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_is_compare(aritlex_token_type op)
+{
+  return op == TOK_EQ || op == TOK_NEQ || op == TOK_LT || op == TOK_LE || op == TOK_GT || op == TOK_GE;
+}
+
+ARITLEX_API ARITLEX_INLINE s32 aritlex_s32_binary(aritlex_token_type op, s32 a, s32 b)
+{
+  switch (op)
+  {
+  case TOK_PLUS:
+    return (s32)((u32)a + (u32)b);
+  case TOK_MINUS:
+    return (s32)((u32)a - (u32)b);
+  case TOK_MUL:
+    return (s32)((u32)a * (u32)b);
+  case TOK_DIV:
+    /* INT_MIN / -1 wraps to INT_MIN instead of trapping */
+    return b == 0 ? 0 : (b == -1 ? (s32)(0u - (u32)a) : a / b);
+  case TOK_MOD:
+    return (b == 0 || b == -1) ? 0 : a % b;
+  case TOK_AND:
+    return a & b;
+  case TOK_OR:
+    return a | b;
+  case TOK_XOR:
+    return a ^ b;
+  case TOK_SHL:
+    return (s32)((u32)a << ((u32)b & 31u));
+  case TOK_SHR:
+    return a >> (b & 31); /* arithmetic shift */
+  case TOK_EQ:
+    return a == b;
+  case TOK_NEQ:
+    return a != b;
+  case TOK_LT:
+    return a < b;
+  case TOK_LE:
+    return a <= b;
+  case TOK_GT:
+    return a > b;
+  case TOK_GE:
+    return a >= b;
+  case TOK_AND_AND:
+    return a != 0 && b != 0;
+  case TOK_OR_OR:
+    return a != 0 || b != 0;
+  default:
+    return 0;
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_f64_binary(aritlex_token_type op, f64 a, f64 b)
+{
+  switch (op)
+  {
+  case TOK_PLUS:
+    return a + b;
+  case TOK_MINUS:
+    return a - b;
+  case TOK_MUL:
+    return a * b;
+  case TOK_DIV:
+    return a / b;
+  default:
+    return 0.0;
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE s32 aritlex_f64_compare(aritlex_token_type op, f64 a, f64 b)
+{
+  switch (op)
+  {
+  case TOK_EQ:
+    return a == b;
+  case TOK_NEQ:
+    return a != b;
+  case TOK_LT:
+    return a < b;
+  case TOK_LE:
+    return a <= b;
+  case TOK_GT:
+    return a > b;
+  case TOK_GE:
+    return a >= b;
+  default:
+    return 0;
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_value aritlex_value_unary(aritlex_token_type op, aritlex_value a)
+{
+  aritlex_value r;
+  r.type = ARITLEX_TYPE_S32;
+
+  if (op == TOK_MINUS && a.type == ARITLEX_TYPE_F64)
+  {
+    r.type = ARITLEX_TYPE_F64;
+    r.val.number_floating = -a.val.number_floating;
+  }
+  else if (op == TOK_MINUS)
+  {
+    r.val.number_integer = (s32)(0u - (u32)a.val.number_integer);
+  }
+  else if (op == TOK_NOT)
+  {
+    r.val.number_integer = !aritlex_value_truth(a);
+  }
+  else
+  {
+    r.val.number_integer = ~aritlex_value_to_s32(a);
+  }
+
+  return r;
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_value aritlex_value_binary(aritlex_token_type op, aritlex_value a, aritlex_value b)
+{
+  aritlex_value r;
+  u32 both_s32 = a.type == ARITLEX_TYPE_S32 && b.type == ARITLEX_TYPE_S32;
+
+  r.type = aritlex_result_type(op, 2, a.type, b.type, b.type);
+
+  switch (op)
+  {
+  case TOK_PLUS:
+  case TOK_MINUS:
+  case TOK_MUL:
+  case TOK_DIV:
+  {
+    if (both_s32)
+    {
+      r.val.number_integer = aritlex_s32_binary(op, a.val.number_integer, b.val.number_integer);
+    }
+    else
+    {
+      r.val.number_floating = aritlex_f64_binary(op, aritlex_value_to_f64(a), aritlex_value_to_f64(b));
+    }
+    break;
+  }
+  case TOK_EQ:
+  case TOK_NEQ:
+  case TOK_LT:
+  case TOK_LE:
+  case TOK_GT:
+  case TOK_GE:
+  {
+    r.val.number_integer = both_s32
+                               ? aritlex_s32_binary(op, a.val.number_integer, b.val.number_integer)
+                               : aritlex_f64_compare(op, aritlex_value_to_f64(a), aritlex_value_to_f64(b));
+    break;
+  }
+  case TOK_AND_AND:
+  case TOK_OR_OR:
+  {
+    r.val.number_integer = aritlex_s32_binary(op, aritlex_value_truth(a), aritlex_value_truth(b));
+    break;
+  }
+  default:
+  {
+    r.val.number_integer = aritlex_s32_binary(op, aritlex_value_to_s32(a), aritlex_value_to_s32(b));
+    break;
+  }
+  }
+
+  return r;
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_value aritlex_value_select(aritlex_value cond, aritlex_value a, aritlex_value b)
+{
+  aritlex_value r = aritlex_value_truth(cond) ? a : b;
+
+  if (a.type != b.type && r.type == ARITLEX_TYPE_S32)
+  {
+    r.type = ARITLEX_TYPE_F64;
+    r.val.number_floating = (f64)r.val.number_integer;
+  }
+
+  return r;
+}
+
+/* Evaluates code_size instructions (at most ARITLEX_STACK_CAPACITY deep) for one set of variables */
+ARITLEX_API ARITLEX_INLINE aritlex_value aritlex_eval_code(aritlex_instruction *code, u32 code_size, f64 *vars)
+{
+  aritlex_value stack[ARITLEX_STACK_CAPACITY];
+  u32 sp = 0;
+  u32 i;
+
+  stack[0].type = ARITLEX_TYPE_S32;
+  stack[0].val.number_integer = 0;
+
+  for (i = 0; i < code_size; ++i)
+  {
+    aritlex_instruction *instruction = &code[i];
+
+    switch (instruction->arity)
+    {
+    case 0:
+    {
+      aritlex_value *v = &stack[sp++];
+
+      if (instruction->type == TOK_NUM_INTEGER)
+      {
+        v->type = ARITLEX_TYPE_S32;
+        v->val.number_integer = instruction->val.number_integer;
+      }
+      else
+      {
+        v->type = ARITLEX_TYPE_F64;
+        v->val.number_floating = instruction->type == TOK_VAR ? vars[instruction->val.slot] : instruction->val.number_floating;
+      }
+      break;
+    }
+    case 1:
+    {
+      stack[sp - 1] = aritlex_value_unary(instruction->type, stack[sp - 1]);
+      break;
+    }
+    case 2:
+    {
+      sp--;
+      stack[sp - 1] = aritlex_value_binary(instruction->type, stack[sp - 1], stack[sp]);
+      break;
+    }
+    default:
+    {
+      sp -= 2;
+      stack[sp - 1] = aritlex_value_select(stack[sp - 1], stack[sp], stack[sp + 1]);
+      break;
+    }
+    }
+  }
+
+  return stack[0];
+}
+
+/* Evaluates program for one set of variables (indexed by slot) and keeps the result type */
+ARITLEX_API ARITLEX_INLINE aritlex_value aritlex_eval_value(aritlex_program *program, f64 *vars)
+{
+  return aritlex_eval_code(program->code, program->code_size, vars);
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_eval(aritlex_program *program, f64 *vars)
+{
+  return aritlex_value_to_f64(aritlex_eval_value(program, vars));
+}
+
+/* #############################################################################
+ * # SIMD KERNELS
+ * #############################################################################
+ *
+ * Column kernels for the operators of aritlex_token_type over s32 and f64
+ * lanes. Every kernel has a scalar version. Defining ARITLEX_SIMD adds, on x86
+ * with GCC/Clang, SSE2 and AVX2 versions compiled with target attributes (no
+ * -m flags needed), the best supported set is picked at runtime through cpuid.
+ * They are opt-in because <immintrin.h> pulls in hosted C library headers.
+ *
+ * Comparisons and logical operators produce 0/1 lanes through compare masks.
+ * The ternary operator blends both operands under a mask, so no kernel
+ * branches per lane.
+ */
+#define ARITLEX_SIMD_SCALAR 0
+#define ARITLEX_SIMD_SSE2 1
+#define ARITLEX_SIMD_AVX2 2
+
+#if defined(ARITLEX_SIMD) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define ARITLEX_SIMD_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*aritlex_kernel_f64)(f64 *out, f64 *a, f64 *b, u32 n);
+typedef void (*aritlex_kernel_f64_compare)(s32 *out, f64 *a, f64 *b, u32 n);
+typedef void (*aritlex_kernel_s32)(s32 *out, s32 *a, s32 *b, u32 n);
+typedef void (*aritlex_kernel_s32_unary)(s32 *out, s32 *a, u32 n);
+
+typedef struct aritlex_kernels
+{
+  aritlex_kernel_f64 f64_binary[ARITLEX_TOKEN_TYPE_COUNT];          /* + - * /                     */
+  aritlex_kernel_f64_compare f64_compare[ARITLEX_TOKEN_TYPE_COUNT]; /* == != < <= > >=             */
+  aritlex_kernel_s32 s32_binary[ARITLEX_TOKEN_TYPE_COUNT];          /* every binary operator       */
+  aritlex_kernel_s32_unary s32_unary[ARITLEX_TOKEN_TYPE_COUNT];     /* - ! ~                       */
+
+  void (*f64_negate)(f64 *out, f64 *a, u32 n);
+  void (*f64_truth)(s32 *out, f64 *a, u32 n); /* a != 0.0 as 0/1 */
+  void (*s32_to_f64)(f64 *out, s32 *a, u32 n);
+  void (*f64_to_s32)(s32 *out, f64 *a, u32 n); /* same truncation as aritlex_f64_to_s32 */
+  void (*f64_select)(f64 *out, s32 *cond, f64 *a, f64 *b, u32 n);
+  void (*s32_select)(s32 *out, s32 *cond, s32 *a, s32 *b, u32 n);
+
+  u32 level; /* ARITLEX_SIMD_SCALAR, ARITLEX_SIMD_SSE2 or ARITLEX_SIMD_AVX2 */
+
+} aritlex_kernels;
+
+#define ARITLEX_KERNEL_SCALAR_BINARY(name, type_out, type_in, expression) \
+  ARITLEX_API ARITLEX_INLINE void name(type_out *out, type_in *a, type_in *b, u32 n) \
+  {                                                                       \
+    u32 i;                                                                \
+    for (i = 0; i < n; ++i)                                               \
+    {                                                                     \
+      out[i] = (expression);                                              \
+    }                                                                     \
+  }
+
+#define ARITLEX_KERNEL_SCALAR_UNARY(name, type_out, type_in, expression)   \
+  ARITLEX_API ARITLEX_INLINE void name(type_out *out, type_in *a, u32 n) \
+  {                                                                       \
+    u32 i;                                                                \
+    for (i = 0; i < n; ++i)                                               \
+    {                                                                     \
+      out[i] = (expression);                                              \
+    }                                                                     \
+  }
+
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_add_f64, f64, f64, a[i] + b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_sub_f64, f64, f64, a[i] - b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_mul_f64, f64, f64, a[i] * b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_div_f64, f64, f64, a[i] / b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_eq_f64, s32, f64, a[i] == b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_neq_f64, s32, f64, a[i] != b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_lt_f64, s32, f64, a[i] < b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_le_f64, s32, f64, a[i] <= b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_gt_f64, s32, f64, a[i] > b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_ge_f64, s32, f64, a[i] >= b[i])
+
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_add_s32, s32, s32, aritlex_s32_binary(TOK_PLUS, a[i], b[i]))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_sub_s32, s32, s32, aritlex_s32_binary(TOK_MINUS, a[i], b[i]))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_mul_s32, s32, s32, aritlex_s32_binary(TOK_MUL, a[i], b[i]))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_div_s32, s32, s32, aritlex_s32_binary(TOK_DIV, a[i], b[i]))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_mod_s32, s32, s32, aritlex_s32_binary(TOK_MOD, a[i], b[i]))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_and_s32, s32, s32, a[i] & b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_or_s32, s32, s32, a[i] | b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_xor_s32, s32, s32, a[i] ^ b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_shl_s32, s32, s32, aritlex_s32_binary(TOK_SHL, a[i], b[i]))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_shr_s32, s32, s32, aritlex_s32_binary(TOK_SHR, a[i], b[i]))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_eq_s32, s32, s32, a[i] == b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_neq_s32, s32, s32, a[i] != b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_lt_s32, s32, s32, a[i] < b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_le_s32, s32, s32, a[i] <= b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_gt_s32, s32, s32, a[i] > b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_ge_s32, s32, s32, a[i] >= b[i])
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_and_and_s32, s32, s32, (a[i] != 0) & (b[i] != 0))
+ARITLEX_KERNEL_SCALAR_BINARY(aritlex_kernel_scalar_or_or_s32, s32, s32, (a[i] != 0) | (b[i] != 0))
+
+ARITLEX_KERNEL_SCALAR_UNARY(aritlex_kernel_scalar_neg_s32, s32, s32, (s32)(0u - (u32)a[i]))
+ARITLEX_KERNEL_SCALAR_UNARY(aritlex_kernel_scalar_not_s32, s32, s32, a[i] == 0)
+ARITLEX_KERNEL_SCALAR_UNARY(aritlex_kernel_scalar_not_bit_s32, s32, s32, ~a[i])
+ARITLEX_KERNEL_SCALAR_UNARY(aritlex_kernel_scalar_negate_f64, f64, f64, -a[i])
+ARITLEX_KERNEL_SCALAR_UNARY(aritlex_kernel_scalar_truth_f64, s32, f64, a[i] != 0.0)
+ARITLEX_KERNEL_SCALAR_UNARY(aritlex_kernel_scalar_s32_to_f64, f64, s32, (f64)a[i])
+ARITLEX_KERNEL_SCALAR_UNARY(aritlex_kernel_scalar_f64_to_s32, s32, f64, aritlex_f64_to_s32(a[i]))
+
+ARITLEX_API ARITLEX_INLINE void aritlex_kernel_scalar_select_f64(f64 *out, s32 *cond, f64 *a, f64 *b, u32 n)
+{
+  u32 i;
+  for (i = 0; i < n; ++i)
+  {
+    out[i] = cond[i] ? a[i] : b[i];
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_kernel_scalar_select_s32(s32 *out, s32 *cond, s32 *a, s32 *b, u32 n)
+{
+  u32 i;
+  for (i = 0; i < n; ++i)
+  {
+    /* Mask blend, -(cond != 0) is all ones for true lanes */
+    s32 mask = -(cond[i] != 0);
+    out[i] = (a[i] & mask) | (b[i] & ~mask);
+  }
+}
+
+#ifdef ARITLEX_SIMD_X86
+
+ARITLEX_API ARITLEX_INLINE void aritlex_cpuid(u32 leaf, u32 subleaf, u32 *eax, u32 *ebx, u32 *ecx, u32 *edx)
+{
+  __asm__ __volatile__("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(subleaf));
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_xgetbv(void)
+{
+  u32 low, high;
+  __asm__ __volatile__(".byte 0x0f, 0x01, 0xd0" : "=a"(low), "=d"(high) : "c"(0));
+  (void)high;
+  return low;
+}
+
+/* SSE2: 2 f64 lanes / 4 s32 lanes per iteration, tails use the scalar kernel */
+#define ARITLEX_KERNEL_SSE2_F64(name, type_out, expression, store, tail)                          \
+  ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void name(type_out *out, f64 *a, f64 *b, u32 n) \
+  {                                                                                               \
+    __m128d one = _mm_set1_pd(1.0);                                                               \
+    u32 i = 0;                                                                                    \
+    (void)one;                                                                                    \
+    for (; i + 2 <= n; i += 2)                                                                    \
+    {                                                                                             \
+      __m128d x = _mm_loadu_pd(a + i);                                                            \
+      __m128d y = _mm_loadu_pd(b + i);                                                            \
+      store(out + i, (expression));                                                               \
+    }                                                                                             \
+    tail(out + i, a + i, b + i, n - i);                                                           \
+  }
+
+#define ARITLEX_KERNEL_SSE2_S32(name, expression, tail)                                           \
+  ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void name(s32 *out, s32 *a, s32 *b, u32 n) \
+  {                                                                                               \
+    __m128i zero = _mm_setzero_si128();                                                           \
+    __m128i one = _mm_set1_epi32(1);                                                              \
+    u32 i = 0;                                                                                    \
+    (void)zero;                                                                                   \
+    (void)one;                                                                                    \
+    for (; i + 4 <= n; i += 4)                                                                    \
+    {                                                                                             \
+      __m128i x = _mm_loadu_si128((__m128i *)(a + i));                                            \
+      __m128i y = _mm_loadu_si128((__m128i *)(b + i));                                            \
+      _mm_storeu_si128((__m128i *)(out + i), (expression));                                       \
+    }                                                                                             \
+    tail(out + i, a + i, b + i, n - i);                                                           \
+  }
+
+#define ARITLEX_SSE2_STORE_F64(p, v) _mm_storeu_pd((p), (v))
+#define ARITLEX_SSE2_STORE_MASK(p, v) _mm_storel_epi64((__m128i *)(p), _mm_cvttpd_epi32(_mm_and_pd((v), one)))
+
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_add_f64, f64, _mm_add_pd(x, y), ARITLEX_SSE2_STORE_F64, aritlex_kernel_scalar_add_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_sub_f64, f64, _mm_sub_pd(x, y), ARITLEX_SSE2_STORE_F64, aritlex_kernel_scalar_sub_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_mul_f64, f64, _mm_mul_pd(x, y), ARITLEX_SSE2_STORE_F64, aritlex_kernel_scalar_mul_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_div_f64, f64, _mm_div_pd(x, y), ARITLEX_SSE2_STORE_F64, aritlex_kernel_scalar_div_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_eq_f64, s32, _mm_cmpeq_pd(x, y), ARITLEX_SSE2_STORE_MASK, aritlex_kernel_scalar_eq_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_neq_f64, s32, _mm_cmpneq_pd(x, y), ARITLEX_SSE2_STORE_MASK, aritlex_kernel_scalar_neq_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_lt_f64, s32, _mm_cmplt_pd(x, y), ARITLEX_SSE2_STORE_MASK, aritlex_kernel_scalar_lt_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_le_f64, s32, _mm_cmple_pd(x, y), ARITLEX_SSE2_STORE_MASK, aritlex_kernel_scalar_le_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_gt_f64, s32, _mm_cmpgt_pd(x, y), ARITLEX_SSE2_STORE_MASK, aritlex_kernel_scalar_gt_f64)
+ARITLEX_KERNEL_SSE2_F64(aritlex_kernel_sse2_ge_f64, s32, _mm_cmpge_pd(x, y), ARITLEX_SSE2_STORE_MASK, aritlex_kernel_scalar_ge_f64)
+
+/* SSE2 has no 32 bit mullo, multiply even and odd lanes with pmuludq and interleave the low halves */
+#define ARITLEX_SSE2_MULLO_EPI32(x, y)                                                                            \
+  _mm_unpacklo_epi32(_mm_shuffle_epi32(_mm_mul_epu32((x), (y)), 0x08),                                            \
+                     _mm_shuffle_epi32(_mm_mul_epu32(_mm_srli_si128((x), 4), _mm_srli_si128((y), 4)), 0x08))
+
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_add_s32, _mm_add_epi32(x, y), aritlex_kernel_scalar_add_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_sub_s32, _mm_sub_epi32(x, y), aritlex_kernel_scalar_sub_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_mul_s32, ARITLEX_SSE2_MULLO_EPI32(x, y), aritlex_kernel_scalar_mul_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_and_s32, _mm_and_si128(x, y), aritlex_kernel_scalar_and_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_or_s32, _mm_or_si128(x, y), aritlex_kernel_scalar_or_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_xor_s32, _mm_xor_si128(x, y), aritlex_kernel_scalar_xor_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_eq_s32, _mm_and_si128(_mm_cmpeq_epi32(x, y), one), aritlex_kernel_scalar_eq_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_neq_s32, _mm_andnot_si128(_mm_cmpeq_epi32(x, y), one), aritlex_kernel_scalar_neq_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_lt_s32, _mm_and_si128(_mm_cmplt_epi32(x, y), one), aritlex_kernel_scalar_lt_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_le_s32, _mm_andnot_si128(_mm_cmpgt_epi32(x, y), one), aritlex_kernel_scalar_le_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_gt_s32, _mm_and_si128(_mm_cmpgt_epi32(x, y), one), aritlex_kernel_scalar_gt_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_ge_s32, _mm_andnot_si128(_mm_cmplt_epi32(x, y), one), aritlex_kernel_scalar_ge_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_and_and_s32, _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(x, zero), _mm_cmpeq_epi32(y, zero)), one), aritlex_kernel_scalar_and_and_s32)
+ARITLEX_KERNEL_SSE2_S32(aritlex_kernel_sse2_or_or_s32, _mm_andnot_si128(_mm_and_si128(_mm_cmpeq_epi32(x, zero), _mm_cmpeq_epi32(y, zero)), one), aritlex_kernel_scalar_or_or_s32)
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void aritlex_kernel_sse2_select_f64(f64 *out, s32 *cond, f64 *a, f64 *b, u32 n)
+{
+  u32 i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    /* Widen the two 32 bit "cond == 0" lanes to 64 bit masks */
+    __m128i zero_mask = _mm_cmpeq_epi32(_mm_loadl_epi64((__m128i *)(cond + i)), _mm_setzero_si128());
+    __m128d mask = _mm_castsi128_pd(_mm_unpacklo_epi32(zero_mask, zero_mask));
+    _mm_storeu_pd(out + i, _mm_or_pd(_mm_and_pd(mask, _mm_loadu_pd(b + i)), _mm_andnot_pd(mask, _mm_loadu_pd(a + i))));
+  }
+  aritlex_kernel_scalar_select_f64(out + i, cond + i, a + i, b + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void aritlex_kernel_sse2_select_s32(s32 *out, s32 *cond, s32 *a, s32 *b, u32 n)
+{
+  u32 i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i mask = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(cond + i)), _mm_setzero_si128());
+    __m128i x = _mm_loadu_si128((__m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((__m128i *)(b + i));
+    _mm_storeu_si128((__m128i *)(out + i), _mm_or_si128(_mm_and_si128(mask, y), _mm_andnot_si128(mask, x)));
+  }
+  aritlex_kernel_scalar_select_s32(out + i, cond + i, a + i, b + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void aritlex_kernel_sse2_negate_f64(f64 *out, f64 *a, u32 n)
+{
+  __m128d sign = _mm_set1_pd(-0.0);
+  u32 i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    _mm_storeu_pd(out + i, _mm_xor_pd(_mm_loadu_pd(a + i), sign));
+  }
+  aritlex_kernel_scalar_negate_f64(out + i, a + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void aritlex_kernel_sse2_truth_f64(s32 *out, f64 *a, u32 n)
+{
+  __m128d one = _mm_set1_pd(1.0);
+  u32 i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    __m128d mask = _mm_cmpneq_pd(_mm_loadu_pd(a + i), _mm_setzero_pd());
+    _mm_storel_epi64((__m128i *)(out + i), _mm_cvttpd_epi32(_mm_and_pd(mask, one)));
+  }
+  aritlex_kernel_scalar_truth_f64(out + i, a + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void aritlex_kernel_sse2_s32_to_f64(f64 *out, s32 *a, u32 n)
+{
+  u32 i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    _mm_storeu_pd(out + i, _mm_cvtepi32_pd(_mm_loadl_epi64((__m128i *)(a + i))));
+  }
+  aritlex_kernel_scalar_s32_to_f64(out + i, a + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("sse2"))) void aritlex_kernel_sse2_f64_to_s32(s32 *out, f64 *a, u32 n)
+{
+  u32 i = 0;
+  for (; i + 2 <= n; i += 2)
+  {
+    _mm_storel_epi64((__m128i *)(out + i), _mm_cvttpd_epi32(_mm_loadu_pd(a + i)));
+  }
+  aritlex_kernel_scalar_f64_to_s32(out + i, a + i, n - i);
+}
+
+/* AVX2: 4 f64 lanes / 8 s32 lanes per iteration, tails use the SSE2 or scalar kernel */
+#define ARITLEX_KERNEL_AVX2_F64(name, expression, tail)                                           \
+  ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void name(f64 *out, f64 *a, f64 *b, u32 n) \
+  {                                                                                               \
+    u32 i = 0;                                                                                    \
+    for (; i + 4 <= n; i += 4)                                                                    \
+    {                                                                                             \
+      __m256d x = _mm256_loadu_pd(a + i);                                                         \
+      __m256d y = _mm256_loadu_pd(b + i);                                                         \
+      _mm256_storeu_pd(out + i, (expression));                                                    \
+    }                                                                                             \
+    tail(out + i, a + i, b + i, n - i);                                                           \
+  }
+
+#define ARITLEX_KERNEL_AVX2_F64_COMPARE(name, predicate, tail)                                    \
+  ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void name(s32 *out, f64 *a, f64 *b, u32 n) \
+  {                                                                                               \
+    __m256d one = _mm256_set1_pd(1.0);                                                            \
+    u32 i = 0;                                                                                    \
+    for (; i + 4 <= n; i += 4)                                                                    \
+    {                                                                                             \
+      __m256d mask = _mm256_cmp_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), (predicate));  \
+      _mm_storeu_si128((__m128i *)(out + i), _mm256_cvttpd_epi32(_mm256_and_pd(mask, one)));      \
+    }                                                                                             \
+    tail(out + i, a + i, b + i, n - i);                                                           \
+  }
+
+#define ARITLEX_KERNEL_AVX2_S32(name, expression, tail)                                           \
+  ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void name(s32 *out, s32 *a, s32 *b, u32 n) \
+  {                                                                                               \
+    __m256i zero = _mm256_setzero_si256();                                                        \
+    __m256i one = _mm256_set1_epi32(1);                                                           \
+    __m256i count_mask = _mm256_set1_epi32(31);                                                   \
+    u32 i = 0;                                                                                    \
+    (void)zero;                                                                                   \
+    (void)one;                                                                                    \
+    (void)count_mask;                                                                             \
+    for (; i + 8 <= n; i += 8)                                                                    \
+    {                                                                                             \
+      __m256i x = _mm256_loadu_si256((__m256i *)(a + i));                                         \
+      __m256i y = _mm256_loadu_si256((__m256i *)(b + i));                                         \
+      _mm256_storeu_si256((__m256i *)(out + i), (expression));                                    \
+    }                                                                                             \
+    tail(out + i, a + i, b + i, n - i);                                                           \
+  }
+
+ARITLEX_KERNEL_AVX2_F64(aritlex_kernel_avx2_add_f64, _mm256_add_pd(x, y), aritlex_kernel_sse2_add_f64)
+ARITLEX_KERNEL_AVX2_F64(aritlex_kernel_avx2_sub_f64, _mm256_sub_pd(x, y), aritlex_kernel_sse2_sub_f64)
+ARITLEX_KERNEL_AVX2_F64(aritlex_kernel_avx2_mul_f64, _mm256_mul_pd(x, y), aritlex_kernel_sse2_mul_f64)
+ARITLEX_KERNEL_AVX2_F64(aritlex_kernel_avx2_div_f64, _mm256_div_pd(x, y), aritlex_kernel_sse2_div_f64)
+
+/* Ordered predicates except !=, which is unordered so that NaN != x holds like in C */
+ARITLEX_KERNEL_AVX2_F64_COMPARE(aritlex_kernel_avx2_eq_f64, _CMP_EQ_OQ, aritlex_kernel_sse2_eq_f64)
+ARITLEX_KERNEL_AVX2_F64_COMPARE(aritlex_kernel_avx2_neq_f64, _CMP_NEQ_UQ, aritlex_kernel_sse2_neq_f64)
+ARITLEX_KERNEL_AVX2_F64_COMPARE(aritlex_kernel_avx2_lt_f64, _CMP_LT_OQ, aritlex_kernel_sse2_lt_f64)
+ARITLEX_KERNEL_AVX2_F64_COMPARE(aritlex_kernel_avx2_le_f64, _CMP_LE_OQ, aritlex_kernel_sse2_le_f64)
+ARITLEX_KERNEL_AVX2_F64_COMPARE(aritlex_kernel_avx2_gt_f64, _CMP_GT_OQ, aritlex_kernel_sse2_gt_f64)
+ARITLEX_KERNEL_AVX2_F64_COMPARE(aritlex_kernel_avx2_ge_f64, _CMP_GE_OQ, aritlex_kernel_sse2_ge_f64)
+
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_add_s32, _mm256_add_epi32(x, y), aritlex_kernel_sse2_add_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_sub_s32, _mm256_sub_epi32(x, y), aritlex_kernel_sse2_sub_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_mul_s32, _mm256_mullo_epi32(x, y), aritlex_kernel_sse2_mul_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_and_s32, _mm256_and_si256(x, y), aritlex_kernel_sse2_and_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_or_s32, _mm256_or_si256(x, y), aritlex_kernel_sse2_or_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_xor_s32, _mm256_xor_si256(x, y), aritlex_kernel_sse2_xor_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_shl_s32, _mm256_sllv_epi32(x, _mm256_and_si256(y, count_mask)), aritlex_kernel_scalar_shl_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_shr_s32, _mm256_srav_epi32(x, _mm256_and_si256(y, count_mask)), aritlex_kernel_scalar_shr_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_eq_s32, _mm256_and_si256(_mm256_cmpeq_epi32(x, y), one), aritlex_kernel_sse2_eq_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_neq_s32, _mm256_andnot_si256(_mm256_cmpeq_epi32(x, y), one), aritlex_kernel_sse2_neq_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_lt_s32, _mm256_and_si256(_mm256_cmpgt_epi32(y, x), one), aritlex_kernel_sse2_lt_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_le_s32, _mm256_andnot_si256(_mm256_cmpgt_epi32(x, y), one), aritlex_kernel_sse2_le_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_gt_s32, _mm256_and_si256(_mm256_cmpgt_epi32(x, y), one), aritlex_kernel_sse2_gt_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_ge_s32, _mm256_andnot_si256(_mm256_cmpgt_epi32(y, x), one), aritlex_kernel_sse2_ge_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_and_and_s32, _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(x, zero), _mm256_cmpeq_epi32(y, zero)), one), aritlex_kernel_sse2_and_and_s32)
+ARITLEX_KERNEL_AVX2_S32(aritlex_kernel_avx2_or_or_s32, _mm256_andnot_si256(_mm256_and_si256(_mm256_cmpeq_epi32(x, zero), _mm256_cmpeq_epi32(y, zero)), one), aritlex_kernel_sse2_or_or_s32)
+
+/* Integer division through f64 is exact for s32 operands. Lanes dividing by zero are masked to 0.
+ * INT_MIN / -1 converts 2^31 back to INT_MIN, the same wrap as aritlex_s32_binary.
+ */
+ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void aritlex_kernel_avx2_divmod_s32(s32 *out, s32 *a, s32 *b, u32 n, u32 modulo)
+{
+  __m128i zero = _mm_setzero_si128();
+  u32 i = 0;
+
+  for (; i + 4 <= n; i += 4)
+  {
+    __m128i x = _mm_loadu_si128((__m128i *)(a + i));
+    __m128i y = _mm_loadu_si128((__m128i *)(b + i));
+    __m128i y_zero = _mm_cmpeq_epi32(y, zero);
+    __m128i q = _mm256_cvttpd_epi32(_mm256_div_pd(_mm256_cvtepi32_pd(x), _mm256_cvtepi32_pd(y)));
+    __m128i r = modulo ? _mm_sub_epi32(x, _mm_mullo_epi32(q, y)) : q;
+    _mm_storeu_si128((__m128i *)(out + i), _mm_andnot_si128(y_zero, r));
+  }
+
+  if (modulo)
+  {
+    aritlex_kernel_scalar_mod_s32(out + i, a + i, b + i, n - i);
+  }
+  else
+  {
+    aritlex_kernel_scalar_div_s32(out + i, a + i, b + i, n - i);
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void aritlex_kernel_avx2_div_s32(s32 *out, s32 *a, s32 *b, u32 n)
+{
+  aritlex_kernel_avx2_divmod_s32(out, a, b, n, 0);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void aritlex_kernel_avx2_mod_s32(s32 *out, s32 *a, s32 *b, u32 n)
+{
+  aritlex_kernel_avx2_divmod_s32(out, a, b, n, 1);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void aritlex_kernel_avx2_select_f64(f64 *out, s32 *cond, f64 *a, f64 *b, u32 n)
+{
+  u32 i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    /* Sign extend the four 32 bit "cond == 0" masks to 64 bit and blend b into those lanes */
+    __m128i zero_mask = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(cond + i)), _mm_setzero_si128());
+    __m256d mask = _mm256_castsi256_pd(_mm256_cvtepi32_epi64(zero_mask));
+    _mm256_storeu_pd(out + i, _mm256_blendv_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i), mask));
+  }
+  aritlex_kernel_sse2_select_f64(out + i, cond + i, a + i, b + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void aritlex_kernel_avx2_select_s32(s32 *out, s32 *cond, s32 *a, s32 *b, u32 n)
+{
+  u32 i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256i mask = _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i *)(cond + i)), _mm256_setzero_si256());
+    __m256i x = _mm256_loadu_si256((__m256i *)(a + i));
+    __m256i y = _mm256_loadu_si256((__m256i *)(b + i));
+    _mm256_storeu_si256((__m256i *)(out + i), _mm256_blendv_epi8(x, y, mask));
+  }
+  aritlex_kernel_sse2_select_s32(out + i, cond + i, a + i, b + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void aritlex_kernel_avx2_s32_to_f64(f64 *out, s32 *a, u32 n)
+{
+  u32 i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    _mm256_storeu_pd(out + i, _mm256_cvtepi32_pd(_mm_loadu_si128((__m128i *)(a + i))));
+  }
+  aritlex_kernel_sse2_s32_to_f64(out + i, a + i, n - i);
+}
+
+ARITLEX_API ARITLEX_INLINE __attribute__((target("avx2"))) void aritlex_kernel_avx2_f64_to_s32(s32 *out, f64 *a, u32 n)
+{
+  u32 i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    _mm_storeu_si128((__m128i *)(out + i), _mm256_cvttpd_epi32(_mm256_loadu_pd(a + i)));
+  }
+  aritlex_kernel_sse2_f64_to_s32(out + i, a + i, n - i);
+}
+
+#endif /* ARITLEX_SIMD_X86 */
+
+/* Highest kernel set supported by the CPU and the OS */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_simd_detect(void)
+{
+#ifdef ARITLEX_SIMD_X86
+  u32 eax, ebx, ecx, edx;
+  u32 max_leaf;
+  u32 level = ARITLEX_SIMD_SCALAR;
+
+  aritlex_cpuid(0, 0, &max_leaf, &ebx, &ecx, &edx);
+  aritlex_cpuid(1, 0, &eax, &ebx, &ecx, &edx);
+
+  if (edx & (1u << 26))
+  {
+    level = ARITLEX_SIMD_SSE2;
+  }
+
+  /* AVX2 needs the CPU flag plus OSXSAVE/AVX and the OS saving XMM and YMM state (XCR0 bits 1 and 2) */
+  if (max_leaf >= 7 && (ecx & (1u << 27)) && (ecx & (1u << 28)) && (aritlex_xgetbv() & 6u) == 6u)
+  {
+    aritlex_cpuid(7, 0, &eax, &ebx, &ecx, &edx);
+
+    if (ebx & (1u << 5))
+    {
+      level = ARITLEX_SIMD_AVX2;
+    }
+  }
+
+  return level;
+#else
+  return ARITLEX_SIMD_SCALAR;
+#endif
+}
+
+/* Fills kernels with the best implementation up to level (clamped to what the CPU supports) */
+ARITLEX_API ARITLEX_INLINE void aritlex_kernels_init(aritlex_kernels *k, u32 level)
+{
+  u32 supported = aritlex_simd_detect();
+
+  k->level = level < supported ? level : supported;
+
+  k->f64_binary[TOK_PLUS] = aritlex_kernel_scalar_add_f64;
+  k->f64_binary[TOK_MINUS] = aritlex_kernel_scalar_sub_f64;
+  k->f64_binary[TOK_MUL] = aritlex_kernel_scalar_mul_f64;
+  k->f64_binary[TOK_DIV] = aritlex_kernel_scalar_div_f64;
+
+  k->f64_compare[TOK_EQ] = aritlex_kernel_scalar_eq_f64;
+  k->f64_compare[TOK_NEQ] = aritlex_kernel_scalar_neq_f64;
+  k->f64_compare[TOK_LT] = aritlex_kernel_scalar_lt_f64;
+  k->f64_compare[TOK_LE] = aritlex_kernel_scalar_le_f64;
+  k->f64_compare[TOK_GT] = aritlex_kernel_scalar_gt_f64;
+  k->f64_compare[TOK_GE] = aritlex_kernel_scalar_ge_f64;
+
+  k->s32_binary[TOK_PLUS] = aritlex_kernel_scalar_add_s32;
+  k->s32_binary[TOK_MINUS] = aritlex_kernel_scalar_sub_s32;
+  k->s32_binary[TOK_MUL] = aritlex_kernel_scalar_mul_s32;
+  k->s32_binary[TOK_DIV] = aritlex_kernel_scalar_div_s32;
+  k->s32_binary[TOK_MOD] = aritlex_kernel_scalar_mod_s32;
+  k->s32_binary[TOK_AND] = aritlex_kernel_scalar_and_s32;
+  k->s32_binary[TOK_OR] = aritlex_kernel_scalar_or_s32;
+  k->s32_binary[TOK_XOR] = aritlex_kernel_scalar_xor_s32;
+  k->s32_binary[TOK_SHL] = aritlex_kernel_scalar_shl_s32;
+  k->s32_binary[TOK_SHR] = aritlex_kernel_scalar_shr_s32;
+  k->s32_binary[TOK_EQ] = aritlex_kernel_scalar_eq_s32;
+  k->s32_binary[TOK_NEQ] = aritlex_kernel_scalar_neq_s32;
+  k->s32_binary[TOK_LT] = aritlex_kernel_scalar_lt_s32;
+  k->s32_binary[TOK_LE] = aritlex_kernel_scalar_le_s32;
+  k->s32_binary[TOK_GT] = aritlex_kernel_scalar_gt_s32;
+  k->s32_binary[TOK_GE] = aritlex_kernel_scalar_ge_s32;
+  k->s32_binary[TOK_AND_AND] = aritlex_kernel_scalar_and_and_s32;
+  k->s32_binary[TOK_OR_OR] = aritlex_kernel_scalar_or_or_s32;
+
+  k->s32_unary[TOK_MINUS] = aritlex_kernel_scalar_neg_s32;
+  k->s32_unary[TOK_NOT] = aritlex_kernel_scalar_not_s32;
+  k->s32_unary[TOK_NOT_BIT] = aritlex_kernel_scalar_not_bit_s32;
+
+  k->f64_negate = aritlex_kernel_scalar_negate_f64;
+  k->f64_truth = aritlex_kernel_scalar_truth_f64;
+  k->s32_to_f64 = aritlex_kernel_scalar_s32_to_f64;
+  k->f64_to_s32 = aritlex_kernel_scalar_f64_to_s32;
+  k->f64_select = aritlex_kernel_scalar_select_f64;
+  k->s32_select = aritlex_kernel_scalar_select_s32;
+
+#ifdef ARITLEX_SIMD_X86
+  if (k->level >= ARITLEX_SIMD_SSE2)
+  {
+    k->f64_binary[TOK_PLUS] = aritlex_kernel_sse2_add_f64;
+    k->f64_binary[TOK_MINUS] = aritlex_kernel_sse2_sub_f64;
+    k->f64_binary[TOK_MUL] = aritlex_kernel_sse2_mul_f64;
+    k->f64_binary[TOK_DIV] = aritlex_kernel_sse2_div_f64;
+
+    k->f64_compare[TOK_EQ] = aritlex_kernel_sse2_eq_f64;
+    k->f64_compare[TOK_NEQ] = aritlex_kernel_sse2_neq_f64;
+    k->f64_compare[TOK_LT] = aritlex_kernel_sse2_lt_f64;
+    k->f64_compare[TOK_LE] = aritlex_kernel_sse2_le_f64;
+    k->f64_compare[TOK_GT] = aritlex_kernel_sse2_gt_f64;
+    k->f64_compare[TOK_GE] = aritlex_kernel_sse2_ge_f64;
+
+    k->s32_binary[TOK_PLUS] = aritlex_kernel_sse2_add_s32;
+    k->s32_binary[TOK_MINUS] = aritlex_kernel_sse2_sub_s32;
+    k->s32_binary[TOK_MUL] = aritlex_kernel_sse2_mul_s32;
+    k->s32_binary[TOK_AND] = aritlex_kernel_sse2_and_s32;
+    k->s32_binary[TOK_OR] = aritlex_kernel_sse2_or_s32;
+    k->s32_binary[TOK_XOR] = aritlex_kernel_sse2_xor_s32;
+    k->s32_binary[TOK_EQ] = aritlex_kernel_sse2_eq_s32;
+    k->s32_binary[TOK_NEQ] = aritlex_kernel_sse2_neq_s32;
+    k->s32_binary[TOK_LT] = aritlex_kernel_sse2_lt_s32;
+    k->s32_binary[TOK_LE] = aritlex_kernel_sse2_le_s32;
+    k->s32_binary[TOK_GT] = aritlex_kernel_sse2_gt_s32;
+    k->s32_binary[TOK_GE] = aritlex_kernel_sse2_ge_s32;
+    k->s32_binary[TOK_AND_AND] = aritlex_kernel_sse2_and_and_s32;
+    k->s32_binary[TOK_OR_OR] = aritlex_kernel_sse2_or_or_s32;
+
+    k->f64_negate = aritlex_kernel_sse2_negate_f64;
+    k->f64_truth = aritlex_kernel_sse2_truth_f64;
+    k->s32_to_f64 = aritlex_kernel_sse2_s32_to_f64;
+    k->f64_to_s32 = aritlex_kernel_sse2_f64_to_s32;
+    k->f64_select = aritlex_kernel_sse2_select_f64;
+    k->s32_select = aritlex_kernel_sse2_select_s32;
+  }
+
+  if (k->level >= ARITLEX_SIMD_AVX2)
+  {
+    k->f64_binary[TOK_PLUS] = aritlex_kernel_avx2_add_f64;
+    k->f64_binary[TOK_MINUS] = aritlex_kernel_avx2_sub_f64;
+    k->f64_binary[TOK_MUL] = aritlex_kernel_avx2_mul_f64;
+    k->f64_binary[TOK_DIV] = aritlex_kernel_avx2_div_f64;
+
+    k->f64_compare[TOK_EQ] = aritlex_kernel_avx2_eq_f64;
+    k->f64_compare[TOK_NEQ] = aritlex_kernel_avx2_neq_f64;
+    k->f64_compare[TOK_LT] = aritlex_kernel_avx2_lt_f64;
+    k->f64_compare[TOK_LE] = aritlex_kernel_avx2_le_f64;
+    k->f64_compare[TOK_GT] = aritlex_kernel_avx2_gt_f64;
+    k->f64_compare[TOK_GE] = aritlex_kernel_avx2_ge_f64;
+
+    k->s32_binary[TOK_PLUS] = aritlex_kernel_avx2_add_s32;
+    k->s32_binary[TOK_MINUS] = aritlex_kernel_avx2_sub_s32;
+    k->s32_binary[TOK_MUL] = aritlex_kernel_avx2_mul_s32;
+    k->s32_binary[TOK_DIV] = aritlex_kernel_avx2_div_s32;
+    k->s32_binary[TOK_MOD] = aritlex_kernel_avx2_mod_s32;
+    k->s32_binary[TOK_AND] = aritlex_kernel_avx2_and_s32;
+    k->s32_binary[TOK_OR] = aritlex_kernel_avx2_or_s32;
+    k->s32_binary[TOK_XOR] = aritlex_kernel_avx2_xor_s32;
+    k->s32_binary[TOK_SHL] = aritlex_kernel_avx2_shl_s32;
+    k->s32_binary[TOK_SHR] = aritlex_kernel_avx2_shr_s32;
+    k->s32_binary[TOK_EQ] = aritlex_kernel_avx2_eq_s32;
+    k->s32_binary[TOK_NEQ] = aritlex_kernel_avx2_neq_s32;
+    k->s32_binary[TOK_LT] = aritlex_kernel_avx2_lt_s32;
+    k->s32_binary[TOK_LE] = aritlex_kernel_avx2_le_s32;
+    k->s32_binary[TOK_GT] = aritlex_kernel_avx2_gt_s32;
+    k->s32_binary[TOK_GE] = aritlex_kernel_avx2_ge_s32;
+    k->s32_binary[TOK_AND_AND] = aritlex_kernel_avx2_and_and_s32;
+    k->s32_binary[TOK_OR_OR] = aritlex_kernel_avx2_or_or_s32;
+
+    k->s32_to_f64 = aritlex_kernel_avx2_s32_to_f64;
+    k->f64_to_s32 = aritlex_kernel_avx2_f64_to_s32;
+    k->f64_select = aritlex_kernel_avx2_select_f64;
+    k->s32_select = aritlex_kernel_avx2_select_s32;
+  }
+#endif /* ARITLEX_SIMD_X86 */
+}
+
+/* Process wide kernel table, dispatched on first use. With GCC/Clang the first caller fills it
+ * and publishes it with a release store while concurrent callers wait, other compilers need the
+ * first call (e.g. aritlex_batch_init) to happen before threads are started. */
+ARITLEX_API ARITLEX_INLINE aritlex_kernels *aritlex_kernels_get(void)
+{
+  static aritlex_kernels kernels;
+  static u32 kernels_state = 0; /* 0 empty, 1 being filled, 2 ready */
+
+#if defined(__GNUC__) || defined(__clang__)
+  if (__atomic_load_n(&kernels_state, __ATOMIC_ACQUIRE) != 2)
+  {
+    u32 expected = 0;
+
+    if (__atomic_compare_exchange_n(&kernels_state, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+      aritlex_kernels_init(&kernels, ARITLEX_SIMD_AVX2);
+      __atomic_store_n(&kernels_state, 2, __ATOMIC_RELEASE);
+    }
+
+    while (__atomic_load_n(&kernels_state, __ATOMIC_ACQUIRE) != 2)
+    {
+    }
+  }
+#else
+  if (kernels_state != 2)
+  {
+    aritlex_kernels_init(&kernels, ARITLEX_SIMD_AVX2);
+    kernels_state = 2;
+  }
+#endif
+
+  return &kernels;
+}
+
+/* #############################################################################
+ * # VECTORIZED EVALUATOR
+ * #############################################################################
+ *
+ * Evaluates a program over columns of rows, ARITLEX_BATCH_SIZE rows at a time.
+ * Each instruction runs one kernel over the whole chunk. Variable loads point
+ * straight into the input columns, and operand types are checked once per
+ * chunk rather than once per row.
+ */
+#ifndef ARITLEX_BATCH_SIZE
+#define ARITLEX_BATCH_SIZE 256 /* Rows per chunk, keeps the working set in L1/L2 */
+#endif
+
+#define ARITLEX_BATCH_LANES_CAPACITY (ARITLEX_STACK_CAPACITY + 3) /* stack + result + promotion temporaries */
+
+typedef union aritlex_lanes
+{
+  f64 number_floating[ARITLEX_BATCH_SIZE];
+  s32 number_integer[ARITLEX_BATCH_SIZE];
+
+} aritlex_lanes;
+
+typedef struct aritlex_batch_slot
+{
+  aritlex_type type;
+  f64 *number_floating; /* valid if ARITLEX_TYPE_F64 */
+  s32 *number_integer;  /* valid if ARITLEX_TYPE_S32 */
+  u32 lanes;            /* Owned scratch lanes or ARITLEX_SLOT_INVALID for borrowed input columns */
+
+} aritlex_batch_slot;
+
+typedef struct aritlex_batch_scratch
+{
+  aritlex_kernels *kernels;
+  aritlex_lanes lanes[ARITLEX_BATCH_LANES_CAPACITY];
+  u32 lanes_free[ARITLEX_BATCH_LANES_CAPACITY];
+  u32 lanes_free_size;
+
+} aritlex_batch_scratch;
+
+ARITLEX_API ARITLEX_INLINE void aritlex_batch_init(aritlex_batch_scratch *scratch)
+{
+  scratch->kernels = aritlex_kernels_get();
+  scratch->lanes_free_size = 0;
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_batch_release(aritlex_batch_scratch *scratch, aritlex_batch_slot *slot)
+{
+  if (slot->lanes != ARITLEX_SLOT_INVALID)
+  {
+    scratch->lanes_free[scratch->lanes_free_size++] = slot->lanes;
+    slot->lanes = ARITLEX_SLOT_INVALID;
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_batch_assign(aritlex_batch_scratch *scratch, aritlex_batch_slot *slot, aritlex_type type, u32 lanes)
+{
+  aritlex_batch_release(scratch, slot);
+  slot->type = type;
+  slot->lanes = lanes;
+  slot->number_floating = scratch->lanes[lanes].number_floating;
+  slot->number_integer = scratch->lanes[lanes].number_integer;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_batch_alloc(aritlex_batch_scratch *scratch)
+{
+  return scratch->lanes_free[--scratch->lanes_free_size];
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_batch_to_f64(aritlex_batch_scratch *scratch, aritlex_batch_slot *slot, u32 n)
+{
+  if (slot->type == ARITLEX_TYPE_S32)
+  {
+    u32 lanes = aritlex_batch_alloc(scratch);
+    scratch->kernels->s32_to_f64(scratch->lanes[lanes].number_floating, slot->number_integer, n);
+    aritlex_batch_assign(scratch, slot, ARITLEX_TYPE_F64, lanes);
+  }
+}
+
+/* Converts to s32 lanes, either by truncation or (truth != 0) to 0/1 */
+ARITLEX_API ARITLEX_INLINE void aritlex_batch_to_s32(aritlex_batch_scratch *scratch, aritlex_batch_slot *slot, u32 n, u32 truth)
+{
+  if (slot->type == ARITLEX_TYPE_F64)
+  {
+    u32 lanes = aritlex_batch_alloc(scratch);
+
+    if (truth)
+    {
+      scratch->kernels->f64_truth(scratch->lanes[lanes].number_integer, slot->number_floating, n);
+    }
+    else
+    {
+      scratch->kernels->f64_to_s32(scratch->lanes[lanes].number_integer, slot->number_floating, n);
+    }
+
+    aritlex_batch_assign(scratch, slot, ARITLEX_TYPE_S32, lanes);
+  }
+}
+
+/* Evaluates one chunk of n rows and leaves the result in stack[0] */
+ARITLEX_API ARITLEX_INLINE void aritlex_eval_batch_chunk(
+    aritlex_program *program,
+    f64 **columns,
+    u32 row,
+    u32 n,
+    aritlex_batch_scratch *scratch,
+    aritlex_batch_slot *stack)
+{
+  aritlex_kernels *k = scratch->kernels;
+  u32 sp = 0;
+  u32 i;
+
+  for (scratch->lanes_free_size = 0; scratch->lanes_free_size < ARITLEX_BATCH_LANES_CAPACITY; ++scratch->lanes_free_size)
+  {
+    scratch->lanes_free[scratch->lanes_free_size] = scratch->lanes_free_size;
+  }
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction *instruction = &program->code[i];
+    aritlex_token_type op = instruction->type;
+
+    if (instruction->arity == 0)
+    {
+      aritlex_batch_slot *s = &stack[sp++];
+      u32 j;
+
+      s->lanes = ARITLEX_SLOT_INVALID;
+
+      if (op == TOK_VAR)
+      {
+        s->type = ARITLEX_TYPE_F64;
+        s->number_floating = columns[instruction->val.slot] + row;
+      }
+      else if (op == TOK_NUM_INTEGER)
+      {
+        aritlex_batch_assign(scratch, s, ARITLEX_TYPE_S32, aritlex_batch_alloc(scratch));
+        for (j = 0; j < n; ++j)
+        {
+          s->number_integer[j] = instruction->val.number_integer;
+        }
+      }
+      else
+      {
+        aritlex_batch_assign(scratch, s, ARITLEX_TYPE_F64, aritlex_batch_alloc(scratch));
+        for (j = 0; j < n; ++j)
+        {
+          s->number_floating[j] = instruction->val.number_floating;
+        }
+      }
+    }
+    else if (instruction->arity == 1)
+    {
+      aritlex_batch_slot *a = &stack[sp - 1];
+      u32 dst = aritlex_batch_alloc(scratch);
+
+      if (op == TOK_MINUS && a->type == ARITLEX_TYPE_F64)
+      {
+        k->f64_negate(scratch->lanes[dst].number_floating, a->number_floating, n);
+        aritlex_batch_assign(scratch, a, ARITLEX_TYPE_F64, dst);
+      }
+      else
+      {
+        aritlex_batch_to_s32(scratch, a, n, op == TOK_NOT);
+        k->s32_unary[op](scratch->lanes[dst].number_integer, a->number_integer, n);
+        aritlex_batch_assign(scratch, a, ARITLEX_TYPE_S32, dst);
+      }
+    }
+    else if (instruction->arity == 2)
+    {
+      aritlex_batch_slot *b = &stack[--sp];
+      aritlex_batch_slot *a = &stack[sp - 1];
+      u32 both_s32 = a->type == ARITLEX_TYPE_S32 && b->type == ARITLEX_TYPE_S32;
+      aritlex_type type = ARITLEX_TYPE_S32;
+      u32 dst;
+
+      if (!both_s32 && (op == TOK_PLUS || op == TOK_MINUS || op == TOK_MUL || op == TOK_DIV))
+      {
+        aritlex_batch_to_f64(scratch, a, n);
+        aritlex_batch_to_f64(scratch, b, n);
+        dst = aritlex_batch_alloc(scratch);
+        k->f64_binary[op](scratch->lanes[dst].number_floating, a->number_floating, b->number_floating, n);
+        type = ARITLEX_TYPE_F64;
+      }
+      else if (!both_s32 && aritlex_is_compare(op))
+      {
+        aritlex_batch_to_f64(scratch, a, n);
+        aritlex_batch_to_f64(scratch, b, n);
+        dst = aritlex_batch_alloc(scratch);
+        k->f64_compare[op](scratch->lanes[dst].number_integer, a->number_floating, b->number_floating, n);
+      }
+      else
+      {
+        u32 truth = op == TOK_AND_AND || op == TOK_OR_OR;
+        aritlex_batch_to_s32(scratch, a, n, truth);
+        aritlex_batch_to_s32(scratch, b, n, truth);
+        dst = aritlex_batch_alloc(scratch);
+        k->s32_binary[op](scratch->lanes[dst].number_integer, a->number_integer, b->number_integer, n);
+      }
+
+      aritlex_batch_release(scratch, b);
+      aritlex_batch_assign(scratch, a, type, dst);
+    }
+    else
+    {
+      aritlex_batch_slot *c = &stack[--sp];
+      aritlex_batch_slot *b = &stack[--sp];
+      aritlex_batch_slot *cond = &stack[sp - 1];
+      u32 dst;
+
+      aritlex_batch_to_s32(scratch, cond, n, 1);
+
+      if (b->type == ARITLEX_TYPE_S32 && c->type == ARITLEX_TYPE_S32)
+      {
+        dst = aritlex_batch_alloc(scratch);
+        k->s32_select(scratch->lanes[dst].number_integer, cond->number_integer, b->number_integer, c->number_integer, n);
+        aritlex_batch_assign(scratch, cond, ARITLEX_TYPE_S32, dst);
+      }
+      else
+      {
+        aritlex_batch_to_f64(scratch, b, n);
+        aritlex_batch_to_f64(scratch, c, n);
+        dst = aritlex_batch_alloc(scratch);
+        k->f64_select(scratch->lanes[dst].number_floating, cond->number_integer, b->number_floating, c->number_floating, n);
+        aritlex_batch_assign(scratch, cond, ARITLEX_TYPE_F64, dst);
+      }
+
+      aritlex_batch_release(scratch, b);
+      aritlex_batch_release(scratch, c);
+    }
+  }
+}
+
+/* Evaluates program for every row. columns[slot] holds rows values of the variable in that slot. */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_eval_batch(
+    aritlex_program *program,
+    f64 **columns,
+    u32 rows,
+    f64 *out,
+    aritlex_batch_scratch *scratch)
+{
+  aritlex_batch_slot stack[ARITLEX_STACK_CAPACITY];
+  u32 row;
+
+  if (!program || program->code_size == 0 || (!columns && program->vars_size) || !out || !scratch || !scratch->kernels)
+  {
+    return 0;
+  }
+
+  for (row = 0; row < rows; row += ARITLEX_BATCH_SIZE)
+  {
+    u32 n = rows - row < ARITLEX_BATCH_SIZE ? rows - row : ARITLEX_BATCH_SIZE;
+    u32 j;
+
+    aritlex_eval_batch_chunk(program, columns, row, n, scratch, stack);
+
+    if (stack[0].type == ARITLEX_TYPE_S32)
+    {
+      scratch->kernels->s32_to_f64(out + row, stack[0].number_integer, n);
+    }
+    else
+    {
+      for (j = 0; j < n; ++j)
+      {
+        out[row + j] = stack[0].number_floating[j];
+      }
+    }
+  }
+
+  return 1;
+}
+
+/* #############################################################################
+ * # X86-64 JIT
+ * #############################################################################
+ *
+ * Translates a compiled program into native SSE2 code for Linux x86-64. The
+ * code is placed in pages obtained by raw mmap/mprotect syscalls, so there is
+ * still no C standard library involved. The pages are written first and only
+ * then made executable (never writable and executable at the same time).
+ *
+ * Every value lives in an xmm register as f64 (stack slot k is xmm k). This
+ * is exact for f64 values and for the 0/1 results of comparisons and logical
+ * operators. Constant operands are folded at compile time with the same
+ * aritlex_value operations the interpreter uses. Integer arithmetic on
+ * non-constant s32 values (wrapping +, -, *, /, %, bitwise, shifts) has no
+ * exact f64 equivalent. Programs that need it, or more than 14 stack slots,
+ * are not translated, and aritlex_jit_eval falls back to the interpreter.
+ * Define ARITLEX_NO_JIT to leave the native path out entirely.
+ */
+typedef f64 (*aritlex_jit_function)(f64 *vars);
+
+typedef struct aritlex_jit
+{
+  aritlex_program *program;      /* Interpreted whenever function is 0 */
+  aritlex_jit_function function; /* Native code or 0 */
+  void *memory;
+  u32 memory_size;
+  u32 code_size;
+
+} aritlex_jit;
+
+#if !defined(ARITLEX_NO_JIT) && defined(__linux__) && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define ARITLEX_JIT_X64
+
+#define ARITLEX_JIT_SYS_MMAP 9
+#define ARITLEX_JIT_SYS_MPROTECT 10
+#define ARITLEX_JIT_SYS_MUNMAP 11
+#define ARITLEX_JIT_REGISTERS 14    /* xmm0..xmm13 hold stack slots, xmm14/xmm15 are temporaries */
+#define ARITLEX_JIT_MAX_INSTRUCTION 48 /* Upper bound of bytes emitted per program instruction */
+
+typedef struct aritlex_jit_emitter
+{
+  u8 *code;
+  u32 size;
+  u32 capacity;
+
+} aritlex_jit_emitter;
+
+typedef struct aritlex_jit_slot
+{
+  aritlex_value constant; /* valid if is_constant, otherwise the value is in xmm (slot index) */
+  u32 is_constant;
+  aritlex_type type;
+
+} aritlex_jit_slot;
+
+ARITLEX_API ARITLEX_INLINE long aritlex_jit_syscall(long number, long a1, long a2, long a3, long a4, long a5, long a6)
+{
+  long result;
+  register long r10 __asm__("r10") = a4;
+  register long r8 __asm__("r8") = a5;
+  register long r9 __asm__("r9") = a6;
+
+  __asm__ __volatile__("syscall"
+                       : "=a"(result)
+                       : "a"(number), "D"(a1), "S"(a2), "d"(a3), "r"(r10), "r"(r8), "r"(r9)
+                       : "rcx", "r11", "memory");
+
+  return result;
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_byte(aritlex_jit_emitter *e, u32 byte)
+{
+  if (e->size < e->capacity)
+  {
+    e->code[e->size] = (u8)byte;
+  }
+  e->size++;
+}
+
+/* SSE2 register to register instruction: prefix [REX] 0F opcode ModRM(11, reg, rm) */
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_sse(aritlex_jit_emitter *e, u32 prefix, u32 opcode, u32 reg, u32 rm)
+{
+  aritlex_jit_byte(e, prefix);
+  if (reg >= 8 || rm >= 8)
+  {
+    aritlex_jit_byte(e, 0x40u | ((reg >> 3) << 2) | (rm >> 3));
+  }
+  aritlex_jit_byte(e, 0x0F);
+  aritlex_jit_byte(e, opcode);
+  aritlex_jit_byte(e, 0xC0u | ((reg & 7u) << 3) | (rm & 7u));
+}
+
+/* cmpsd reg, rm, predicate (0 eq, 1 lt, 2 le, 4 neq - ordered except neq, like C) */
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_cmpsd(aritlex_jit_emitter *e, u32 reg, u32 rm, u32 predicate)
+{
+  aritlex_jit_sse(e, 0xF2, 0xC2, reg, rm);
+  aritlex_jit_byte(e, predicate);
+}
+
+/* mov rax, imm64 ; movq xmm, rax */
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_load_f64(aritlex_jit_emitter *e, u32 reg, f64 value)
+{
+  union
+  {
+    f64 number_floating;
+    u8 bytes[8];
+  } bits;
+  u32 i;
+
+  bits.number_floating = value;
+
+  aritlex_jit_byte(e, 0x48);
+  aritlex_jit_byte(e, 0xB8);
+  for (i = 0; i < 8; ++i)
+  {
+    aritlex_jit_byte(e, bits.bytes[i]); /* x86 is little endian like the host */
+  }
+
+  aritlex_jit_byte(e, 0x66);
+  aritlex_jit_byte(e, 0x48u | ((reg >> 3) << 2));
+  aritlex_jit_byte(e, 0x0F);
+  aritlex_jit_byte(e, 0x6E);
+  aritlex_jit_byte(e, 0xC0u | ((reg & 7u) << 3));
+}
+
+/* movsd xmm, [rdi + slot * 8] */
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_load_var(aritlex_jit_emitter *e, u32 reg, u32 slot)
+{
+  u32 offset = slot * 8;
+
+  aritlex_jit_byte(e, 0xF2);
+  if (reg >= 8)
+  {
+    aritlex_jit_byte(e, 0x44);
+  }
+  aritlex_jit_byte(e, 0x0F);
+  aritlex_jit_byte(e, 0x10);
+  aritlex_jit_byte(e, 0x80u | ((reg & 7u) << 3) | 7u); /* mod 10, rm 111 = rdi + disp32 */
+  aritlex_jit_byte(e, offset & 0xFFu);
+  aritlex_jit_byte(e, (offset >> 8) & 0xFFu);
+  aritlex_jit_byte(e, (offset >> 16) & 0xFFu);
+  aritlex_jit_byte(e, (offset >> 24) & 0xFFu);
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_materialize(aritlex_jit_emitter *e, aritlex_jit_slot *stack, u32 index)
+{
+  if (stack[index].is_constant)
+  {
+    aritlex_jit_load_f64(e, index, aritlex_value_to_f64(stack[index].constant));
+    stack[index].is_constant = 0;
+  }
+}
+
+/* reg = (reg != 0.0) as an all ones/zero mask, NaN counts as true like in C */
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_truth_mask(aritlex_jit_emitter *e, u32 reg)
+{
+  aritlex_jit_sse(e, 0x66, 0x57, 15, 15); /* xorpd xmm15, xmm15 */
+  aritlex_jit_cmpsd(e, reg, 15, 4);
+}
+
+/* reg = mask & 1.0 */
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_mask_to_one(aritlex_jit_emitter *e, u32 reg)
+{
+  aritlex_jit_load_f64(e, 14, 1.0);
+  aritlex_jit_sse(e, 0x66, 0x54, reg, 14); /* andpd */
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_jit_emit_program(aritlex_jit_emitter *e, aritlex_program *program)
+{
+  aritlex_jit_slot stack[ARITLEX_JIT_REGISTERS];
+  u32 sp = 0;
+  u32 i;
+
+  if (program->code_size == 0 || program->stack_size > ARITLEX_JIT_REGISTERS)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction *instruction = &program->code[i];
+    aritlex_token_type op = instruction->type;
+
+    if (instruction->arity == 0)
+    {
+      aritlex_jit_slot *s = &stack[sp];
+
+      s->is_constant = op != TOK_VAR;
+      s->type = aritlex_result_type(op, 0, ARITLEX_TYPE_S32, ARITLEX_TYPE_S32, ARITLEX_TYPE_S32);
+      s->constant.type = s->type;
+
+      if (op == TOK_NUM_INTEGER)
+      {
+        s->constant.val.number_integer = instruction->val.number_integer;
+      }
+      else if (op == TOK_NUM_FLOAT)
+      {
+        s->constant.val.number_floating = instruction->val.number_floating;
+      }
+      else
+      {
+        aritlex_jit_load_var(e, sp, instruction->val.slot);
+      }
+
+      sp++;
+    }
+    else if (instruction->arity == 1)
+    {
+      u32 a = sp - 1;
+
+      if (stack[a].is_constant)
+      {
+        stack[a].constant = aritlex_value_unary(op, stack[a].constant);
+        stack[a].type = stack[a].constant.type;
+      }
+      else if (op == TOK_MINUS && stack[a].type == ARITLEX_TYPE_F64)
+      {
+        aritlex_jit_load_f64(e, 14, -0.0);
+        aritlex_jit_sse(e, 0x66, 0x57, a, 14); /* xorpd flips the sign bit */
+      }
+      else if (op == TOK_NOT)
+      {
+        aritlex_jit_sse(e, 0x66, 0x57, 15, 15);
+        aritlex_jit_cmpsd(e, a, 15, 0);
+        aritlex_jit_mask_to_one(e, a);
+        stack[a].type = ARITLEX_TYPE_S32;
+      }
+      else
+      {
+        return 0; /* s32 negation and ~ */
+      }
+    }
+    else if (instruction->arity == 2)
+    {
+      u32 b = --sp;
+      u32 a = sp - 1;
+      u32 both_s32 = stack[a].type == ARITLEX_TYPE_S32 && stack[b].type == ARITLEX_TYPE_S32;
+      aritlex_type type = aritlex_result_type(op, 2, stack[a].type, stack[b].type, stack[b].type);
+
+      if (stack[a].is_constant && stack[b].is_constant)
+      {
+        stack[a].constant = aritlex_value_binary(op, stack[a].constant, stack[b].constant);
+        stack[a].type = type;
+        continue;
+      }
+
+      aritlex_jit_materialize(e, stack, a);
+      aritlex_jit_materialize(e, stack, b);
+
+      switch (op)
+      {
+      case TOK_PLUS:
+      case TOK_MINUS:
+      case TOK_MUL:
+      case TOK_DIV:
+      {
+        if (both_s32)
+        {
+          return 0;
+        }
+
+        /* addsd, subsd, mulsd, divsd */
+        aritlex_jit_sse(e, 0xF2, op == TOK_PLUS ? 0x58u : (op == TOK_MINUS ? 0x5Cu : (op == TOK_MUL ? 0x59u : 0x5Eu)), a, b);
+        break;
+      }
+      case TOK_EQ:
+      case TOK_NEQ:
+      case TOK_LT:
+      case TOK_LE:
+      {
+        aritlex_jit_cmpsd(e, a, b, op == TOK_EQ ? 0u : (op == TOK_NEQ ? 4u : (op == TOK_LT ? 1u : 2u)));
+        aritlex_jit_mask_to_one(e, a);
+        break;
+      }
+      case TOK_GT:
+      case TOK_GE:
+      {
+        /* a > b is b < a: compare into xmm15 and move the result back */
+        aritlex_jit_sse(e, 0x66, 0x28, 15, b);
+        aritlex_jit_cmpsd(e, 15, a, op == TOK_GT ? 1u : 2u);
+        aritlex_jit_sse(e, 0x66, 0x28, a, 15);
+        aritlex_jit_mask_to_one(e, a);
+        break;
+      }
+      case TOK_AND_AND:
+      case TOK_OR_OR:
+      {
+        aritlex_jit_truth_mask(e, a);
+        aritlex_jit_truth_mask(e, b);
+        aritlex_jit_sse(e, 0x66, op == TOK_AND_AND ? 0x54u : 0x56u, a, b); /* andpd / orpd */
+        aritlex_jit_mask_to_one(e, a);
+        break;
+      }
+      default:
+        return 0; /* %, bitwise and shifts on non constant operands */
+      }
+
+      stack[a].type = type;
+    }
+    else
+    {
+      u32 c = --sp;
+      u32 b = --sp;
+      u32 cond = sp - 1;
+      aritlex_type type = aritlex_result_type(op, 3, stack[cond].type, stack[b].type, stack[c].type);
+
+      if (stack[cond].is_constant)
+      {
+        u32 chosen = aritlex_value_truth(stack[cond].constant) ? b : c;
+
+        if (stack[chosen].is_constant)
+        {
+          stack[cond].constant = stack[chosen].constant;
+          if (type == ARITLEX_TYPE_F64 && stack[cond].constant.type == ARITLEX_TYPE_S32)
+          {
+            stack[cond].constant.type = ARITLEX_TYPE_F64;
+            stack[cond].constant.val.number_floating = (f64)stack[cond].constant.val.number_integer;
+          }
+        }
+        else
+        {
+          stack[cond].is_constant = 0;
+          aritlex_jit_sse(e, 0x66, 0x28, cond, chosen); /* movapd */
+        }
+      }
+      else
+      {
+        aritlex_jit_materialize(e, stack, b);
+        aritlex_jit_materialize(e, stack, c);
+        aritlex_jit_truth_mask(e, cond);
+        aritlex_jit_sse(e, 0x66, 0x54, b, cond);    /* andpd  b, mask        */
+        aritlex_jit_sse(e, 0x66, 0x55, cond, c);    /* andnpd mask, c (~m&c) */
+        aritlex_jit_sse(e, 0x66, 0x56, cond, b);    /* orpd                  */
+      }
+
+      stack[cond].type = type;
+    }
+  }
+
+  aritlex_jit_materialize(e, stack, 0);
+  aritlex_jit_byte(e, 0xC3); /* ret, the result is in xmm0 */
+
+  return e->size <= e->capacity;
+}
+#endif /* ARITLEX_JIT_X64 */
+
+/* Returns 1 if native code was generated. On 0 the jit still evaluates program through the interpreter. */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_jit_compile(aritlex_program *program, aritlex_jit *jit)
+{
+  jit->program = program;
+  jit->function = 0;
+  jit->memory = 0;
+  jit->memory_size = 0;
+  jit->code_size = 0;
+
+#ifdef ARITLEX_JIT_X64
+  {
+    aritlex_jit_emitter e;
+    long memory;
+    union
+    {
+      void *memory;
+      aritlex_jit_function function;
+    } entry;
+
+    u32 capacity = (program->code_size * ARITLEX_JIT_MAX_INSTRUCTION + 4095u) & ~4095u;
+
+    if (capacity == 0)
+    {
+      return 0;
+    }
+
+    memory = aritlex_jit_syscall(ARITLEX_JIT_SYS_MMAP, 0, (long)capacity, 3 /* PROT_READ | PROT_WRITE */, 0x22 /* MAP_PRIVATE | MAP_ANONYMOUS */, -1, 0);
+
+    if (memory < 0 && memory > -4096)
+    {
+      return 0;
+    }
+
+    e.code = (u8 *)memory;
+    e.size = 0;
+    e.capacity = capacity;
+
+    if (!aritlex_jit_emit_program(&e, program) ||
+        aritlex_jit_syscall(ARITLEX_JIT_SYS_MPROTECT, memory, (long)capacity, 5 /* PROT_READ | PROT_EXEC */, 0, 0, 0) != 0)
+    {
+      aritlex_jit_syscall(ARITLEX_JIT_SYS_MUNMAP, memory, (long)capacity, 0, 0, 0, 0);
+      return 0;
+    }
+
+    entry.memory = (void *)memory;
+    jit->function = entry.function;
+    jit->memory = entry.memory;
+    jit->memory_size = capacity;
+    jit->code_size = e.size;
+
+    return 1;
+  }
+#else
+  return 0;
+#endif
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_jit_eval(aritlex_jit *jit, f64 *vars)
+{
+  return jit->function ? jit->function(vars) : aritlex_eval(jit->program, vars);
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_jit_free(aritlex_jit *jit)
+{
+#ifdef ARITLEX_JIT_X64
+  if (jit->memory)
+  {
+    aritlex_jit_syscall(ARITLEX_JIT_SYS_MUNMAP, (long)jit->memory, (long)jit->memory_size, 0, 0, 0, 0);
+  }
+#endif
+  jit->function = 0;
+  jit->memory = 0;
+  jit->memory_size = 0;
+  jit->code_size = 0;
+}
+
+/* #############################################################################
+ * # RULE SET
+ * #############################################################################
+ *
+ * Compiles many expressions into one DAG where identical subexpressions (also
+ * across rules) are stored once. Nodes are hash-consed: before a node is added
+ * it is looked up by (operator, operands, literal), and the operands of
+ * commutative operators are ordered first so "a * b" and "b * a" share a node.
+ * Operands are always added before their users, so evaluating the nodes in
+ * order computes every shared node exactly once per input.
+ *
+ * The node and hash table arrays are provided by the caller since rule sets
+ * can be large. The table capacity must be a power of two greater than the
+ * node capacity (twice the node capacity keeps the probe sequences short).
+ */
+#ifndef ARITLEX_RULESET_VARS_CAPACITY
+#define ARITLEX_RULESET_VARS_CAPACITY 256
+#endif
+
+typedef struct aritlex_ruleset_node
+{
+  aritlex_instruction instruction; /* val.slot refers to the rule set variables */
+  u32 operands[3];                 /* node indices, valid up to instruction.arity */
+
+} aritlex_ruleset_node;
+
+typedef struct aritlex_ruleset
+{
+  aritlex_ruleset_node *nodes;
+  u32 nodes_size;
+  u32 nodes_capacity;
+
+  u32 *table; /* node index + 1, 0 marks an empty entry */
+  u32 table_capacity;
+
+  u32 *rules; /* root node of each rule */
+  u32 rules_size;
+  u32 rules_capacity;
+
+  u32 instructions; /* sum of all rule program sizes (nodes needed without sharing) */
+
+  s8 vars[ARITLEX_RULESET_VARS_CAPACITY][32];
+  u32 vars_size;
+
+  aritlex_program program; /* compile scratch */
+
+} aritlex_ruleset;
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_ruleset_init(
+    aritlex_ruleset *set,
+    aritlex_ruleset_node *nodes, u32 nodes_capacity,
+    u32 *table, u32 table_capacity,
+    u32 *rules, u32 rules_capacity)
+{
+  u32 i;
+
+  if (table_capacity <= nodes_capacity || (table_capacity & (table_capacity - 1)) != 0)
+  {
+    return 0;
+  }
+
+  set->nodes = nodes;
+  set->nodes_size = 0;
+  set->nodes_capacity = nodes_capacity;
+  set->table = table;
+  set->table_capacity = table_capacity;
+  set->rules = rules;
+  set->rules_size = 0;
+  set->rules_capacity = rules_capacity;
+  set->instructions = 0;
+  set->vars_size = 0;
+
+  for (i = 0; i < table_capacity; ++i)
+  {
+    table[i] = 0;
+  }
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_ruleset_slot(aritlex_ruleset *set, s8 *name)
+{
+  u32 i;
+
+  for (i = 0; i < set->vars_size; ++i)
+  {
+    if (aritlex_name_equals(set->vars[i], name))
+    {
+      return i;
+    }
+  }
+
+  return ARITLEX_SLOT_INVALID;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_ruleset_is_commutative(aritlex_token_type op)
+{
+  return op == TOK_PLUS || op == TOK_MUL || op == TOK_EQ || op == TOK_NEQ ||
+         op == TOK_AND_AND || op == TOK_OR_OR || op == TOK_AND || op == TOK_OR || op == TOK_XOR;
+}
+
+/* Literal payload as two words so floats are compared and hashed by their bits */
+ARITLEX_API ARITLEX_INLINE void aritlex_ruleset_literal(aritlex_instruction *instruction, u32 bits[2])
+{
+  union
+  {
+    f64 number_floating;
+    u32 words[2];
+  } literal;
+
+  literal.number_floating = 0.0;
+
+  if (instruction->type == TOK_NUM_FLOAT)
+  {
+    literal.number_floating = instruction->val.number_floating;
+  }
+  else if (instruction->arity == 0)
+  {
+    literal.words[0] = instruction->type == TOK_VAR ? instruction->val.slot : (u32)instruction->val.number_integer;
+  }
+
+  bits[0] = literal.words[0];
+  bits[1] = literal.words[1];
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_ruleset_node_equals(aritlex_ruleset_node *a, aritlex_ruleset_node *b)
+{
+  u32 x[2], y[2], i;
+
+  if (a->instruction.type != b->instruction.type || a->instruction.arity != b->instruction.arity)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < a->instruction.arity; ++i)
+  {
+    if (a->operands[i] != b->operands[i])
+    {
+      return 0;
+    }
+  }
+
+  aritlex_ruleset_literal(&a->instruction, x);
+  aritlex_ruleset_literal(&b->instruction, y);
+
+  return x[0] == y[0] && x[1] == y[1];
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_ruleset_hash(aritlex_ruleset_node *node)
+{
+  u32 bits[2], i;
+  u32 hash = 2166136261u; /* FNV-1a over 32 bit words */
+
+  aritlex_ruleset_literal(&node->instruction, bits);
+
+  hash = (hash ^ (u32)node->instruction.type) * 16777619u;
+  hash = (hash ^ node->instruction.arity) * 16777619u;
+  hash = (hash ^ bits[0]) * 16777619u;
+  hash = (hash ^ bits[1]) * 16777619u;
+
+  for (i = 0; i < node->instruction.arity; ++i)
+  {
+    hash = (hash ^ node->operands[i]) * 16777619u;
+  }
+
+  return hash ^ (hash >> 15);
+}
+
+/* Returns the index of the existing equal node or appends node, ARITLEX_SLOT_INVALID if full */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_ruleset_intern(aritlex_ruleset *set, aritlex_ruleset_node *node)
+{
+  u32 mask = set->table_capacity - 1;
+  u32 i = aritlex_ruleset_hash(node) & mask;
+
+  while (set->table[i])
+  {
+    u32 index = set->table[i] - 1;
+
+    if (aritlex_ruleset_node_equals(&set->nodes[index], node))
+    {
+      return index;
+    }
+
+    i = (i + 1) & mask;
+  }
+
+  if (set->nodes_size >= set->nodes_capacity)
+  {
+    return ARITLEX_SLOT_INVALID;
+  }
+
+  set->nodes[set->nodes_size] = *node;
+  set->table[i] = ++set->nodes_size;
+
+  return set->nodes_size - 1;
+}
+
+/* Adds one rule, its result is out[set->rules_size - 1] of aritlex_ruleset_eval */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_ruleset_add(aritlex_ruleset *set, aritlex_token *tokens, u32 tokens_size)
+{
+  aritlex_program *program = &set->program;
+  u32 stack[ARITLEX_STACK_CAPACITY];
+  u32 slots[ARITLEX_VARS_CAPACITY];
+  u32 sp = 0;
+  u32 i;
+
+  if (set->rules_size >= set->rules_capacity || !aritlex_compile(tokens, tokens_size, program))
+  {
+    return 0;
+  }
+
+  /* Map the program variable slots to the rule set slots */
+  for (i = 0; i < program->vars_size; ++i)
+  {
+    slots[i] = aritlex_ruleset_slot(set, program->vars[i]);
+
+    if (slots[i] == ARITLEX_SLOT_INVALID)
+    {
+      u32 j = 0;
+
+      if (set->vars_size >= ARITLEX_RULESET_VARS_CAPACITY)
+      {
+        return 0;
+      }
+
+      do
+      {
+        set->vars[set->vars_size][j] = program->vars[i][j];
+      } while (program->vars[i][j++]);
+
+      slots[i] = set->vars_size++;
+    }
+  }
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_ruleset_node node;
+    u32 arity = program->code[i].arity;
+    u32 j;
+
+    node.instruction = program->code[i];
+
+    if (node.instruction.type == TOK_VAR)
+    {
+      node.instruction.val.slot = slots[node.instruction.val.slot];
+    }
+
+    sp -= arity;
+
+    for (j = 0; j < 3; ++j)
+    {
+      node.operands[j] = j < arity ? stack[sp + j] : 0;
+    }
+
+    if (arity == 2 && aritlex_ruleset_is_commutative(node.instruction.type) && node.operands[0] > node.operands[1])
+    {
+      node.operands[0] = stack[sp + 1];
+      node.operands[1] = stack[sp];
+    }
+
+    stack[sp] = aritlex_ruleset_intern(set, &node);
+
+    if (stack[sp] == ARITLEX_SLOT_INVALID)
+    {
+      return 0;
+    }
+
+    sp++;
+  }
+
+  set->rules[set->rules_size++] = stack[0];
+  set->instructions += program->code_size;
+
+  return 1;
+}
+
+/* Number of nodes evaluated without sharing per node actually evaluated (1.0 means nothing is shared) */
+ARITLEX_API ARITLEX_INLINE f64 aritlex_ruleset_sharing(aritlex_ruleset *set)
+{
+  return set->nodes_size ? (f64)set->instructions / (f64)set->nodes_size : 1.0;
+}
+
+/* Evaluates all rules for one input. values needs room for nodes_size entries, out for rules_size. */
+ARITLEX_API ARITLEX_INLINE void aritlex_ruleset_eval(aritlex_ruleset *set, f64 *vars, aritlex_value *values, f64 *out)
+{
+  u32 i;
+
+  for (i = 0; i < set->nodes_size; ++i)
+  {
+    aritlex_ruleset_node *node = &set->nodes[i];
+    aritlex_instruction *instruction = &node->instruction;
+
+    switch (instruction->arity)
+    {
+    case 0:
+    {
+      if (instruction->type == TOK_NUM_INTEGER)
+      {
+        values[i].type = ARITLEX_TYPE_S32;
+        values[i].val.number_integer = instruction->val.number_integer;
+      }
+      else
+      {
+        values[i].type = ARITLEX_TYPE_F64;
+        values[i].val.number_floating = instruction->type == TOK_VAR ? vars[instruction->val.slot] : instruction->val.number_floating;
+      }
+      break;
+    }
+    case 1:
+    {
+      values[i] = aritlex_value_unary(instruction->type, values[node->operands[0]]);
+      break;
+    }
+    case 2:
+    {
+      values[i] = aritlex_value_binary(instruction->type, values[node->operands[0]], values[node->operands[1]]);
+      break;
+    }
+    default:
+    {
+      values[i] = aritlex_value_select(values[node->operands[0]], values[node->operands[1]], values[node->operands[2]]);
+      break;
+    }
+    }
+  }
+
+  for (i = 0; i < set->rules_size; ++i)
+  {
+    out[i] = aritlex_value_to_f64(values[set->rules[i]]);
+  }
+}
+
+/* #############################################################################
+ * # SHEET
+ * #############################################################################
+ *
+ * Spreadsheet style cells defined by assignments like "total = a + b". Every
+ * name is a cell: either an input set by the caller or a formula. Each formula
+ * is linked into the dependents list of every cell it reads, so a change only
+ * walks the cells downstream of it. The walk is a depth first search over
+ * the dependents whose reverse post order is a topological order, so every
+ * affected formula is evaluated once and after all of its inputs.
+ *
+ * A formula that would create a cycle is rejected and the previous formula or
+ * value of the cell is kept. Cells and the name hash table are provided by the
+ * caller (the table capacity must be a power of two greater than the cell
+ * capacity).
+ */
+typedef struct aritlex_sheet_cell
+{
+  s8 name[32];
+  f64 value;
+  u32 is_formula;
+  aritlex_program program;              /* valid if is_formula */
+  u32 inputs[ARITLEX_VARS_CAPACITY];    /* cell read by each program variable slot */
+  u32 link_prev[ARITLEX_VARS_CAPACITY]; /* dependents list of inputs[slot], the link id is cell * ARITLEX_VARS_CAPACITY + slot */
+  u32 link_next[ARITLEX_VARS_CAPACITY];
+  u32 dependents; /* first link of the formulas reading this cell */
+
+  u32 mark;       /* traversal epoch */
+  u32 cursor;     /* next dependents link to visit */
+  u32 stack_next; /* depth first search stack */
+  u32 order_next; /* topological order list */
+
+} aritlex_sheet_cell;
+
+typedef struct aritlex_sheet
+{
+  aritlex_sheet_cell *cells;
+  u32 cells_size;
+  u32 cells_capacity;
+
+  u32 *table; /* cell index + 1, 0 marks an empty entry */
+  u32 table_capacity;
+
+  u32 epoch;
+  u32 evaluations; /* formula evaluations so far */
+  u32 cycle_cell;  /* cell that would have closed a cycle in the last rejected formula */
+
+  aritlex_program program; /* compile scratch */
+
+} aritlex_sheet;
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_init(aritlex_sheet *sheet, aritlex_sheet_cell *cells, u32 cells_capacity, u32 *table, u32 table_capacity)
+{
+  u32 i;
+
+  if (table_capacity <= cells_capacity || (table_capacity & (table_capacity - 1)) != 0)
+  {
+    return 0;
+  }
+
+  sheet->cells = cells;
+  sheet->cells_size = 0;
+  sheet->cells_capacity = cells_capacity;
+  sheet->table = table;
+  sheet->table_capacity = table_capacity;
+  sheet->epoch = 0;
+  sheet->evaluations = 0;
+  sheet->cycle_cell = ARITLEX_SLOT_INVALID;
+
+  for (i = 0; i < table_capacity; ++i)
+  {
+    table[i] = 0;
+  }
+
+  return 1;
+}
+
+/* Table entry holding name or the empty entry where it would be inserted */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_entry(aritlex_sheet *sheet, s8 *name)
+{
+  u32 mask = sheet->table_capacity - 1;
+  u32 hash = 2166136261u;
+  s8 *c = name;
+
+  while (*c)
+  {
+    hash = (hash ^ (u32)(u8)*c++) * 16777619u;
+  }
+
+  hash &= mask;
+
+  while (sheet->table[hash] && !aritlex_name_equals(sheet->cells[sheet->table[hash] - 1].name, name))
+  {
+    hash = (hash + 1) & mask;
+  }
+
+  return hash;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_find(aritlex_sheet *sheet, s8 *name)
+{
+  return sheet->table[aritlex_sheet_entry(sheet, name)] - 1; /* ARITLEX_SLOT_INVALID if missing */
+}
+
+/* Returns the cell of name, a missing name becomes an input with value 0 */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_cell_of(aritlex_sheet *sheet, s8 *name)
+{
+  u32 entry = aritlex_sheet_entry(sheet, name);
+  aritlex_sheet_cell *cell;
+  u32 i = 0;
+
+  if (sheet->table[entry])
+  {
+    return sheet->table[entry] - 1;
+  }
+
+  if (sheet->cells_size >= sheet->cells_capacity)
+  {
+    return ARITLEX_SLOT_INVALID;
+  }
+
+  cell = &sheet->cells[sheet->cells_size];
+
+  do
+  {
+    cell->name[i] = name[i];
+  } while (name[i++] && i < 32);
+
+  cell->name[31] = 0;
+  cell->value = 0.0;
+  cell->is_formula = 0;
+  cell->dependents = ARITLEX_SLOT_INVALID;
+  cell->mark = 0;
+
+  sheet->table[entry] = ++sheet->cells_size;
+
+  return sheet->cells_size - 1;
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_sheet_unlink(aritlex_sheet *sheet, u32 index)
+{
+  aritlex_sheet_cell *cell = &sheet->cells[index];
+  u32 slot;
+
+  if (!cell->is_formula)
+  {
+    return;
+  }
+
+  for (slot = 0; slot < cell->program.vars_size; ++slot)
+  {
+    u32 prev = cell->link_prev[slot];
+    u32 next = cell->link_next[slot];
+
+    if (prev == ARITLEX_SLOT_INVALID)
+    {
+      sheet->cells[cell->inputs[slot]].dependents = next;
+    }
+    else
+    {
+      sheet->cells[prev / ARITLEX_VARS_CAPACITY].link_next[prev % ARITLEX_VARS_CAPACITY] = next;
+    }
+
+    if (next != ARITLEX_SLOT_INVALID)
+    {
+      sheet->cells[next / ARITLEX_VARS_CAPACITY].link_prev[next % ARITLEX_VARS_CAPACITY] = prev;
+    }
+  }
+
+  cell->is_formula = 0;
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_sheet_link(aritlex_sheet *sheet, u32 index)
+{
+  aritlex_sheet_cell *cell = &sheet->cells[index];
+  u32 slot;
+
+  for (slot = 0; slot < cell->program.vars_size; ++slot)
+  {
+    aritlex_sheet_cell *input = &sheet->cells[cell->inputs[slot]];
+    u32 link = index * ARITLEX_VARS_CAPACITY + slot;
+
+    cell->link_prev[slot] = ARITLEX_SLOT_INVALID;
+    cell->link_next[slot] = input->dependents;
+
+    if (input->dependents != ARITLEX_SLOT_INVALID)
+    {
+      sheet->cells[input->dependents / ARITLEX_VARS_CAPACITY].link_prev[input->dependents % ARITLEX_VARS_CAPACITY] = link;
+    }
+
+    input->dependents = link;
+  }
+
+  cell->is_formula = 1;
+}
+
+/* Marks start and everything downstream, returns them as a topological list (start first) */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_collect(aritlex_sheet *sheet, u32 start)
+{
+  aritlex_sheet_cell *cells = sheet->cells;
+  u32 top = start;
+  u32 head = ARITLEX_SLOT_INVALID;
+
+  sheet->epoch++;
+
+  cells[start].mark = sheet->epoch;
+  cells[start].cursor = cells[start].dependents;
+  cells[start].stack_next = ARITLEX_SLOT_INVALID;
+
+  while (top != ARITLEX_SLOT_INVALID)
+  {
+    aritlex_sheet_cell *cell = &cells[top];
+    u32 link = cell->cursor;
+
+    if (link != ARITLEX_SLOT_INVALID)
+    {
+      u32 dependent = link / ARITLEX_VARS_CAPACITY;
+
+      cell->cursor = cells[dependent].link_next[link % ARITLEX_VARS_CAPACITY];
+
+      if (cells[dependent].mark != sheet->epoch)
+      {
+        cells[dependent].mark = sheet->epoch;
+        cells[dependent].cursor = cells[dependent].dependents;
+        cells[dependent].stack_next = top;
+        top = dependent;
+      }
+    }
+    else
+    {
+      /* Post order: prepending yields the reverse post order */
+      top = cell->stack_next;
+      cell->order_next = head;
+      head = (u32)(cell - cells);
+    }
+  }
+
+  return head;
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_sheet_recompute(aritlex_sheet *sheet, u32 head)
+{
+  f64 vars[ARITLEX_VARS_CAPACITY];
+
+  while (head != ARITLEX_SLOT_INVALID)
+  {
+    aritlex_sheet_cell *cell = &sheet->cells[head];
+
+    if (cell->is_formula)
+    {
+      u32 slot;
+
+      for (slot = 0; slot < cell->program.vars_size; ++slot)
+      {
+        vars[slot] = sheet->cells[cell->inputs[slot]].value;
+      }
+
+      cell->value = aritlex_eval(&cell->program, vars);
+      sheet->evaluations++;
+    }
+
+    head = cell->order_next;
+  }
+}
+
+/* Defines or replaces the formula of "name = expression" and recomputes its dependents.
+ * Returns 0 on syntax errors, full capacities or if the formula would create a cycle (see cycle_cell). */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_set_formula(aritlex_sheet *sheet, aritlex_token *tokens, u32 tokens_size)
+{
+  aritlex_program *program = &sheet->program;
+  u32 target, head, slot, missing = 0;
+
+  sheet->cycle_cell = ARITLEX_SLOT_INVALID;
+
+  if (tokens_size < 3 || tokens[0].type != TOK_VAR || tokens[1].type != TOK_ASSIGN ||
+      !aritlex_compile(tokens + 2, tokens_size - 2, program))
+  {
+    return 0;
+  }
+
+  target = aritlex_sheet_find(sheet, tokens[0].val.name);
+  missing += target == ARITLEX_SLOT_INVALID;
+
+  for (slot = 0; slot < program->vars_size; ++slot)
+  {
+    missing += aritlex_sheet_find(sheet, program->vars[slot]) == ARITLEX_SLOT_INVALID;
+  }
+
+  if (sheet->cells_size + missing > sheet->cells_capacity)
+  {
+    return 0;
+  }
+
+  target = aritlex_sheet_cell_of(sheet, tokens[0].val.name);
+  head = aritlex_sheet_collect(sheet, target);
+
+  /* An input that is the target or downstream of it would close a cycle */
+  for (slot = 0; slot < program->vars_size; ++slot)
+  {
+    u32 input = aritlex_sheet_find(sheet, program->vars[slot]);
+
+    if (input != ARITLEX_SLOT_INVALID && sheet->cells[input].mark == sheet->epoch)
+    {
+      sheet->cycle_cell = input;
+      return 0;
+    }
+  }
+
+  aritlex_sheet_unlink(sheet, target);
+
+  sheet->cells[target].program = *program;
+
+  for (slot = 0; slot < program->vars_size; ++slot)
+  {
+    sheet->cells[target].inputs[slot] = aritlex_sheet_cell_of(sheet, program->vars[slot]);
+  }
+
+  aritlex_sheet_link(sheet, target);
+
+  /* The new links only point into target, so the order collected above is still valid */
+  aritlex_sheet_recompute(sheet, head);
+
+  return 1;
+}
+
+/* Sets the value of a cell (replacing its formula if it had one) and recomputes its dependents */
+ARITLEX_API ARITLEX_INLINE void aritlex_sheet_set_cell(aritlex_sheet *sheet, u32 cell, f64 value)
+{
+  aritlex_sheet_unlink(sheet, cell);
+  sheet->cells[cell].value = value;
+  aritlex_sheet_recompute(sheet, aritlex_sheet_collect(sheet, cell));
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_set_input(aritlex_sheet *sheet, s8 *name, f64 value)
+{
+  u32 cell = aritlex_sheet_cell_of(sheet, name);
+
+  if (cell == ARITLEX_SLOT_INVALID)
+  {
+    return 0;
+  }
+
+  aritlex_sheet_set_cell(sheet, cell, value);
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_sheet_get(aritlex_sheet *sheet, s8 *name, f64 *value)
+{
+  u32 cell = aritlex_sheet_find(sheet, name);
+
+  if (cell == ARITLEX_SLOT_INVALID)
+  {
+    return 0;
+  }
+
+  *value = sheet->cells[cell].value;
+
+  return 1;
+}
+
+/* #############################################################################
+ * # FILTER AGGREGATE
+ * #############################################################################
+ *
+ * Computes "aggregate(value) where predicate" in one pass over the columns.
+ * Per chunk of ARITLEX_BATCH_SIZE rows the predicate is evaluated and turned
+ * into a selection vector (the indices of the matching rows). If most rows
+ * match, the value expression is evaluated on the whole chunk and aggregated
+ * through the selection vector. Otherwise only the selected rows of its input
+ * columns are gathered and evaluated. All intermediate data is chunk sized
+ * and never written back to memory as full columns.
+ */
+typedef enum aritlex_aggregate
+{
+  ARITLEX_AGGREGATE_SUM,
+  ARITLEX_AGGREGATE_MIN, /* NaN values are ignored by min and max, no rows yield +/-infinity */
+  ARITLEX_AGGREGATE_MAX,
+  ARITLEX_AGGREGATE_COUNT /* the value expression is not needed */
+
+} aritlex_aggregate;
+
+typedef struct aritlex_filter_scratch
+{
+  aritlex_batch_scratch batch;
+  u32 selection[ARITLEX_BATCH_SIZE];
+  f64 gathered[ARITLEX_VARS_CAPACITY][ARITLEX_BATCH_SIZE];
+
+} aritlex_filter_scratch;
+
+ARITLEX_API ARITLEX_INLINE void aritlex_filter_init(aritlex_filter_scratch *scratch)
+{
+  aritlex_batch_init(&scratch->batch);
+}
+
+/* Folds values[selection[i]] (or values[i] without selection) into result */
+ARITLEX_API ARITLEX_INLINE f64 aritlex_filter_fold(aritlex_aggregate aggregate, f64 result, aritlex_batch_slot *values, u32 *selection, u32 n)
+{
+  u32 i;
+
+  for (i = 0; i < n; ++i)
+  {
+    u32 j = selection ? selection[i] : i;
+    f64 v = values->type == ARITLEX_TYPE_S32 ? (f64)values->number_integer[j] : values->number_floating[j];
+
+    if (aggregate == ARITLEX_AGGREGATE_SUM)
+    {
+      result += v;
+    }
+    else if (aggregate == ARITLEX_AGGREGATE_MIN)
+    {
+      result = v < result ? v : result;
+    }
+    else
+    {
+      result = v > result ? v : result;
+    }
+  }
+
+  return result;
+}
+
+/* predicate_columns and value_columns are indexed by the variable slots of the respective program */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_eval_filter_aggregate(
+    aritlex_program *predicate,
+    f64 **predicate_columns,
+    aritlex_program *value,
+    f64 **value_columns,
+    u32 rows,
+    aritlex_aggregate aggregate,
+    f64 *result,
+    u32 *count,
+    aritlex_filter_scratch *scratch)
+{
+  aritlex_batch_slot stack[ARITLEX_STACK_CAPACITY];
+  f64 *gathered[ARITLEX_VARS_CAPACITY];
+  u32 *selection = scratch->selection;
+  u32 row, i, j;
+
+  if (!predicate || predicate->code_size == 0 || !result || !scratch->batch.kernels ||
+      (aggregate != ARITLEX_AGGREGATE_COUNT && (!value || value->code_size == 0)))
+  {
+    return 0;
+  }
+
+  *result = aggregate == ARITLEX_AGGREGATE_MIN ? 1.0 / 0.0 : (aggregate == ARITLEX_AGGREGATE_MAX ? -1.0 / 0.0 : 0.0);
+
+  if (count)
+  {
+    *count = 0;
+  }
+
+  if (value)
+  {
+    for (i = 0; i < value->vars_size; ++i)
+    {
+      gathered[i] = scratch->gathered[i];
+    }
+  }
+
+  for (row = 0; row < rows; row += ARITLEX_BATCH_SIZE)
+  {
+    u32 n = rows - row < ARITLEX_BATCH_SIZE ? rows - row : ARITLEX_BATCH_SIZE;
+    u32 selected = 0;
+
+    aritlex_eval_batch_chunk(predicate, predicate_columns, row, n, &scratch->batch, stack);
+
+    /* Branch free selection vector */
+    if (stack[0].type == ARITLEX_TYPE_S32)
+    {
+      for (j = 0; j < n; ++j)
+      {
+        selection[selected] = j;
+        selected += stack[0].number_integer[j] != 0;
+      }
+    }
+    else
+    {
+      for (j = 0; j < n; ++j)
+      {
+        selection[selected] = j;
+        selected += stack[0].number_floating[j] != 0.0;
+      }
+    }
+
+    if (count)
+    {
+      *count += selected;
+    }
+
+    if (aggregate == ARITLEX_AGGREGATE_COUNT)
+    {
+      *result += (f64)selected;
+      continue;
+    }
+
+    if (selected == 0)
+    {
+      continue;
+    }
+
+    if (selected * 2 >= n)
+    {
+      /* Dense: evaluating every row is cheaper than gathering */
+      aritlex_eval_batch_chunk(value, value_columns, row, n, &scratch->batch, stack);
+      *result = aritlex_filter_fold(aggregate, *result, &stack[0], selected == n ? 0 : selection, selected);
+    }
+    else
+    {
+      for (i = 0; i < value->vars_size; ++i)
+      {
+        f64 *column = value_columns[i] + row;
+
+        for (j = 0; j < selected; ++j)
+        {
+          gathered[i][j] = column[selection[j]];
+        }
+      }
+
+      aritlex_eval_batch_chunk(value, gathered, 0, selected, &scratch->batch, stack);
+      *result = aritlex_filter_fold(aggregate, *result, &stack[0], 0, selected);
+    }
+  }
+
+  return 1;
+}
+
+/* #############################################################################
+ * # SPECIALIZATION
+ * #############################################################################
+ *
+ * Partial evaluation of a compiled program for a set of fixed variables. The
+ * bound variables become constants, and every subexpression whose operands
+ * are all constant is folded with the evaluator's own operations, so the
+ * residual program returns exactly what the original returns. "0 && x" and
+ * "1 || x" collapse as well, and ?: with a constant condition keeps only the
+ * chosen branch. The residual program only has the unbound variables that are
+ * still used, in their original order.
+ *
+ * Specializations can be cached by their bindings. The cache key is the
+ * source program, a hash of its code, constants and variable names, and the
+ * value of each bound slot, so the order of the bindings and bindings of names
+ * the program does not use do not matter, and a program recompiled in place
+ * misses instead of getting the specialization of its old code.
+ */
+#ifndef ARITLEX_SPECIALIZE_CACHE_CAPACITY
+#define ARITLEX_SPECIALIZE_CACHE_CAPACITY 16
+#endif
+
+typedef struct aritlex_binding
+{
+  s8 *name;
+  f64 value;
+
+} aritlex_binding;
+
+typedef struct aritlex_specialize_operand
+{
+  aritlex_value constant; /* valid if is_constant */
+  u32 is_constant;
+  aritlex_type type;
+  u32 start; /* first residual instruction of a non constant operand */
+#ifdef ARITLEX_FIXED_POINT
+  u32 is_fixed;       /* constant_fixed holds the exact Qm.n value of an unfolded literal */
+  s32 constant_fixed; /* valid if is_fixed */
+#endif
+
+} aritlex_specialize_operand;
+
+/* Slot values of the bindings: bound[slot] is 1 if the program variable in slot is fixed */
+ARITLEX_API ARITLEX_INLINE void aritlex_specialize_slots(aritlex_program *program, aritlex_binding *bindings, u32 bindings_size, u8 *bound, f64 *values)
+{
+  u32 slot, i;
+
+  for (slot = 0; slot < program->vars_size; ++slot)
+  {
+    bound[slot] = 0;
+    values[slot] = 0.0;
+
+    for (i = 0; i < bindings_size; ++i)
+    {
+      if (aritlex_name_equals(program->vars[slot], bindings[i].name))
+      {
+        bound[slot] = 1;
+        values[slot] = bindings[i].value;
+      }
+    }
+  }
+}
+
+/* Inserts instruction at position, moving the following instructions back */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize_insert(aritlex_program *residual, u32 position, aritlex_instruction instruction)
+{
+  u32 i;
+
+  if (residual->code_size >= ARITLEX_PROGRAM_CAPACITY)
+  {
+    return 0;
+  }
+
+  for (i = residual->code_size; i > position; --i)
+  {
+    residual->code[i] = residual->code[i - 1];
+  }
+
+  residual->code[position] = instruction;
+  residual->code_size++;
+
+  return 1;
+}
+
+/* Literals keep their parsed Qm.n value, bound and folded constants are f64 and rounded once */
+ARITLEX_API ARITLEX_INLINE aritlex_instruction aritlex_specialize_literal(aritlex_specialize_operand *operand)
+{
+  aritlex_instruction instruction;
+
+  instruction.arity = 0;
+
+  if (operand->constant.type == ARITLEX_TYPE_S32)
+  {
+    instruction.type = TOK_NUM_INTEGER;
+    instruction.val.number_integer = operand->constant.val.number_integer;
+  }
+  else
+  {
+    instruction.type = TOK_NUM_FLOAT;
+    instruction.val.number_floating = operand->constant.val.number_floating;
+#ifdef ARITLEX_FIXED_POINT
+    instruction.number_fixed = operand->is_fixed ? operand->constant_fixed : aritlex_fixed_from_f64(operand->constant.val.number_floating);
+#endif
+  }
+
+  return instruction;
+}
+
+/* Emits the constant operands of an operator in front of the code of the operands that follow them */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize_materialize(aritlex_program *residual, aritlex_specialize_operand *operands, u32 count)
+{
+  u32 i, j;
+
+  for (i = 0; i < count; ++i)
+  {
+    u32 position = residual->code_size;
+
+    if (!operands[i].is_constant)
+    {
+      continue;
+    }
+
+    for (j = i + 1; j < count; ++j)
+    {
+      if (!operands[j].is_constant)
+      {
+        position = operands[j].start;
+        break;
+      }
+    }
+
+    if (!aritlex_specialize_insert(residual, position, aritlex_specialize_literal(&operands[i])))
+    {
+      return 0;
+    }
+
+    operands[i].is_constant = 0;
+    operands[i].start = position;
+
+    for (j = i + 1; j < count; ++j)
+    {
+      operands[j].start += !operands[j].is_constant;
+    }
+  }
+
+  return 1;
+}
+
+/* Keeps operand as the result of a ?: whose other branch had a different type (s32 becomes f64 like in aritlex_value_select) */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize_promote(aritlex_program *residual, aritlex_specialize_operand *operand)
+{
+  aritlex_instruction instruction;
+
+  if (operand->type == ARITLEX_TYPE_F64)
+  {
+    return 1;
+  }
+
+  operand->type = ARITLEX_TYPE_F64;
+
+  if (operand->is_constant)
+  {
+    operand->constant.type = ARITLEX_TYPE_F64;
+    operand->constant.val.number_floating = (f64)operand->constant.val.number_integer;
+#ifdef ARITLEX_FIXED_POINT
+    operand->is_fixed = 1;
+    operand->constant_fixed = aritlex_fixed_from_s32(operand->constant.val.number_integer);
+#endif
+    return 1;
+  }
+
+  /* x + 0.0 is the exact f64 value of an s32 x */
+  instruction.type = TOK_NUM_FLOAT;
+  instruction.val.number_floating = 0.0;
+#ifdef ARITLEX_FIXED_POINT
+  instruction.number_fixed = 0;
+#endif
+  instruction.arity = 0;
+
+  if (!aritlex_specialize_insert(residual, residual->code_size, instruction))
+  {
+    return 0;
+  }
+
+  instruction.type = TOK_PLUS;
+  instruction.arity = 2;
+
+  return aritlex_specialize_insert(residual, residual->code_size, instruction);
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize_bound(aritlex_program *program, u8 *bound, f64 *values, aritlex_program *residual)
+{
+  aritlex_specialize_operand stack[ARITLEX_STACK_CAPACITY];
+  u32 slots[ARITLEX_VARS_CAPACITY];
+  u32 sp = 0, depth = 0;
+  u32 i;
+
+  residual->code_size = 0;
+  residual->stack_size = 0;
+  residual->vars_size = 0;
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction instruction = program->code[i];
+    aritlex_token_type op = instruction.type;
+    u32 arity = instruction.arity;
+    aritlex_specialize_operand *operands = &stack[sp - arity];
+    aritlex_specialize_operand result;
+    u32 all_constant = 1, j;
+
+    for (j = 0; j < arity; ++j)
+    {
+      all_constant &= operands[j].is_constant;
+    }
+
+    result.is_constant = 0;
+#ifdef ARITLEX_FIXED_POINT
+    result.is_fixed = 0;
+    result.constant_fixed = 0;
+#endif
+    result.start = arity ? operands[0].start : residual->code_size;
+    result.type = aritlex_result_type(op, arity, arity > 0 ? operands[0].type : ARITLEX_TYPE_S32,
+                                      arity > 1 ? operands[1].type : ARITLEX_TYPE_S32,
+                                      arity > 2 ? operands[2].type : ARITLEX_TYPE_S32);
+
+    if (op == TOK_VAR && bound[instruction.val.slot])
+    {
+      result.is_constant = 1;
+      result.constant.type = ARITLEX_TYPE_F64;
+      result.constant.val.number_floating = values[instruction.val.slot];
+    }
+    else if (op == TOK_VAR)
+    {
+      /* Keeps the source slot, remapped once it is known which variables survive */
+      if (!aritlex_specialize_insert(residual, residual->code_size, instruction))
+      {
+        return 0;
+      }
+    }
+    else if (arity == 0)
+    {
+      result.is_constant = 1;
+      result.constant.type = result.type;
+
+      if (op == TOK_NUM_FLOAT)
+      {
+        result.constant.val.number_floating = instruction.val.number_floating;
+#ifdef ARITLEX_FIXED_POINT
+        result.is_fixed = 1;
+        result.constant_fixed = instruction.number_fixed;
+#endif
+      }
+      else
+      {
+        result.constant.val.number_integer = instruction.val.number_integer;
+      }
+    }
+    else if (all_constant)
+    {
+      result.is_constant = 1;
+      result.constant = arity == 1   ? aritlex_value_unary(op, operands[0].constant)
+                        : arity == 2 ? aritlex_value_binary(op, operands[0].constant, operands[1].constant)
+                                     : aritlex_value_select(operands[0].constant, operands[1].constant, operands[2].constant);
+    }
+    else if (arity == 2 && (op == TOK_AND_AND || op == TOK_OR_OR) &&
+             ((operands[0].is_constant && aritlex_value_truth(operands[0].constant) == (op == TOK_OR_OR)) ||
+              (operands[1].is_constant && aritlex_value_truth(operands[1].constant) == (op == TOK_OR_OR))))
+    {
+      /* 0 && x is 0 and 1 || x is 1 whatever x is, drop the code of x */
+      residual->code_size = operands[0].is_constant ? operands[1].start : operands[0].start;
+      result.is_constant = 1;
+      result.constant.type = ARITLEX_TYPE_S32;
+      result.constant.val.number_integer = op == TOK_OR_OR;
+    }
+    else if (arity == 3 && operands[0].is_constant)
+    {
+      u32 pick = aritlex_value_truth(operands[0].constant) ? 1 : 2;
+      u32 mixed = operands[1].type != operands[2].type;
+
+      if (pick == 1 && !operands[2].is_constant)
+      {
+        residual->code_size = operands[2].start;
+      }
+      else if (pick == 2 && !operands[1].is_constant)
+      {
+        /* Move the code of the else branch over the code of the then branch */
+        u32 from = operands[2].is_constant ? residual->code_size : operands[2].start;
+        u32 to = operands[1].start;
+        u32 size = residual->code_size - from;
+
+        for (j = 0; j < size; ++j)
+        {
+          residual->code[to + j] = residual->code[from + j];
+        }
+
+        residual->code_size = to + size;
+        operands[2].start = to;
+      }
+
+      result = operands[pick];
+
+      if (mixed && !aritlex_specialize_promote(residual, &result))
+      {
+        return 0;
+      }
+    }
+    else
+    {
+      if (!aritlex_specialize_materialize(residual, operands, arity) ||
+          !aritlex_specialize_insert(residual, residual->code_size, instruction))
+      {
+        return 0;
+      }
+
+      result.start = operands[0].start;
+    }
+
+    sp -= arity;
+    stack[sp++] = result;
+  }
+
+  if (sp != 1 || (stack[0].is_constant && !aritlex_specialize_insert(residual, 0, aritlex_specialize_literal(&stack[0]))))
+  {
+    residual->code_size = 0;
+    return 0;
+  }
+
+  for (i = 0; i < program->vars_size; ++i)
+  {
+    slots[i] = ARITLEX_SLOT_INVALID;
+  }
+
+  for (i = 0; i < residual->code_size; ++i)
+  {
+    depth = depth + 1 - residual->code[i].arity;
+    residual->stack_size = depth > residual->stack_size ? depth : residual->stack_size;
+
+    if (residual->code[i].type == TOK_VAR)
+    {
+      slots[residual->code[i].val.slot] = 0;
+    }
+  }
+
+  /* Number the remaining variables in their source order */
+  for (i = 0; i < program->vars_size; ++i)
+  {
+    u32 k = 0;
+
+    if (slots[i] == ARITLEX_SLOT_INVALID)
+    {
+      continue;
+    }
+
+    do
+    {
+      residual->vars[residual->vars_size][k] = program->vars[i][k];
+    } while (program->vars[i][k++]);
+
+    slots[i] = residual->vars_size++;
+  }
+
+  for (i = 0; i < residual->code_size; ++i)
+  {
+    if (residual->code[i].type == TOK_VAR)
+    {
+      residual->code[i].val.slot = slots[residual->code[i].val.slot];
+    }
+  }
+
+  return 1;
+}
+
+/* Builds the residual program of program with the bound variables folded in */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize(aritlex_program *program, aritlex_binding *bindings, u32 bindings_size, aritlex_program *residual)
+{
+  u8 bound[ARITLEX_VARS_CAPACITY];
+  f64 values[ARITLEX_VARS_CAPACITY];
+
+  if (!program || !residual || program == residual || program->code_size == 0)
+  {
+    return 0;
+  }
+
+  aritlex_specialize_slots(program, bindings, bindings_size, bound, values);
+
+  return aritlex_specialize_bound(program, bound, values, residual);
+}
+
+typedef struct aritlex_specialization
+{
+  aritlex_program *source; /* 0 if the entry is unused */
+  u32 program_hash;        /* aritlex_specialize_program_hash of source when specialized */
+  u32 hash;
+  u8 bound[ARITLEX_VARS_CAPACITY];
+  f64 values[ARITLEX_VARS_CAPACITY];
+  u32 last_used;
+  aritlex_program residual;
+
+} aritlex_specialization;
+
+typedef struct aritlex_specialize_cache
+{
+  aritlex_specialization entries[ARITLEX_SPECIALIZE_CACHE_CAPACITY];
+  u32 clock;
+  u32 hits;
+  u32 misses;
+
+} aritlex_specialize_cache;
+
+ARITLEX_API ARITLEX_INLINE void aritlex_specialize_cache_init(aritlex_specialize_cache *cache)
+{
+  u32 i;
+
+  for (i = 0; i < ARITLEX_SPECIALIZE_CACHE_CAPACITY; ++i)
+  {
+    cache->entries[i].source = 0;
+    cache->entries[i].last_used = 0;
+  }
+
+  cache->clock = 0;
+  cache->hits = 0;
+  cache->misses = 0;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize_same_bits(f64 a, f64 b)
+{
+  union
+  {
+    f64 number_floating;
+    u32 words[2];
+  } x, y;
+
+  x.number_floating = a;
+  y.number_floating = b;
+
+  return x.words[0] == y.words[0] && x.words[1] == y.words[1];
+}
+
+/* FNV-1a over the bound slots and the bits of their values */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize_hash(u32 vars_size, u8 *bound, f64 *values)
+{
+  u32 hash = 2166136261u;
+  u32 slot, i;
+
+  for (slot = 0; slot < vars_size; ++slot)
+  {
+    union
+    {
+      f64 number_floating;
+      u8 bytes[8];
+    } bits;
+
+    if (!bound[slot])
+    {
+      continue;
+    }
+
+    bits.number_floating = values[slot];
+    hash = (hash ^ slot) * 16777619u;
+
+    for (i = 0; i < 8; ++i)
+    {
+      hash = (hash ^ bits.bytes[i]) * 16777619u;
+    }
+  }
+
+  return hash;
+}
+
+/* FNV-1a over the instructions, constants and variable names of program */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_specialize_program_hash(aritlex_program *program)
+{
+  u32 hash = 2166136261u;
+  u32 i, k;
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction *instruction = &program->code[i];
+    union
+    {
+      f64 number_floating;
+      u8 bytes[8];
+    } bits;
+
+    /* Only the union member the type uses, the rest of it is not initialized */
+    bits.number_floating = 0.0;
+
+    if (instruction->type == TOK_NUM_FLOAT)
+    {
+      bits.number_floating = instruction->val.number_floating;
+    }
+    else if (instruction->type == TOK_NUM_INTEGER)
+    {
+      bits.number_floating = (f64)instruction->val.number_integer;
+    }
+    else if (instruction->type == TOK_VAR)
+    {
+      bits.number_floating = (f64)instruction->val.slot;
+    }
+
+    hash = (hash ^ (u32)instruction->type) * 16777619u;
+
+    for (k = 0; k < 8; ++k)
+    {
+      hash = (hash ^ bits.bytes[k]) * 16777619u;
+    }
+  }
+
+  for (i = 0; i < program->vars_size; ++i)
+  {
+    for (k = 0; program->vars[i][k]; ++k)
+    {
+      hash = (hash ^ (u8)program->vars[i][k]) * 16777619u;
+    }
+
+    hash *= 16777619u; /* the terminating 0 separates the names */
+  }
+
+  return hash;
+}
+
+/* Returns the cached residual program for these bindings, specializing it on a miss
+ * (evicting the least recently used entry). Returns 0 if the program can not be specialized. */
+ARITLEX_API ARITLEX_INLINE aritlex_program *aritlex_specialize_cached(aritlex_specialize_cache *cache, aritlex_program *program, aritlex_binding *bindings, u32 bindings_size)
+{
+  u8 bound[ARITLEX_VARS_CAPACITY];
+  f64 values[ARITLEX_VARS_CAPACITY];
+  aritlex_specialization *victim = &cache->entries[0];
+  u32 program_hash, hash, i, slot;
+
+  if (!program || program->code_size == 0)
+  {
+    return 0;
+  }
+
+  aritlex_specialize_slots(program, bindings, bindings_size, bound, values);
+  program_hash = aritlex_specialize_program_hash(program);
+  hash = aritlex_specialize_hash(program->vars_size, bound, values);
+  cache->clock++;
+
+  for (i = 0; i < ARITLEX_SPECIALIZE_CACHE_CAPACITY; ++i)
+  {
+    aritlex_specialization *entry = &cache->entries[i];
+    u32 equal = entry->source == program && entry->program_hash == program_hash && entry->hash == hash;
+
+    /* Compare the bits: NaN bindings have to hit and 0.0 and -0.0 differ */
+    for (slot = 0; equal && slot < program->vars_size; ++slot)
+    {
+      equal = entry->bound[slot] == bound[slot] &&
+              (!bound[slot] || aritlex_specialize_same_bits(entry->values[slot], values[slot]));
+    }
+
+    if (equal)
+    {
+      entry->last_used = cache->clock;
+      cache->hits++;
+      return &entry->residual;
+    }
+
+    if (entry->last_used < victim->last_used)
+    {
+      victim = entry;
+    }
+  }
+
+  cache->misses++;
+  victim->source = 0;
+
+  if (!aritlex_specialize_bound(program, bound, values, &victim->residual))
+  {
+    return 0;
+  }
+
+  victim->source = program;
+  victim->program_hash = program_hash;
+  victim->hash = hash;
+  victim->last_used = cache->clock;
+
+  for (slot = 0; slot < program->vars_size; ++slot)
+  {
+    victim->bound[slot] = bound[slot];
+    victim->values[slot] = values[slot];
+  }
+
+  return &victim->residual;
+}
+
+/* #############################################################################
+ * # TYPE INFERENCE
+ * #############################################################################
+ *
+ * aritlex_eval checks the type tags of its operands for every operation
+ * because variables could be anything. When the variable types are declared
+ * (s32, s64 or f64) the type of every subexpression is known before running
+ * it. aritlex_infer computes them and emits typed instructions: each operator
+ * is specialized for its operand type, and the remaining conversions become
+ * explicit instructions. aritlex_eval_typed runs them on untagged registers
+ * with a single dispatch per instruction.
+ *
+ * The promotion rules follow C: integer arithmetic stays in the widest
+ * integer type (s32 < s64) and anything combined with f64 becomes f64.
+ * Integer only operators (% & | ^ ~ << >>) work in s64 if an operand is s64,
+ * otherwise in s32, and truncate f64 operands. With every variable declared
+ * f64 the results are identical to aritlex_eval. Every conversion between
+ * s32, s64 and f64 is reported in promotions, and pure[i] tells whether the
+ * subexpression ending at source instruction i needs none.
+ */
+#define ARITLEX_TYPED_CAPACITY (ARITLEX_PROGRAM_CAPACITY * 3)
+#define ARITLEX_TYPED_OP(token, type) ((u32)(token) * 3u + (u32)(type))
+
+/* Pseudo tokens for instructions that have no source token */
+#define ARITLEX_TYPED_FROM_S32 (ARITLEX_TOKEN_TYPE_COUNT + 0) /* + source type: converts stack[sp - 1 - depth] to the instruction type */
+#define ARITLEX_TYPED_FROM_F64 (ARITLEX_TOKEN_TYPE_COUNT + 1)
+#define ARITLEX_TYPED_FROM_S64 (ARITLEX_TOKEN_TYPE_COUNT + 2)
+#define ARITLEX_TYPED_TRUTH (ARITLEX_TOKEN_TYPE_COUNT + 3)  /* stack[sp - 1 - depth] != 0 as s32, typed by the source type */
+#define ARITLEX_TYPED_NEGATE (ARITLEX_TOKEN_TYPE_COUNT + 4) /* unary minus, TOK_MINUS is the binary one */
+
+typedef union aritlex_register
+{
+  s32 number_integer;   /* ARITLEX_TYPE_S32 */
+  f64 number_floating;  /* ARITLEX_TYPE_F64 */
+  s64 number_integer64; /* ARITLEX_TYPE_S64 */
+
+} aritlex_register;
+
+typedef struct aritlex_typed_instruction
+{
+  u32 op;    /* ARITLEX_TYPED_OP(token or pseudo token, type) */
+  u32 depth; /* conversions: distance of the converted value from the stack top */
+
+  union
+  {
+    s32 number_integer;
+    f64 number_floating;
+    u32 slot;
+
+  } val;
+
+} aritlex_typed_instruction;
+
+typedef struct aritlex_promotion
+{
+  u32 instruction; /* source program index of the operator that needs it */
+  u32 operand;     /* 0 for the first operand (or condition), 1, 2 */
+  aritlex_type from;
+  aritlex_type to;
+
+} aritlex_promotion;
+
+typedef struct aritlex_typed_program
+{
+  aritlex_typed_instruction code[ARITLEX_TYPED_CAPACITY];
+  u32 code_size;
+  u32 stack_size;
+  aritlex_type result_type;
+
+  aritlex_type types[ARITLEX_PROGRAM_CAPACITY]; /* result type of each source instruction */
+  u32 pure[ARITLEX_PROGRAM_CAPACITY];           /* 1 if the subexpression ending at the source instruction needs no promotion */
+
+  aritlex_promotion promotions[ARITLEX_PROGRAM_CAPACITY];
+  u32 promotions_size;
+
+} aritlex_typed_program;
+
+ARITLEX_API ARITLEX_INLINE s64 aritlex_f64_to_s64(f64 x)
+{
+  /* NaN and out of range values map to INT64_MIN like cvttsd2si */
+  return (x >= -9223372036854775808.0 && x < 9223372036854775808.0) ? (s64)x : (s64)((u64)1 << 63);
+}
+
+ARITLEX_API ARITLEX_INLINE s64 aritlex_s64_binary(aritlex_token_type op, s64 a, s64 b)
+{
+  switch (op)
+  {
+  case TOK_PLUS:
+    return (s64)((u64)a + (u64)b);
+  case TOK_MINUS:
+    return (s64)((u64)a - (u64)b);
+  case TOK_MUL:
+    return (s64)((u64)a * (u64)b);
+  case TOK_DIV:
+    return b == 0 ? 0 : (b == -1 ? (s64)(0u - (u64)a) : a / b);
+  case TOK_MOD:
+    return (b == 0 || b == -1) ? 0 : a % b;
+  case TOK_AND:
+    return a & b;
+  case TOK_OR:
+    return a | b;
+  case TOK_XOR:
+    return a ^ b;
+  case TOK_SHL:
+    return (s64)((u64)a << ((u64)b & 63u));
+  case TOK_SHR:
+    return a >> (b & 63); /* arithmetic shift */
+  case TOK_EQ:
+    return a == b;
+  case TOK_NEQ:
+    return a != b;
+  case TOK_LT:
+    return a < b;
+  case TOK_LE:
+    return a <= b;
+  case TOK_GT:
+    return a > b;
+  case TOK_GE:
+    return a >= b;
+  default:
+    return 0;
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_register_to_f64(aritlex_register r, aritlex_type type)
+{
+  return type == ARITLEX_TYPE_S32 ? (f64)r.number_integer : (type == ARITLEX_TYPE_S64 ? (f64)r.number_integer64 : r.number_floating);
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_infer_emit(aritlex_typed_program *typed, u32 token, aritlex_type type, u32 depth)
+{
+  if (typed->code_size >= ARITLEX_TYPED_CAPACITY)
+  {
+    return 0;
+  }
+
+  typed->code[typed->code_size].op = ARITLEX_TYPED_OP(token, type);
+  typed->code[typed->code_size].depth = depth;
+  typed->code[typed->code_size].val.slot = 0;
+  typed->code_size++;
+
+  return 1;
+}
+
+/* Converts operand (depth from the stack top) of source instruction to type */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_infer_convert(aritlex_typed_program *typed, aritlex_type *types, u32 sp, u32 depth, aritlex_type to, u32 instruction, u32 operand)
+{
+  aritlex_type *from = &types[sp - 1 - depth];
+  aritlex_promotion *promotion = &typed->promotions[typed->promotions_size];
+
+  if (*from == to)
+  {
+    return 1;
+  }
+
+  if (typed->promotions_size >= ARITLEX_PROGRAM_CAPACITY || !aritlex_infer_emit(typed, ARITLEX_TYPED_FROM_S32 + (u32)*from, to, depth))
+  {
+    return 0;
+  }
+
+  promotion->instruction = instruction;
+  promotion->operand = operand;
+  promotion->from = *from;
+  promotion->to = to;
+  typed->promotions_size++;
+
+  *from = to;
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_infer_truth(aritlex_typed_program *typed, aritlex_type *types, u32 sp, u32 depth)
+{
+  aritlex_type *from = &types[sp - 1 - depth];
+
+  if (*from == ARITLEX_TYPE_S32)
+  {
+    return 1;
+  }
+
+  if (!aritlex_infer_emit(typed, ARITLEX_TYPED_TRUTH, *from, depth))
+  {
+    return 0;
+  }
+
+  *from = ARITLEX_TYPE_S32;
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_type aritlex_infer_arithmetic(aritlex_type a, aritlex_type b)
+{
+  return (a == ARITLEX_TYPE_F64 || b == ARITLEX_TYPE_F64) ? ARITLEX_TYPE_F64 : ((a == ARITLEX_TYPE_S64 || b == ARITLEX_TYPE_S64) ? ARITLEX_TYPE_S64 : ARITLEX_TYPE_S32);
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_type aritlex_infer_integer(aritlex_type a, aritlex_type b)
+{
+  return (a == ARITLEX_TYPE_S64 || b == ARITLEX_TYPE_S64) ? ARITLEX_TYPE_S64 : ARITLEX_TYPE_S32;
+}
+
+/* declared[slot] is the type of each program variable, 0 declares all of them f64 */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_infer(aritlex_program *program, aritlex_type *declared, aritlex_typed_program *typed)
+{
+  aritlex_type types[ARITLEX_STACK_CAPACITY];
+  u32 pure[ARITLEX_STACK_CAPACITY];
+  u32 sp = 0;
+  u32 i;
+
+  typed->code_size = 0;
+  typed->stack_size = program->stack_size;
+  typed->promotions_size = 0;
+
+  if (program->code_size == 0)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction *instruction = &program->code[i];
+    aritlex_token_type op = instruction->type;
+    u32 arity = instruction->arity;
+    u32 promotions = typed->promotions_size;
+    u32 ok = 1;
+    u32 j;
+    aritlex_type type;
+
+    if (arity == 0)
+    {
+      type = op == TOK_VAR ? (declared ? declared[instruction->val.slot] : ARITLEX_TYPE_F64) : (op == TOK_NUM_FLOAT ? ARITLEX_TYPE_F64 : ARITLEX_TYPE_S32);
+      ok = aritlex_infer_emit(typed, op, type, 0);
+
+      if (ok)
+      {
+        typed->code[typed->code_size - 1].val.slot = instruction->val.slot;
+
+        if (op == TOK_NUM_FLOAT)
+        {
+          typed->code[typed->code_size - 1].val.number_floating = instruction->val.number_floating;
+        }
+        else if (op == TOK_NUM_INTEGER)
+        {
+          typed->code[typed->code_size - 1].val.number_integer = instruction->val.number_integer;
+        }
+      }
+
+      types[sp] = type;
+      pure[sp++] = 1;
+    }
+    else if (arity == 1)
+    {
+      type = types[sp - 1];
+
+      if (op == TOK_NOT_BIT)
+      {
+        type = aritlex_infer_integer(type, type);
+        ok = aritlex_infer_convert(typed, types, sp, 0, type, i, 0);
+      }
+
+      ok = ok && aritlex_infer_emit(typed, op == TOK_MINUS ? ARITLEX_TYPED_NEGATE : (u32)op, type, 0);
+      type = op == TOK_NOT ? ARITLEX_TYPE_S32 : type;
+    }
+    else if (arity == 2)
+    {
+      aritlex_type a = types[sp - 2];
+      aritlex_type b = types[sp - 1];
+
+      if (op == TOK_AND_AND || op == TOK_OR_OR)
+      {
+        type = ARITLEX_TYPE_S32;
+        ok = aritlex_infer_truth(typed, types, sp, 1) && aritlex_infer_truth(typed, types, sp, 0);
+      }
+      else
+      {
+        type = (op == TOK_PLUS || op == TOK_MINUS || op == TOK_MUL || op == TOK_DIV || aritlex_is_compare(op)) ? aritlex_infer_arithmetic(a, b) : aritlex_infer_integer(a, b);
+        ok = aritlex_infer_convert(typed, types, sp, 1, type, i, 0) && aritlex_infer_convert(typed, types, sp, 0, type, i, 1);
+      }
+
+      ok = ok && aritlex_infer_emit(typed, op, type, 0);
+      type = aritlex_is_compare(op) ? ARITLEX_TYPE_S32 : type;
+    }
+    else
+    {
+      aritlex_type b = types[sp - 2];
+      aritlex_type c = types[sp - 1];
+
+      type = b == c ? b : aritlex_infer_arithmetic(b, c);
+      ok = aritlex_infer_truth(typed, types, sp, 2) &&
+           aritlex_infer_convert(typed, types, sp, 1, type, i, 1) &&
+           aritlex_infer_convert(typed, types, sp, 0, type, i, 2) &&
+           aritlex_infer_emit(typed, op, type, 0);
+    }
+
+    if (!ok)
+    {
+      typed->code_size = 0;
+      return 0;
+    }
+
+    if (arity > 0)
+    {
+      u32 is_pure = typed->promotions_size == promotions;
+
+      for (j = 0; j < arity; ++j)
+      {
+        is_pure &= pure[sp - 1 - j];
+      }
+
+      sp -= arity;
+      types[sp] = type;
+      pure[sp++] = is_pure;
+    }
+
+    typed->types[i] = types[sp - 1];
+    typed->pure[i] = pure[sp - 1];
+  }
+
+  typed->result_type = types[0];
+
+  return 1;
+}
+
+#define ARITLEX_TYPED_CASE(token, type, target, function, member)                                      \
+  case ARITLEX_TYPED_OP(token, type):                                                                    \
+    sp--;                                                                                                \
+    stack[sp - 1].target = function(token, stack[sp - 1].member, stack[sp].member);                     \
+    break;
+
+#define ARITLEX_TYPED_CASE_S32(token) ARITLEX_TYPED_CASE(token, ARITLEX_TYPE_S32, number_integer, aritlex_s32_binary, number_integer)
+#define ARITLEX_TYPED_CASE_S64(token) ARITLEX_TYPED_CASE(token, ARITLEX_TYPE_S64, number_integer64, aritlex_s64_binary, number_integer64)
+#define ARITLEX_TYPED_CASE_F64(token) ARITLEX_TYPED_CASE(token, ARITLEX_TYPE_F64, number_floating, aritlex_f64_binary, number_floating)
+#define ARITLEX_TYPED_CASE_S64_COMPARE(token) ARITLEX_TYPED_CASE(token, ARITLEX_TYPE_S64, number_integer, (s32)aritlex_s64_binary, number_integer64)
+#define ARITLEX_TYPED_CASE_F64_COMPARE(token) ARITLEX_TYPED_CASE(token, ARITLEX_TYPE_F64, number_integer, aritlex_f64_compare, number_floating)
+
+/* vars[slot] holds the member of the declared type, the result has the type typed->result_type */
+ARITLEX_API ARITLEX_INLINE aritlex_register aritlex_eval_typed(aritlex_typed_program *typed, aritlex_register *vars)
+{
+  aritlex_register stack[ARITLEX_STACK_CAPACITY];
+  aritlex_register *r;
+  u32 sp = 0;
+  u32 i;
+
+  stack[0].number_integer64 = 0;
+
+  for (i = 0; i < typed->code_size; ++i)
+  {
+    aritlex_typed_instruction *instruction = &typed->code[i];
+
+    switch (instruction->op)
+    {
+    /* Operands */
+    case ARITLEX_TYPED_OP(TOK_NUM_INTEGER, ARITLEX_TYPE_S32):
+      stack[sp++].number_integer = instruction->val.number_integer;
+      break;
+    case ARITLEX_TYPED_OP(TOK_NUM_FLOAT, ARITLEX_TYPE_F64):
+      stack[sp++].number_floating = instruction->val.number_floating;
+      break;
+    case ARITLEX_TYPED_OP(TOK_VAR, ARITLEX_TYPE_S32):
+    case ARITLEX_TYPED_OP(TOK_VAR, ARITLEX_TYPE_F64):
+    case ARITLEX_TYPED_OP(TOK_VAR, ARITLEX_TYPE_S64):
+      stack[sp++] = vars[instruction->val.slot];
+      break;
+
+    /* Conversions */
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_FROM_S32, ARITLEX_TYPE_F64):
+      r = &stack[sp - 1 - instruction->depth];
+      r->number_floating = (f64)r->number_integer;
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_FROM_S32, ARITLEX_TYPE_S64):
+      r = &stack[sp - 1 - instruction->depth];
+      r->number_integer64 = (s64)r->number_integer;
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_FROM_S64, ARITLEX_TYPE_F64):
+      r = &stack[sp - 1 - instruction->depth];
+      r->number_floating = (f64)r->number_integer64;
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_FROM_F64, ARITLEX_TYPE_S32):
+      r = &stack[sp - 1 - instruction->depth];
+      r->number_integer = aritlex_f64_to_s32(r->number_floating);
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_FROM_F64, ARITLEX_TYPE_S64):
+      r = &stack[sp - 1 - instruction->depth];
+      r->number_integer64 = aritlex_f64_to_s64(r->number_floating);
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_TRUTH, ARITLEX_TYPE_F64):
+      r = &stack[sp - 1 - instruction->depth];
+      r->number_integer = r->number_floating != 0.0;
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_TRUTH, ARITLEX_TYPE_S64):
+      r = &stack[sp - 1 - instruction->depth];
+      r->number_integer = r->number_integer64 != 0;
+      break;
+
+    /* Unary operators */
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_NEGATE, ARITLEX_TYPE_S32):
+      stack[sp - 1].number_integer = (s32)(0u - (u32)stack[sp - 1].number_integer);
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_NEGATE, ARITLEX_TYPE_F64):
+      stack[sp - 1].number_floating = -stack[sp - 1].number_floating;
+      break;
+    case ARITLEX_TYPED_OP(ARITLEX_TYPED_NEGATE, ARITLEX_TYPE_S64):
+      stack[sp - 1].number_integer64 = (s64)(0u - (u64)stack[sp - 1].number_integer64);
+      break;
+    case ARITLEX_TYPED_OP(TOK_NOT, ARITLEX_TYPE_S32):
+      stack[sp - 1].number_integer = stack[sp - 1].number_integer == 0;
+      break;
+    case ARITLEX_TYPED_OP(TOK_NOT, ARITLEX_TYPE_F64):
+      stack[sp - 1].number_integer = stack[sp - 1].number_floating == 0.0;
+      break;
+    case ARITLEX_TYPED_OP(TOK_NOT, ARITLEX_TYPE_S64):
+      stack[sp - 1].number_integer = stack[sp - 1].number_integer64 == 0;
+      break;
+    case ARITLEX_TYPED_OP(TOK_NOT_BIT, ARITLEX_TYPE_S32):
+      stack[sp - 1].number_integer = ~stack[sp - 1].number_integer;
+      break;
+    case ARITLEX_TYPED_OP(TOK_NOT_BIT, ARITLEX_TYPE_S64):
+      stack[sp - 1].number_integer64 = ~stack[sp - 1].number_integer64;
+      break;
+
+    /* Binary operators */
+    ARITLEX_TYPED_CASE_S32(TOK_PLUS)
+    ARITLEX_TYPED_CASE_S32(TOK_MINUS)
+    ARITLEX_TYPED_CASE_S32(TOK_MUL)
+    ARITLEX_TYPED_CASE_S32(TOK_DIV)
+    ARITLEX_TYPED_CASE_S32(TOK_MOD)
+    ARITLEX_TYPED_CASE_S32(TOK_AND)
+    ARITLEX_TYPED_CASE_S32(TOK_OR)
+    ARITLEX_TYPED_CASE_S32(TOK_XOR)
+    ARITLEX_TYPED_CASE_S32(TOK_SHL)
+    ARITLEX_TYPED_CASE_S32(TOK_SHR)
+    ARITLEX_TYPED_CASE_S32(TOK_EQ)
+    ARITLEX_TYPED_CASE_S32(TOK_NEQ)
+    ARITLEX_TYPED_CASE_S32(TOK_LT)
+    ARITLEX_TYPED_CASE_S32(TOK_LE)
+    ARITLEX_TYPED_CASE_S32(TOK_GT)
+    ARITLEX_TYPED_CASE_S32(TOK_GE)
+    ARITLEX_TYPED_CASE_S32(TOK_AND_AND)
+    ARITLEX_TYPED_CASE_S32(TOK_OR_OR)
+
+    ARITLEX_TYPED_CASE_S64(TOK_PLUS)
+    ARITLEX_TYPED_CASE_S64(TOK_MINUS)
+    ARITLEX_TYPED_CASE_S64(TOK_MUL)
+    ARITLEX_TYPED_CASE_S64(TOK_DIV)
+    ARITLEX_TYPED_CASE_S64(TOK_MOD)
+    ARITLEX_TYPED_CASE_S64(TOK_AND)
+    ARITLEX_TYPED_CASE_S64(TOK_OR)
+    ARITLEX_TYPED_CASE_S64(TOK_XOR)
+    ARITLEX_TYPED_CASE_S64(TOK_SHL)
+    ARITLEX_TYPED_CASE_S64(TOK_SHR)
+    ARITLEX_TYPED_CASE_S64_COMPARE(TOK_EQ)
+    ARITLEX_TYPED_CASE_S64_COMPARE(TOK_NEQ)
+    ARITLEX_TYPED_CASE_S64_COMPARE(TOK_LT)
+    ARITLEX_TYPED_CASE_S64_COMPARE(TOK_LE)
+    ARITLEX_TYPED_CASE_S64_COMPARE(TOK_GT)
+    ARITLEX_TYPED_CASE_S64_COMPARE(TOK_GE)
+
+    ARITLEX_TYPED_CASE_F64(TOK_PLUS)
+    ARITLEX_TYPED_CASE_F64(TOK_MINUS)
+    ARITLEX_TYPED_CASE_F64(TOK_MUL)
+    ARITLEX_TYPED_CASE_F64(TOK_DIV)
+    ARITLEX_TYPED_CASE_F64_COMPARE(TOK_EQ)
+    ARITLEX_TYPED_CASE_F64_COMPARE(TOK_NEQ)
+    ARITLEX_TYPED_CASE_F64_COMPARE(TOK_LT)
+    ARITLEX_TYPED_CASE_F64_COMPARE(TOK_LE)
+    ARITLEX_TYPED_CASE_F64_COMPARE(TOK_GT)
+    ARITLEX_TYPED_CASE_F64_COMPARE(TOK_GE)
+
+    /* Ternary, the condition is already s32 and both branches have the instruction type */
+    case ARITLEX_TYPED_OP(TOK_QMARK, ARITLEX_TYPE_S32):
+    case ARITLEX_TYPED_OP(TOK_QMARK, ARITLEX_TYPE_F64):
+    case ARITLEX_TYPED_OP(TOK_QMARK, ARITLEX_TYPE_S64):
+      sp -= 2;
+      stack[sp - 1] = stack[sp - 1].number_integer ? stack[sp] : stack[sp + 1];
+      break;
+
+    default:
+      break;
+    }
+  }
+
+  return stack[0];
+}
+
+#undef ARITLEX_TYPED_CASE_F64_COMPARE
+#undef ARITLEX_TYPED_CASE_S64_COMPARE
+#undef ARITLEX_TYPED_CASE_F64
+#undef ARITLEX_TYPED_CASE_S64
+#undef ARITLEX_TYPED_CASE_S32
+#undef ARITLEX_TYPED_CASE
+
+/* #############################################################################
+ * # FIXED POINT EVALUATOR
+ * #############################################################################
+ *
+ * Same semantics as aritlex_eval_value with Qm.n numbers (see FIXED POINT
+ * NUMBERS) in place of f64 and integer instructions only. Variables are
+ * aritlex_fixed. Integer subexpressions stay s32 and wrap like before, the
+ * f64 operators + - * / and comparisons saturate and round instead, and
+ * division of a non zero number by zero saturates like an infinity would.
+ */
+typedef struct aritlex_fixed_value
+{
+  aritlex_type type; /* ARITLEX_TYPE_S32 or ARITLEX_TYPE_F64 for Qm.n */
+  s32 value;
+
+} aritlex_fixed_value;
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_literal(aritlex_instruction *instruction)
+{
+#ifdef ARITLEX_FIXED_POINT
+  return instruction->number_fixed;
+#else
+  return aritlex_fixed_from_f64(instruction->val.number_floating);
+#endif
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_value_to_fixed(aritlex_fixed_value v)
+{
+  return v.type == ARITLEX_TYPE_S32 ? aritlex_fixed_from_s32(v.value) : v.value;
+}
+
+ARITLEX_API ARITLEX_INLINE s32 aritlex_fixed_value_to_s32(aritlex_fixed_value v)
+{
+  return v.type == ARITLEX_TYPE_S32 ? v.value : aritlex_fixed_to_s32(v.value);
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_mul(aritlex_fixed a, aritlex_fixed b)
+{
+  s64 product = (s64)a * (s64)b;
+  u64 magnitude = product < 0 ? 0u - (u64)product : (u64)product;
+
+  return aritlex_fixed_signed((magnitude + ((u64)1 << (ARITLEX_FIXED_FRACTION_BITS - 1))) >> ARITLEX_FIXED_FRACTION_BITS, product < 0);
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_div(aritlex_fixed a, aritlex_fixed b)
+{
+  u64 numerator = (a < 0 ? 0u - (u64)(s64)a : (u64)a) << ARITLEX_FIXED_FRACTION_BITS;
+  u64 denominator = b < 0 ? 0u - (u64)(s64)b : (u64)b;
+
+  if (b == 0)
+  {
+    return a > 0 ? ARITLEX_FIXED_MAX : (a < 0 ? ARITLEX_FIXED_MIN : 0);
+  }
+
+  return aritlex_fixed_signed((numerator + denominator / 2) / denominator, (a < 0) != (b < 0));
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_fixed_binary(aritlex_token_type op, aritlex_fixed a, aritlex_fixed b)
+{
+  switch (op)
+  {
+  case TOK_PLUS:
+    return aritlex_fixed_saturate((s64)a + (s64)b);
+  case TOK_MINUS:
+    return aritlex_fixed_saturate((s64)a - (s64)b);
+  case TOK_MUL:
+    return aritlex_fixed_mul(a, b);
+  case TOK_DIV:
+    return aritlex_fixed_div(a, b);
+  default:
+    return aritlex_s32_binary(op, a, b); /* comparisons, the scale is the same on both sides */
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed_value aritlex_fixed_value_unary(aritlex_token_type op, aritlex_fixed_value a)
+{
+  aritlex_fixed_value r;
+  r.type = ARITLEX_TYPE_S32;
+
+  if (op == TOK_MINUS && a.type == ARITLEX_TYPE_F64)
+  {
+    r.type = ARITLEX_TYPE_F64;
+    r.value = aritlex_fixed_saturate(-(s64)a.value);
+  }
+  else if (op == TOK_MINUS)
+  {
+    r.value = (s32)(0u - (u32)a.value);
+  }
+  else if (op == TOK_NOT)
+  {
+    r.value = a.value == 0;
+  }
+  else
+  {
+    r.value = ~aritlex_fixed_value_to_s32(a);
+  }
+
+  return r;
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed_value aritlex_fixed_value_binary(aritlex_token_type op, aritlex_fixed_value a, aritlex_fixed_value b)
+{
+  aritlex_fixed_value r;
+  u32 both_s32 = a.type == ARITLEX_TYPE_S32 && b.type == ARITLEX_TYPE_S32;
+
+  r.type = aritlex_result_type(op, 2, a.type, b.type, b.type);
+
+  if (op == TOK_AND_AND || op == TOK_OR_OR)
+  {
+    r.value = aritlex_s32_binary(op, a.value != 0, b.value != 0);
+  }
+  else if (both_s32 || !(op == TOK_PLUS || op == TOK_MINUS || op == TOK_MUL || op == TOK_DIV || aritlex_is_compare(op)))
+  {
+    r.value = aritlex_s32_binary(op, aritlex_fixed_value_to_s32(a), aritlex_fixed_value_to_s32(b));
+  }
+  else
+  {
+    r.value = aritlex_fixed_binary(op, aritlex_fixed_value_to_fixed(a), aritlex_fixed_value_to_fixed(b));
+  }
+
+  return r;
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed_value aritlex_fixed_value_select(aritlex_fixed_value cond, aritlex_fixed_value a, aritlex_fixed_value b)
+{
+  aritlex_fixed_value r = cond.value != 0 ? a : b;
+
+  if (a.type != b.type && r.type == ARITLEX_TYPE_S32)
+  {
+    r.type = ARITLEX_TYPE_F64;
+    r.value = aritlex_fixed_from_s32(r.value);
+  }
+
+  return r;
+}
+
+/* Evaluates program for one set of fixed point variables (indexed by slot) and keeps the result type */
+ARITLEX_API ARITLEX_INLINE aritlex_fixed_value aritlex_eval_fixed_value(aritlex_program *program, aritlex_fixed *vars)
+{
+  aritlex_fixed_value stack[ARITLEX_STACK_CAPACITY];
+  u32 sp = 0;
+  u32 i;
+
+  stack[0].type = ARITLEX_TYPE_S32;
+  stack[0].value = 0;
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction *instruction = &program->code[i];
+
+    switch (instruction->arity)
+    {
+    case 0:
+    {
+      aritlex_fixed_value *v = &stack[sp++];
+
+      if (instruction->type == TOK_NUM_INTEGER)
+      {
+        v->type = ARITLEX_TYPE_S32;
+        v->value = instruction->val.number_integer;
+      }
+      else
+      {
+        v->type = ARITLEX_TYPE_F64;
+        v->value = instruction->type == TOK_VAR ? vars[instruction->val.slot] : aritlex_fixed_literal(instruction);
+      }
+      break;
+    }
+    case 1:
+    {
+      stack[sp - 1] = aritlex_fixed_value_unary(instruction->type, stack[sp - 1]);
+      break;
+    }
+    case 2:
+    {
+      sp--;
+      stack[sp - 1] = aritlex_fixed_value_binary(instruction->type, stack[sp - 1], stack[sp]);
+      break;
+    }
+    default:
+    {
+      sp -= 2;
+      stack[sp - 1] = aritlex_fixed_value_select(stack[sp - 1], stack[sp], stack[sp + 1]);
+      break;
+    }
+    }
+  }
+
+  return stack[0];
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_fixed aritlex_eval_fixed(aritlex_program *program, aritlex_fixed *vars)
+{
+  return aritlex_fixed_value_to_fixed(aritlex_eval_fixed_value(program, vars));
+}
+
+/* #############################################################################
+ * # PRECOMPILED IMAGE
+ * #############################################################################
+ *
+ * A flat binary format for compiled programs that is executed where it lies,
+ * e.g. straight from a mmapped cache file, so a process start does not need
+ * to tokenize and compile its expressions again. Every structure is made of
+ * 32/64 bit fields at 8 byte aligned offsets, the image holds no pointers.
+ *
+ *   aritlex_image_header
+ *   per expression (8 byte aligned):
+ *     aritlex_image_expression
+ *     aritlex_image_instruction code[code_size]
+ *     f64 constants[constants_size]   constant pool
+ *     s8 vars[vars_size][32]          variable slot table
+ *   u32 offsets[expressions_size]     expression records by index
+ *
+ * The header stores a hash of the source the image was compiled from (see
+ * aritlex_image_hash) and the ARITLEX_STACK_CAPACITY and ARITLEX_VARS_CAPACITY
+ * it was built with. aritlex_image_open rejects images with a different hash,
+ * format version or byte order, or larger capacities, and validates every
+ * expression record once: it has to lie aligned inside the image, its stack
+ * depth, constant indices and slots have to stay within its sizes and the
+ * capacities, and its variable names have to be terminated. The evaluation
+ * of an opened image needs no further checks.
+ */
+#define ARITLEX_IMAGE_MAGIC 0x43584C41u /* "ALXC" in little endian */
+#define ARITLEX_IMAGE_VERSION 2u
+#define ARITLEX_IMAGE_NAME_SIZE 32 /* size of the names in aritlex_program.vars */
+
+typedef struct aritlex_image_header
+{
+  u32 magic;
+  u32 version;
+  u64 source_hash;
+  u32 expressions_size;
+  u32 offsets_offset; /* byte offset of the offsets table */
+  u32 image_size;
+  u32 capacities; /* ARITLEX_STACK_CAPACITY | ARITLEX_VARS_CAPACITY << 16 of the builder */
+
+} aritlex_image_header;
+
+typedef struct aritlex_image_expression
+{
+  u32 code_size;
+  u32 stack_size;
+  u32 constants_size;
+  u32 vars_size;
+
+} aritlex_image_expression;
+
+typedef struct aritlex_image_instruction
+{
+  u32 op; /* aritlex_token_type | arity << 8 */
+
+  union
+  {
+    s32 number_integer; /* TOK_NUM_INTEGER */
+    u32 index;          /* TOK_NUM_FLOAT: constant pool index, TOK_VAR: slot */
+
+  } val;
+
+} aritlex_image_instruction;
+
+typedef struct aritlex_image_builder
+{
+  u8 *buffer; /* 8 byte aligned */
+  u32 capacity;
+  u32 size;
+
+  u32 *offsets; /* caller provided, one per expression */
+  u32 offsets_capacity;
+  u32 expressions_size;
+
+  u64 source_hash;
+
+} aritlex_image_builder;
+
+/* FNV-1a 64 */
+ARITLEX_API ARITLEX_INLINE u64 aritlex_image_hash(s8 *source, u32 source_size)
+{
+  u64 hash = ((u64)0xCBF29CE4u << 32) | 0x84222325u;
+  u64 prime = ((u64)0x100u << 32) | 0x000001B3u;
+  u32 i;
+
+  for (i = 0; i < source_size; ++i)
+  {
+    hash = (hash ^ (u8)source[i]) * prime;
+  }
+
+  return hash;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_align(u32 size)
+{
+  return (size + 7u) & ~7u;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_begin(aritlex_image_builder *builder, u8 *buffer, u32 capacity, u32 *offsets, u32 offsets_capacity, u64 source_hash)
+{
+  if (!buffer || capacity < sizeof(aritlex_image_header) || !offsets)
+  {
+    return 0;
+  }
+
+  builder->buffer = buffer;
+  builder->capacity = capacity;
+  builder->size = (u32)sizeof(aritlex_image_header);
+  builder->offsets = offsets;
+  builder->offsets_capacity = offsets_capacity;
+  builder->expressions_size = 0;
+  builder->source_hash = source_hash;
+
+  return 1;
+}
+
+/* Appends a compiled program, its index in the image is the number of programs added before */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_add(aritlex_image_builder *builder, aritlex_program *program)
+{
+  aritlex_image_expression *expression;
+  aritlex_image_instruction *code;
+  f64 *constants;
+  s8 *vars;
+  u32 constants_size = 0;
+  u32 size, i;
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    constants_size += program->code[i].type == TOK_NUM_FLOAT;
+  }
+
+  size = (u32)sizeof(aritlex_image_expression) +
+         program->code_size * (u32)sizeof(aritlex_image_instruction) +
+         constants_size * (u32)sizeof(f64) +
+         program->vars_size * ARITLEX_IMAGE_NAME_SIZE;
+
+  if (builder->expressions_size >= builder->offsets_capacity || size > builder->capacity - builder->size)
+  {
+    return 0;
+  }
+
+  expression = (aritlex_image_expression *)(void *)(builder->buffer + builder->size);
+  code = (aritlex_image_instruction *)(void *)(expression + 1);
+  constants = (f64 *)(void *)(code + program->code_size);
+  vars = (s8 *)(constants + constants_size);
+
+  expression->code_size = program->code_size;
+  expression->stack_size = program->stack_size;
+  expression->constants_size = constants_size;
+  expression->vars_size = program->vars_size;
+
+  constants_size = 0;
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction *instruction = &program->code[i];
+
+    code[i].op = (u32)instruction->type | instruction->arity << 8;
+    code[i].val.index = instruction->val.slot;
+
+    if (instruction->type == TOK_NUM_INTEGER)
+    {
+      code[i].val.number_integer = instruction->val.number_integer;
+    }
+    else if (instruction->type == TOK_NUM_FLOAT)
+    {
+      constants[constants_size] = instruction->val.number_floating;
+      code[i].val.index = constants_size++;
+    }
+  }
+
+  for (i = 0; i < program->vars_size * ARITLEX_IMAGE_NAME_SIZE; ++i)
+  {
+    vars[i] = program->vars[i / ARITLEX_IMAGE_NAME_SIZE][i % ARITLEX_IMAGE_NAME_SIZE];
+  }
+
+  builder->offsets[builder->expressions_size++] = builder->size;
+  builder->size += size;
+
+  return 1;
+}
+
+/* Writes the offsets table and the header, image_size is the number of bytes to store */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_finish(aritlex_image_builder *builder, u32 *image_size)
+{
+  aritlex_image_header *header = (aritlex_image_header *)(void *)builder->buffer;
+  u32 table_size = aritlex_image_align(builder->expressions_size * (u32)sizeof(u32));
+  u32 *table = (u32 *)(void *)(builder->buffer + builder->size);
+  u32 i;
+
+  if (table_size > builder->capacity - builder->size)
+  {
+    return 0;
+  }
+
+  for (i = 0; i < table_size / (u32)sizeof(u32); ++i)
+  {
+    table[i] = i < builder->expressions_size ? builder->offsets[i] : 0;
+  }
+
+  header->magic = ARITLEX_IMAGE_MAGIC;
+  header->version = ARITLEX_IMAGE_VERSION;
+  header->source_hash = builder->source_hash;
+  header->expressions_size = builder->expressions_size;
+  header->offsets_offset = builder->size;
+  header->image_size = builder->size + table_size;
+  header->capacities = (u32)ARITLEX_STACK_CAPACITY | (u32)ARITLEX_VARS_CAPACITY << 16;
+
+  *image_size = header->image_size;
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE aritlex_image_instruction *aritlex_image_code(aritlex_image_expression *expression)
+{
+  return (aritlex_image_instruction *)(void *)(expression + 1);
+}
+
+ARITLEX_API ARITLEX_INLINE f64 *aritlex_image_constants(aritlex_image_expression *expression)
+{
+  return (f64 *)(void *)(aritlex_image_code(expression) + expression->code_size);
+}
+
+/* Name of variable slot */
+ARITLEX_API ARITLEX_INLINE s8 *aritlex_image_var(aritlex_image_expression *expression, u32 slot)
+{
+  return (s8 *)(aritlex_image_constants(expression) + expression->constants_size) + slot * ARITLEX_IMAGE_NAME_SIZE;
+}
+
+/* Checks that the expression record at offset fits before end and evaluates within its sizes and the capacities */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_check(u8 *image, u32 offset, u32 end)
+{
+  aritlex_image_expression *expression;
+  aritlex_image_instruction *code;
+  s8 *vars;
+  u32 depth = 0;
+  u32 i, k;
+
+  if (offset % 8 != 0 || offset < sizeof(aritlex_image_header) || offset > end || end - offset < sizeof(aritlex_image_expression))
+  {
+    return 0;
+  }
+
+  expression = (aritlex_image_expression *)(void *)(image + offset);
+
+  /* Bounded sizes first, so the record size below can not overflow */
+  if (expression->code_size == 0 || expression->code_size > ARITLEX_PROGRAM_CAPACITY ||
+      expression->constants_size > expression->code_size ||
+      expression->vars_size > ARITLEX_VARS_CAPACITY ||
+      expression->stack_size == 0 || expression->stack_size > ARITLEX_STACK_CAPACITY ||
+      end - offset - (u32)sizeof(aritlex_image_expression) < expression->code_size * (u32)sizeof(aritlex_image_instruction) +
+                                                                 expression->constants_size * (u32)sizeof(f64) +
+                                                                 expression->vars_size * ARITLEX_IMAGE_NAME_SIZE)
+  {
+    return 0;
+  }
+
+  code = aritlex_image_code(expression);
+
+  for (i = 0; i < expression->code_size; ++i)
+  {
+    u32 type = code[i].op & 0xFFu;
+    u32 arity = code[i].op >> 8;
+
+    if (arity == 0)
+    {
+      if (!(type == TOK_NUM_INTEGER ||
+            (type == TOK_NUM_FLOAT && code[i].val.index < expression->constants_size) ||
+            (type == TOK_VAR && code[i].val.index < expression->vars_size)))
+      {
+        return 0;
+      }
+    }
+    else if (arity > 3 || depth < arity || type >= ARITLEX_TOKEN_TYPE_COUNT ||
+             type == TOK_NUM_INTEGER || type == TOK_NUM_FLOAT || type == TOK_VAR || (arity == 3) != (type == TOK_QMARK))
+    {
+      return 0;
+    }
+
+    depth = depth + 1 - arity;
+
+    if (depth > expression->stack_size)
+    {
+      return 0;
+    }
+  }
+
+  if (depth != 1)
+  {
+    return 0;
+  }
+
+  vars = aritlex_image_var(expression, 0);
+
+  for (i = 0; i < expression->vars_size; ++i)
+  {
+    for (k = 0; k < ARITLEX_IMAGE_NAME_SIZE && vars[i * ARITLEX_IMAGE_NAME_SIZE + k]; ++k)
+    {
+    }
+
+    if (k == ARITLEX_IMAGE_NAME_SIZE)
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* Validates an image (8 byte aligned, e.g. mmapped) compiled from the source with source_hash and every expression in it */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_open(u8 *image, u32 image_size, u64 source_hash)
+{
+  aritlex_image_header *header = (aritlex_image_header *)(void *)image;
+  u32 *offsets;
+  u32 i;
+
+  if (!image ||
+      image_size < sizeof(aritlex_image_header) ||
+      header->magic != ARITLEX_IMAGE_MAGIC ||
+      header->version != ARITLEX_IMAGE_VERSION ||
+      header->source_hash != source_hash ||
+      header->image_size != image_size ||
+      (header->capacities & 0xFFFFu) > ARITLEX_STACK_CAPACITY ||
+      (header->capacities >> 16) > ARITLEX_VARS_CAPACITY ||
+      header->offsets_offset % 8 != 0 ||
+      header->offsets_offset < sizeof(aritlex_image_header) ||
+      header->offsets_offset > image_size ||
+      header->expressions_size > (image_size - header->offsets_offset) / sizeof(u32))
+  {
+    return 0;
+  }
+
+  offsets = (u32 *)(void *)(image + header->offsets_offset);
+
+  for (i = 0; i < header->expressions_size; ++i)
+  {
+    if (!aritlex_image_check(image, offsets[i], header->offsets_offset))
+    {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_count(u8 *image)
+{
+  return ((aritlex_image_header *)(void *)image)->expressions_size;
+}
+
+/* Expression at index of an opened image, 0 if out of range */
+ARITLEX_API ARITLEX_INLINE aritlex_image_expression *aritlex_image_get(u8 *image, u32 index)
+{
+  aritlex_image_header *header = (aritlex_image_header *)(void *)image;
+  u32 offset;
+
+  if (index >= header->expressions_size)
+  {
+    return 0;
+  }
+
+  offset = ((u32 *)(void *)(image + header->offsets_offset))[index];
+
+  return offset < header->offsets_offset ? (aritlex_image_expression *)(void *)(image + offset) : 0;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_image_slot(aritlex_image_expression *expression, s8 *name)
+{
+  u32 i;
+
+  for (i = 0; i < expression->vars_size; ++i)
+  {
+    if (aritlex_name_equals(aritlex_image_var(expression, i), name))
+    {
+      return i;
+    }
+  }
+
+  return ARITLEX_SLOT_INVALID;
+}
+
+/* Same as aritlex_eval_value, reading the instructions from the image */
+ARITLEX_API ARITLEX_INLINE aritlex_value aritlex_image_eval_value(aritlex_image_expression *expression, f64 *vars)
+{
+  aritlex_image_instruction *code = aritlex_image_code(expression);
+  f64 *constants = aritlex_image_constants(expression);
+  aritlex_value stack[ARITLEX_STACK_CAPACITY];
+  u32 sp = 0;
+  u32 i;
+
+  stack[0].type = ARITLEX_TYPE_S32;
+  stack[0].val.number_integer = 0;
+
+  for (i = 0; i < expression->code_size; ++i)
+  {
+    aritlex_token_type type = (aritlex_token_type)(code[i].op & 0xFFu);
+
+    switch (code[i].op >> 8)
+    {
+    case 0:
+    {
+      aritlex_value *v = &stack[sp++];
+
+      if (type == TOK_NUM_INTEGER)
+      {
+        v->type = ARITLEX_TYPE_S32;
+        v->val.number_integer = code[i].val.number_integer;
+      }
+      else
+      {
+        v->type = ARITLEX_TYPE_F64;
+        v->val.number_floating = type == TOK_VAR ? vars[code[i].val.index] : constants[code[i].val.index];
+      }
+      break;
+    }
+    case 1:
+    {
+      stack[sp - 1] = aritlex_value_unary(type, stack[sp - 1]);
+      break;
+    }
+    case 2:
+    {
+      sp--;
+      stack[sp - 1] = aritlex_value_binary(type, stack[sp - 1], stack[sp]);
+      break;
+    }
+    default:
+    {
+      sp -= 2;
+      stack[sp - 1] = aritlex_value_select(stack[sp - 1], stack[sp], stack[sp + 1]);
+      break;
+    }
+    }
+  }
+
+  return stack[0];
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_image_eval(aritlex_image_expression *expression, f64 *vars)
+{
+  return aritlex_value_to_f64(aritlex_image_eval_value(expression, vars));
+}
+
+/* #############################################################################
+ * # RULE ENGINE
+ * #############################################################################
+ *
+ * Matches events (one value per variable) against many boolean rules without
+ * evaluating every rule. Each rule is split at its top level && operators and
+ * only the rules whose indexed conjuncts all hold for the event are evaluated:
+ *
+ *   var == constant   every such conjunct is posted in a hash table keyed by
+ *                     (variable, constant). An event looks up the key of each
+ *                     variable and counts the hits per rule, a rule is only
+ *                     evaluated once all of its equalities were hit.
+ *   var > constant    rules without an equality use one range conjunct, sorted
+ *   var < constant    by constant per variable, the matching rules are a
+ *                     prefix / suffix found by binary search.
+ *
+ * Rules with neither are evaluated for every event. The work per event is the
+ * postings of the keys the event hits plus the rules evaluated, so it follows
+ * the selectivity of the equalities and not the rule count: with a growing
+ * set of keys (tools/aritlex_engine_bench.c) 20x more rules cost less than 2x
+ * in events per second, the rest being cache misses on the larger tables.
+ * Range only and scanned rules still cost in proportion to their number.
+ *
+ * The arrays are provided by the caller. The table capacity must be a power
+ * of two greater than the postings capacity (one posting per equality
+ * conjunct). Call aritlex_engine_build after adding rules.
+ */
+#ifndef ARITLEX_ENGINE_VARS_CAPACITY
+#define ARITLEX_ENGINE_VARS_CAPACITY 256
+#endif
+
+typedef struct aritlex_engine_rule
+{
+  u32 code_begin; /* instructions in aritlex_engine.code, val.slot refers to the engine variables */
+  u32 code_size;
+  u32 next;   /* next rule in the scan list, ARITLEX_SLOT_INVALID ends */
+  u32 needed; /* equality conjuncts, 0 if the rule is not in the postings */
+  u32 hits;   /* equalities hit by the event of stamp */
+  u32 stamp;
+
+} aritlex_engine_rule;
+
+/* One equality conjunct of a rule */
+typedef struct aritlex_engine_posting
+{
+  u32 rule;
+  u32 next; /* next posting with the same key, ARITLEX_SLOT_INVALID ends */
+
+} aritlex_engine_posting;
+
+typedef struct aritlex_engine_key
+{
+  u32 slot; /* ARITLEX_SLOT_INVALID marks an empty entry */
+  u32 head; /* first posting */
+  f64 value;
+
+} aritlex_engine_key;
+
+typedef struct aritlex_engine_range
+{
+  u32 slot;
+  u32 upper; /* 0 for var > / >= constant, 1 for var < / <= constant */
+  u32 strict;
+  u32 rule;
+  f64 value;
+
+} aritlex_engine_range;
+
+typedef struct aritlex_engine
+{
+  aritlex_engine_rule *rules;
+  u32 rules_size;
+  u32 rules_capacity;
+
+  aritlex_instruction *code;
+  u32 code_size;
+  u32 code_capacity;
+
+  aritlex_engine_posting *postings;
+  u32 postings_size;
+  u32 postings_capacity;
+
+  aritlex_engine_key *table;
+  u32 table_capacity;
+
+  aritlex_engine_range *ranges; /* sorted by (slot, upper, value) in aritlex_engine_build */
+  u32 ranges_size;
+  u32 ranges_capacity;
+  u32 ranges_begin[ARITLEX_ENGINE_VARS_CAPACITY][2]; /* segment of each (slot, upper) in ranges */
+  u32 ranges_end[ARITLEX_ENGINE_VARS_CAPACITY][2];
+  u32 built;
+
+  u32 equalities[ARITLEX_ENGINE_VARS_CAPACITY]; /* number of postings per variable */
+  u32 scan;                                     /* rules without indexed conjunct */
+  u32 stamp;                                    /* events matched, tags the hit counts of the rules */
+  u32 evaluated;                                /* rules evaluated by the last aritlex_engine_match */
+  u32 hits;                                     /* postings visited by the last aritlex_engine_match */
+
+  s8 vars[ARITLEX_ENGINE_VARS_CAPACITY][32];
+  u32 vars_size;
+
+  aritlex_program program; /* compile scratch */
+
+} aritlex_engine;
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_init(
+    aritlex_engine *engine,
+    aritlex_engine_rule *rules, u32 rules_capacity,
+    aritlex_instruction *code, u32 code_capacity,
+    aritlex_engine_posting *postings, u32 postings_capacity,
+    aritlex_engine_key *table, u32 table_capacity,
+    aritlex_engine_range *ranges, u32 ranges_capacity)
+{
+  u32 i;
+
+  if (table_capacity <= postings_capacity || (table_capacity & (table_capacity - 1)) != 0)
+  {
+    return 0;
+  }
+
+  engine->rules = rules;
+  engine->rules_size = 0;
+  engine->rules_capacity = rules_capacity;
+  engine->code = code;
+  engine->code_size = 0;
+  engine->code_capacity = code_capacity;
+  engine->postings = postings;
+  engine->postings_size = 0;
+  engine->postings_capacity = postings_capacity;
+  engine->table = table;
+  engine->table_capacity = table_capacity;
+  engine->ranges = ranges;
+  engine->ranges_size = 0;
+  engine->ranges_capacity = ranges_capacity;
+  engine->built = 1;
+  engine->scan = ARITLEX_SLOT_INVALID;
+  engine->stamp = 0;
+  engine->evaluated = 0;
+  engine->hits = 0;
+  engine->vars_size = 0;
+
+  for (i = 0; i < table_capacity; ++i)
+  {
+    table[i].slot = ARITLEX_SLOT_INVALID;
+  }
+
+  for (i = 0; i < ARITLEX_ENGINE_VARS_CAPACITY; ++i)
+  {
+    engine->ranges_begin[i][0] = engine->ranges_end[i][0] = 0;
+    engine->ranges_begin[i][1] = engine->ranges_end[i][1] = 0;
+    engine->equalities[i] = 0;
+  }
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_slot(aritlex_engine *engine, s8 *name)
+{
+  u32 i;
+
+  for (i = 0; i < engine->vars_size; ++i)
+  {
+    if (aritlex_name_equals(engine->vars[i], name))
+    {
+      return i;
+    }
+  }
+
+  return ARITLEX_SLOT_INVALID;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_hash(u32 slot, f64 value)
+{
+  union
+  {
+    f64 number_floating;
+    u32 words[2];
+  } bits;
+
+  u32 hash = 2166136261u;
+
+  bits.number_floating = value == 0.0 ? 0.0 : value; /* -0.0 == 0.0 */
+  hash = (hash ^ slot) * 16777619u;
+  hash = (hash ^ bits.words[0]) * 16777619u;
+  hash = (hash ^ bits.words[1]) * 16777619u;
+
+  return hash ^ (hash >> 15);
+}
+
+/* Entry for (slot, value), the empty entry where it would be inserted if it is missing */
+ARITLEX_API ARITLEX_INLINE aritlex_engine_key *aritlex_engine_find(aritlex_engine *engine, u32 slot, f64 value)
+{
+  u32 mask = engine->table_capacity - 1;
+  u32 i = aritlex_engine_hash(slot, value) & mask;
+
+  while (engine->table[i].slot != ARITLEX_SLOT_INVALID && (engine->table[i].slot != slot || engine->table[i].value != value))
+  {
+    i = (i + 1) & mask;
+  }
+
+  return &engine->table[i];
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_is_literal(aritlex_instruction *instruction)
+{
+  return instruction->type == TOK_NUM_INTEGER || instruction->type == TOK_NUM_FLOAT;
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_engine_literal(aritlex_instruction *instruction)
+{
+  return instruction->type == TOK_NUM_INTEGER ? (f64)instruction->val.number_integer : instruction->val.number_floating;
+}
+
+/* Collects the top level var == constant compare instructions of code into equalities and
+ * returns the index of one var < <= > >= constant compare, ARITLEX_SLOT_INVALID if none */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_access(aritlex_instruction *code, u32 code_size, u32 *equalities, u32 *equalities_size)
+{
+  u32 begin[ARITLEX_PROGRAM_CAPACITY]; /* first instruction of the subexpression ending at i */
+  u32 stack[ARITLEX_STACK_CAPACITY];
+  u32 roots[ARITLEX_PROGRAM_CAPACITY];
+  u32 sp = 0, roots_size = 0, range = ARITLEX_SLOT_INVALID;
+  u32 i;
+
+  *equalities_size = 0;
+
+  for (i = 0; i < code_size; ++i)
+  {
+    sp -= code[i].arity;
+    begin[i] = code[i].arity ? stack[sp] : i;
+    stack[sp++] = begin[i];
+  }
+
+  /* Walk the top level && operands, the condition of the rule is the conjunction of them */
+  roots[roots_size++] = code_size - 1;
+
+  while (roots_size)
+  {
+    u32 root = roots[--roots_size];
+    aritlex_instruction *left, *right;
+    aritlex_token_type op = code[root].type;
+
+    if (op == TOK_AND_AND)
+    {
+      roots[roots_size++] = root - 1;
+      roots[roots_size++] = begin[root - 1] - 1;
+      continue;
+    }
+
+    if (code[root].arity != 2 || !aritlex_is_compare(op) || op == TOK_NEQ || begin[root] != root - 2)
+    {
+      continue;
+    }
+
+    left = &code[root - 2];
+    right = &code[root - 1];
+
+    if (!((left->type == TOK_VAR && aritlex_engine_is_literal(right)) || (right->type == TOK_VAR && aritlex_engine_is_literal(left))))
+    {
+      continue;
+    }
+
+    if (op == TOK_EQ)
+    {
+      equalities[(*equalities_size)++] = root;
+    }
+    else if (range == ARITLEX_SLOT_INVALID)
+    {
+      range = root;
+    }
+  }
+
+  return range;
+}
+
+/* Compiles a boolean rule, its index is the number of rules added before */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_add(aritlex_engine *engine, aritlex_token *tokens, u32 tokens_size)
+{
+  aritlex_program *program = &engine->program;
+  aritlex_engine_rule *rule;
+  u32 slots[ARITLEX_VARS_CAPACITY];
+  u32 equalities[ARITLEX_PROGRAM_CAPACITY / 3];
+  u32 index = engine->rules_size;
+  u32 range, equalities_size, i;
+
+  if (engine->rules_size >= engine->rules_capacity || !aritlex_compile(tokens, tokens_size, program) ||
+      program->code_size > engine->code_capacity - engine->code_size)
+  {
+    return 0;
+  }
+
+  /* Map the program variable slots to the engine slots */
+  for (i = 0; i < program->vars_size; ++i)
+  {
+    slots[i] = aritlex_engine_slot(engine, program->vars[i]);
+
+    if (slots[i] == ARITLEX_SLOT_INVALID)
+    {
+      u32 j = 0;
+
+      if (engine->vars_size >= ARITLEX_ENGINE_VARS_CAPACITY)
+      {
+        return 0;
+      }
+
+      do
+      {
+        engine->vars[engine->vars_size][j] = program->vars[i][j];
+      } while (program->vars[i][j++]);
+
+      slots[i] = engine->vars_size++;
+    }
+  }
+
+  range = aritlex_engine_access(program->code, program->code_size, equalities, &equalities_size);
+
+  if (equalities_size > engine->postings_capacity - engine->postings_size ||
+      (equalities_size == 0 && range != ARITLEX_SLOT_INVALID && engine->ranges_size >= engine->ranges_capacity))
+  {
+    return 0;
+  }
+
+  rule = &engine->rules[engine->rules_size++];
+  rule->code_begin = engine->code_size;
+  rule->code_size = program->code_size;
+  rule->next = ARITLEX_SLOT_INVALID;
+  rule->needed = equalities_size;
+  rule->hits = 0;
+  rule->stamp = 0;
+
+  for (i = 0; i < program->code_size; ++i)
+  {
+    aritlex_instruction *instruction = &engine->code[engine->code_size++];
+
+    *instruction = program->code[i];
+
+    if (instruction->type == TOK_VAR)
+    {
+      instruction->val.slot = slots[instruction->val.slot];
+    }
+  }
+
+  for (i = 0; i < equalities_size; ++i)
+  {
+    aritlex_instruction *code = engine->code + rule->code_begin;
+    u32 root = equalities[i];
+    u32 flipped = code[root - 2].type != TOK_VAR; /* constant == var */
+    u32 slot = code[root - 2 + flipped].val.slot;
+    f64 value = aritlex_engine_literal(&code[root - 1 - flipped]);
+    aritlex_engine_key *key = aritlex_engine_find(engine, slot, value);
+    aritlex_engine_posting *posting = &engine->postings[engine->postings_size];
+
+    if (key->slot == ARITLEX_SLOT_INVALID)
+    {
+      key->slot = slot;
+      key->value = value;
+      key->head = ARITLEX_SLOT_INVALID;
+    }
+
+    posting->rule = index;
+    posting->next = key->head;
+    key->head = engine->postings_size++;
+    engine->equalities[slot]++;
+  }
+
+  if (equalities_size == 0 && range == ARITLEX_SLOT_INVALID)
+  {
+    rule->next = engine->scan;
+    engine->scan = index;
+  }
+  else if (equalities_size == 0)
+  {
+    aritlex_instruction *code = engine->code + rule->code_begin;
+    aritlex_token_type op = code[range].type;
+    u32 flipped = code[range - 2].type != TOK_VAR; /* constant op var */
+    aritlex_engine_range *entry = &engine->ranges[engine->ranges_size++];
+
+    entry->slot = code[range - 2 + flipped].val.slot;
+    entry->upper = (op == TOK_LT || op == TOK_LE) != flipped;
+    entry->strict = op == TOK_LT || op == TOK_GT;
+    entry->rule = index;
+    entry->value = aritlex_engine_literal(&code[range - 1 - flipped]);
+    engine->built = 0;
+  }
+
+  return 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_range_less(aritlex_engine_range *a, aritlex_engine_range *b)
+{
+  return a->slot != b->slot ? a->slot < b->slot : (a->upper != b->upper ? a->upper < b->upper : a->value < b->value);
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_engine_sift(aritlex_engine_range *ranges, u32 root, u32 size)
+{
+  for (;;)
+  {
+    u32 child = root * 2 + 1;
+    aritlex_engine_range swap;
+
+    if (child >= size)
+    {
+      break;
+    }
+
+    child += child + 1 < size && aritlex_engine_range_less(&ranges[child], &ranges[child + 1]);
+
+    if (!aritlex_engine_range_less(&ranges[root], &ranges[child]))
+    {
+      break;
+    }
+
+    swap = ranges[root];
+    ranges[root] = ranges[child];
+    ranges[child] = swap;
+    root = child;
+  }
+}
+
+/* Sorts the range predicates (heap sort, in place) and finds the segment of every variable */
+ARITLEX_API ARITLEX_INLINE void aritlex_engine_build(aritlex_engine *engine)
+{
+  aritlex_engine_range *ranges = engine->ranges;
+  u32 i;
+
+  for (i = engine->ranges_size / 2; i > 0; --i)
+  {
+    aritlex_engine_sift(ranges, i - 1, engine->ranges_size);
+  }
+
+  for (i = engine->ranges_size; i > 1; --i)
+  {
+    aritlex_engine_range top = ranges[0];
+
+    ranges[0] = ranges[i - 1];
+    ranges[i - 1] = top;
+    aritlex_engine_sift(ranges, 0, i - 1);
+  }
+
+  for (i = 0; i < ARITLEX_ENGINE_VARS_CAPACITY; ++i)
+  {
+    engine->ranges_begin[i][0] = engine->ranges_end[i][0] = 0;
+    engine->ranges_begin[i][1] = engine->ranges_end[i][1] = 0;
+  }
+
+  for (i = 0; i < engine->ranges_size; ++i)
+  {
+    aritlex_engine_range *range = &ranges[i];
+
+    if (i == 0 || range->slot != ranges[i - 1].slot || range->upper != ranges[i - 1].upper)
+    {
+      engine->ranges_begin[range->slot][range->upper] = i;
+    }
+
+    engine->ranges_end[range->slot][range->upper] = i + 1;
+  }
+
+  engine->built = 1;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_check(aritlex_engine *engine, u32 index, f64 *vars, u32 *matches, u32 matches_capacity, u32 *matches_size)
+{
+  aritlex_engine_rule *rule = &engine->rules[index];
+
+  engine->evaluated++;
+
+  if (!aritlex_value_truth(aritlex_eval_code(engine->code + rule->code_begin, rule->code_size, vars)))
+  {
+    return 1;
+  }
+
+  if (*matches_size >= matches_capacity)
+  {
+    return 0;
+  }
+
+  matches[(*matches_size)++] = index;
+
+  return 1;
+}
+
+/* vars[slot] holds the event value of each engine variable (see aritlex_engine_slot).
+ * matches receives the indices of the rules that are true, in no particular order.
+ */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_engine_match(aritlex_engine *engine, f64 *vars, u32 *matches, u32 matches_capacity, u32 *matches_size)
+{
+  aritlex_engine_range *ranges = engine->ranges;
+  u32 ok = 1;
+  u32 slot, i;
+
+  *matches_size = 0;
+  engine->evaluated = 0;
+  engine->hits = 0;
+
+  if (!engine->built)
+  {
+    return 0;
+  }
+
+  /* A new stamp resets the hit counts of every rule, they are only cleared when it wraps */
+  if (++engine->stamp == 0)
+  {
+    for (i = 0; i < engine->rules_size; ++i)
+    {
+      engine->rules[i].stamp = 0;
+    }
+
+    engine->stamp = 1;
+  }
+
+  for (i = engine->scan; i != ARITLEX_SLOT_INVALID && ok; i = engine->rules[i].next)
+  {
+    ok = aritlex_engine_check(engine, i, vars, matches, matches_capacity, matches_size);
+  }
+
+  for (slot = 0; slot < engine->vars_size && ok; ++slot)
+  {
+    f64 value = vars[slot];
+    u32 begin, end, low, high;
+
+    if (value != value)
+    {
+      continue; /* NaN is not equal, less or greater than anything */
+    }
+
+    if (engine->equalities[slot])
+    {
+      aritlex_engine_key *key = aritlex_engine_find(engine, slot, value);
+
+      for (i = key->slot == ARITLEX_SLOT_INVALID ? ARITLEX_SLOT_INVALID : key->head; i != ARITLEX_SLOT_INVALID && ok; i = engine->postings[i].next)
+      {
+        aritlex_engine_rule *rule = &engine->rules[engine->postings[i].rule];
+
+        if (rule->stamp != engine->stamp)
+        {
+          rule->stamp = engine->stamp;
+          rule->hits = 0;
+        }
+
+        engine->hits++;
+
+        if (++rule->hits == rule->needed)
+        {
+          ok = aritlex_engine_check(engine, engine->postings[i].rule, vars, matches, matches_capacity, matches_size);
+        }
+      }
+    }
+
+    /* var > constant holds for the constants up to the value (== only for >=) */
+    begin = low = engine->ranges_begin[slot][0];
+    high = engine->ranges_end[slot][0];
+
+    while (low < high)
+    {
+      u32 middle = low + (high - low) / 2;
+
+      if (ranges[middle].value <= value)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    for (i = begin; i < low && ok; ++i)
+    {
+      if (!ranges[i].strict || ranges[i].value != value)
+      {
+        ok = aritlex_engine_check(engine, ranges[i].rule, vars, matches, matches_capacity, matches_size);
+      }
+    }
+
+    /* var < constant holds for the constants from the value on (== only for <=) */
+    low = engine->ranges_begin[slot][1];
+    high = end = engine->ranges_end[slot][1];
+
+    while (low < high)
+    {
+      u32 middle = low + (high - low) / 2;
+
+      if (ranges[middle].value < value)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    for (i = low; i < end && ok; ++i)
+    {
+      if (!ranges[i].strict || ranges[i].value != value)
+      {
+        ok = aritlex_engine_check(engine, ranges[i].rule, vars, matches, matches_capacity, matches_size);
+      }
+    }
+  }
+
+  return ok;
+}
+
+/* #############################################################################
+ * # PARALLEL EVALUATOR
+ * #############################################################################
+ *
+ * Runs aritlex_eval_batch over large row counts on a pthread pool. This is the
+ * only part of aritlex that needs the C library, so it is only compiled when
+ * ARITLEX_THREADS_ENABLE is defined (link with -pthread).
+ *
+ * The rows are split into chunks of ARITLEX_PARALLEL_CHUNK rows. Each worker
+ * starts with an equal, contiguous range of chunks and takes chunks from the
+ * front of its own range. A worker that runs out steals the back half of the
+ * remaining range of another worker, so uneven progress (other load on the
+ * machine, slow cores) is balanced without a shared queue. Each worker has its
+ * own batch scratch. Outputs are written in row order, and reductions are
+ * combined from the per worker partial results. The calling thread works as
+ * worker 0.
+ */
+#ifdef ARITLEX_THREADS_ENABLE
+#include <pthread.h>
+
+#ifndef ARITLEX_THREADS_CAPACITY
+#define ARITLEX_THREADS_CAPACITY 64
+#endif
+
+#ifndef ARITLEX_PARALLEL_CHUNK
+#define ARITLEX_PARALLEL_CHUNK (ARITLEX_BATCH_SIZE * 64) /* Rows per stealable task */
+#endif
+
+typedef enum aritlex_reduce
+{
+  ARITLEX_REDUCE_NONE, /* write every row to out */
+  ARITLEX_REDUCE_SUM,
+  ARITLEX_REDUCE_MIN, /* NaN rows are ignored by min and max */
+  ARITLEX_REDUCE_MAX
+
+} aritlex_reduce;
+
+struct aritlex_parallel;
+
+typedef struct aritlex_parallel_worker
+{
+  struct aritlex_parallel *pool;
+  pthread_t thread;
+  pthread_mutex_t lock; /* guards next and end */
+  u32 next;             /* chunks [next, end) are left to do */
+  u32 end;
+  u32 generation;
+  u32 failed;
+  u32 steals;
+  f64 partial;
+  f64 buffer[ARITLEX_BATCH_SIZE]; /* rows of a chunk that is only reduced */
+  aritlex_batch_scratch scratch;
+
+} aritlex_parallel_worker;
+
+typedef struct aritlex_parallel
+{
+  aritlex_parallel_worker workers[ARITLEX_THREADS_CAPACITY];
+  u32 threads_size;
+
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  u32 generation;
+  u32 pending;
+  u32 stop;
+
+  /* Current job */
+  aritlex_program *program;
+  f64 **columns;
+  u32 rows;
+  f64 *out;
+  aritlex_reduce reduce;
+
+} aritlex_parallel;
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_parallel_identity(aritlex_reduce reduce)
+{
+  return reduce == ARITLEX_REDUCE_MIN ? 1.0 / 0.0 : (reduce == ARITLEX_REDUCE_MAX ? -1.0 / 0.0 : 0.0);
+}
+
+ARITLEX_API ARITLEX_INLINE f64 aritlex_parallel_combine(aritlex_reduce reduce, f64 a, f64 b)
+{
+  switch (reduce)
+  {
+  case ARITLEX_REDUCE_MIN:
+    return b < a ? b : a;
+  case ARITLEX_REDUCE_MAX:
+    return b > a ? b : a;
+  default:
+    return a + b;
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_parallel_chunk(aritlex_parallel *pool, aritlex_parallel_worker *worker, u32 chunk)
+{
+  f64 *columns[ARITLEX_VARS_CAPACITY];
+  u32 row = chunk * ARITLEX_PARALLEL_CHUNK;
+  u32 end = pool->rows - row < ARITLEX_PARALLEL_CHUNK ? pool->rows : row + ARITLEX_PARALLEL_CHUNK;
+  u32 i, j;
+
+  if (pool->reduce == ARITLEX_REDUCE_NONE)
+  {
+    for (i = 0; i < pool->program->vars_size; ++i)
+    {
+      columns[i] = pool->columns[i] + row;
+    }
+
+    worker->failed |= !aritlex_eval_batch(pool->program, columns, end - row, pool->out + row, &worker->scratch);
+    return;
+  }
+
+  for (; row < end; row += ARITLEX_BATCH_SIZE)
+  {
+    u32 n = end - row < ARITLEX_BATCH_SIZE ? end - row : ARITLEX_BATCH_SIZE;
+
+    for (i = 0; i < pool->program->vars_size; ++i)
+    {
+      columns[i] = pool->columns[i] + row;
+    }
+
+    worker->failed |= !aritlex_eval_batch(pool->program, columns, n, worker->buffer, &worker->scratch);
+
+    for (j = 0; j < n; ++j)
+    {
+      worker->partial = aritlex_parallel_combine(pool->reduce, worker->partial, worker->buffer[j]);
+    }
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parallel_take(aritlex_parallel_worker *worker, u32 *chunk)
+{
+  u32 taken = 0;
+
+  pthread_mutex_lock(&worker->lock);
+  if (worker->next < worker->end)
+  {
+    *chunk = worker->next++;
+    taken = 1;
+  }
+  pthread_mutex_unlock(&worker->lock);
+
+  return taken;
+}
+
+/* Moves the back half of another worker's remaining chunks to thief */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parallel_steal(aritlex_parallel *pool, aritlex_parallel_worker *thief)
+{
+  u32 self = (u32)(thief - pool->workers);
+  u32 i;
+
+  for (i = 1; i < pool->threads_size; ++i)
+  {
+    aritlex_parallel_worker *victim = &pool->workers[(self + i) % pool->threads_size];
+    u32 begin = 0, count = 0;
+
+    pthread_mutex_lock(&victim->lock);
+    if (victim->next < victim->end)
+    {
+      count = (victim->end - victim->next + 1) / 2;
+      victim->end -= count;
+      begin = victim->end;
+    }
+    pthread_mutex_unlock(&victim->lock);
+
+    if (count)
+    {
+      pthread_mutex_lock(&thief->lock);
+      thief->next = begin;
+      thief->end = begin + count;
+      pthread_mutex_unlock(&thief->lock);
+      thief->steals++;
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_parallel_run(aritlex_parallel *pool, aritlex_parallel_worker *worker)
+{
+  u32 chunk;
+
+  do
+  {
+    while (aritlex_parallel_take(worker, &chunk))
+    {
+      aritlex_parallel_chunk(pool, worker, chunk);
+    }
+  } while (aritlex_parallel_steal(pool, worker));
+}
+
+ARITLEX_API ARITLEX_INLINE void *aritlex_parallel_thread(void *argument)
+{
+  aritlex_parallel_worker *worker = (aritlex_parallel_worker *)argument;
+  aritlex_parallel *pool = worker->pool;
+
+  for (;;)
+  {
+    u32 stop;
+
+    pthread_mutex_lock(&pool->lock);
+    while (worker->generation == pool->generation && !pool->stop)
+    {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    worker->generation = pool->generation;
+    stop = pool->stop;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (stop)
+    {
+      return 0;
+    }
+
+    aritlex_parallel_run(pool, worker);
+
+    pthread_mutex_lock(&pool->lock);
+    if (--pool->pending == 0)
+    {
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_parallel_free(aritlex_parallel *pool)
+{
+  u32 i;
+
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (i = 1; i < pool->threads_size; ++i)
+  {
+    pthread_join(pool->workers[i].thread, 0);
+  }
+
+  for (i = 0; i < pool->threads_size; ++i)
+  {
+    pthread_mutex_destroy(&pool->workers[i].lock);
+  }
+
+  pthread_cond_destroy(&pool->done);
+  pthread_cond_destroy(&pool->start);
+  pthread_mutex_destroy(&pool->lock);
+}
+
+/* Starts threads_size - 1 threads (the caller is the first worker). If a thread can not be
+ * created the started ones are joined, the locks destroyed and 0 is returned. */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parallel_init(aritlex_parallel *pool, u32 threads_size)
+{
+  u32 started = 1;
+  u32 i;
+
+  if (threads_size == 0 || threads_size > ARITLEX_THREADS_CAPACITY)
+  {
+    return 0;
+  }
+
+  pool->threads_size = threads_size;
+  pool->generation = 0;
+  pool->pending = 0;
+  pool->stop = 0;
+
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->start, 0);
+  pthread_cond_init(&pool->done, 0);
+
+  for (i = 0; i < threads_size; ++i)
+  {
+    aritlex_parallel_worker *worker = &pool->workers[i];
+
+    worker->pool = pool;
+    worker->next = 0;
+    worker->end = 0;
+    worker->generation = 0;
+    worker->steals = 0;
+    pthread_mutex_init(&worker->lock, 0);
+    aritlex_batch_init(&worker->scratch); /* selects the kernels before any thread runs */
+  }
+
+  for (i = 1; i < threads_size; ++i)
+  {
+    if (pthread_create(&pool->workers[i].thread, 0, aritlex_parallel_thread, &pool->workers[i]) != 0)
+    {
+      break;
+    }
+
+    started++;
+  }
+
+  if (started != threads_size)
+  {
+    pool->threads_size = started;
+    aritlex_parallel_free(pool); /* joins the started threads */
+
+    for (i = started; i < threads_size; ++i)
+    {
+      pthread_mutex_destroy(&pool->workers[i].lock);
+    }
+
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Evaluates program over rows. With ARITLEX_REDUCE_NONE every row is written to out,
+ * otherwise only the reduction is stored in result (sums may differ in the last bits
+ * between runs since the partial sums depend on how the chunks were stolen). */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_parallel_eval(
+    aritlex_parallel *pool,
+    aritlex_program *program,
+    f64 **columns,
+    u32 rows,
+    f64 *out,
+    aritlex_reduce reduce,
+    f64 *result)
+{
+  u32 chunks = rows / ARITLEX_PARALLEL_CHUNK + (rows % ARITLEX_PARALLEL_CHUNK != 0);
+  u32 failed = 0;
+  u32 i;
+
+  if (!program || program->code_size == 0 || (reduce == ARITLEX_REDUCE_NONE ? !out : !result))
+  {
+    return 0;
+  }
+
+  pool->program = program;
+  pool->columns = columns;
+  pool->rows = rows;
+  pool->out = out;
+  pool->reduce = reduce;
+
+  for (i = 0; i < pool->threads_size; ++i)
+  {
+    aritlex_parallel_worker *worker = &pool->workers[i];
+
+    pthread_mutex_lock(&worker->lock);
+    worker->next = (u32)((unsigned long)chunks * i / pool->threads_size);
+    worker->end = (u32)((unsigned long)chunks * (i + 1) / pool->threads_size);
+    pthread_mutex_unlock(&worker->lock);
+
+    worker->failed = 0;
+    worker->partial = aritlex_parallel_identity(reduce);
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->generation++;
+  pool->pending = pool->threads_size - 1;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+
+  aritlex_parallel_run(pool, &pool->workers[0]);
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->pending)
+  {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  if (result)
+  {
+    *result = aritlex_parallel_identity(reduce);
+  }
+
+  for (i = 0; i < pool->threads_size; ++i)
+  {
+    failed |= pool->workers[i].failed;
+
+    if (result && reduce != ARITLEX_REDUCE_NONE)
+    {
+      *result = aritlex_parallel_combine(reduce, *result, pool->workers[i].partial);
+    }
+  }
+
+  return !failed;
+}
+
+/* #############################################################################
+ * # PIPELINE
+ * #############################################################################
+ *
+ * Runs aritlex_tokenize, aritlex_compile and the evaluation of a stream of
+ * expressions on three threads, so each stage keeps its own code and tables
+ * hot in the cache of its core. The caller feeds requests with
+ * aritlex_pipeline_submit and collects results with aritlex_pipeline_poll.
+ *
+ * The stages are connected by single producer, single consumer rings. The
+ * read and write indices live on separate cache lines and each side keeps a
+ * cached copy of the other side's index, so the shared lines are only touched
+ * once per batch of up to ARITLEX_PIPELINE_BATCH items (the batch is handed
+ * over with one release store). No locks are taken, a stage that finds its
+ * input empty or its output full spins for a while and then yields.
+ *
+ * For each stage the items, batches, input queue depth seen at every batch
+ * and the number of times it stalled on an empty input or a full output are
+ * counted. The stage with the deepest input queue and the fewest empty stalls
+ * is the bottleneck. Needs the gcc/clang __atomic builtins.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#include <sched.h>
+
+#ifndef ARITLEX_PIPELINE_CAPACITY
+#define ARITLEX_PIPELINE_CAPACITY 64 /* Items per ring, must be a power of two */
+#endif
+
+#ifndef ARITLEX_PIPELINE_BATCH
+#define ARITLEX_PIPELINE_BATCH 16
+#endif
+
+#ifndef ARITLEX_PIPELINE_TOKENS_CAPACITY
+#define ARITLEX_PIPELINE_TOKENS_CAPACITY 64 /* Longer expressions (in bytes) fail, each byte gives at most one token plus TOK_EOF */
+#endif
+
+#ifndef ARITLEX_PIPELINE_SPIN
+#define ARITLEX_PIPELINE_SPIN 256 /* Empty polls before a stage yields its core */
+#endif
+
+#define ARITLEX_PIPELINE_CACHE_LINE 64
+#define ARITLEX_PIPELINE_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define ARITLEX_PIPELINE_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+#define ARITLEX_PIPELINE_COUNT(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELAXED)
+
+typedef enum aritlex_pipeline_stage_index
+{
+  ARITLEX_PIPELINE_LEX,
+  ARITLEX_PIPELINE_COMPILE,
+  ARITLEX_PIPELINE_EVAL,
+  ARITLEX_PIPELINE_STAGES
+
+} aritlex_pipeline_stage_index;
+
+/* code must be NUL terminated. code and bindings must stay valid until the result is polled. */
+typedef struct aritlex_pipeline_request
+{
+  u32 id;
+  s8 *code;
+  aritlex_binding *bindings; /* every variable of the expression must be bound */
+  u32 bindings_size;
+
+} aritlex_pipeline_request;
+
+typedef struct aritlex_pipeline_result
+{
+  u32 id;
+  u32 ok; /* 0 if the expression was too long, did not tokenize, compile or had unbound variables */
+  aritlex_value value;
+
+} aritlex_pipeline_result;
+
+typedef struct aritlex_pipeline_lexed
+{
+  aritlex_pipeline_request request;
+  aritlex_token tokens[ARITLEX_PIPELINE_TOKENS_CAPACITY];
+  u32 tokens_size;
+  u32 ok;
+
+} aritlex_pipeline_lexed;
+
+typedef struct aritlex_pipeline_compiled
+{
+  aritlex_pipeline_request request;
+  aritlex_program program;
+  u32 ok;
+
+} aritlex_pipeline_compiled;
+
+/* Indices run freely and are masked on access, tail - head is the fill level */
+typedef struct aritlex_pipeline_ring
+{
+  u32 head;        /* written by the consumer */
+  u32 tail_cached; /* consumer's copy of tail */
+  u8 consumer_pad[ARITLEX_PIPELINE_CACHE_LINE - 2 * sizeof(u32)];
+  u32 tail;        /* written by the producer */
+  u32 head_cached; /* producer's copy of head */
+  u8 producer_pad[ARITLEX_PIPELINE_CACHE_LINE - 2 * sizeof(u32)];
+
+} aritlex_pipeline_ring;
+
+/* Read them with aritlex_pipeline_stats_get while the pipeline runs */
+typedef struct aritlex_pipeline_stats
+{
+  u32 items;
+  u32 batches;
+  u32 stalls_empty; /* wait episodes on an empty input ring */
+  u32 stalls_full;  /* wait episodes on a full output ring */
+  u32 depth_max;    /* largest input fill level seen at a batch */
+  u64 depth_sum;    /* depth_sum / batches is the average input fill level */
+
+} aritlex_pipeline_stats;
+
+struct aritlex_pipeline;
+
+typedef struct aritlex_pipeline_stage
+{
+  struct aritlex_pipeline *pipeline;
+  pthread_t thread;
+  aritlex_pipeline_stage_index index;
+  aritlex_pipeline_stats stats;
+  u8 pad[ARITLEX_PIPELINE_CACHE_LINE]; /* keeps the counters of neighbouring stages apart */
+
+} aritlex_pipeline_stage;
+
+/* Large (about 1 MB with the default capacities), allocate it statically or on the heap */
+typedef struct aritlex_pipeline
+{
+  aritlex_pipeline_ring rings[ARITLEX_PIPELINE_STAGES + 1]; /* stage i reads ring i and writes ring i + 1 */
+  aritlex_pipeline_stage stages[ARITLEX_PIPELINE_STAGES];
+  u32 stages_size; /* threads started */
+  u32 running;
+
+  aritlex_pipeline_request requests[ARITLEX_PIPELINE_CAPACITY];
+  aritlex_pipeline_lexed lexed[ARITLEX_PIPELINE_CAPACITY];
+  aritlex_pipeline_compiled compiled[ARITLEX_PIPELINE_CAPACITY];
+  aritlex_pipeline_result results[ARITLEX_PIPELINE_CAPACITY];
+
+} aritlex_pipeline;
+
+/* Items the consumer can read. The tail is reloaded once per call, which is once per batch. */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_pipeline_readable(aritlex_pipeline_ring *ring)
+{
+  ring->tail_cached = ARITLEX_PIPELINE_LOAD(ring->tail);
+  return ring->tail_cached - ring->head;
+}
+
+/* Free slots for the producer. The head is only reloaded when the cached copy shows less than a batch. */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_pipeline_writable(aritlex_pipeline_ring *ring)
+{
+  u32 space = ARITLEX_PIPELINE_CAPACITY - (ring->tail - ring->head_cached);
+
+  if (space < ARITLEX_PIPELINE_BATCH)
+  {
+    ring->head_cached = ARITLEX_PIPELINE_LOAD(ring->head);
+    space = ARITLEX_PIPELINE_CAPACITY - (ring->tail - ring->head_cached);
+  }
+
+  return space;
+}
+
+ARITLEX_API ARITLEX_INLINE void aritlex_pipeline_bind(aritlex_pipeline_compiled *in, aritlex_pipeline_result *out)
+{
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  u8 bound[ARITLEX_VARS_CAPACITY];
+  u32 i;
+
+  out->id = in->request.id;
+  out->ok = in->ok;
+  out->value.type = ARITLEX_TYPE_F64;
+  out->value.val.number_floating = 0.0;
+
+  if (!out->ok)
+  {
+    return;
+  }
+
+  aritlex_specialize_slots(&in->program, in->request.bindings, in->request.bindings_size, bound, vars);
+
+  for (i = 0; i < in->program.vars_size; ++i)
+  {
+    out->ok &= bound[i];
+  }
+
+  if (out->ok)
+  {
+    out->value = aritlex_eval_value(&in->program, vars);
+  }
+}
+
+/* Runs one item of stage from input slot read to output slot write */
+ARITLEX_API ARITLEX_INLINE void aritlex_pipeline_process(aritlex_pipeline *pipeline, aritlex_pipeline_stage_index stage, u32 read, u32 write)
+{
+  read &= ARITLEX_PIPELINE_CAPACITY - 1;
+  write &= ARITLEX_PIPELINE_CAPACITY - 1;
+
+  switch (stage)
+  {
+  case ARITLEX_PIPELINE_LEX:
+  {
+    aritlex_pipeline_request *in = &pipeline->requests[read];
+    aritlex_pipeline_lexed *out = &pipeline->lexed[write];
+    u32 code_size = aritlex_strlen(in->code);
+
+    out->request = *in;
+    out->tokens_size = 0;
+
+    /* aritlex_tokenize does not bound its writes by the capacity, the length does */
+    out->ok = code_size < ARITLEX_PIPELINE_TOKENS_CAPACITY &&
+              aritlex_tokenize(in->code, code_size, out->tokens, ARITLEX_PIPELINE_TOKENS_CAPACITY, &out->tokens_size);
+    break;
+  }
+  case ARITLEX_PIPELINE_COMPILE:
+  {
+    aritlex_pipeline_lexed *in = &pipeline->lexed[read];
+    aritlex_pipeline_compiled *out = &pipeline->compiled[write];
+
+    out->request = in->request;
+    out->ok = in->ok && aritlex_compile(in->tokens, in->tokens_size, &out->program);
+    break;
+  }
+  default:
+    aritlex_pipeline_bind(&pipeline->compiled[read], &pipeline->results[write]);
+    break;
+  }
+}
+
+ARITLEX_API ARITLEX_INLINE void *aritlex_pipeline_thread(void *argument)
+{
+  aritlex_pipeline_stage *stage = (aritlex_pipeline_stage *)argument;
+  aritlex_pipeline_stats *stats = &stage->stats;
+  aritlex_pipeline_ring *in = &stage->pipeline->rings[stage->index];
+  aritlex_pipeline_ring *out = &stage->pipeline->rings[stage->index + 1];
+  u32 waiting_empty = 0, waiting_full = 0, idle = 0;
+
+  while (__atomic_load_n(&stage->pipeline->running, __ATOMIC_RELAXED))
+  {
+    u32 depth = aritlex_pipeline_readable(in);
+    u32 n = depth < ARITLEX_PIPELINE_BATCH ? depth : ARITLEX_PIPELINE_BATCH;
+    u32 space = n ? aritlex_pipeline_writable(out) : 0;
+    u32 i;
+
+    if (n == 0 || space == 0)
+    {
+      if (n == 0 && !waiting_empty)
+      {
+        ARITLEX_PIPELINE_COUNT(stats->stalls_empty, stats->stalls_empty + 1);
+      }
+      else if (n != 0 && !waiting_full)
+      {
+        ARITLEX_PIPELINE_COUNT(stats->stalls_full, stats->stalls_full + 1);
+      }
+
+      waiting_empty = n == 0;
+      waiting_full = n != 0;
+
+      if (++idle >= ARITLEX_PIPELINE_SPIN)
+      {
+        idle = 0;
+        sched_yield();
+      }
+
+      continue;
+    }
+
+    waiting_empty = waiting_full = 0;
+    idle = 0;
+    n = n < space ? n : space;
+
+    for (i = 0; i < n; ++i)
+    {
+      aritlex_pipeline_process(stage->pipeline, stage->index, in->head + i, out->tail + i);
+    }
+
+    ARITLEX_PIPELINE_STORE(in->head, in->head + n);
+    ARITLEX_PIPELINE_STORE(out->tail, out->tail + n);
+
+    ARITLEX_PIPELINE_COUNT(stats->items, stats->items + n);
+    ARITLEX_PIPELINE_COUNT(stats->batches, stats->batches + 1);
+    ARITLEX_PIPELINE_COUNT(stats->depth_sum, stats->depth_sum + depth);
+    ARITLEX_PIPELINE_COUNT(stats->depth_max, depth > stats->depth_max ? depth : stats->depth_max);
+  }
+
+  return 0;
+}
+
+ARITLEX_API ARITLEX_INLINE u32 aritlex_pipeline_init(aritlex_pipeline *pipeline)
+{
+  u32 i;
+
+  if (!pipeline || (ARITLEX_PIPELINE_CAPACITY & (ARITLEX_PIPELINE_CAPACITY - 1)) != 0)
+  {
+    return 0;
+  }
+
+  for (i = 0; i <= ARITLEX_PIPELINE_STAGES; ++i)
+  {
+    aritlex_pipeline_ring *ring = &pipeline->rings[i];
+
+    ring->head = ring->tail_cached = 0;
+    ring->tail = ring->head_cached = 0;
+  }
+
+  pipeline->running = 1;
+  pipeline->stages_size = 0;
+
+  for (i = 0; i < ARITLEX_PIPELINE_STAGES; ++i)
+  {
+    aritlex_pipeline_stage *stage = &pipeline->stages[i];
+    aritlex_pipeline_stats empty = {0};
+
+    stage->pipeline = pipeline;
+    stage->index = (aritlex_pipeline_stage_index)i;
+    stage->stats = empty;
+  }
+
+  for (i = 0; i < ARITLEX_PIPELINE_STAGES; ++i)
+  {
+    if (pthread_create(&pipeline->stages[i].thread, 0, aritlex_pipeline_thread, &pipeline->stages[i]) != 0)
+    {
+      break;
+    }
+
+    pipeline->stages_size++;
+  }
+
+  if (pipeline->stages_size != ARITLEX_PIPELINE_STAGES)
+  {
+    __atomic_store_n(&pipeline->running, 0, __ATOMIC_RELAXED);
+
+    for (i = 0; i < pipeline->stages_size; ++i)
+    {
+      pthread_join(pipeline->stages[i].thread, 0);
+    }
+
+    return 0;
+  }
+
+  return 1;
+}
+
+/* Enqueues up to requests_size requests and returns how many were taken (fewer if the input ring is full) */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_pipeline_submit(aritlex_pipeline *pipeline, aritlex_pipeline_request *requests, u32 requests_size)
+{
+  aritlex_pipeline_ring *ring = &pipeline->rings[ARITLEX_PIPELINE_LEX];
+  u32 space = aritlex_pipeline_writable(ring);
+  u32 n = requests_size < space ? requests_size : space;
+  u32 i;
+
+  for (i = 0; i < n; ++i)
+  {
+    pipeline->requests[(ring->tail + i) & (ARITLEX_PIPELINE_CAPACITY - 1)] = requests[i];
+  }
+
+  ARITLEX_PIPELINE_STORE(ring->tail, ring->tail + n);
+
+  return n;
+}
+
+/* Dequeues up to results_capacity finished results in submission order and returns how many */
+ARITLEX_API ARITLEX_INLINE u32 aritlex_pipeline_poll(aritlex_pipeline *pipeline, aritlex_pipeline_result *results, u32 results_capacity)
+{
+  aritlex_pipeline_ring *ring = &pipeline->rings[ARITLEX_PIPELINE_STAGES];
+  u32 ready = aritlex_pipeline_readable(ring);
+  u32 n = results_capacity < ready ? results_capacity : ready;
+  u32 i;
+
+  for (i = 0; i < n; ++i)
+  {
+    results[i] = pipeline->results[(ring->head + i) & (ARITLEX_PIPELINE_CAPACITY - 1)];
+  }
+
+  ARITLEX_PIPELINE_STORE(ring->head, ring->head + n);
+
+  return n;
+}
+
+/* Snapshot of the counters of one stage, safe to call while the pipeline runs */
+ARITLEX_API ARITLEX_INLINE void aritlex_pipeline_stats_get(aritlex_pipeline *pipeline, aritlex_pipeline_stage_index stage, aritlex_pipeline_stats *stats)
+{
+  aritlex_pipeline_stats *counters = &pipeline->stages[stage].stats;
+
+  stats->items = __atomic_load_n(&counters->items, __ATOMIC_RELAXED);
+  stats->batches = __atomic_load_n(&counters->batches, __ATOMIC_RELAXED);
+  stats->stalls_empty = __atomic_load_n(&counters->stalls_empty, __ATOMIC_RELAXED);
+  stats->stalls_full = __atomic_load_n(&counters->stalls_full, __ATOMIC_RELAXED);
+  stats->depth_max = __atomic_load_n(&counters->depth_max, __ATOMIC_RELAXED);
+  stats->depth_sum = __atomic_load_n(&counters->depth_sum, __ATOMIC_RELAXED);
+}
+
+/* Stops and joins the stage threads. Items still in flight are dropped. */
+ARITLEX_API ARITLEX_INLINE void aritlex_pipeline_free(aritlex_pipeline *pipeline)
+{
+  u32 i;
+
+  __atomic_store_n(&pipeline->running, 0, __ATOMIC_RELAXED);
+
+  for (i = 0; i < pipeline->stages_size; ++i)
+  {
+    pthread_join(pipeline->stages[i].thread, 0);
+  }
+
+  pipeline->stages_size = 0;
+}
+#endif /* __GNUC__ || __clang__ */
+#endif /* ARITLEX_THREADS_ENABLE */
+
 #endif /* ARITLEX_H */
 
 /*
@@ -2,6 +2,8 @@
 
 A C89 standard compliant, single header, nostdlib (no C Standard Library) simple performance profiler.
 
+Forked for aritlex with local extensions, see deps/README.md before updating it from upstream.
+
 LICENSE
 
   Placed in the public domain and also MIT licensed.
@@ -30,6 +32,35 @@ LICENSE
 #define PERF_API static
 #endif
 
+/* Thread local storage, a spin lock and an atomic increment (yields the previous value)
+ * for the per thread counters, the stats contexts and the trace ring */
+#if defined(__GNUC__) || defined(__clang__)
+#define PERF_THREAD_LOCAL __thread
+#define PERF_FETCH_INCREMENT(counter) __sync_fetch_and_add(&counter, 1L)
+#define PERF_LOCK(lock)                        \
+    while (__sync_lock_test_and_set(&lock, 1)) \
+    {                                          \
+    }
+#define PERF_UNLOCK(lock) __sync_lock_release(&lock)
+#elif defined(_MSC_VER)
+long _InterlockedExchange(long volatile *target, long value);
+long _InterlockedExchangeAdd(long volatile *target, long value);
+#pragma intrinsic(_InterlockedExchange)
+#pragma intrinsic(_InterlockedExchangeAdd)
+#define PERF_THREAD_LOCAL __declspec(thread)
+#define PERF_FETCH_INCREMENT(counter) _InterlockedExchangeAdd(&counter, 1L)
+#define PERF_LOCK(lock)                      \
+    while (_InterlockedExchange(&lock, 1))   \
+    {                                        \
+    }
+#define PERF_UNLOCK(lock) _InterlockedExchange(&lock, 0)
+#else
+#define PERF_THREAD_LOCAL /* single threaded, or explicit contexts only */
+#define PERF_FETCH_INCREMENT(counter) (counter)++
+#define PERF_LOCK(lock)
+#define PERF_UNLOCK(lock)
+#endif
+
 PERF_API PERF_INLINE unsigned long perf_strlen(char *str)
 {
     char *s = str;
@@ -142,8 +173,10 @@ PERF_API PERF_INLINE void perf_platform_print(char *str)
 #define _GNU_SOURCE
 #endif
 
-#ifndef __timespec_defined
+/* glibc guards its own definition with _STRUCT_TIMESPEC, e.g. when pthread.h was included first */
+#if !defined(__timespec_defined) && !defined(_STRUCT_TIMESPEC)
 #define __timespec_defined
+#define _STRUCT_TIMESPEC
 struct timespec
 {
     long tv_sec;  /* seconds */
@@ -437,343 +470,2592 @@ PERF_API PERF_INLINE void perf_double_to_string(double value, char *buffer, unsi
 }
 
 /* #############################################################################
- * # PERF MAIN IMPLEMENTATION
+ * # MACHINE READABLE RECORDS
  * #############################################################################
+ *
+ * perf_stats_csv / perf_stats_json and perf_bench_csv / perf_bench_json write the
+ * results into a caller buffer for scripts and regression tracking. Rows are written
+ * whole: a row that does not fit is left out and the output stays well formed.
+ * Numbers are plain decimals (no padding, no exponent), text fields are quoted.
  */
-#ifndef PERF_MAX_PRINT_BUFFER
-#define PERF_MAX_PRINT_BUFFER 1024
-#endif
+typedef struct perf_record
+{
+    char *buffer;
+    unsigned long capacity; /* including the NUL */
+    unsigned long size;
+    unsigned long row;      /* size at the start of the current row */
+    int full;               /* the current row did not fit */
 
-#ifdef PERF_STATS_ENABLE
+} perf_record;
 
-#ifndef PERF_STATS_ENTRIES_MAX
-#define PERF_STATS_ENTRIES_MAX 1024 /* Max unique (file+line+name) combinations */
-#endif
+PERF_API PERF_INLINE void perf_record_init(perf_record *r, char *buffer, unsigned long capacity)
+{
+    r->buffer = buffer;
+    r->capacity = capacity;
+    r->size = 0;
+    r->row = 0;
+    r->full = capacity == 0;
 
-#ifndef PERF_STATS_NAME_MAX
-#define PERF_STATS_NAME_MAX 512
-#endif
+    if (capacity)
+    {
+        buffer[0] = '\0';
+    }
+}
 
-typedef struct perf_stats_entry
+PERF_API PERF_INLINE void perf_record_char(perf_record *r, char c)
 {
-    char file[128];                 /* File name */
-    int line;                       /* Line number */
-    char name[PERF_STATS_NAME_MAX]; /* Function or code block name */
+    if (r->full || r->size + 1 >= r->capacity)
+    {
+        r->full = 1;
+        return;
+    }
 
-    unsigned long count;
+    r->buffer[r->size++] = c;
+    r->buffer[r->size] = '\0';
+}
 
-    unsigned long cycles_min;
-    unsigned long cycles_max;
-    unsigned long cycles_sum;
+PERF_API PERF_INLINE void perf_record_text(perf_record *r, char *text)
+{
+    while (*text)
+    {
+        perf_record_char(r, *text++);
+    }
+}
 
-    double time_ms_min;
-    double time_ms_max;
-    double time_ms_sum;
+/* text in double quotes, escaped for JSON (backslash) or CSV (doubled quote) */
+PERF_API PERF_INLINE void perf_record_quoted(perf_record *r, char *text, int json)
+{
+    perf_record_char(r, '"');
 
-} perf_stats_entry;
+    for (; *text; ++text)
+    {
+        if (*text == '"')
+        {
+            perf_record_char(r, json ? '\\' : '"');
+        }
+        else if (*text == '\\' && json)
+        {
+            perf_record_char(r, '\\');
+        }
 
-static perf_stats_entry perf_stats_entries[PERF_STATS_ENTRIES_MAX];
-static unsigned long perf_stats_entry_count = 0;
+        perf_record_char(r, (unsigned char)*text < ' ' ? ' ' : *text);
+    }
 
-PERF_API PERF_INLINE perf_stats_entry *perf_stats_get_entry(char *file, int line, char *name)
+    perf_record_char(r, '"');
+}
+
+PERF_API PERF_INLINE void perf_record_ulong(perf_record *r, unsigned long value)
 {
-    unsigned long i;
-    for (i = 0; i < perf_stats_entry_count; i++)
+    char digits[21];
+    unsigned long size = 0;
+
+    do
     {
-        if (perf_stats_entries[i].line == line)
-        {
-            char *f1 = perf_stats_entries[i].file;
-            char *f2 = file;
-            while (*f1 && *f2 && *f1 == *f2)
-            {
-                f1++;
-                f2++;
-            }
-            if (*f1 == '\0' && *f2 == '\0')
-            {
-                /* Now check name */
-                char *n1 = perf_stats_entries[i].name;
-                char *n2 = name;
-                while (*n1 && *n2 && *n1 == *n2)
-                {
-                    n1++;
-                    n2++;
-                }
-                if (*n1 == '\0' && *n2 == '\0')
-                {
-                    return &perf_stats_entries[i];
-                }
-            }
-        }
+        digits[size++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+
+    while (size)
+    {
+        perf_record_char(r, digits[--size]);
     }
+}
 
-    /* If not found, create a new entry */
-    if (perf_stats_entry_count < PERF_STATS_ENTRIES_MAX)
+/* value rounded to precision (at most 9) fraction digits */
+PERF_API PERF_INLINE void perf_record_double(perf_record *r, double value, int precision)
+{
+    double scale = 1.0;
+    unsigned long integer, fraction;
+    int i;
+
+    if (value != value)
     {
-        perf_stats_entry *e = &perf_stats_entries[perf_stats_entry_count++];
-        unsigned long j = 0;
+        perf_record_text(r, "0"); /* NaN */
+        return;
+    }
 
-        /* Copy file */
-        while (file[j] && j < sizeof(e->file) - 1)
+    if (value < 0.0)
+    {
+        perf_record_char(r, '-');
+        value = -value;
+    }
+
+    precision = precision < 0 ? 0 : (precision > 9 ? 9 : precision);
+
+    for (i = 0; i < precision; ++i)
+    {
+        scale *= 10.0;
+    }
+
+    value = value * scale + 0.5;
+    value = value < 1.8e19 ? value : 1.8e19;
+    integer = (unsigned long)(value / scale);
+    fraction = (unsigned long)(value - (double)integer * scale);
+    fraction = fraction < (unsigned long)scale ? fraction : (unsigned long)scale - 1;
+
+    perf_record_ulong(r, integer);
+
+    if (precision)
+    {
+        char digits[9];
+
+        perf_record_char(r, '.');
+
+        for (i = precision - 1; i >= 0; --i)
         {
-            e->file[j] = file[j];
-            j++;
+            digits[i] = (char)('0' + fraction % 10);
+            fraction /= 10;
         }
-        e->file[j] = '\0';
 
-        /* Copy name */
-        j = 0;
-        while (name[j] && j < PERF_STATS_NAME_MAX - 1)
+        for (i = 0; i < precision; ++i)
         {
-            e->name[j] = name[j];
-            j++;
+            perf_record_char(r, digits[i]);
         }
+    }
+}
 
-        e->name[j] = '\0';
-
-        e->line = line;
-        e->count = 0;
+PERF_API PERF_INLINE void perf_record_row_begin(perf_record *r)
+{
+    r->row = r->size;
+    r->full = 0;
+}
 
-        e->cycles_min = ~0UL; /* Max unsigned long */
-        e->cycles_max = 0;
-        e->cycles_sum = 0;
+/* Drops the row if it did not fit, returns 1 if it was kept */
+PERF_API PERF_INLINE int perf_record_row_end(perf_record *r)
+{
+    if (r->full)
+    {
+        r->size = r->row;
 
-        e->time_ms_min = 1e30; /* Huge number */
-        e->time_ms_max = 0.0;
-        e->time_ms_sum = 0.0;
+        if (r->capacity)
+        {
+            r->buffer[r->size] = '\0';
+        }
 
-        return e;
+        return 0;
     }
 
-    return 0; /* No space */
+    return 1;
 }
 
-PERF_API PERF_INLINE void perf_stats_store_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+/* #############################################################################
+ * # HISTOGRAM
+ * #############################################################################
+ *
+ * Fixed memory, log bucketed histogram (in the spirit of HdrHistogram) for cycle
+ * counts. Values below 2 * PERF_HISTOGRAM_SUB_BUCKETS have a bucket of their own,
+ * every larger power of two is split into PERF_HISTOGRAM_SUB_BUCKETS equal buckets.
+ * A reported percentile is the highest value of its bucket, which is at most
+ * 1 / PERF_HISTOGRAM_SUB_BUCKETS above the recorded value (6.25% by default).
+ * Values from 2^PERF_HISTOGRAM_VALUE_BITS up (about one second of cycles with the
+ * default 32) share the last bucket, whose percentiles report the recorded max.
+ * Every stats entry embeds one histogram, 1.9 KB with the defaults, so both
+ * macros trade the accuracy of the percentiles against the size of the tables.
+ * Histograms with the same configuration merge by adding their buckets.
+ */
+#ifndef PERF_HISTOGRAM_SUB_BUCKET_BITS
+#define PERF_HISTOGRAM_SUB_BUCKET_BITS 4
+#endif
+
+#ifndef PERF_HISTOGRAM_VALUE_BITS
+#define PERF_HISTOGRAM_VALUE_BITS 32
+#endif
+
+#define PERF_HISTOGRAM_SUB_BUCKETS (1UL << PERF_HISTOGRAM_SUB_BUCKET_BITS)
+#define PERF_HISTOGRAM_BUCKETS ((PERF_HISTOGRAM_VALUE_BITS - PERF_HISTOGRAM_SUB_BUCKET_BITS + 1) * PERF_HISTOGRAM_SUB_BUCKETS)
+
+typedef struct perf_histogram
 {
-    perf_stats_entry *e = perf_stats_get_entry(file, line, name);
+    unsigned long count;
+    unsigned long max;
+    unsigned int buckets[PERF_HISTOGRAM_BUCKETS];
 
-    if (!e)
+} perf_histogram;
+
+PERF_API PERF_INLINE void perf_histogram_reset(perf_histogram *h)
+{
+    unsigned long i;
+
+    h->count = 0;
+    h->max = 0;
+
+    for (i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
     {
-        return; /* Out of slots */
+        h->buckets[i] = 0;
     }
+}
 
-    e->count++;
-    e->cycles_sum += cycles;
-    e->time_ms_sum += time_ms;
+PERF_API PERF_INLINE unsigned long perf_histogram_index(unsigned long value)
+{
+    unsigned long magnitude = 0;
 
-    if (cycles < e->cycles_min)
+    if (value < PERF_HISTOGRAM_SUB_BUCKETS)
     {
-        e->cycles_min = cycles;
+        return value;
     }
-    if (cycles > e->cycles_max)
+
+#if defined(__GNUC__) || defined(__clang__)
+    magnitude = (unsigned long)(sizeof(unsigned long) * 8 - 1) - (unsigned long)__builtin_clzl(value);
+#else
     {
-        e->cycles_max = cycles;
+        unsigned long v = value;
+
+        while (v >>= 1)
+        {
+            magnitude++;
+        }
     }
-    if (time_ms < e->time_ms_min)
+#endif
+
+    if (magnitude >= PERF_HISTOGRAM_VALUE_BITS)
     {
-        e->time_ms_min = time_ms;
+        return PERF_HISTOGRAM_BUCKETS - 1;
     }
-    if (time_ms > e->time_ms_max)
+
+    return (magnitude - PERF_HISTOGRAM_SUB_BUCKET_BITS + 1) * PERF_HISTOGRAM_SUB_BUCKETS +
+           ((value >> (magnitude - PERF_HISTOGRAM_SUB_BUCKET_BITS)) & (PERF_HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+/* Highest value that falls into bucket index */
+PERF_API PERF_INLINE unsigned long perf_histogram_highest(unsigned long index)
+{
+    unsigned long shift;
+
+    if (index < 2 * PERF_HISTOGRAM_SUB_BUCKETS)
     {
-        e->time_ms_max = time_ms;
+        return index;
+    }
+
+    if (index >= PERF_HISTOGRAM_BUCKETS - 1)
+    {
+        return ~0UL;
     }
+
+    shift = index / PERF_HISTOGRAM_SUB_BUCKETS - 1;
+
+    return ((PERF_HISTOGRAM_SUB_BUCKETS + index % PERF_HISTOGRAM_SUB_BUCKETS) << shift) + ((1UL << shift) - 1);
 }
 
-PERF_API PERF_INLINE void perf_print_stats(void)
+PERF_API PERF_INLINE void perf_histogram_record(perf_histogram *h, unsigned long value)
+{
+    h->count++;
+    h->buckets[perf_histogram_index(value)]++;
+
+    if (value > h->max)
+    {
+        h->max = value;
+    }
+}
+
+PERF_API PERF_INLINE void perf_histogram_merge(perf_histogram *dst, perf_histogram *src)
 {
     unsigned long i;
 
-    char buffer[PERF_MAX_PRINT_BUFFER];
+    dst->count += src->count;
 
-    for (i = 0; i < perf_stats_entry_count; ++i)
+    if (src->max > dst->max)
     {
-        unsigned long current_pos = 0;
+        dst->max = src->max;
+    }
 
-        perf_stats_entry *e = &perf_stats_entries[i];
-        unsigned long avg_cycles = e->count ? e->cycles_sum / e->count : 0;
-        double avg_time_ms = e->count ? (e->time_ms_sum / (double)e->count) : 0.0;
+    for (i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
+    {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
 
-        char line_str[5];
-        char count_str[7];
+/* Value below which percentile (0 - 100) percent of the recorded values are, 0 if empty */
+PERF_API PERF_INLINE unsigned long perf_histogram_percentile(perf_histogram *h, double percentile)
+{
+    double rank = (double)h->count * percentile / 100.0;
+    unsigned long target = (unsigned long)rank;
+    unsigned long seen = 0;
+    unsigned long i;
 
-        char cycles_min[12];
-        char cycles_max[12];
-        char cycles_avg[12];
-        char cycles_sum[12];
+    if (h->count == 0)
+    {
+        return 0;
+    }
 
-        char time_min[12];
-        char time_max[12];
-        char time_avg[12];
-        char time_sum[12];
+    target += (double)target < rank; /* nearest rank, rounded up */
+    target = target < 1 ? 1 : (target > h->count ? h->count : target);
 
-        perf_int_to_string(e->line, line_str, sizeof(line_str));
-        perf_ulong_to_string(e->count, count_str, sizeof(count_str));
+    for (i = 0; i < PERF_HISTOGRAM_BUCKETS; ++i)
+    {
+        seen += h->buckets[i];
 
-        perf_ulong_to_string(e->cycles_min, cycles_min, sizeof(cycles_min));
-        perf_ulong_to_string(e->cycles_max, cycles_max, sizeof(cycles_max));
-        perf_ulong_to_string(avg_cycles, cycles_avg, sizeof(cycles_avg));
-        perf_ulong_to_string(e->cycles_sum, cycles_sum, sizeof(cycles_sum));
+        if (seen >= target)
+        {
+            unsigned long highest = perf_histogram_highest(i);
+            return highest < h->max ? highest : h->max;
+        }
+    }
 
-        perf_double_to_string(e->time_ms_min, time_min, sizeof(time_min), 4);
-        perf_double_to_string(e->time_ms_max, time_max, sizeof(time_max), 4);
-        perf_double_to_string(avg_time_ms, time_avg, sizeof(time_avg), 4);
-        perf_double_to_string(e->time_ms_sum, time_sum, sizeof(time_sum), 4);
+    return h->max;
+}
 
-        if (i == 0)
-        {
-            buffer[0] = '\0';
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf]\n");
+/* #############################################################################
+ * # HARDWARE COUNTERS
+ * #############################################################################
+ *
+ * With PERF_COUNTERS_ENABLE on Linux every PERF_PROFILE region also records the
+ * deltas of a group of perf_event counters: instructions, branch misses, cache
+ * misses and task-clock (ns). The events are opened through the raw syscall on the
+ * first profiled region of a thread (they count the calling thread, user space only
+ * so perf_event_paranoid 2 is enough) and read with one group read before and after
+ * the region. task-clock is a software event and gets a group (and a read) of its
+ * own next to the hardware one. Where the hardware events are unavailable, e.g. in
+ * most VMs, the group falls back to the software events task-clock, page-faults,
+ * context-switches and cpu-migrations. The reads are syscalls, so regions shorter
+ * than a few microseconds are dominated by them, the rdtsc cycles are taken inside
+ * and stay unaffected. perf_stats_thread_end closes the events of the thread. The
+ * syscall numbers are known for x86_64, i386, aarch64 and arm (or taken from
+ * sys/syscall.h if it was included), elsewhere the counters stay zero.
+ */
+#define PERF_COUNTERS_MAX 4
 
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------------------------------------------------+-------------------------------------------------------+\n");
+typedef struct perf_counters
+{
+    unsigned long values[PERF_COUNTERS_MAX];
 
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] | cylces                                                | time_ms                                               |\n");
+} perf_counters;
 
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
+typedef enum perf_counters_set
+{
+    PERF_COUNTERS_NONE = 0, /* not opened yet */
+    PERF_COUNTERS_UNAVAILABLE,
+    PERF_COUNTERS_HARDWARE,
+    PERF_COUNTERS_SOFTWARE
+
+} perf_counters_set;
+
+#if defined(PERF_COUNTERS_ENABLE) && defined(__linux__) && !defined(SYS_perf_event_open)
+#if defined(__x86_64__) && !defined(__ILP32__)
+#define SYS_perf_event_open 298
+#define SYS_read 0
+#define SYS_close 3
+#elif defined(__i386__)
+#define SYS_perf_event_open 336
+#define SYS_read 3
+#define SYS_close 6
+#elif defined(__aarch64__)
+#define SYS_perf_event_open 241
+#define SYS_read 63
+#define SYS_close 57
+#elif defined(__arm__)
+#define SYS_perf_event_open 364
+#define SYS_read 3
+#define SYS_close 6
+#endif
+#endif
 
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] |         min |         max |         avg |         sum |         min |         max |         avg |         sum |\n");
+#if defined(PERF_COUNTERS_ENABLE) && defined(__linux__) && defined(SYS_perf_event_open)
+#define PERF_COUNTERS_LINUX
 
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
-            current_pos = 0;
-            perf_platform_print(buffer);
-        }
+#define PERF_EVENT_TYPE_HARDWARE 0
+#define PERF_EVENT_TYPE_SOFTWARE 1
+#define PERF_EVENT_FORMAT_GROUP (1UL << 3)
+#define PERF_EVENT_EXCLUDE_KERNEL (1UL << 5)
+#define PERF_EVENT_EXCLUDE_HV (1UL << 6)
 
-        buffer[0] = '\0';
+/* First PERF_ATTR_SIZE_VER0 (64) bytes of struct perf_event_attr, the kernel zero extends it */
+typedef struct perf_event_attr_v0
+{
+    unsigned int type;
+    unsigned int size;
+    unsigned long config;
+    unsigned long sample_period;
+    unsigned long sample_type;
+    unsigned long read_format;
+    unsigned long flags; /* disabled, inherit, pinned, exclusive, exclude_user, exclude_kernel, ... bits */
+    unsigned int wakeup_events;
+    unsigned int bp_type;
+    unsigned long config1;
+
+} perf_event_attr_v0;
+
+typedef struct perf_counters_state
+{
+    perf_counters_set set;
+    int fds[PERF_COUNTERS_MAX];     /* -1 if not open */
+    int leaders[PERF_COUNTERS_MAX]; /* 1 if fds[i] leads a group of the events up to the next leader */
 
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_min);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_max);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_avg);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_sum);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_min);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_max);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_avg);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_sum);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, count_str);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " x ");
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->name);
-        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n");
-        current_pos = 0;
+} perf_counters_state;
 
-        perf_platform_print(buffer);
+static PERF_THREAD_LOCAL perf_counters_state perf_counters_thread = {PERF_COUNTERS_NONE, {-1, -1, -1, -1}, {0, 0, 0, 0}};
 
-        if (i == perf_stats_entry_count - 1)
+PERF_API PERF_INLINE void perf_counters_close(void)
+{
+    unsigned long i;
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        if (perf_counters_thread.fds[i] >= 0)
+        {
+            syscall(SYS_close, perf_counters_thread.fds[i]);
+        }
+
+        perf_counters_thread.fds[i] = -1;
+    }
+
+    perf_counters_thread.set = PERF_COUNTERS_NONE;
+}
+
+/* Opens every event of set as one group, 0 (and nothing left open) if one of them is unavailable */
+PERF_API PERF_INLINE int perf_counters_open_set(perf_counters_set set)
+{
+    /* (type, config) per slot of the hardware and the software set */
+    static unsigned int events[2][PERF_COUNTERS_MAX][2] = {
+        {{PERF_EVENT_TYPE_HARDWARE, 1}, {PERF_EVENT_TYPE_HARDWARE, 5}, {PERF_EVENT_TYPE_HARDWARE, 3}, {PERF_EVENT_TYPE_SOFTWARE, 1}},
+        {{PERF_EVENT_TYPE_SOFTWARE, 1}, {PERF_EVENT_TYPE_SOFTWARE, 2}, {PERF_EVENT_TYPE_SOFTWARE, 3}, {PERF_EVENT_TYPE_SOFTWARE, 4}}};
+
+    unsigned int(*event)[2] = events[set - PERF_COUNTERS_HARDWARE];
+    long leader = -1;
+    unsigned long i;
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        perf_event_attr_v0 attr = {0};
+        long fd;
+
+        attr.type = event[i][0];
+        attr.size = sizeof(attr);
+        attr.config = event[i][1];
+        attr.read_format = PERF_EVENT_FORMAT_GROUP;
+        attr.flags = PERF_EVENT_EXCLUDE_KERNEL | PERF_EVENT_EXCLUDE_HV;
+
+        /* A new group starts where the event type changes, software events stay out of hardware groups */
+        perf_counters_thread.leaders[i] = i == 0 || event[i][0] != event[i - 1][0];
+
+        /* this thread, any cpu */
+        fd = syscall(SYS_perf_event_open, &attr, 0L, -1L, perf_counters_thread.leaders[i] ? -1L : leader, 0UL);
+
+        if (fd < 0)
+        {
+            perf_counters_close();
+            return 0;
+        }
+
+        perf_counters_thread.fds[i] = (int)fd;
+        leader = perf_counters_thread.leaders[i] ? fd : leader;
+    }
+
+    perf_counters_thread.set = set;
+
+    return 1;
+}
+
+/* Set of counters the calling thread records, opened on first use */
+PERF_API PERF_INLINE perf_counters_set perf_counters_open(void)
+{
+    if (perf_counters_thread.set == PERF_COUNTERS_NONE &&
+        !perf_counters_open_set(PERF_COUNTERS_HARDWARE) &&
+        !perf_counters_open_set(PERF_COUNTERS_SOFTWARE))
+    {
+        perf_counters_thread.set = PERF_COUNTERS_UNAVAILABLE;
+    }
+
+    return perf_counters_thread.set;
+}
+
+PERF_API PERF_INLINE char *perf_counters_name(perf_counters_set set, unsigned long index)
+{
+    static char *names[2][PERF_COUNTERS_MAX] = {
+        {"instructions", "branch-misses", "cache-misses", "task-clock ns"},
+        {"task-clock ns", "page-faults", "context-switches", "cpu-migrations"}};
+
+    return set >= PERF_COUNTERS_HARDWARE ? names[set - PERF_COUNTERS_HARDWARE][index] : "";
+}
+
+/* Column headers of the stats table, 16 characters wide */
+PERF_API PERF_INLINE char *perf_counters_header(perf_counters_set set)
+{
+    static char *headers[2] = {
+        "    instructions |    branch-misses |     cache-misses |    task-clock ns |",
+        "   task-clock ns |      page-faults | context-switches |   cpu-migrations |"};
+
+    return set >= PERF_COUNTERS_HARDWARE ? headers[set - PERF_COUNTERS_HARDWARE] : "";
+}
+
+/* Current values of the counters of the calling thread, zero if they are unavailable */
+PERF_API PERF_INLINE void perf_counters_read(perf_counters *counters)
+{
+    unsigned long group[1 + PERF_COUNTERS_MAX]; /* nr, values[nr] */
+    int available = perf_counters_open() >= PERF_COUNTERS_HARDWARE;
+    unsigned long i, j;
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        counters->values[i] = 0;
+    }
+
+    /* One group read per leader, its values fill the slots from the leader on */
+    for (i = 0; available && i < PERF_COUNTERS_MAX; ++i)
+    {
+        long size;
+
+        if (!perf_counters_thread.leaders[i])
+        {
+            continue;
+        }
+
+        size = syscall(SYS_read, perf_counters_thread.fds[i], group, sizeof(group));
+
+        if (size < (long)(2 * sizeof(group[0])) || group[0] > PERF_COUNTERS_MAX - i ||
+            size != (long)((1 + group[0]) * sizeof(group[0])))
+        {
+            continue;
+        }
+
+        for (j = 0; j < group[0]; ++j)
+        {
+            counters->values[i + j] = group[1 + j];
+        }
+    }
+}
+
+PERF_API PERF_INLINE void perf_counters_begin(perf_counters *counters)
+{
+    perf_counters_read(counters);
+}
+
+/* Turns the values perf_counters_begin stored into the deltas since */
+PERF_API PERF_INLINE void perf_counters_end(perf_counters *counters)
+{
+    perf_counters now;
+    unsigned long i;
+
+    perf_counters_read(&now);
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        counters->values[i] = now.values[i] - counters->values[i];
+    }
+}
+
+#else
+PERF_API PERF_INLINE void perf_counters_begin(perf_counters *counters)
+{
+    unsigned long i;
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        counters->values[i] = 0;
+    }
+}
+
+PERF_API PERF_INLINE void perf_counters_end(perf_counters *counters)
+{
+    (void)counters;
+}
+#endif /* PERF_COUNTERS_LINUX */
+
+/* #############################################################################
+ * # TRACE
+ * #############################################################################
+ *
+ * With PERF_TRACE_ENABLE, PERF_TRACE_BEGIN(name) and PERF_TRACE_END(name) mark zones
+ * that may nest and may be recorded from several threads. Each marker is one event in
+ * a fixed ring of PERF_TRACE_CAPACITY events: an rdtsc, one atomic increment and four
+ * stores, no lock and no syscall after the first event of a thread. Names are not
+ * copied, pass string literals. Once the ring is full the oldest events are
+ * overwritten, so a long running process keeps its most recent timeline.
+ *
+ * perf_trace_json formats the ring as Chrome trace JSON (chrome://tracing or
+ * ui.perfetto.dev). Cycles become microseconds through the rate measured between
+ * perf_trace_reset and the dump. Dump while no thread is recording.
+ */
+#ifdef PERF_TRACE_ENABLE
+
+#ifndef PERF_TRACE_CAPACITY
+#define PERF_TRACE_CAPACITY 65536 /* events, power of two */
+#endif
+
+#ifndef PERF_TRACE_NAME_MAX
+#define PERF_TRACE_NAME_MAX 128 /* longer names are cut in the JSON */
+#endif
+
+typedef struct perf_trace_event
+{
+    unsigned long cycles;
+    char *name;
+    unsigned long thread;
+    char phase; /* 'B' begin, 'E' end */
+
+} perf_trace_event;
+
+static perf_trace_event perf_trace_events[PERF_TRACE_CAPACITY];
+static volatile long perf_trace_count = 0; /* events recorded since perf_trace_reset */
+static unsigned long perf_trace_origin_cycles = 0;
+static double perf_trace_origin_ns = 0.0;
+static PERF_THREAD_LOCAL unsigned long perf_trace_thread = 0; /* id of the calling thread, 0 before its first event */
+
+#if defined(__linux__) && !defined(SYS_gettid)
+#define SYS_gettid 186 /* On x86_64, check for other architectures */
+#endif
+
+PERF_API PERF_INLINE unsigned long perf_trace_thread_id(void)
+{
+#ifdef __linux__
+    return (unsigned long)syscall(SYS_gettid);
+#else
+    return (unsigned long)&perf_trace_thread; /* unique per thread */
+#endif
+}
+
+/* Clears the ring and starts the clock the timestamps are relative to */
+PERF_API PERF_INLINE void perf_trace_reset(void)
+{
+    perf_trace_count = 0;
+    perf_trace_origin_ns = perf_platform_current_time_nanoseconds();
+    perf_trace_origin_cycles = perf_platform_current_cycle_count();
+}
+
+PERF_API PERF_INLINE void perf_trace_record(char *name, char phase)
+{
+    unsigned long index = (unsigned long)PERF_FETCH_INCREMENT(perf_trace_count);
+    perf_trace_event *e = &perf_trace_events[index & (PERF_TRACE_CAPACITY - 1)];
+
+    if (!perf_trace_thread)
+    {
+        perf_trace_thread = perf_trace_thread_id();
+    }
+
+    e->cycles = perf_platform_current_cycle_count();
+    e->name = name;
+    e->thread = perf_trace_thread;
+    e->phase = phase;
+}
+
+/* Decimal digits of value, zero padded to at least digits_min, returns the length */
+PERF_API PERF_INLINE unsigned long perf_trace_digits(char *dst, unsigned long value, unsigned long digits_min)
+{
+    char temp[21];
+    unsigned long size = 0;
+    unsigned long i;
+
+    while (value > 0 || size < digits_min || size == 0)
+    {
+        temp[size++] = (char)('0' + value % 10);
+        value /= 10;
+    }
+
+    for (i = 0; i < size; ++i)
+    {
+        dst[i] = temp[size - 1 - i];
+    }
+
+    return size;
+}
+
+/* Writes the recorded events as Chrome trace JSON into buffer (NUL terminated) and
+ * returns its length. Events that do not fit are left out, the JSON stays valid. */
+PERF_API PERF_INLINE unsigned long perf_trace_json(char *buffer, unsigned long capacity)
+{
+    static char header[] = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    static char footer[] = "\n]}\n";
+
+    unsigned long count = (unsigned long)perf_trace_count;
+    unsigned long first = count > PERF_TRACE_CAPACITY ? count - PERF_TRACE_CAPACITY : 0;
+    unsigned long elapsed_cycles = perf_platform_current_cycle_count() - perf_trace_origin_cycles;
+    double elapsed_ns = perf_platform_current_time_nanoseconds() - perf_trace_origin_ns;
+    double ns_per_cycle = elapsed_cycles ? elapsed_ns / (double)elapsed_cycles : 0.0;
+    unsigned long size = 0;
+    unsigned long i, j;
+
+    if (capacity < sizeof(header) + sizeof(footer))
+    {
+        return 0;
+    }
+
+    for (j = 0; header[j]; ++j)
+    {
+        buffer[size++] = header[j];
+    }
+
+    for (i = first; i < count; ++i)
+    {
+        perf_trace_event *e = &perf_trace_events[i & (PERF_TRACE_CAPACITY - 1)];
+        unsigned long ns = (unsigned long)((double)(e->cycles - perf_trace_origin_cycles) * ns_per_cycle);
+        char event[PERF_TRACE_NAME_MAX * 2 + 128];
+        unsigned long n = 0;
+
+        n += perf_append_string(event, n, sizeof(event), i == first ? "\n{\"name\":\"" : ",\n{\"name\":\"");
+
+        for (j = 0; e->name[j] && j < PERF_TRACE_NAME_MAX; ++j)
+        {
+            if (e->name[j] == '"' || e->name[j] == '\\')
+            {
+                event[n++] = '\\';
+            }
+
+            event[n++] = ((unsigned char)e->name[j] < ' ') ? ' ' : e->name[j];
+        }
+
+        n += perf_append_string(event, n, sizeof(event), e->phase == 'B' ? "\",\"ph\":\"B\",\"pid\":1,\"tid\":" : "\",\"ph\":\"E\",\"pid\":1,\"tid\":");
+        n += perf_trace_digits(event + n, e->thread, 1);
+        n += perf_append_string(event, n, sizeof(event), ",\"ts\":");
+        n += perf_trace_digits(event + n, ns / 1000, 1);
+        event[n++] = '.';
+        n += perf_trace_digits(event + n, ns % 1000, 3);
+        event[n++] = '}';
+
+        if (size + n + sizeof(footer) > capacity)
+        {
+            break; /* keep room for the footer */
+        }
+
+        for (j = 0; j < n; ++j)
+        {
+            buffer[size++] = event[j];
+        }
+    }
+
+    for (j = 0; footer[j]; ++j)
+    {
+        buffer[size++] = footer[j];
+    }
+
+    buffer[size] = '\0';
+
+    return size;
+}
+
+#define PERF_TRACE_BEGIN(name) perf_trace_record((name), 'B')
+#define PERF_TRACE_END(name) perf_trace_record((name), 'E')
+#else
+#define PERF_TRACE_BEGIN(name) ((void)0)
+#define PERF_TRACE_END(name) ((void)0)
+#endif /* PERF_TRACE_ENABLE */
+
+/* #############################################################################
+ * # TIMER OVERHEAD CALIBRATION
+ * #############################################################################
+ *
+ * An empty PERF_PROFILE region still measures the rdtsc and clock_gettime calls that
+ * delimit it. perf_calibrate times PERF_CALIBRATION_RUNS empty regions and keeps the
+ * fastest one as the overhead, every sample has it subtracted (clamped at zero).
+ * The minimum never over corrects, short regions keep a few cycles of jitter.
+ * perf_stats_context_init calibrates once, so registering the contexts before starting
+ * the threads keeps it out of the measured code. Otherwise the first sample of the
+ * process calibrates. The overhead is published under a lock and every thread copies
+ * it on its first sample, samples never read it while it is written.
+ */
+#ifndef PERF_CALIBRATION_RUNS
+#define PERF_CALIBRATION_RUNS 1000
+#endif
+
+static volatile long perf_calibration_lock = 0;
+static int perf_calibrated = 0;
+static unsigned long perf_overhead_cycles = 0;
+static double perf_overhead_ns = 0.0;
+static PERF_THREAD_LOCAL int perf_overhead_thread_copied = 0;
+static PERF_THREAD_LOCAL unsigned long perf_overhead_thread_cycles = 0;
+static PERF_THREAD_LOCAL double perf_overhead_thread_ns = 0.0;
+
+/* Measures the overhead, call with perf_calibration_lock held */
+PERF_API PERF_INLINE void perf_calibrate_locked(void)
+{
+    unsigned long overhead_cycles = ~0UL;
+    double overhead_ns = 1e30;
+    unsigned long i;
+
+    for (i = 0; i < PERF_CALIBRATION_RUNS; ++i)
+    {
+        /* Same sequence as PERF_PROFILE_WITH_CONTEXT around an empty region */
+        double start_time_nano = perf_platform_current_time_nanoseconds();
+        unsigned long start_cycles = perf_platform_current_cycle_count();
+        unsigned long end_cycles = perf_platform_current_cycle_count();
+        double end_time_nano = perf_platform_current_time_nanoseconds();
+
+        if (end_cycles - start_cycles < overhead_cycles)
+        {
+            overhead_cycles = end_cycles - start_cycles;
+        }
+        if (end_time_nano - start_time_nano < overhead_ns)
+        {
+            overhead_ns = end_time_nano - start_time_nano;
+        }
+    }
+
+    perf_overhead_cycles = overhead_cycles;
+    perf_overhead_ns = overhead_ns;
+    perf_calibrated = 1;
+}
+
+/* Copies the overhead into the calling thread, calibrating first if nobody has (or always if force) */
+PERF_API PERF_INLINE void perf_calibrate_thread(int force)
+{
+    PERF_LOCK(perf_calibration_lock);
+
+    if (force || !perf_calibrated)
+    {
+        perf_calibrate_locked();
+    }
+
+    perf_overhead_thread_cycles = perf_overhead_cycles;
+    perf_overhead_thread_ns = perf_overhead_ns;
+    perf_overhead_thread_copied = 1;
+    PERF_UNLOCK(perf_calibration_lock);
+}
+
+/* Measures the overhead again, threads that already sampled keep their copy */
+PERF_API PERF_INLINE void perf_calibrate(void)
+{
+    perf_calibrate_thread(1);
+}
+
+/* Raw region deltas minus the calibrated overhead */
+PERF_API PERF_INLINE void perf_subtract_overhead(unsigned long *cycles, double *time_ns)
+{
+    if (!perf_overhead_thread_copied)
+    {
+        perf_calibrate_thread(0);
+    }
+
+    *cycles = *cycles > perf_overhead_thread_cycles ? *cycles - perf_overhead_thread_cycles : 0;
+    *time_ns = *time_ns > perf_overhead_thread_ns ? *time_ns - perf_overhead_thread_ns : 0.0;
+}
+
+/* #############################################################################
+ * # PERF MAIN IMPLEMENTATION
+ * #############################################################################
+ */
+#ifndef PERF_MAX_PRINT_BUFFER
+#define PERF_MAX_PRINT_BUFFER 1024
+#endif
+
+#ifdef PERF_STATS_ENABLE
+
+#ifndef PERF_STATS_ENTRIES_MAX
+#define PERF_STATS_ENTRIES_MAX 1024 /* Max unique (file+line+name) combinations */
+#endif
+
+#ifndef PERF_STATS_NAME_MAX
+#define PERF_STATS_NAME_MAX 512
+#endif
+
+#ifndef PERF_STATS_TABLE_SIZE
+#define PERF_STATS_TABLE_SIZE 2048 /* Hash table slots, power of two and larger than PERF_STATS_ENTRIES_MAX */
+#endif
+
+typedef struct perf_stats_entry
+{
+    char file[128];                 /* File name */
+    int line;                       /* Line number */
+    char name[PERF_STATS_NAME_MAX]; /* Function or code block name */
+    unsigned long hash;             /* perf_stats_hash of file, line and name */
+
+    unsigned long count; /* timed samples */
+    unsigned long calls; /* invocations the samples stand for, equal to count unless sampled */
+
+    unsigned long cycles_min;
+    unsigned long cycles_max;
+    unsigned long cycles_sum;
+
+    double time_ms_min;
+    double time_ms_max;
+    double time_ms_sum;
+
+    perf_histogram cycles; /* for the tail latency percentiles */
+
+    unsigned long counters_sum[PERF_COUNTERS_MAX]; /* perf_counters deltas, zero without PERF_COUNTERS_ENABLE */
+
+} perf_stats_entry;
+
+/* Recording is per thread and needs no atomics: a thread records into the context it
+ * registered with perf_stats_thread_begin (kept in a thread local pointer), or into the
+ * global perf_stats_entries if it registered none. Where the compiler has no thread
+ * locals pass the context explicitly with PERF_PROFILE_WITH_CONTEXT. Only the first
+ * call of a site on a thread takes the registry lock.
+ *
+ * Per thread counters. entries[i] counts the site of perf_stats_entries[i], only its
+ * counters are used. Large (PERF_STATS_ENTRIES_MAX entries of about 2.6 KB on 64 bit,
+ * mostly the histogram), allocate it statically or on the heap. */
+typedef struct perf_stats_context
+{
+    char *name; /* shown in the per thread report */
+    struct perf_stats_context *next;
+    perf_stats_entry entries[PERF_STATS_ENTRIES_MAX];
+
+} perf_stats_context;
+
+static perf_stats_entry perf_stats_entries[PERF_STATS_ENTRIES_MAX];
+static unsigned long perf_stats_entry_count = 0;
+
+static volatile long perf_stats_lock = 0;        /* guards the registry and the context list */
+static perf_stats_context *perf_stats_contexts = 0; /* registered contexts */
+static PERF_THREAD_LOCAL perf_stats_context *perf_stats_thread = 0;
+
+/* Open addressing table of entry index + 1 (0 is empty), keyed by perf_stats_hash */
+static unsigned long perf_stats_table[PERF_STATS_TABLE_SIZE];
+
+/* FNV-1a over file, line and name */
+PERF_API PERF_INLINE unsigned long perf_stats_hash(char *file, int line, char *name)
+{
+    unsigned long hash = 2166136261UL;
+    unsigned long i;
+
+    while (*file)
+    {
+        hash = ((hash ^ (unsigned char)*file++) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    for (i = 0; i < sizeof(int); ++i)
+    {
+        hash = ((hash ^ (((unsigned long)(unsigned int)line >> (i * 8)) & 0xFFUL)) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    while (*name)
+    {
+        hash = ((hash ^ (unsigned char)*name++) * 16777619UL) & 0xFFFFFFFFUL;
+    }
+
+    return hash;
+}
+
+PERF_API PERF_INLINE int perf_stats_equals(char *a, char *b)
+{
+    while (*a && *a == *b)
+    {
+        a++;
+        b++;
+    }
+
+    return *a == *b;
+}
+
+PERF_API PERF_INLINE void perf_stats_reset_entry(perf_stats_entry *e)
+{
+    unsigned long i;
+
+    e->count = 0;
+    e->calls = 0;
+
+    e->cycles_min = ~0UL; /* Max unsigned long */
+    e->cycles_max = 0;
+    e->cycles_sum = 0;
+
+    e->time_ms_min = 1e30; /* Huge number */
+    e->time_ms_max = 0.0;
+    e->time_ms_sum = 0.0;
+
+    perf_histogram_reset(&e->cycles);
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        e->counters_sum[i] = 0;
+    }
+}
+
+/* Index + 1 of the entry for (file, line, name), created on first use. 0 if the entries or the table are full.
+ * Callers that may run on several threads go through perf_stats_site_locked. */
+PERF_API PERF_INLINE unsigned long perf_stats_site(char *file, int line, char *name)
+{
+    unsigned long hash = perf_stats_hash(file, line, name);
+    unsigned long slot = hash & (PERF_STATS_TABLE_SIZE - 1);
+    unsigned long probes;
+
+    for (probes = 0; probes < PERF_STATS_TABLE_SIZE; ++probes)
+    {
+        unsigned long index = perf_stats_table[slot];
+        perf_stats_entry *e;
+
+        if (index == 0)
+        {
+            break;
+        }
+
+        e = &perf_stats_entries[index - 1];
+
+        if (e->hash == hash && e->line == line && perf_stats_equals(e->file, file) && perf_stats_equals(e->name, name))
+        {
+            return index;
+        }
+
+        slot = (slot + 1) & (PERF_STATS_TABLE_SIZE - 1);
+    }
+
+    /* If not found, create a new entry */
+    if (probes < PERF_STATS_TABLE_SIZE && perf_stats_entry_count < PERF_STATS_ENTRIES_MAX)
+    {
+        perf_stats_entry *e = &perf_stats_entries[perf_stats_entry_count++];
+        unsigned long j = 0;
+
+        /* Copy file */
+        while (file[j] && j < sizeof(e->file) - 1)
+        {
+            e->file[j] = file[j];
+            j++;
+        }
+        e->file[j] = '\0';
+
+        /* Copy name */
+        j = 0;
+        while (name[j] && j < PERF_STATS_NAME_MAX - 1)
+        {
+            e->name[j] = name[j];
+            j++;
+        }
+
+        e->name[j] = '\0';
+
+        e->line = line;
+        e->hash = hash;
+        perf_stats_reset_entry(e);
+
+        perf_stats_table[slot] = perf_stats_entry_count;
+
+        return perf_stats_entry_count;
+    }
+
+    return 0; /* No space */
+}
+
+PERF_API PERF_INLINE unsigned long perf_stats_site_locked(char *file, int line, char *name)
+{
+    unsigned long index;
+
+    PERF_LOCK(perf_stats_lock);
+    index = perf_stats_site(file, line, name);
+    PERF_UNLOCK(perf_stats_lock);
+
+    return index;
+}
+
+PERF_API PERF_INLINE perf_stats_entry *perf_stats_get_entry(char *file, int line, char *name)
+{
+    unsigned long index = perf_stats_site_locked(file, line, name);
+
+    return index ? &perf_stats_entries[index - 1] : 0;
+}
+
+/* Counters of site (entry index + 1) in context, or in the global entries if context is 0 */
+PERF_API PERF_INLINE perf_stats_entry *perf_stats_context_entry(perf_stats_context *context, unsigned long site)
+{
+    return context ? &context->entries[site - 1] : &perf_stats_entries[site - 1];
+}
+
+/* Resets context, calibrates the timer overhead if nobody has yet and adds it to the contexts that perf_stats_merge folds together */
+PERF_API PERF_INLINE void perf_stats_context_init(perf_stats_context *context, char *name)
+{
+    unsigned long i;
+
+    context->name = name;
+
+    for (i = 0; i < PERF_STATS_ENTRIES_MAX; ++i)
+    {
+        perf_stats_reset_entry(&context->entries[i]);
+    }
+
+    perf_calibrate_thread(0);
+
+    PERF_LOCK(perf_stats_lock);
+    context->next = perf_stats_contexts;
+    perf_stats_contexts = context;
+    PERF_UNLOCK(perf_stats_lock);
+}
+
+/* Registers context and makes it the one PERF_PROFILE records into on the calling thread */
+PERF_API PERF_INLINE void perf_stats_thread_begin(perf_stats_context *context, char *name)
+{
+    perf_stats_context_init(context, name);
+    perf_stats_thread = context;
+}
+
+/* Stops recording into the context of the calling thread, it keeps its counters until merged.
+ * Closes the perf_event counters of the thread. */
+PERF_API PERF_INLINE void perf_stats_thread_end(void)
+{
+    perf_stats_thread = 0;
+#ifdef PERF_COUNTERS_LINUX
+    perf_counters_close();
+#endif
+}
+
+PERF_API PERF_INLINE void perf_stats_store_entry(perf_stats_entry *e, unsigned long cycles, double time_ms, unsigned long calls)
+{
+    e->count++;
+    e->calls += calls;
+    e->cycles_sum += cycles;
+    e->time_ms_sum += time_ms;
+
+    if (cycles < e->cycles_min)
+    {
+        e->cycles_min = cycles;
+    }
+    if (cycles > e->cycles_max)
+    {
+        e->cycles_max = cycles;
+    }
+    if (time_ms < e->time_ms_min)
+    {
+        e->time_ms_min = time_ms;
+    }
+    if (time_ms > e->time_ms_max)
+    {
+        e->time_ms_max = time_ms;
+    }
+
+    perf_histogram_record(&e->cycles, cycles);
+}
+
+PERF_API PERF_INLINE void perf_stats_store_counters(perf_stats_entry *e, perf_counters *counters)
+{
+    unsigned long i;
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        e->counters_sum[i] += counters->values[i];
+    }
+}
+
+PERF_API PERF_INLINE void perf_stats_store_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+{
+    perf_stats_entry *e = perf_stats_get_entry(file, line, name);
+
+    if (!e)
+    {
+        return; /* Out of slots */
+    }
+
+    perf_stats_store_entry(e, cycles, time_ms, 1);
+}
+
+/* Factor from the sums over the timed samples of e to estimated totals over all its calls, 1 unless sampled */
+PERF_API PERF_INLINE double perf_stats_scale(perf_stats_entry *e)
+{
+    return e->count ? (double)e->calls / (double)e->count : 0.0;
+}
+
+/* Adds the samples of src (e.g. of an earlier run) to dst */
+PERF_API PERF_INLINE void perf_stats_merge_entry(perf_stats_entry *dst, perf_stats_entry *src)
+{
+    unsigned long i;
+
+    dst->count += src->count;
+    dst->calls += src->calls;
+    dst->cycles_sum += src->cycles_sum;
+    dst->time_ms_sum += src->time_ms_sum;
+
+    if (src->cycles_min < dst->cycles_min)
+    {
+        dst->cycles_min = src->cycles_min;
+    }
+    if (src->cycles_max > dst->cycles_max)
+    {
+        dst->cycles_max = src->cycles_max;
+    }
+    if (src->time_ms_min < dst->time_ms_min)
+    {
+        dst->time_ms_min = src->time_ms_min;
+    }
+    if (src->time_ms_max > dst->time_ms_max)
+    {
+        dst->time_ms_max = src->time_ms_max;
+    }
+
+    perf_histogram_merge(&dst->cycles, &src->cycles);
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        dst->counters_sum[i] += src->counters_sum[i];
+    }
+}
+
+/* Folds the counters of every registered context into the global entries and resets them.
+ * Call it once the threads stopped recording, perf_print_stats then shows the aggregate. */
+PERF_API PERF_INLINE void perf_stats_merge(void)
+{
+    perf_stats_context *context;
+    unsigned long i;
+
+    PERF_LOCK(perf_stats_lock);
+
+    for (context = perf_stats_contexts; context; context = context->next)
+    {
+        for (i = 0; i < perf_stats_entry_count; ++i)
+        {
+            if (context->entries[i].count)
+            {
+                perf_stats_merge_entry(&perf_stats_entries[i], &context->entries[i]);
+                perf_stats_reset_entry(&context->entries[i]);
+            }
+        }
+    }
+
+    PERF_UNLOCK(perf_stats_lock);
+}
+
+/* Prints the counters of every site that has samples in counters (perf_stats_entries or the entries of a context) */
+PERF_API PERF_INLINE void perf_print_stats_entries(perf_stats_entry *counters, char *title)
+{
+    unsigned long i;
+    unsigned long printed = 0;
+    perf_stats_entry *site = 0;
+    char line_str[5];
+
+    char buffer[PERF_MAX_PRINT_BUFFER];
+
+    for (i = 0; i < perf_stats_entry_count; ++i)
+    {
+        unsigned long current_pos = 0;
+
+        perf_stats_entry *e = &counters[i];
+        unsigned long avg_cycles = e->count ? e->cycles_sum / e->count : 0;
+        double avg_time_ms = e->count ? (e->time_ms_sum / (double)e->count) : 0.0;
+
+        char count_str[7];
+        char calls_str[21];
+        char *calls = calls_str;
+
+        char cycles_min[12];
+        char cycles_max[12];
+        char cycles_avg[12];
+        char cycles_sum[12];
+
+        char time_min[12];
+        char time_max[12];
+        char time_avg[12];
+        char time_sum[12];
+
+        char cycles_p50[12];
+        char cycles_p90[12];
+        char cycles_p99[12];
+        char cycles_p999[12];
+
+        if (e->count == 0)
+        {
+            continue;
+        }
+
+        site = &perf_stats_entries[i];
+        perf_int_to_string(site->line, line_str, sizeof(line_str));
+        perf_ulong_to_string(e->count, count_str, sizeof(count_str));
+
+        perf_ulong_to_string(e->cycles_min, cycles_min, sizeof(cycles_min));
+        perf_ulong_to_string(e->cycles_max, cycles_max, sizeof(cycles_max));
+        perf_ulong_to_string(avg_cycles, cycles_avg, sizeof(cycles_avg));
+        perf_ulong_to_string((unsigned long)((double)e->cycles_sum * perf_stats_scale(e)), cycles_sum, sizeof(cycles_sum));
+
+        perf_double_to_string(e->time_ms_min, time_min, sizeof(time_min), 4);
+        perf_double_to_string(e->time_ms_max, time_max, sizeof(time_max), 4);
+        perf_double_to_string(avg_time_ms, time_avg, sizeof(time_avg), 4);
+        perf_double_to_string(e->time_ms_sum * perf_stats_scale(e), time_sum, sizeof(time_sum), 4);
+
+        perf_ulong_to_string(e->calls, calls_str, sizeof(calls_str));
+
+        while (*calls == ' ')
+        {
+            calls++;
+        }
+
+        perf_ulong_to_string(perf_histogram_percentile(&e->cycles, 50.0), cycles_p50, sizeof(cycles_p50));
+        perf_ulong_to_string(perf_histogram_percentile(&e->cycles, 90.0), cycles_p90, sizeof(cycles_p90));
+        perf_ulong_to_string(perf_histogram_percentile(&e->cycles, 99.0), cycles_p99, sizeof(cycles_p99));
+        perf_ulong_to_string(perf_histogram_percentile(&e->cycles, 99.9), cycles_p999, sizeof(cycles_p999));
+
+        if (printed++ == 0)
         {
             buffer[0] = '\0';
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, e->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, title[0] ? " [perf] " : " [perf]");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, title);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------------------------------------------------+-------------------------------------------------------+-------------------------------------------------------+\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] | cylces                                                | time_ms                                               | cycles percentiles                                    |\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] |         min |         max |         avg |         sum |         min |         max |         avg |         sum |         p50 |         p90 |         p99 |       p99.9 |\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
+            current_pos = 0;
+            perf_platform_print(buffer);
+        }
+
+        buffer[0] = '\0';
+
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_min);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_max);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_avg);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_sum);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_min);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_max);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_avg);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_sum);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_p50);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_p90);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_p99);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_p999);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, count_str);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " x ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->name);
+
+        if (e->calls != e->count)
+        {
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " (sampled, ");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, calls);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " calls)");
+        }
+
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n");
+        current_pos = 0;
+
+        perf_platform_print(buffer);
+    }
+
+    if (site)
+    {
+        unsigned long current_pos = 0;
+
+        buffer[0] = '\0';
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
+        perf_platform_print(buffer);
+    }
+}
+
+#ifdef PERF_COUNTERS_LINUX
+/* Average perf_counters deltas per call of every site that has samples in counters */
+PERF_API PERF_INLINE void perf_print_counters_entries(perf_stats_entry *counters, char *title)
+{
+    perf_counters_set set = perf_counters_open();
+    unsigned long i, j;
+    unsigned long printed = 0;
+    perf_stats_entry *site = 0;
+    char line_str[5];
+
+    char buffer[PERF_MAX_PRINT_BUFFER];
+
+    if (set < PERF_COUNTERS_HARDWARE)
+    {
+        return;
+    }
+
+    for (i = 0; i < perf_stats_entry_count; ++i)
+    {
+        unsigned long current_pos = 0;
+
+        perf_stats_entry *e = &counters[i];
+
+        char count_str[7];
+        char value_str[17];
+
+        if (e->count == 0)
+        {
+            continue;
+        }
+
+        site = &perf_stats_entries[i];
+        perf_int_to_string(site->line, line_str, sizeof(line_str));
+        perf_ulong_to_string(e->count, count_str, sizeof(count_str));
+
+        buffer[0] = '\0';
+
+        if (printed++ == 0)
+        {
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
             current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
             current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +-------------+-------------+-------------+-------------+-------------+-------------+-------------+-------------+\n");
-            current_pos = 0;
-            perf_platform_print(buffer);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, set == PERF_COUNTERS_HARDWARE ? " [perf] counters per call" : " [perf] software counters per call");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, title[0] ? " " : "");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, title);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +------------------+------------------+------------------+------------------+\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] | ");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_counters_header(set));
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n");
+
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +------------------+------------------+------------------+------------------+\n");
+        }
+
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] | ");
+
+        for (j = 0; j < PERF_COUNTERS_MAX; ++j)
+        {
+            perf_ulong_to_string(e->counters_sum[j] / e->count, value_str, sizeof(value_str));
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, value_str);
+            current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " | ");
+        }
+
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, count_str);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " x ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->name);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n");
+
+        perf_platform_print(buffer);
+    }
+
+    if (site)
+    {
+        unsigned long current_pos = 0;
+
+        buffer[0] = '\0';
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, site->file);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] +------------------+------------------+------------------+------------------+\n");
+        perf_platform_print(buffer);
+    }
+}
+#else
+PERF_API PERF_INLINE void perf_print_counters_entries(perf_stats_entry *counters, char *title)
+{
+    (void)counters;
+    (void)title;
+}
+#endif /* PERF_COUNTERS_LINUX */
+
+PERF_API PERF_INLINE void perf_print_stats(void)
+{
+    perf_print_stats_entries(perf_stats_entries, "");
+    perf_print_counters_entries(perf_stats_entries, "");
+}
+
+/* Per thread report of a context, print them before perf_stats_merge moves the counters */
+PERF_API PERF_INLINE void perf_print_stats_context(perf_stats_context *context)
+{
+    perf_print_stats_entries(context->entries, context->name);
+    perf_print_counters_entries(context->entries, context->name);
+}
+
+/* Writes one CSV row per site with samples (counters: perf_stats_entries or the entries of a context), returns the length.
+ * count is the number of timed samples, calls the invocations they stand for. The sums are
+ * estimated totals over all calls (scaled by calls / count for sampled sites). */
+PERF_API PERF_INLINE unsigned long perf_stats_csv_entries(perf_stats_entry *counters, char *buffer, unsigned long capacity)
+{
+    perf_record r;
+    unsigned long i, j;
+
+    perf_record_init(&r, buffer, capacity);
+    perf_record_text(&r, "file,line,name,count,calls,cycles_min,cycles_max,cycles_avg,cycles_sum,time_ms_min,time_ms_max,time_ms_avg,time_ms_sum,cycles_p50,cycles_p90,cycles_p99,cycles_p999,counter0_sum,counter1_sum,counter2_sum,counter3_sum\n");
+
+    if (!perf_record_row_end(&r))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < perf_stats_entry_count; ++i)
+    {
+        perf_stats_entry *e = &counters[i];
+        perf_stats_entry *site = &perf_stats_entries[i];
+
+        if (e->count == 0)
+        {
+            continue;
+        }
+
+        perf_record_row_begin(&r);
+        perf_record_quoted(&r, site->file, 0);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, (unsigned long)site->line);
+        perf_record_char(&r, ',');
+        perf_record_quoted(&r, site->name, 0);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, e->count);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, e->calls);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, e->cycles_min);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, e->cycles_max);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, e->cycles_sum / e->count);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, (unsigned long)((double)e->cycles_sum * perf_stats_scale(e)));
+        perf_record_char(&r, ',');
+        perf_record_double(&r, e->time_ms_min, 6);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, e->time_ms_max, 6);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, e->time_ms_sum / (double)e->count, 6);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, e->time_ms_sum * perf_stats_scale(e), 6);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 50.0));
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 90.0));
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 99.0));
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 99.9));
+
+        for (j = 0; j < PERF_COUNTERS_MAX; ++j)
+        {
+            perf_record_char(&r, ',');
+            perf_record_ulong(&r, (unsigned long)((double)e->counters_sum[j] * perf_stats_scale(e)));
+        }
+
+        perf_record_char(&r, '\n');
+
+        if (!perf_record_row_end(&r))
+        {
+            break;
+        }
+    }
+
+    return r.size;
+}
+
+/* Same as perf_stats_csv_entries as a JSON array of objects */
+PERF_API PERF_INLINE unsigned long perf_stats_json_entries(perf_stats_entry *counters, char *buffer, unsigned long capacity)
+{
+    perf_record r;
+    unsigned long i, j;
+    unsigned long rows = 0;
+
+    if (capacity < 4)
+    {
+        return 0;
+    }
+
+    perf_record_init(&r, buffer, capacity - 3); /* room for the closing "\n]\n" */
+    perf_record_char(&r, '[');
+
+    for (i = 0; i < perf_stats_entry_count; ++i)
+    {
+        perf_stats_entry *e = &counters[i];
+        perf_stats_entry *site = &perf_stats_entries[i];
+
+        if (e->count == 0)
+        {
+            continue;
+        }
+
+        perf_record_row_begin(&r);
+        perf_record_text(&r, rows ? ",\n{\"file\":" : "\n{\"file\":");
+        perf_record_quoted(&r, site->file, 1);
+        perf_record_text(&r, ",\"line\":");
+        perf_record_ulong(&r, (unsigned long)site->line);
+        perf_record_text(&r, ",\"name\":");
+        perf_record_quoted(&r, site->name, 1);
+        perf_record_text(&r, ",\"count\":");
+        perf_record_ulong(&r, e->count);
+        perf_record_text(&r, ",\"calls\":");
+        perf_record_ulong(&r, e->calls);
+        perf_record_text(&r, ",\"cycles_min\":");
+        perf_record_ulong(&r, e->cycles_min);
+        perf_record_text(&r, ",\"cycles_max\":");
+        perf_record_ulong(&r, e->cycles_max);
+        perf_record_text(&r, ",\"cycles_avg\":");
+        perf_record_ulong(&r, e->cycles_sum / e->count);
+        perf_record_text(&r, ",\"cycles_sum\":");
+        perf_record_ulong(&r, (unsigned long)((double)e->cycles_sum * perf_stats_scale(e)));
+        perf_record_text(&r, ",\"time_ms_min\":");
+        perf_record_double(&r, e->time_ms_min, 6);
+        perf_record_text(&r, ",\"time_ms_max\":");
+        perf_record_double(&r, e->time_ms_max, 6);
+        perf_record_text(&r, ",\"time_ms_avg\":");
+        perf_record_double(&r, e->time_ms_sum / (double)e->count, 6);
+        perf_record_text(&r, ",\"time_ms_sum\":");
+        perf_record_double(&r, e->time_ms_sum * perf_stats_scale(e), 6);
+        perf_record_text(&r, ",\"cycles_p50\":");
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 50.0));
+        perf_record_text(&r, ",\"cycles_p90\":");
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 90.0));
+        perf_record_text(&r, ",\"cycles_p99\":");
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 99.0));
+        perf_record_text(&r, ",\"cycles_p999\":");
+        perf_record_ulong(&r, perf_histogram_percentile(&e->cycles, 99.9));
+        perf_record_text(&r, ",\"counters_sum\":[");
+
+        for (j = 0; j < PERF_COUNTERS_MAX; ++j)
+        {
+            perf_record_text(&r, j ? "," : "");
+            perf_record_ulong(&r, (unsigned long)((double)e->counters_sum[j] * perf_stats_scale(e)));
+        }
+
+        perf_record_text(&r, "]}");
+
+        if (!perf_record_row_end(&r))
+        {
+            break;
+        }
+
+        rows++;
+    }
+
+    r.capacity = capacity;
+    r.full = 0;
+    perf_record_text(&r, "\n]\n");
+
+    return r.size;
+}
+
+PERF_API PERF_INLINE unsigned long perf_stats_csv(char *buffer, unsigned long capacity)
+{
+    return perf_stats_csv_entries(perf_stats_entries, buffer, capacity);
+}
+
+PERF_API PERF_INLINE unsigned long perf_stats_json(char *buffer, unsigned long capacity)
+{
+    return perf_stats_json_entries(perf_stats_entries, buffer, capacity);
+}
+
+/* Each call site resolves its entry once and keeps the index in a static. The site is
+ * resolved again when it is called with a different name pointer, so a name that is
+ * rebuilt in the same buffer between calls should go through perf_stats_store_result. */
+#define PERF_STATS_THREAD perf_stats_thread
+#define PERF_STATS_RECORD(context, cycles, time_ms, counters, calls, name)                 \
+    do                                                                                     \
+    {                                                                                      \
+        static PERF_THREAD_LOCAL unsigned long perf_site = 0; /* entry index + 1 */        \
+        static PERF_THREAD_LOCAL char *perf_site_name = 0;                                 \
+        char *perf_name = (name);                                                          \
+        if (perf_site == 0 || perf_site_name != perf_name)                                 \
+        {                                                                                  \
+            perf_site = perf_stats_site_locked(__FILE__, __LINE__, perf_name);             \
+            perf_site_name = perf_name;                                                    \
+        }                                                                                  \
+        if (perf_site)                                                                     \
+        {                                                                                  \
+            perf_stats_entry *perf_entry = perf_stats_context_entry((context), perf_site); \
+            perf_stats_store_entry(perf_entry, (cycles), (time_ms), (calls));              \
+            perf_stats_store_counters(perf_entry, (counters));                             \
+        }                                                                                  \
+    } while (0)
+#else
+PERF_API PERF_INLINE void perf_stats_store_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+{
+    (void)file;
+    (void)line;
+    (void)cycles;
+    (void)time_ms;
+    (void)name;
+}
+
+#define PERF_STATS_THREAD 0
+#define PERF_STATS_RECORD(context, cycles, time_ms, counters, calls, name) perf_stats_store_result(__FILE__, __LINE__, (cycles), (time_ms), (name))
+#endif /* PERF_STATS_ENABLE */
+
+/* #############################################################################
+ * # REPORTING
+ * #############################################################################
+ *
+ * By default every PERF_PROFILE region prints its result line right away, one write
+ * syscall per call. With PERF_DEFERRED_PRINT the results are only stored in a fixed
+ * buffer of PERF_DEFERRED_CAPACITY results and printed by perf_flush: on demand, when
+ * the buffer is full and at exit (gcc / clang destructor, call perf_flush yourself on
+ * other compilers or without the C runtime). The flush formats many lines per write.
+ * Names and file names are kept as pointers until the flush, pass string literals.
+ */
+#ifdef PERF_DISBALE_INTERMEDIATE_PRINT
+PERF_API PERF_INLINE void perf_print_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+{
+    (void)file;
+    (void)line;
+    (void)cycles;
+    (void)time_ms;
+    (void)name;
+}
+#else
+/* Formats the result line of one region into buffer (capacity PERF_MAX_PRINT_BUFFER), returns its length */
+PERF_API PERF_INLINE unsigned long perf_format_result(char *buffer, char *file, int line, unsigned long cycles, double time_ms, char *name)
+{
+    char cycles_str[14];
+    char time_ms_str[14];
+    char line_str[12];
+    unsigned long current_pos = 0;
+
+    /* Format numbers into temporary buffers. */
+    perf_ulong_to_string(cycles, cycles_str, sizeof(cycles_str));
+    perf_double_to_string(time_ms, time_ms_str, sizeof(time_ms_str), 6);
+    perf_int_to_string(line, line_str, sizeof(line_str));
+
+    /* Build the final string safely and efficiently. */
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, file);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_str);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " cycles, ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_ms_str);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " ms, \"");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, name);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\"\n");
+
+    return current_pos;
+}
+
+PERF_API PERF_INLINE void perf_print_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+{
+    char buffer[PERF_MAX_PRINT_BUFFER];
+
+    perf_format_result(buffer, file, line, cycles, time_ms, name);
+    perf_platform_print(buffer);
+}
+#endif
+
+#if defined(PERF_COUNTERS_LINUX) && !defined(PERF_DISBALE_INTERMEDIATE_PRINT)
+/* Formats the counter line of one region into buffer (capacity PERF_MAX_PRINT_BUFFER), returns its length */
+PERF_API PERF_INLINE unsigned long perf_format_counters(char *buffer, char *file, int line, perf_counters *counters, char *name)
+{
+    perf_counters_set set = perf_counters_open();
+    char value_str[14];
+    char line_str[12];
+    unsigned long current_pos = 0;
+    unsigned long i;
+
+    buffer[0] = '\0';
+
+    if (set < PERF_COUNTERS_HARDWARE)
+    {
+        return 0;
+    }
+
+    perf_int_to_string(line, line_str, sizeof(line_str));
+
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, file);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf]");
+
+    for (i = 0; i < PERF_COUNTERS_MAX; ++i)
+    {
+        perf_ulong_to_string(counters->values[i], value_str, sizeof(value_str));
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, value_str);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_counters_name(set, i));
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ",");
+    }
+
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " \"");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, name);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\"\n");
+
+    return current_pos;
+}
+
+PERF_API PERF_INLINE void perf_print_counters(char *file, int line, perf_counters *counters, char *name)
+{
+    char buffer[PERF_MAX_PRINT_BUFFER];
+
+    if (perf_format_counters(buffer, file, line, counters, name))
+    {
+        perf_platform_print(buffer);
+    }
+}
+#else
+PERF_API PERF_INLINE void perf_print_counters(char *file, int line, perf_counters *counters, char *name)
+{
+    (void)file;
+    (void)line;
+    (void)counters;
+    (void)name;
+}
+#endif
+
+#if defined(PERF_DEFERRED_PRINT) && !defined(PERF_DISBALE_INTERMEDIATE_PRINT)
+
+#ifndef PERF_DEFERRED_CAPACITY
+#define PERF_DEFERRED_CAPACITY 4096 /* results stored between two flushes */
+#endif
+
+#ifndef PERF_DEFERRED_OUTPUT
+#define PERF_DEFERRED_OUTPUT 65536 /* bytes printed per write */
+#endif
+
+typedef struct perf_deferred_result
+{
+    char *file;
+    int line;
+    unsigned long cycles;
+    double time_ms;
+    char *name;
+    perf_counters counters;
+
+} perf_deferred_result;
+
+static perf_deferred_result perf_deferred_results[PERF_DEFERRED_CAPACITY];
+static unsigned long perf_deferred_count = 0;
+static volatile long perf_deferred_lock = 0; /* guards the results between threads */
+static char perf_deferred_output[PERF_DEFERRED_OUTPUT + PERF_MAX_PRINT_BUFFER];
+
+/* Prints the stored results (the caller holds perf_deferred_lock) */
+PERF_API PERF_INLINE void perf_flush_locked(void)
+{
+    unsigned long size = 0;
+    unsigned long i;
+
+    for (i = 0; i < perf_deferred_count; ++i)
+    {
+        perf_deferred_result *r = &perf_deferred_results[i];
+
+        size += perf_format_result(perf_deferred_output + size, r->file, r->line, r->cycles, r->time_ms, r->name);
+#ifdef PERF_COUNTERS_LINUX
+        size += perf_format_counters(perf_deferred_output + size, r->file, r->line, &r->counters, r->name);
+#endif
+
+        if (size > PERF_DEFERRED_OUTPUT - PERF_MAX_PRINT_BUFFER)
+        {
+            perf_platform_print(perf_deferred_output);
+            size = 0;
         }
     }
+
+    if (size)
+    {
+        perf_platform_print(perf_deferred_output);
+    }
+
+    perf_deferred_count = 0;
+}
+
+/* Prints and clears the results stored so far */
+PERF_API PERF_INLINE void perf_flush(void)
+{
+    PERF_LOCK(perf_deferred_lock);
+    perf_flush_locked();
+    PERF_UNLOCK(perf_deferred_lock);
+}
+
+#if defined(__GNUC__) || defined(__clang__)
+__attribute__((destructor)) static void perf_flush_at_exit(void)
+{
+    perf_flush();
+}
+#endif
+
+PERF_API PERF_INLINE void perf_report(char *file, int line, unsigned long cycles, double time_ms, perf_counters *counters, char *name)
+{
+    perf_deferred_result *r;
+
+    PERF_LOCK(perf_deferred_lock);
+
+    if (perf_deferred_count == PERF_DEFERRED_CAPACITY)
+    {
+        perf_flush_locked();
+    }
+
+    r = &perf_deferred_results[perf_deferred_count++];
+    r->file = file;
+    r->line = line;
+    r->cycles = cycles;
+    r->time_ms = time_ms;
+    r->name = name;
+    r->counters = *counters;
+
+    PERF_UNLOCK(perf_deferred_lock);
 }
 #else
-PERF_API PERF_INLINE void perf_stats_store_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+PERF_API PERF_INLINE void perf_flush(void)
 {
-    (void)file;
-    (void)line;
-    (void)cycles;
-    (void)time_ms;
-    (void)name;
 }
-#endif /* PERF_STATS_ENABLE */
 
-#ifdef PERF_DISBALE_INTERMEDIATE_PRINT
-PERF_API PERF_INLINE void perf_print_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+PERF_API PERF_INLINE void perf_report(char *file, int line, unsigned long cycles, double time_ms, perf_counters *counters, char *name)
 {
-    (void)file;
-    (void)line;
-    (void)cycles;
-    (void)time_ms;
-    (void)name;
+    perf_print_result(file, line, cycles, time_ms, name);
+    perf_print_counters(file, line, counters, name);
 }
-#else
-PERF_API PERF_INLINE void perf_print_result(char *file, int line, unsigned long cycles, double time_ms, char *name)
+#endif /* PERF_DEFERRED_PRINT */
+
+#define PERF_PROFILE(func_call) PERF_PROFILE_WITH_NAME(func_call, #func_call)
+#define PERF_PROFILE_WITH_NAME(func_call, name) PERF_PROFILE_WITH_CONTEXT(PERF_STATS_THREAD, func_call, name)
+
+/* #############################################################################
+ * # SAMPLING
+ * #############################################################################
+ *
+ * PERF_PROFILE_SAMPLED times about one in period calls of a site and runs the others
+ * untimed, which costs a thread local decrement and a branch. The gap to the next
+ * timed call is drawn uniformly from 1 .. 2 * period - 1 with a per thread xorshift,
+ * so loops with a fixed stride do not alias with the sampling. Every sample records
+ * the number of calls since the previous one, perf_print_stats and the CSV / JSON
+ * records scale the sums by calls / count to estimate the totals, the min, max,
+ * averages and percentiles are those of the timed calls.
+ *
+ * The timed call costs about as much as PERF_PROFILE (tens of ns, plus two syscalls
+ * with PERF_COUNTERS_ENABLE), pick period so that cost / period stays below 1% of
+ * the profiled code, and define PERF_DISBALE_INTERMEDIATE_PRINT or PERF_DEFERRED_PRINT
+ * so the samples are not printed one by one.
+ */
+#ifndef PERF_SAMPLE_PERIOD
+#define PERF_SAMPLE_PERIOD 64
+#endif
+
+static PERF_THREAD_LOCAL unsigned long perf_sample_state = 0;
+
+/* Untimed calls before the next timed one, uniform in 0 .. 2 * period - 2 (mean period - 1) */
+PERF_API PERF_INLINE unsigned long perf_sample_next_skip(unsigned long period)
 {
-    char buffer[PERF_MAX_PRINT_BUFFER];
-    char cycles_str[14];
-    char time_ms_str[14];
-    char line_str[12];
-    unsigned long current_pos = 0;
+    unsigned long x = perf_sample_state ? perf_sample_state : 2463534242UL;
 
-    /* Format numbers into temporary buffers. */
-    perf_ulong_to_string(cycles, cycles_str, sizeof(cycles_str));
-    perf_double_to_string(time_ms, time_ms_str, sizeof(time_ms_str), 6);
-    perf_int_to_string(line, line_str, sizeof(line_str));
+    if (period < 2)
+    {
+        return 0;
+    }
 
-    /* Build the final string safely and efficiently. */
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, file);
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ":");
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, line_str);
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " [perf] ");
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, cycles_str);
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " cycles, ");
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, time_ms_str);
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " ms, \"");
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, name);
-    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\"\n");
+    /* xorshift32, masked so it behaves the same with a 64 bit unsigned long */
+    x ^= (x << 13) & 0xFFFFFFFFUL;
+    x ^= x >> 17;
+    x ^= (x << 5) & 0xFFFFFFFFUL;
+    perf_sample_state = x;
 
-    perf_platform_print(buffer);
+    return x % (2 * period - 1);
 }
-#endif
 
-#define PERF_PROFILE(func_call) PERF_PROFILE_WITH_NAME(func_call, #func_call)
+#define PERF_PROFILE_SAMPLED(func_call) PERF_PROFILE_SAMPLED_WITH_NAME(func_call, #func_call, PERF_SAMPLE_PERIOD)
+#define PERF_PROFILE_SAMPLED_WITH_NAME(func_call, name, period) PERF_PROFILE_SAMPLED_WITH_CONTEXT(PERF_STATS_THREAD, func_call, name, period)
 
 #ifdef PERF_DISABLE
-#define PERF_PROFILE_WITH_NAME(func_call, name) func_call;
+#define PERF_PROFILE_WITH_CONTEXT(context, func_call, name) func_call;
+#define PERF_PROFILE_SAMPLED_WITH_CONTEXT(context, func_call, name, period) func_call;
 #else
-#define PERF_PROFILE_WITH_NAME(func_call, name)                                                                 \
+#define PERF_PROFILE_WITH_CONTEXT(context, func_call, name) PERF_PROFILE_REGION(context, func_call, name, 1)
+
+/* Times func_call once and records it as standing for calls invocations */
+#define PERF_PROFILE_REGION(context, func_call, name, calls)                                                    \
     do                                                                                                          \
     {                                                                                                           \
-        unsigned long perf_start_cycles, perf_end_cycles;                                                       \
-        double perf_start_time_nano, perf_end_time_nano;                                                        \
+        unsigned long perf_start_cycles, perf_end_cycles, perf_cycles;                                          \
+        double perf_start_time_nano, perf_end_time_nano, perf_time_nano;                                        \
         double perf_time_ms;                                                                                    \
+        perf_counters perf_region_counters;                                                                     \
+        perf_counters_begin(&perf_region_counters);                                                             \
         perf_start_time_nano = perf_platform_current_time_nanoseconds();                                        \
         perf_start_cycles = perf_platform_current_cycle_count();                                                \
         func_call;                                                                                              \
         perf_end_cycles = perf_platform_current_cycle_count();                                                  \
         perf_end_time_nano = perf_platform_current_time_nanoseconds();                                          \
-        perf_time_ms = ((perf_end_time_nano - perf_start_time_nano) / 1000000.0);                               \
-        perf_print_result(                                                                                      \
-            __FILE__,                                                                                           \
-            __LINE__,                                                                                           \
-            perf_end_cycles - perf_start_cycles,                                                                \
-            perf_time_ms,                                                                                       \
-            (name));                                                                                            \
-        perf_stats_store_result(__FILE__, __LINE__, perf_end_cycles - perf_start_cycles, perf_time_ms, (name)); \
+        perf_counters_end(&perf_region_counters);                                                               \
+        perf_cycles = perf_end_cycles - perf_start_cycles;                                                      \
+        perf_time_nano = perf_end_time_nano - perf_start_time_nano;                                             \
+        perf_subtract_overhead(&perf_cycles, &perf_time_nano);                                                  \
+        perf_time_ms = perf_time_nano / 1000000.0;                                                              \
+        perf_report(__FILE__, __LINE__, perf_cycles, perf_time_ms, &perf_region_counters, (name));              \
+        PERF_STATS_RECORD((context), perf_cycles, perf_time_ms, &perf_region_counters, (calls), (name));        \
+    } while (0)
+
+#define PERF_PROFILE_SAMPLED_WITH_CONTEXT(context, func_call, name, period)                                     \
+    do                                                                                                          \
+    {                                                                                                           \
+        static PERF_THREAD_LOCAL unsigned long perf_sample_skip = 0;  /* calls left until the next sample */    \
+        static PERF_THREAD_LOCAL unsigned long perf_sample_calls = 0; /* calls since the last sample */         \
+        perf_sample_calls++;                                                                                    \
+        if (perf_sample_skip)                                                                                   \
+        {                                                                                                       \
+            perf_sample_skip--;                                                                                 \
+            func_call;                                                                                          \
+        }                                                                                                       \
+        else                                                                                                    \
+        {                                                                                                       \
+            perf_sample_skip = perf_sample_next_skip(period);                                                   \
+            PERF_PROFILE_REGION(context, func_call, name, perf_sample_calls);                                   \
+            perf_sample_calls = 0;                                                                              \
+        }                                                                                                       \
     } while (0)
 #endif
 
+/* #############################################################################
+ * # BENCHMARK RUNNER
+ * #############################################################################
+ *
+ * PERF_BENCH(&bench, code) runs code in batches until the numbers are stable enough
+ * to compare between builds:
+ *
+ *   1. warmup: batches grow (at most 10x per step) until one batch takes sample_ns
+ *      and warmup_ns passed in total, the last batch fixes the iterations per sample
+ *   2. samples_size batches of that many iterations, each one a sample of the time
+ *      and the cycles per iteration
+ *   3. samples with a modified z-score above 3.5 (median absolute deviation) are
+ *      rejected as outliers, the median of the rest is reported with its 95%
+ *      confidence interval (order statistics, no normality assumed)
+ *
+ * The cycles are read with lfence; rdtsc before and rdtscp; lfence after the batch on
+ * x86, so the measured code can not be reordered around the timestamps. Units added
+ * with perf_bench_unit (bytes, tokens, ... per iteration) are reported as throughput
+ * and cycles per unit. Keep results alive with PERF_BENCH_KEEP or a volatile sink.
+ */
+#ifndef PERF_BENCH_SAMPLES_MAX
+#define PERF_BENCH_SAMPLES_MAX 101
+#endif
+
+#ifndef PERF_BENCH_SAMPLES
+#define PERF_BENCH_SAMPLES 31 /* up to PERF_BENCH_SAMPLES_MAX */
+#endif
+
+#ifndef PERF_BENCH_WARMUP_NS
+#define PERF_BENCH_WARMUP_NS 100000000.0 /* 100 ms */
+#endif
+
+#ifndef PERF_BENCH_SAMPLE_NS
+#define PERF_BENCH_SAMPLE_NS 10000000.0 /* 10 ms */
+#endif
+
+#define PERF_BENCH_UNITS_MAX 4
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PERF_BENCH_KEEP(value) __asm__ __volatile__("" : : "r"(&(value)) : "memory")
+#else
+#define PERF_BENCH_KEEP(value) perf_bench_keep((void *)&(value))
+static void *volatile perf_bench_sink;
+PERF_API PERF_INLINE void perf_bench_keep(void *value)
+{
+    perf_bench_sink = value;
+}
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+PERF_API PERF_INLINE unsigned long perf_bench_cycles_begin(void)
+{
+    unsigned int low_part, high_part;
+    __asm__ __volatile__("lfence\n\trdtsc" : "=a"(low_part), "=d"(high_part) : : "memory");
+    return ((unsigned long)((double)high_part * 4294967296.0 + (double)low_part));
+}
+
+PERF_API PERF_INLINE unsigned long perf_bench_cycles_end(void)
+{
+    unsigned int low_part, high_part;
+    __asm__ __volatile__("rdtscp\n\tlfence" : "=a"(low_part), "=d"(high_part) : : "ecx", "memory");
+    return ((unsigned long)((double)high_part * 4294967296.0 + (double)low_part));
+}
+#else
+#define perf_bench_cycles_begin perf_platform_current_cycle_count
+#define perf_bench_cycles_end perf_platform_current_cycle_count
+#endif
+
+typedef enum perf_bench_phase
+{
+    PERF_BENCH_IDLE = 0,
+    PERF_BENCH_WARMUP,
+    PERF_BENCH_MEASURE,
+    PERF_BENCH_DONE
+
+} perf_bench_phase;
+
+typedef struct perf_bench_summary
+{
+    unsigned long samples;  /* kept */
+    unsigned long outliers; /* rejected */
+    double median;          /* ns per iteration */
+    double low;             /* 95% confidence interval of the median */
+    double high;
+    double min;
+    double max;
+
+} perf_bench_summary;
+
+typedef struct perf_bench
+{
+    char *name;
+    unsigned long samples_size; /* settings, perf_bench_init sets the defaults */
+    double warmup_ns;
+    double sample_ns;
+
+    unsigned long units_size;
+    double units[PERF_BENCH_UNITS_MAX]; /* per iteration */
+    char *unit_names[PERF_BENCH_UNITS_MAX];
+
+    perf_bench_phase phase;
+    unsigned long iterations; /* per batch */
+    double warmup_elapsed_ns;
+    unsigned long count;
+    double ns[PERF_BENCH_SAMPLES_MAX]; /* per iteration */
+    double cycles[PERF_BENCH_SAMPLES_MAX];
+
+    perf_bench_summary summary; /* once PERF_BENCH returned */
+    double cycles_median;
+
+} perf_bench;
+
+PERF_API PERF_INLINE double perf_sqrt(double value)
+{
+    double x = value > 1.0 ? value : 1.0;
+    int i;
+
+    if (value <= 0.0)
+    {
+        return 0.0;
+    }
+
+    for (i = 0; i < 64; ++i)
+    {
+        x = 0.5 * (x + value / x);
+    }
+
+    return x;
+}
+
+PERF_API PERF_INLINE void perf_sort(double *values, unsigned long size)
+{
+    unsigned long i, j;
+
+    for (i = 1; i < size; ++i)
+    {
+        double value = values[i];
+
+        for (j = i; j > 0 && values[j - 1] > value; --j)
+        {
+            values[j] = values[j - 1];
+        }
+
+        values[j] = value;
+    }
+}
+
+/* Median of sorted values */
+PERF_API PERF_INLINE double perf_median(double *values, unsigned long size)
+{
+    if (size == 0)
+    {
+        return 0.0;
+    }
+
+    return size % 2 ? values[size / 2] : 0.5 * (values[size / 2 - 1] + values[size / 2]);
+}
+
+/* Outlier rejection and median with its confidence interval of size samples (size <= PERF_BENCH_SAMPLES_MAX) */
+PERF_API PERF_INLINE void perf_bench_summarize(double *samples, unsigned long size, perf_bench_summary *summary)
+{
+    double sorted[PERF_BENCH_SAMPLES_MAX];
+    double deviations[PERF_BENCH_SAMPLES_MAX];
+    double median, mad, half_width;
+    unsigned long kept = 0;
+    unsigned long i;
+    long low, high;
+
+    for (i = 0; i < size; ++i)
+    {
+        sorted[i] = samples[i];
+    }
+
+    perf_sort(sorted, size);
+    median = perf_median(sorted, size);
+
+    for (i = 0; i < size; ++i)
+    {
+        deviations[i] = sorted[i] > median ? sorted[i] - median : median - sorted[i];
+    }
+
+    perf_sort(deviations, size);
+    mad = perf_median(deviations, size);
+
+    /* Modified z-score 0.6745 * |x - median| / mad > 3.5, keeps the sorted order */
+    for (i = 0; i < size; ++i)
+    {
+        double deviation = sorted[i] > median ? sorted[i] - median : median - sorted[i];
+
+        if (mad == 0.0 || 0.6745 * deviation <= 3.5 * mad)
+        {
+            sorted[kept++] = sorted[i];
+        }
+    }
+
+    summary->samples = kept;
+    summary->outliers = size - kept;
+    summary->median = perf_median(sorted, kept);
+    summary->min = kept ? sorted[0] : 0.0;
+    summary->max = kept ? sorted[kept - 1] : 0.0;
+
+    /* Ranks n / 2 -+ 1.96 * sqrt(n) / 2 (1 based) of the sorted samples */
+    half_width = 1.96 * perf_sqrt((double)kept) / 2.0;
+    low = (long)((double)kept / 2.0 - half_width);
+    high = (long)((double)kept / 2.0 + half_width + 1.0);
+    low = low < 1 ? 1 : low;
+    high = high > (long)kept ? (long)kept : high;
+
+    summary->low = kept ? sorted[low - 1] : 0.0;
+    summary->high = kept ? sorted[high - 1] : 0.0;
+}
+
+PERF_API PERF_INLINE void perf_bench_init(perf_bench *bench, char *name)
+{
+    bench->name = name;
+    bench->samples_size = PERF_BENCH_SAMPLES;
+    bench->warmup_ns = PERF_BENCH_WARMUP_NS;
+    bench->sample_ns = PERF_BENCH_SAMPLE_NS;
+    bench->units_size = 0;
+    bench->phase = PERF_BENCH_IDLE;
+    bench->iterations = 1;
+    bench->warmup_elapsed_ns = 0.0;
+    bench->count = 0;
+    bench->cycles_median = 0.0;
+}
+
+/* Reports units (bytes, tokens, ...) processed per iteration as throughput */
+PERF_API PERF_INLINE void perf_bench_unit(perf_bench *bench, double per_iteration, char *name)
+{
+    if (bench->units_size < PERF_BENCH_UNITS_MAX)
+    {
+        bench->units[bench->units_size] = per_iteration;
+        bench->unit_names[bench->units_size] = name;
+        bench->units_size++;
+    }
+}
+
+/* Iterations of the next batch, 0 once every sample is taken (the summary is ready then) */
+PERF_API PERF_INLINE unsigned long perf_bench_next(perf_bench *bench)
+{
+    if (bench->phase == PERF_BENCH_IDLE)
+    {
+        bench->phase = PERF_BENCH_WARMUP;
+        bench->iterations = 1;
+        bench->samples_size = bench->samples_size > PERF_BENCH_SAMPLES_MAX ? PERF_BENCH_SAMPLES_MAX : bench->samples_size;
+    }
+
+    if (bench->phase == PERF_BENCH_MEASURE && bench->count == bench->samples_size)
+    {
+        perf_bench_summarize(bench->ns, bench->count, &bench->summary);
+        perf_sort(bench->cycles, bench->count);
+        bench->cycles_median = perf_median(bench->cycles, bench->count);
+        bench->phase = PERF_BENCH_DONE;
+    }
+
+    return bench->phase == PERF_BENCH_DONE ? 0 : bench->iterations;
+}
+
+/* Takes the cycles and the time of the batch perf_bench_next asked for */
+PERF_API PERF_INLINE void perf_bench_sample(perf_bench *bench, unsigned long cycles, double ns)
+{
+    if (bench->phase == PERF_BENCH_WARMUP)
+    {
+        double scale = ns > 0.0 ? bench->sample_ns / ns : 10.0;
+
+        bench->warmup_elapsed_ns += ns;
+
+        if (scale > 1.0 || bench->warmup_elapsed_ns < bench->warmup_ns)
+        {
+            double iterations = (double)bench->iterations * (scale > 10.0 ? 10.0 : scale);
+
+            bench->iterations = iterations < 1.0 ? 1 : (unsigned long)(iterations + 0.5);
+        }
+
+        if (scale <= 1.0 && bench->warmup_elapsed_ns >= bench->warmup_ns)
+        {
+            double iterations = (double)bench->iterations * scale;
+
+            bench->iterations = iterations < 1.0 ? 1 : (unsigned long)(iterations + 0.5);
+            bench->phase = PERF_BENCH_MEASURE;
+        }
+
+        return;
+    }
+
+    if (bench->phase == PERF_BENCH_MEASURE && bench->count < bench->samples_size)
+    {
+        bench->ns[bench->count] = ns / (double)bench->iterations;
+        bench->cycles[bench->count] = (double)cycles / (double)bench->iterations;
+        bench->count++;
+    }
+}
+
+/* The number in a right aligned field of perf_ulong_to_string / perf_double_to_string */
+PERF_API PERF_INLINE char *perf_bench_trim(char *str)
+{
+    while (*str == ' ')
+    {
+        str++;
+    }
+
+    return str;
+}
+
+/* Appends value scaled to K, M or G, returns the number of characters appended */
+PERF_API PERF_INLINE unsigned long perf_bench_append_scaled(char *buffer, unsigned long current_pos, double value)
+{
+    char value_str[12];
+    char *prefix = " ";
+    unsigned long appended;
+
+    if (value >= 1e9)
+    {
+        value /= 1e9;
+        prefix = " G";
+    }
+    else if (value >= 1e6)
+    {
+        value /= 1e6;
+        prefix = " M";
+    }
+    else if (value >= 1e3)
+    {
+        value /= 1e3;
+        prefix = " K";
+    }
+
+    perf_double_to_string(value, value_str, sizeof(value_str), 2);
+
+    appended = perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(value_str));
+    return appended + perf_append_string(buffer, current_pos + appended, PERF_MAX_PRINT_BUFFER, prefix);
+}
+
+PERF_API PERF_INLINE void perf_bench_print(perf_bench *bench)
+{
+    perf_bench_summary *s = &bench->summary;
+    char buffer[PERF_MAX_PRINT_BUFFER];
+    char median_str[14];
+    char low_str[14];
+    char high_str[14];
+    char cycles_str[14];
+    char kept_str[8];
+    char outliers_str[8];
+    char iterations_str[14];
+    unsigned long current_pos = 0;
+    unsigned long i;
+
+    perf_double_to_string(s->median, median_str, sizeof(median_str), 2);
+    perf_double_to_string(s->low, low_str, sizeof(low_str), 2);
+    perf_double_to_string(s->high, high_str, sizeof(high_str), 2);
+    perf_double_to_string(bench->cycles_median, cycles_str, sizeof(cycles_str), 1);
+    perf_ulong_to_string(s->samples, kept_str, sizeof(kept_str));
+    perf_ulong_to_string(s->outliers, outliers_str, sizeof(outliers_str));
+    perf_ulong_to_string(bench->iterations, iterations_str, sizeof(iterations_str));
+
+    buffer[0] = '\0';
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "[bench] ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, bench->name);
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n[bench]   median ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(median_str));
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " ns/iter, 95% CI [");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(low_str));
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ", ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(high_str));
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "], ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(cycles_str));
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " cycles/iter\n[bench]   samples ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(kept_str));
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " (outliers ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(outliers_str));
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, ") x ");
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(iterations_str));
+    current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " iterations\n");
+
+    for (i = 0; i < bench->units_size; ++i)
+    {
+        char per_unit_str[14];
+        double per_second = s->median > 0.0 ? bench->units[i] * 1e9 / s->median : 0.0;
+
+        perf_double_to_string(bench->units[i] > 0.0 ? bench->cycles_median / bench->units[i] : 0.0, per_unit_str, sizeof(per_unit_str), 3);
+
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "[bench]   ");
+        current_pos += perf_bench_append_scaled(buffer, current_pos, per_second);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, bench->unit_names[i]);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "/s, ");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, perf_bench_trim(per_unit_str));
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, " cycles/");
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, bench->unit_names[i]);
+        current_pos += perf_append_string(buffer, current_pos, PERF_MAX_PRINT_BUFFER, "\n");
+    }
+
+    perf_platform_print(buffer);
+}
+
+/* Writes the summaries of benches as CSV (one row per bench), returns the length. Every row
+ * has the columns unit0,per_second0 .. unitN,per_secondN for PERF_BENCH_UNITS_MAX units,
+ * the units a bench did not declare with perf_bench_unit are left empty */
+PERF_API PERF_INLINE unsigned long perf_bench_csv(perf_bench *benches, unsigned long size, char *buffer, unsigned long capacity)
+{
+    perf_record r;
+    unsigned long i, j;
+
+    perf_record_init(&r, buffer, capacity);
+    perf_record_text(&r, "name,samples,outliers,iterations,median_ns,low_ns,high_ns,min_ns,max_ns,cycles");
+
+    for (j = 0; j < PERF_BENCH_UNITS_MAX; ++j)
+    {
+        perf_record_text(&r, ",unit");
+        perf_record_ulong(&r, j);
+        perf_record_text(&r, ",per_second");
+        perf_record_ulong(&r, j);
+    }
+
+    perf_record_char(&r, '\n');
+
+    if (!perf_record_row_end(&r))
+    {
+        return 0;
+    }
+
+    for (i = 0; i < size; ++i)
+    {
+        perf_bench *bench = &benches[i];
+        perf_bench_summary *s = &bench->summary;
+
+        perf_record_row_begin(&r);
+        perf_record_quoted(&r, bench->name, 0);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, s->samples);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, s->outliers);
+        perf_record_char(&r, ',');
+        perf_record_ulong(&r, bench->iterations);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, s->median, 3);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, s->low, 3);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, s->high, 3);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, s->min, 3);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, s->max, 3);
+        perf_record_char(&r, ',');
+        perf_record_double(&r, bench->cycles_median, 3);
+
+        for (j = 0; j < PERF_BENCH_UNITS_MAX; ++j)
+        {
+            perf_record_char(&r, ',');
+
+            if (j < bench->units_size)
+            {
+                perf_record_quoted(&r, bench->unit_names[j], 0);
+                perf_record_char(&r, ',');
+                perf_record_double(&r, s->median > 0.0 ? bench->units[j] * 1e9 / s->median : 0.0, 3);
+            }
+            else
+            {
+                perf_record_char(&r, ',');
+            }
+        }
+
+        perf_record_char(&r, '\n');
+
+        if (!perf_record_row_end(&r))
+        {
+            break;
+        }
+    }
+
+    return r.size;
+}
+
+/* Same as perf_bench_csv as a JSON array of objects */
+PERF_API PERF_INLINE unsigned long perf_bench_json(perf_bench *benches, unsigned long size, char *buffer, unsigned long capacity)
+{
+    perf_record r;
+    unsigned long i, j;
+
+    if (capacity < 4)
+    {
+        return 0;
+    }
+
+    perf_record_init(&r, buffer, capacity - 3); /* room for the closing "\n]\n" */
+    perf_record_char(&r, '[');
+
+    for (i = 0; i < size; ++i)
+    {
+        perf_bench *bench = &benches[i];
+        perf_bench_summary *s = &bench->summary;
+
+        perf_record_row_begin(&r);
+        perf_record_text(&r, i ? ",\n{\"name\":" : "\n{\"name\":");
+        perf_record_quoted(&r, bench->name, 1);
+        perf_record_text(&r, ",\"samples\":");
+        perf_record_ulong(&r, s->samples);
+        perf_record_text(&r, ",\"outliers\":");
+        perf_record_ulong(&r, s->outliers);
+        perf_record_text(&r, ",\"iterations\":");
+        perf_record_ulong(&r, bench->iterations);
+        perf_record_text(&r, ",\"median_ns\":");
+        perf_record_double(&r, s->median, 3);
+        perf_record_text(&r, ",\"low_ns\":");
+        perf_record_double(&r, s->low, 3);
+        perf_record_text(&r, ",\"high_ns\":");
+        perf_record_double(&r, s->high, 3);
+        perf_record_text(&r, ",\"min_ns\":");
+        perf_record_double(&r, s->min, 3);
+        perf_record_text(&r, ",\"max_ns\":");
+        perf_record_double(&r, s->max, 3);
+        perf_record_text(&r, ",\"cycles\":");
+        perf_record_double(&r, bench->cycles_median, 3);
+        perf_record_text(&r, ",\"per_second\":{");
+
+        for (j = 0; j < bench->units_size; ++j)
+        {
+            perf_record_text(&r, j ? "," : "");
+            perf_record_quoted(&r, bench->unit_names[j], 1);
+            perf_record_char(&r, ':');
+            perf_record_double(&r, s->median > 0.0 ? bench->units[j] * 1e9 / s->median : 0.0, 3);
+        }
+
+        perf_record_text(&r, "}}");
+
+        if (!perf_record_row_end(&r))
+        {
+            break;
+        }
+    }
+
+    r.capacity = capacity;
+    r.full = 0;
+    perf_record_text(&r, "\n]\n");
+
+    return r.size;
+}
+
+#define PERF_BENCH(bench, code)                                                                                 \
+    do                                                                                                          \
+    {                                                                                                           \
+        unsigned long perf_iterations;                                                                          \
+        while ((perf_iterations = perf_bench_next(bench)) != 0)                                                 \
+        {                                                                                                       \
+            unsigned long perf_iteration, perf_start_cycles, perf_end_cycles;                                   \
+            double perf_start_time_nano = perf_platform_current_time_nanoseconds();                             \
+            perf_start_cycles = perf_bench_cycles_begin();                                                      \
+            for (perf_iteration = 0; perf_iteration < perf_iterations; ++perf_iteration)                        \
+            {                                                                                                   \
+                code;                                                                                           \
+            }                                                                                                   \
+            perf_end_cycles = perf_bench_cycles_end();                                                          \
+            perf_bench_sample(bench, perf_end_cycles - perf_start_cycles,                                       \
+                              perf_platform_current_time_nanoseconds() - perf_start_time_nano);                 \
+        }                                                                                                       \
+    } while (0)
+
 #endif /* PERF_H */
 
 /*
@@ -1,7 +1,10 @@
 @echo off
 setlocal enabledelayedexpansion
 
-set DEPS=test perf
+set DEPS=test
+
+REM Forks carry local changes and are never downloaded, upstream them before moving them to DEPS
+set FORKS=perf
 
 REM ===============================
 REM Check if DEPS is empty
@@ -47,4 +50,28 @@ for %%D in (%DEPS%) do (
     echo - %%D.h: https://github.com/nickscha/%%D - last updated: !TIMESTAMP! >> README.md
 )
 
+REM ===============================
+REM List forks, keep their local files
+REM ===============================
+for %%D in (%FORKS%) do (
+    echo - %%D.h: fork of https://github.com/nickscha/%%D - kept local, not downloaded >> README.md
+)
+
+echo. >> README.md
+echo --- >> README.md
+echo. >> README.md
+echo Forks: >> README.md
+echo. >> README.md
+echo perf.h is forked from perf.h v0.5 and extended for the aritlex tests and tools: >> README.md
+echo - log bucketed cycle histograms and percentiles per stats entry >> README.md
+echo - per call site entries in a hash table, per thread stats contexts and merging >> README.md
+echo - Linux perf_event counters around PERF_PROFILE regions with PERF_COUNTERS_ENABLE >> README.md
+echo - nested trace zones with Chrome trace JSON export with PERF_TRACE_ENABLE >> README.md
+echo - deferred printing and subtraction of the calibrated timer overhead >> README.md
+echo - CSV and JSON records of the stats and benchmark results >> README.md
+echo - the PERF_BENCH benchmark runner and PERF_PROFILE_SAMPLED >> README.md
+echo. >> README.md
+echo update_dependencies.bat does not download forks, it would overwrite the local changes. >> README.md
+echo Upstream the changes to https://github.com/nickscha/perf first, then move perf back to DEPS. >> README.md
+
 echo README.md generated successfully.
@@ -254,6 +254,1288 @@ static void aritlex_test_symbols(void)
   assert(tokens[4].type == TOK_EOF);
 }
 
+static aritlex_program program;
+
+static u32 aritlex_test_compile(s8 *code)
+{
+  return aritlex_tokenize(code, aritlex_strlen(code), tokens, TOKENS_CAPACITY, &tokens_size) &&
+         aritlex_compile(tokens, tokens_size, &program);
+}
+
+/* The value of a float literal as the evaluators see it, Qm.n precision with ARITLEX_FIXED_POINT */
+static f64 aritlex_test_literal(s8 *code)
+{
+  aritlex_token literal[2];
+  u32 literal_size;
+
+  return aritlex_tokenize(code, aritlex_strlen(code), literal, 2, &literal_size) ? literal[0].val.number_floating : 0.0;
+}
+
+/* Binds the variables a, b, c, d of the compiled program from one row of values */
+static void aritlex_test_bind(f64 *vars, f64 *values)
+{
+  u32 i;
+
+  for (i = 0; i < program.vars_size; ++i)
+  {
+    vars[i] = values[program.vars[i][0] - 'a'];
+  }
+}
+
+static u32 aritlex_test_same(f64 x, f64 y)
+{
+  return x == y || (x != x && y != y);
+}
+
+static u32 aritlex_test_random_state = 12345;
+
+static u32 aritlex_test_random(void)
+{
+  aritlex_test_random_state = aritlex_test_random_state * 1103515245u + 12345u;
+  return aritlex_test_random_state >> 8;
+}
+
+/* Mix of small integers, zeros, fractions and values outside the s32 range */
+static f64 aritlex_test_random_value(void)
+{
+  switch (aritlex_test_random() % 6)
+  {
+  case 0:
+    return 0.0;
+  case 1:
+    return (f64)(aritlex_test_random() % 7) - 3.0;
+  case 2:
+    return ((f64)(aritlex_test_random() % 20001) - 10000.0) / 64.0;
+  case 3:
+    return (aritlex_test_random() % 2) ? 3000000000.0 : -3000000000.0;
+  default:
+    return (f64)(aritlex_test_random() % 201) - 100.0;
+  }
+}
+
+static void aritlex_test_compile_expression(void)
+{
+  assert(aritlex_test_compile("1 + 2 * 3") == 1);
+  assert(program.code_size == 5);
+  assert(program.stack_size == 3);
+  assert(program.code[3].type == TOK_MUL);
+  assert(program.code[4].type == TOK_PLUS);
+
+  assert(aritlex_test_compile("price * qty - price") == 1);
+  assert(program.vars_size == 2);
+  assert(aritlex_program_slot(&program, "price") == 0);
+  assert(aritlex_program_slot(&program, "qty") == 1);
+  assert(aritlex_program_slot(&program, "missing") == ARITLEX_SLOT_INVALID);
+
+  assert(aritlex_test_compile("a ? b : c ? d : e") == 1);
+  assert(program.code[program.code_size - 1].type == TOK_QMARK);
+  assert(program.code[program.code_size - 1].arity == 3);
+
+  assert(!aritlex_test_compile("1 +"));
+  assert(!aritlex_test_compile("(1 + 2"));
+  assert(!aritlex_test_compile("1 2"));
+  assert(!aritlex_test_compile("a = 1"));
+  assert(!aritlex_test_compile("a ? b"));
+}
+
+static void aritlex_test_eval_semantics(void)
+{
+  static struct
+  {
+    s8 *code;
+    f64 expected;
+  } cases[] = {
+      {"2 + 3 * 4 - 6 / 2", 11.0},
+      {"(2 + 3) * 4", 20.0},
+      {"7 / 2", 3.0},
+      {"7 / 2.0", 3.5},
+      {"-7 % 3", -1.0},
+      {"1 / 0 + 5 % 0", 0.0},
+      {"2147483647 + 1", -2147483648.0},
+      {"1 << 33", 2.0},
+      {"-8 >> 1", -4.0},
+      {"0x10 | 0b0011 ^ 1", 18.0},
+      {"1 < 2 && 2.5 >= 2.5 || 0", 1.0},
+      {"!0 + !3 + ~0", 0.0},
+      {"- -a", 2.5},
+      {"a * 2", 5.0},
+      {"a % 2", 0.0},
+      {"b & 6", 4.0},
+      {"a > 0 ? 10 : 20", 10.0},
+      {"a < 0 ? 1 : b", -4.0},
+      {"1 ? 2 : 3 ? 4 : 5", 2.0},
+      {"0 ? 2 : 0 ? 4 : 5", 5.0},
+      {"a != a", 0.0}};
+
+  f64 values[4] = {2.5, -4.0, 0.0, 1.0};
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  u32 i;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+  {
+    assert(aritlex_test_compile(cases[i].code) == 1);
+    aritlex_test_bind(vars, values);
+    assert(aritlex_eval(&program, vars) == cases[i].expected);
+  }
+
+  assert(aritlex_test_compile("7 / 2") == 1);
+  assert(aritlex_eval_value(&program, vars).type == ARITLEX_TYPE_S32);
+  assert(aritlex_test_compile("7 / 2.0") == 1);
+  assert(aritlex_eval_value(&program, vars).type == ARITLEX_TYPE_F64);
+}
+
+#define BATCH_ROWS 1027 /* not a multiple of any vector width to exercise the kernel tails */
+
+static void aritlex_test_eval_batch(void)
+{
+  static s8 *codes[] = {
+      "a + b * c - d / a",
+      "(a < b) + (c >= d) * 2 - (a == a) + (b != c) + (c <= d) + (d > a)",
+      "a % 7 + (b & 12) - (c | 3) ^ (d << 2) >> 1",
+      "(3 + 4) * 5 / 2 % 3 - (9 / 0) + (a / 0)",
+      "-a + ~b - !c + -(a < d)",
+      "a > b ? c : d",
+      "a > b ? 1 : 2",
+      "a ? b / 3 : 7",
+      "a && b || !c",
+      "(a < 1) && (b > 2.5) || c == 0",
+      "a * 3 / (b - 1) + 1.5",
+      "(c << (a < 0)) * (d >> 3) / (b % 5) - 7 % (c + 1)"};
+
+  static f64 data[4][BATCH_ROWS];
+  static f64 out[BATCH_ROWS];
+  static aritlex_batch_scratch scratch;
+  static aritlex_kernels kernels;
+  f64 *columns[ARITLEX_VARS_CAPACITY];
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  f64 values[4];
+  u32 level, supported = aritlex_simd_detect();
+  u32 i, j, row;
+
+  for (i = 0; i < 4; ++i)
+  {
+    for (row = 0; row < BATCH_ROWS; ++row)
+    {
+      data[i][row] = aritlex_test_random_value();
+    }
+  }
+
+  printf("[aritlex] simd level: %u\n", supported);
+
+  aritlex_batch_init(&scratch);
+  assert(scratch.kernels->level == supported);
+
+  for (level = ARITLEX_SIMD_SCALAR; level <= supported; ++level)
+  {
+    aritlex_kernels_init(&kernels, level);
+    scratch.kernels = &kernels;
+
+    for (i = 0; i < sizeof(codes) / sizeof(codes[0]); ++i)
+    {
+      u32 mismatches = 0;
+
+      assert(aritlex_test_compile(codes[i]) == 1);
+
+      for (j = 0; j < program.vars_size; ++j)
+      {
+        columns[j] = data[program.vars[j][0] - 'a'];
+      }
+
+      assert(aritlex_eval_batch(&program, columns, BATCH_ROWS, out, &scratch) == 1);
+
+      for (row = 0; row < BATCH_ROWS; ++row)
+      {
+        for (j = 0; j < 4; ++j)
+        {
+          values[j] = data[j][row];
+        }
+
+        aritlex_test_bind(vars, values);
+        mismatches += !aritlex_test_same(out[row], aritlex_eval(&program, vars));
+      }
+
+      assert(mismatches == 0);
+    }
+  }
+}
+
+/* Appends a random expression over a..d; depth bounds the size and the register pressure */
+static void aritlex_test_random_expression(s8 *buffer, u32 *size, u32 depth)
+{
+  static s8 *operators[] = {"+", "-", "*", "/", "<", "<=", ">", ">=", "==", "!=", "&&", "||", "%", "&", "<<"};
+  static s8 *leaves[] = {"a", "b", "c", "d", "2", "0", "1.5", "-3"};
+  s8 *part;
+  u32 choice = aritlex_test_random() % 8;
+
+  if (depth == 0 || choice < 2)
+  {
+    part = leaves[aritlex_test_random() % (sizeof(leaves) / sizeof(leaves[0]))];
+    while (*part)
+    {
+      buffer[(*size)++] = *part++;
+    }
+    return;
+  }
+
+  buffer[(*size)++] = '(';
+
+  if (choice == 2)
+  {
+    buffer[(*size)++] = (aritlex_test_random() % 2) ? '-' : '!';
+    buffer[(*size)++] = ' '; /* keeps "- -3" from lexing as a decrement */
+    aritlex_test_random_expression(buffer, size, depth - 1);
+  }
+  else if (choice == 3)
+  {
+    aritlex_test_random_expression(buffer, size, depth - 1);
+    buffer[(*size)++] = '?';
+    aritlex_test_random_expression(buffer, size, depth - 1);
+    buffer[(*size)++] = ':';
+    aritlex_test_random_expression(buffer, size, depth - 1);
+  }
+  else
+  {
+    /* Mostly the f64 friendly operators, the last ones force the interpreter fallback */
+    u32 count = sizeof(operators) / sizeof(operators[0]);
+    aritlex_test_random_expression(buffer, size, depth - 1);
+    part = operators[aritlex_test_random() % ((aritlex_test_random() % 8) ? count - 3 : count)];
+    buffer[(*size)++] = ' ';
+    while (*part)
+    {
+      buffer[(*size)++] = *part++;
+    }
+    buffer[(*size)++] = ' ';
+    aritlex_test_random_expression(buffer, size, depth - 1);
+  }
+
+  buffer[(*size)++] = ')';
+}
+
+#define JIT_ROWS 64
+#define JIT_EXPRESSIONS 300
+
+static void aritlex_test_jit(void)
+{
+  static struct
+  {
+    s8 *code;
+    u32 native;
+  } cases[] = {
+      {"a + b * c - d / a", 1},
+      {"(a < b) + 2.5 * (c >= d) - (a == a) + (b != c) + (c <= d) + (d > a)", 1},
+      {"a > b ? c : d", 1},
+      {"a ? b / 3 : 7", 1},
+      {"a && b || !c", 1},
+      {"-a * (1 + 2 * 3) - 7 / 2 + (5 % 3 << 2)", 1},
+      {"0 ? a : b + 1", 1},
+      {"1.5 + 2", 1},
+      {"a % 7", 0},
+      {"(a < b) + (c < d)", 0},
+      {"-(a < d)", 0},
+      {"~b", 0},
+      {"c << 1", 0}};
+
+  static s8 code[1024];
+  f64 values[4];
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  aritlex_jit jit;
+  u32 i, j, row, size, native = 0;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+  {
+    u32 mismatches = 0;
+
+    assert(aritlex_test_compile(cases[i].code) == 1);
+
+#if !defined(ARITLEX_NO_JIT) && defined(__linux__) && defined(__x86_64__)
+    assert(aritlex_jit_compile(&program, &jit) == cases[i].native);
+#else
+    assert(aritlex_jit_compile(&program, &jit) == 0);
+#endif
+
+    for (row = 0; row < JIT_ROWS; ++row)
+    {
+      for (j = 0; j < 4; ++j)
+      {
+        values[j] = aritlex_test_random_value();
+      }
+
+      aritlex_test_bind(vars, values);
+      mismatches += !aritlex_test_same(aritlex_jit_eval(&jit, vars), aritlex_eval(&program, vars));
+    }
+
+    aritlex_jit_free(&jit);
+    assert(mismatches == 0);
+  }
+
+  /* Differential test against the interpreter on random expressions and inputs */
+  for (i = 0; i < JIT_EXPRESSIONS; ++i)
+  {
+    u32 mismatches = 0;
+
+    size = 0;
+    aritlex_test_random_expression(code, &size, 4);
+    code[size] = 0;
+
+    assert(aritlex_test_compile(code) == 1);
+    native += aritlex_jit_compile(&program, &jit);
+
+    for (row = 0; row < JIT_ROWS; ++row)
+    {
+      for (j = 0; j < 4; ++j)
+      {
+        values[j] = aritlex_test_random_value();
+      }
+
+      aritlex_test_bind(vars, values);
+      mismatches += !aritlex_test_same(aritlex_jit_eval(&jit, vars), aritlex_eval(&program, vars));
+    }
+
+    if (mismatches)
+    {
+      printf("[aritlex] jit mismatch: %s\n", code);
+    }
+
+    aritlex_jit_free(&jit);
+    assert(mismatches == 0);
+  }
+
+  printf("[aritlex] jit compiled %u of %u random expressions\n", native, JIT_EXPRESSIONS);
+}
+
+static void aritlex_test_ruleset(void)
+{
+  static s8 *codes[] = {
+      "a * b",
+      "a * b - c",
+      "b * a + 1",
+      "(c - d) / d",
+      "(c - d) / d * 2",
+      "a * b - c",
+      "a > b ? (c - d) / d : a * b",
+      "a - b"};
+
+  static aritlex_ruleset set;
+  static aritlex_ruleset_node nodes[64];
+  static u32 table[128];
+  static u32 rules[16];
+  static aritlex_value values[64];
+  f64 out[16];
+  f64 data[4];
+  f64 vars[ARITLEX_RULESET_VARS_CAPACITY];
+  f64 program_vars[ARITLEX_VARS_CAPACITY];
+  u32 i, j, row, mismatches = 0;
+
+  assert(!aritlex_ruleset_init(&set, nodes, 64, table, 64, rules, 16));
+  assert(aritlex_ruleset_init(&set, nodes, 64, table, 128, rules, 16) == 1);
+
+  for (i = 0; i < sizeof(codes) / sizeof(codes[0]); ++i)
+  {
+    aritlex_tokenize(codes[i], aritlex_strlen(codes[i]), tokens, TOKENS_CAPACITY, &tokens_size);
+    assert(aritlex_ruleset_add(&set, tokens, tokens_size) == 1);
+  }
+
+  /* a, b, a*b, c, a*b-c, 1, a*b+1, d, c-d, (c-d)/d, 2, (c-d)/d*2, a>b, ?:, a-b */
+  assert(set.rules_size == 8);
+  assert(set.nodes_size == 15);
+  assert(set.instructions == 45);
+  assert(set.rules[1] == set.rules[5]);
+  assert(set.rules[0] == set.nodes[set.rules[2]].operands[0]);
+  assert(aritlex_ruleset_sharing(&set) == 3.0);
+
+  for (row = 0; row < 256; ++row)
+  {
+    for (j = 0; j < 4; ++j)
+    {
+      data[j] = aritlex_test_random_value();
+    }
+
+    for (j = 0; j < set.vars_size; ++j)
+    {
+      vars[j] = data[set.vars[j][0] - 'a'];
+    }
+
+    aritlex_ruleset_eval(&set, vars, values, out);
+
+    for (i = 0; i < set.rules_size; ++i)
+    {
+      assert(aritlex_test_compile(codes[i]) == 1);
+      aritlex_test_bind(program_vars, data);
+      mismatches += !aritlex_test_same(out[i], aritlex_eval(&program, program_vars));
+    }
+  }
+
+  assert(mismatches == 0);
+}
+
+static u32 aritlex_test_sheet_set(aritlex_sheet *sheet, s8 *code)
+{
+  return aritlex_tokenize(code, aritlex_strlen(code), tokens, TOKENS_CAPACITY, &tokens_size) &&
+         aritlex_sheet_set_formula(sheet, tokens, tokens_size);
+}
+
+static void aritlex_test_sheet(void)
+{
+  static aritlex_sheet sheet;
+  static aritlex_sheet_cell cells[16];
+  static u32 table[32];
+  f64 value = 0.0;
+  u32 evaluations;
+
+  assert(!aritlex_sheet_init(&sheet, cells, 16, table, 16));
+  assert(aritlex_sheet_init(&sheet, cells, 16, table, 32) == 1);
+
+  assert(aritlex_sheet_set_input(&sheet, "a", 1.0) == 1);
+  assert(aritlex_sheet_set_input(&sheet, "b", 2.0) == 1);
+  assert(aritlex_sheet_set_input(&sheet, "c", 4.0) == 1);
+
+  /* Defined out of order: x reads ratio before ratio exists */
+  assert(aritlex_test_sheet_set(&sheet, "total = a + b") == 1);
+  assert(aritlex_test_sheet_set(&sheet, "x = ratio * 2 + total") == 1);
+  assert(aritlex_test_sheet_set(&sheet, "ratio = total / c") == 1);
+  assert(aritlex_test_sheet_set(&sheet, "y = d * 2") == 1);
+
+  assert(aritlex_sheet_get(&sheet, "x", &value) == 1);
+  assert(value == 4.5);
+
+  /* Only total, ratio and x are downstream of a, each evaluated once */
+  evaluations = sheet.evaluations;
+  assert(aritlex_sheet_set_input(&sheet, "a", 6.0) == 1);
+  assert(sheet.evaluations - evaluations == 3);
+  assert(aritlex_sheet_get(&sheet, "x", &value) == 1);
+  assert(value == 12.0);
+
+  evaluations = sheet.evaluations;
+  assert(aritlex_sheet_set_input(&sheet, "d", 5.0) == 1);
+  assert(sheet.evaluations - evaluations == 1);
+  assert(aritlex_sheet_get(&sheet, "y", &value) == 1);
+  assert(value == 10.0);
+
+  /* Cycles are rejected and keep the previous definition */
+  assert(!aritlex_test_sheet_set(&sheet, "a = x + 1"));
+  assert(sheet.cycle_cell == aritlex_sheet_find(&sheet, "x"));
+  assert(!aritlex_test_sheet_set(&sheet, "total = total + 1"));
+  assert(sheet.cycle_cell == aritlex_sheet_find(&sheet, "total"));
+  assert(aritlex_sheet_get(&sheet, "a", &value) == 1);
+  assert(value == 6.0);
+
+  /* Redefining ratio drops its dependency on c */
+  assert(aritlex_test_sheet_set(&sheet, "ratio = total - 1") == 1);
+  assert(aritlex_sheet_get(&sheet, "x", &value) == 1);
+  assert(value == 22.0);
+
+  evaluations = sheet.evaluations;
+  assert(aritlex_sheet_set_input(&sheet, "c", 1.0) == 1);
+  assert(sheet.evaluations == evaluations);
+
+  /* Replacing a formula by a value detaches it from its inputs */
+  assert(aritlex_sheet_set_input(&sheet, "total", 1.0) == 1);
+  assert(aritlex_sheet_get(&sheet, "x", &value) == 1);
+  assert(value == 1.0);
+  evaluations = sheet.evaluations;
+  assert(aritlex_sheet_set_input(&sheet, "a", 0.0) == 1);
+  assert(sheet.evaluations == evaluations);
+  assert(aritlex_test_sheet_set(&sheet, "a = x + 1") == 1);
+
+  assert(!aritlex_test_sheet_set(&sheet, "a + 1"));
+  assert(!aritlex_sheet_get(&sheet, "missing", &value));
+}
+
+#define FILTER_ROWS 1000
+
+static void aritlex_test_filter_aggregate(void)
+{
+  static struct
+  {
+    s8 *predicate;
+    s8 *value;
+  } cases[] = {
+      {"a == 0 && b > 10", "c * 2 + d"}, /* sparse selection, gathered */
+      {"a != 0", "c * d"},               /* dense selection */
+      {"1", "a - b"},                    /* every row */
+      {"a > 1000000", "a"},              /* no row */
+      {"b / 3.0", "(c < d) + 1"},        /* f64 predicate, s32 value */
+      {"c > d", "a / b"}};
+
+  static f64 data[4][FILTER_ROWS];
+  static aritlex_program predicate;
+  static aritlex_filter_scratch scratch;
+  f64 *predicate_columns[ARITLEX_VARS_CAPACITY];
+  f64 *value_columns[ARITLEX_VARS_CAPACITY];
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  f64 values[4];
+  u32 i, j, row, aggregate;
+
+  for (i = 0; i < 4; ++i)
+  {
+    for (row = 0; row < FILTER_ROWS; ++row)
+    {
+      data[i][row] = aritlex_test_random_value();
+    }
+  }
+
+  aritlex_filter_init(&scratch);
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+  {
+    assert(aritlex_test_compile(cases[i].predicate) == 1);
+    predicate = program;
+    assert(aritlex_test_compile(cases[i].value) == 1);
+
+    for (j = 0; j < predicate.vars_size; ++j)
+    {
+      predicate_columns[j] = data[predicate.vars[j][0] - 'a'];
+    }
+
+    for (j = 0; j < program.vars_size; ++j)
+    {
+      value_columns[j] = data[program.vars[j][0] - 'a'];
+    }
+
+    for (aggregate = ARITLEX_AGGREGATE_SUM; aggregate <= ARITLEX_AGGREGATE_COUNT; ++aggregate)
+    {
+      f64 expected = aggregate == ARITLEX_AGGREGATE_MIN ? 1.0 / 0.0 : (aggregate == ARITLEX_AGGREGATE_MAX ? -1.0 / 0.0 : 0.0);
+      f64 aggregated = 0.0;
+      u32 count = 0, expected_count = 0;
+
+      /* Reference: row by row with the interpreter */
+      for (row = 0; row < FILTER_ROWS; ++row)
+      {
+        f64 v;
+
+        for (j = 0; j < 4; ++j)
+        {
+          values[j] = data[j][row];
+        }
+
+        for (j = 0; j < predicate.vars_size; ++j)
+        {
+          vars[j] = values[predicate.vars[j][0] - 'a'];
+        }
+
+        if (aritlex_eval(&predicate, vars) == 0.0)
+        {
+          continue;
+        }
+
+        expected_count++;
+        aritlex_test_bind(vars, values);
+        v = aritlex_eval(&program, vars);
+
+        expected = aggregate == ARITLEX_AGGREGATE_SUM ? expected + v : (aggregate == ARITLEX_AGGREGATE_MIN ? (v < expected ? v : expected) : (aggregate == ARITLEX_AGGREGATE_MAX ? (v > expected ? v : expected) : expected + 1.0));
+      }
+
+      assert(aritlex_eval_filter_aggregate(&predicate, predicate_columns, &program, value_columns, FILTER_ROWS, (aritlex_aggregate)aggregate, &aggregated, &count, &scratch) == 1);
+      assert(count == expected_count);
+      assert(aritlex_test_same(aggregated, expected) == 1);
+    }
+  }
+
+  assert(aritlex_eval_filter_aggregate(&predicate, predicate_columns, 0, 0, FILTER_ROWS, ARITLEX_AGGREGATE_COUNT, values, 0, &scratch) == 1);
+  assert(!aritlex_eval_filter_aggregate(&predicate, predicate_columns, 0, 0, FILTER_ROWS, ARITLEX_AGGREGATE_SUM, values, 0, &scratch));
+}
+
+static f64 aritlex_test_eval_named(aritlex_program *compiled, f64 *values)
+{
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  u32 i;
+
+  for (i = 0; i < compiled->vars_size; ++i)
+  {
+    vars[i] = values[compiled->vars[i][0] - 'a'];
+  }
+
+  return aritlex_eval(compiled, vars);
+}
+
+static void aritlex_test_specialize(void)
+{
+  static aritlex_program residual;
+  static aritlex_specialize_cache cache;
+  static s8 code[1024];
+  static s8 *names[] = {"a", "b", "c", "d"};
+  aritlex_binding bindings[4];
+  f64 values[4];
+  f64 vars[1];
+  u32 i, j, row, size, mismatches = 0;
+
+  bindings[0].name = "threshold";
+  bindings[0].value = 2.0;
+  bindings[1].name = "rate";
+  bindings[1].value = 3.0;
+
+  assert(aritlex_test_compile("threshold * rate + x") == 1);
+  assert(aritlex_specialize(&program, bindings, 2, &residual) == 1);
+  assert(residual.code_size == 3);
+  assert(residual.code[0].type == TOK_NUM_FLOAT);
+  assert(residual.code[0].val.number_floating == 6.0);
+  assert(residual.vars_size == 1);
+  assert(aritlex_program_slot(&residual, "x") == 0);
+  vars[0] = 1.5;
+  assert(aritlex_eval(&residual, vars) == 7.5);
+
+  /* Constant condition keeps one branch, promoted to f64 since the other branch is f64 */
+  assert(aritlex_test_compile("(rate < 1 ? x : 2) * 2") == 1);
+  assert(aritlex_specialize(&program, bindings, 2, &residual) == 1);
+  assert(residual.code_size == 1);
+  assert(residual.code[0].type == TOK_NUM_FLOAT);
+  assert(residual.vars_size == 0);
+
+  assert(aritlex_test_compile("threshold - 1 || x > 1") == 1);
+  assert(aritlex_specialize(&program, bindings, 2, &residual) == 1);
+  assert(residual.code_size == 1);
+  assert(residual.code[0].type == TOK_NUM_INTEGER);
+  assert(residual.code[0].val.number_integer == 1);
+
+  assert(aritlex_test_compile("(threshold < 0) && x") == 1);
+  assert(aritlex_specialize(&program, bindings, 2, &residual) == 1);
+  assert(residual.code_size == 1);
+  assert(residual.code[0].val.number_integer == 0);
+
+#ifdef ARITLEX_FIXED_POINT
+  /* Literals keep the Qm.n value they were parsed into */
+  assert(aritlex_test_compile("x * 0.1 + rate") == 1);
+  assert(aritlex_specialize(&program, bindings, 2, &residual) == 1);
+  assert(residual.code[1].type == TOK_NUM_FLOAT);
+  assert(residual.code[1].number_fixed == aritlex_fixed_parse("0.1", 0));
+  assert(residual.code[3].number_fixed == 3 * ARITLEX_FIXED_ONE);
+#endif
+
+  /* Residual programs of random expressions agree with the original for every subset of bound variables */
+  for (i = 0; i < 200; ++i)
+  {
+    u32 mask = aritlex_test_random() % 16;
+    u32 bindings_size = 0;
+
+    size = 0;
+    aritlex_test_random_expression(code, &size, 4);
+    code[size] = 0;
+    assert(aritlex_test_compile(code) == 1);
+
+    for (row = 0; row < 16; ++row)
+    {
+      for (j = 0; j < 4; ++j)
+      {
+        values[j] = aritlex_test_random_value();
+      }
+
+      bindings_size = 0;
+      for (j = 0; j < 4; ++j)
+      {
+        if (mask & (1u << j))
+        {
+          bindings[bindings_size].name = names[j];
+          bindings[bindings_size++].value = values[j];
+        }
+      }
+
+      if (!aritlex_specialize(&program, bindings, bindings_size, &residual) || residual.code_size > program.code_size + 2)
+      {
+        mismatches++;
+        continue;
+      }
+
+      mismatches += !aritlex_test_same(aritlex_test_eval_named(&residual, values), aritlex_test_eval_named(&program, values));
+    }
+  }
+
+  assert(mismatches == 0);
+
+  /* Cache keyed by the bound values, independent of the binding order */
+  aritlex_specialize_cache_init(&cache);
+  assert(aritlex_test_compile("a * b + c") == 1);
+
+  bindings[0].name = "a";
+  bindings[0].value = 2.0;
+  bindings[1].name = "b";
+  bindings[1].value = 4.0;
+  assert(aritlex_specialize_cached(&cache, &program, bindings, 2)->code_size == 3);
+
+  bindings[0].name = "b";
+  bindings[1].name = "a";
+  bindings[1].value = 2.0;
+  bindings[0].value = 4.0;
+  assert(aritlex_specialize_cached(&cache, &program, bindings, 2)->code_size == 3);
+  assert(cache.hits == 1);
+  assert(cache.misses == 1);
+
+  bindings[0].value = 5.0;
+  values[2] = 1.0;
+  assert(aritlex_test_eval_named(aritlex_specialize_cached(&cache, &program, bindings, 2), values) == 11.0);
+  assert(cache.misses == 2);
+
+  /* Recompiling into the same program misses instead of returning the old specialization */
+  assert(aritlex_test_compile("a * b - c") == 1);
+  assert(aritlex_test_eval_named(aritlex_specialize_cached(&cache, &program, bindings, 2), values) == 9.0);
+  assert(cache.misses == 3);
+  assert(aritlex_specialize_cached(&cache, &program, bindings, 2) != 0);
+  assert(cache.hits == 2);
+}
+
+static void aritlex_test_infer(void)
+{
+  static aritlex_typed_program typed;
+  static s8 code[1024];
+  aritlex_type declared[ARITLEX_VARS_CAPACITY];
+  aritlex_register registers[ARITLEX_VARS_CAPACITY];
+  f64 values[4];
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  u32 i, j, row, size, mismatches = 0;
+
+  /* With every variable declared f64 the typed evaluation matches aritlex_eval_value */
+  for (i = 0; i < 200; ++i)
+  {
+    size = 0;
+    aritlex_test_random_expression(code, &size, 4);
+    code[size] = 0;
+    assert(aritlex_test_compile(code) == 1);
+    assert(aritlex_infer(&program, 0, &typed) == 1);
+
+    for (row = 0; row < 16; ++row)
+    {
+      aritlex_value expected;
+
+      for (j = 0; j < 4; ++j)
+      {
+        values[j] = aritlex_test_random_value();
+      }
+
+      aritlex_test_bind(vars, values);
+
+      for (j = 0; j < program.vars_size; ++j)
+      {
+        registers[j].number_floating = vars[j];
+      }
+
+      expected = aritlex_eval_value(&program, vars);
+      mismatches += expected.type != typed.result_type ||
+                    !aritlex_test_same(aritlex_register_to_f64(aritlex_eval_typed(&typed, registers), typed.result_type), aritlex_value_to_f64(expected));
+    }
+  }
+
+  assert(mismatches == 0);
+
+  /* s32 variables keep the whole expression in s32 without promotions */
+  assert(aritlex_test_compile("a + b * 2") == 1);
+  declared[0] = ARITLEX_TYPE_S32;
+  declared[1] = ARITLEX_TYPE_S32;
+  assert(aritlex_infer(&program, declared, &typed) == 1);
+  assert(typed.result_type == ARITLEX_TYPE_S32);
+  assert(typed.promotions_size == 0);
+  assert(typed.pure[program.code_size - 1] == 1);
+  registers[0].number_integer = 2147483647;
+  registers[1].number_integer = 1;
+  assert(aritlex_eval_typed(&typed, registers).number_integer == -2147483647); /* wraps */
+
+  assert(aritlex_test_compile("a + 0.5") == 1);
+  assert(aritlex_infer(&program, declared, &typed) == 1);
+  assert(typed.result_type == ARITLEX_TYPE_F64);
+  assert(typed.promotions_size == 1);
+  assert(typed.promotions[0].instruction == 2);
+  assert(typed.promotions[0].operand == 0);
+  assert(typed.promotions[0].from == ARITLEX_TYPE_S32);
+  assert(typed.promotions[0].to == ARITLEX_TYPE_F64);
+  assert(typed.pure[0] == 1);
+  assert(typed.pure[2] == 0);
+  registers[0].number_integer = 3;
+  assert(aritlex_eval_typed(&typed, registers).number_floating == 3.5);
+
+  /* s64 arithmetic is exact beyond the s32 and f64 mantissa range */
+  assert(aritlex_test_compile("a * b + 1") == 1);
+  declared[0] = ARITLEX_TYPE_S64;
+  declared[1] = ARITLEX_TYPE_S32;
+  assert(aritlex_infer(&program, declared, &typed) == 1);
+  assert(typed.result_type == ARITLEX_TYPE_S64);
+  assert(typed.promotions_size == 2);
+  assert(typed.promotions[0].instruction == 2);
+  assert(typed.promotions[0].operand == 1);
+  assert(typed.promotions[1].instruction == 4);
+  assert(typed.types[2] == ARITLEX_TYPE_S64);
+  registers[0].number_integer64 = (s64)3000000 * 1000;
+  registers[1].number_integer = 3000;
+  assert(aritlex_eval_typed(&typed, registers).number_integer64 == (s64)9000000 * 1000000 + 1);
+
+  assert(aritlex_test_compile("a * a == 0 && (a << 20) / -1 < 0") == 1);
+  assert(aritlex_infer(&program, declared, &typed) == 1);
+  assert(typed.result_type == ARITLEX_TYPE_S32);
+  registers[0].number_integer64 = (s64)65536 * 65536; /* squared wraps to 0 */
+  assert(aritlex_eval_typed(&typed, registers).number_integer == 1);
+
+  /* Mixed ternary branches are promoted to f64, the condition only needs its truth value */
+  assert(aritlex_test_compile("a ? b : 1.5") == 1);
+  declared[1] = ARITLEX_TYPE_S64;
+  assert(aritlex_infer(&program, declared, &typed) == 1);
+  assert(typed.result_type == ARITLEX_TYPE_F64);
+  assert(typed.promotions_size == 1);
+  assert(typed.promotions[0].operand == 1);
+  assert(typed.promotions[0].from == ARITLEX_TYPE_S64);
+  registers[0].number_integer64 = 0;
+  assert(aritlex_eval_typed(&typed, registers).number_floating == 1.5);
+  registers[0].number_integer64 = 7;
+  registers[1].number_integer64 = 9;
+  assert(aritlex_eval_typed(&typed, registers).number_floating == 9.0);
+}
+
+static s8 *aritlex_test_fixed_codes[] = {
+    "a + b * 0.25 - c",
+    "(a - b) * (c + 1.5) / 8",
+    "a < b ? a * 0.5 : b / (d * d + 1)",
+    "(a % 3) + (b & 7) - ~c",
+    "-a * 2.125 + !b + (c >= d && a != 0.5)",
+    "a / 3.0 * 3"};
+
+static void aritlex_test_fixed(void)
+{
+  static struct
+  {
+    s8 *code;
+    f64 expected;
+  } cases[] = {
+      {"1.5", 1.5},
+      {"0.1", 6554.0 / 65536.0}, /* 6553.6 rounds up */
+      {"-2.25e1", -22.5},
+      {"1_000.000_5", 65536033.0 / 65536.0},
+      {"0.00000762939453125", 1.0 / 65536.0}, /* exactly half an ulp, ties away from zero */
+      {"0.0000076293945312", 0.0},
+      {"12345678901234567890e-15", 809086412.0 / 65536.0},
+      {"4e4", 32767.0 + 65535.0 / 65536.0}, /* saturates */
+      {"-32768", -32768.0},
+      {"-1e100", -32768.0},
+      {"1e-100", 0.0}};
+  f64 values[4] = {2.5, -4.0, 0.0, 1.0};
+  aritlex_fixed fixed[ARITLEX_VARS_CAPACITY];
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  s8 *end;
+  u32 i, mismatches = 0;
+
+  for (i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+  {
+    assert(aritlex_fixed_to_f64(aritlex_fixed_parse(cases[i].code, &end)) == cases[i].expected);
+    assert(*end == 0);
+  }
+
+#ifdef ARITLEX_FIXED_POINT
+  /* Literals are parsed into Qm.n only, the f64 value is its exact conversion */
+  assert(aritlex_test_compile("0.1 * x") == 1);
+  assert(program.code[0].number_fixed == aritlex_fixed_parse("0.1", 0));
+  assert(program.code[0].val.number_floating == aritlex_fixed_to_f64(aritlex_fixed_parse("0.1", 0)));
+#endif
+
+  /* Integer subexpressions keep the s32 semantics */
+  assert(aritlex_test_compile("7 / 2 + (2147483647 + 1 < 0)") == 1);
+  assert(aritlex_eval_fixed_value(&program, fixed).type == ARITLEX_TYPE_S32);
+  assert(aritlex_eval_fixed(&program, fixed) == 4 * ARITLEX_FIXED_ONE);
+
+  /* The f64 operators saturate and round to nearest */
+  fixed[0] = aritlex_fixed_from_s32(30000);
+  assert(aritlex_test_compile("a * 2") == 1);
+  assert(aritlex_eval_fixed(&program, fixed) == ARITLEX_FIXED_MAX);
+  assert(aritlex_test_compile("-a * 2 - 1") == 1);
+  assert(aritlex_eval_fixed(&program, fixed) == ARITLEX_FIXED_MIN);
+  assert(aritlex_test_compile("a / 0") == 1);
+  assert(aritlex_eval_fixed(&program, fixed) == ARITLEX_FIXED_MAX);
+  fixed[0] = 1;
+  assert(aritlex_test_compile("a * 0.5") == 1);
+  assert(aritlex_eval_fixed(&program, fixed) == 1);
+  assert(aritlex_test_compile("-a * 0.5") == 1);
+  assert(aritlex_eval_fixed(&program, fixed) == -1);
+  assert(aritlex_test_compile("a / 3") == 1);
+  assert(aritlex_eval_fixed(&program, fixed) == 0);
+  fixed[0] = aritlex_fixed_from_s32(2);
+  assert(aritlex_eval_fixed(&program, fixed) == 43691); /* 2/3 = 43690.67 */
+
+  /* Agrees with the f64 evaluator within the resolution on expressions that stay in range */
+  for (i = 0; i < sizeof(aritlex_test_fixed_codes) / sizeof(aritlex_test_fixed_codes[0]); ++i)
+  {
+    u32 row;
+
+    assert(aritlex_test_compile(aritlex_test_fixed_codes[i]) == 1);
+
+    for (row = 0; row < 64; ++row)
+    {
+      f64 expected, difference;
+      u32 j;
+
+      for (j = 0; j < 4; ++j)
+      {
+        values[j] = (f64)(s32)(aritlex_test_random() % 2001 - 1000) / 16.0;
+      }
+
+      aritlex_test_bind(vars, values);
+
+      for (j = 0; j < program.vars_size; ++j)
+      {
+        fixed[j] = aritlex_fixed_from_f64(vars[j]);
+      }
+
+      expected = aritlex_eval(&program, vars);
+      difference = aritlex_fixed_to_f64(aritlex_eval_fixed(&program, fixed)) - expected;
+      mismatches += difference > 0.001 || difference < -0.001;
+    }
+  }
+
+  assert(mismatches == 0);
+}
+
+static void aritlex_test_image(void)
+{
+  static f64 image[16384]; /* 8 byte aligned like a mmapped file */
+  static s8 codes[64][256];
+  static u32 offsets[64];
+  aritlex_image_builder builder;
+  aritlex_image_expression *expression;
+  s8 *source = "price * qty - discount";
+  u64 hash = aritlex_image_hash(source, aritlex_strlen(source));
+  f64 values[4];
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  u32 i, j, row, size, image_size, mismatches = 0;
+
+  assert(aritlex_image_begin(&builder, (u8 *)image, sizeof(image), offsets, 64, hash) == 1);
+
+  for (i = 0; i < 64; ++i)
+  {
+    size = 0;
+    aritlex_test_random_expression(codes[i], &size, 4);
+    codes[i][size] = 0;
+    assert(aritlex_test_compile(codes[i]) == 1);
+    assert(aritlex_image_add(&builder, &program) == 1);
+  }
+
+  assert(aritlex_image_finish(&builder, &image_size) == 1);
+  assert(image_size % 8 == 0);
+  assert(aritlex_image_open((u8 *)image, image_size, hash) == 1);
+  assert(aritlex_image_open((u8 *)image, image_size, hash + 1) == 0);
+  assert(aritlex_image_open((u8 *)image, image_size - 8, hash) == 0);
+  assert(aritlex_image_count((u8 *)image) == 64);
+  assert(aritlex_image_get((u8 *)image, 64) == 0);
+
+  /* Evaluating in place gives the same results as the compiled programs */
+  for (i = 0; i < 64; ++i)
+  {
+    assert(aritlex_test_compile(codes[i]) == 1);
+    expression = aritlex_image_get((u8 *)image, i);
+
+    for (row = 0; row < 16; ++row)
+    {
+      f64 image_vars[ARITLEX_VARS_CAPACITY];
+
+      for (j = 0; j < 4; ++j)
+      {
+        values[j] = aritlex_test_random_value();
+      }
+
+      aritlex_test_bind(vars, values);
+
+      for (j = 0; j < expression->vars_size; ++j)
+      {
+        image_vars[j] = values[aritlex_image_var(expression, j)[0] - 'a'];
+      }
+
+      mismatches += expression->code_size != program.code_size ||
+                    !aritlex_test_same(aritlex_image_eval(expression, image_vars), aritlex_eval(&program, vars));
+    }
+  }
+
+  assert(mismatches == 0);
+
+  /* Variable slot table */
+  assert(aritlex_image_begin(&builder, (u8 *)image, sizeof(image), offsets, 64, hash) == 1);
+  assert(aritlex_test_compile(source) == 1);
+  assert(aritlex_image_add(&builder, &program) == 1);
+  assert(aritlex_test_compile("1.5 * 2") == 1);
+  assert(aritlex_image_add(&builder, &program) == 1);
+  assert(aritlex_image_finish(&builder, &image_size) == 1);
+  assert(aritlex_image_open((u8 *)image, image_size, hash) == 1);
+
+  expression = aritlex_image_get((u8 *)image, 0);
+  assert(expression->vars_size == 3);
+  assert(aritlex_image_slot(expression, "discount") == 2);
+  assert(aritlex_image_slot(expression, "tax") == ARITLEX_SLOT_INVALID);
+  vars[0] = 4.0;
+  vars[1] = 2.5;
+  vars[2] = 1.0;
+  assert(aritlex_image_eval(expression, vars) == 9.0);
+
+  expression = aritlex_image_get((u8 *)image, 1);
+  assert(expression->constants_size == 1);
+  assert(aritlex_image_eval(expression, vars) == 3.0);
+
+  /* Corrupted records are rejected on open */
+  {
+    aritlex_image_header *header = (aritlex_image_header *)(void *)image;
+    u32 *table = (u32 *)(void *)((u8 *)image + header->offsets_offset);
+    aritlex_image_instruction *code = aritlex_image_code(expression);
+    aritlex_image_expression *first = aritlex_image_get((u8 *)image, 0);
+    u32 saved;
+
+    for (i = 0; (code[i].op & 0xFFu) != TOK_NUM_FLOAT; ++i)
+    {
+    }
+
+    saved = code[i].val.index;
+    code[i].val.index = expression->constants_size;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    code[i].val.index = saved;
+
+    saved = aritlex_image_code(first)[0].val.index;
+    aritlex_image_code(first)[0].val.index = first->vars_size;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    aritlex_image_code(first)[0].val.index = saved;
+
+    saved = code[0].op;
+    code[0].op = (u32)TOK_PLUS | 2u << 8;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    code[0].op = saved;
+
+    saved = first->stack_size;
+    first->stack_size = ARITLEX_STACK_CAPACITY + 1;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    first->stack_size = saved;
+
+    saved = expression->vars_size;
+    expression->vars_size = ARITLEX_VARS_CAPACITY;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    expression->vars_size = saved;
+
+    for (j = 0; j < ARITLEX_IMAGE_NAME_SIZE; ++j)
+    {
+      aritlex_image_var(first, 0)[j] = 'x';
+    }
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+
+    assert(aritlex_test_compile(source) == 1);
+    assert(aritlex_image_begin(&builder, (u8 *)image, sizeof(image), offsets, 64, hash) == 1);
+    assert(aritlex_image_add(&builder, &program) == 1);
+    assert(aritlex_image_finish(&builder, &image_size) == 1);
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 1);
+
+    table = (u32 *)(void *)((u8 *)image + header->offsets_offset);
+    table[0] += 4;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    table[0] = header->offsets_offset;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    table[0] = sizeof(aritlex_image_header);
+
+    header->capacities += 1;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 0);
+    header->capacities -= 1;
+    assert(aritlex_image_open((u8 *)image, image_size, hash) == 1);
+  }
+
+  /* Capacity checks */
+  assert(aritlex_image_begin(&builder, (u8 *)image, 64, offsets, 64, hash) == 1);
+  assert(aritlex_image_add(&builder, &program) == 0);
+}
+
+#define ENGINE_RULES 2000
+
+static void aritlex_test_engine(void)
+{
+  static aritlex_engine engine;
+  static aritlex_engine_rule rules[ENGINE_RULES];
+  static aritlex_instruction code[ENGINE_RULES * 16];
+  static aritlex_engine_posting postings[ENGINE_RULES * 2];
+  static aritlex_engine_key table[8192]; /* power of two above the postings */
+  static aritlex_engine_range ranges[ENGINE_RULES];
+  static s8 *names[] = {"a", "b", "c", "d"};
+  static s8 *ops[] = {"<", "<=", ">", ">=", "!=", "==", "==", "==", "==", "=="}; /* mostly equalities like real rule sets */
+  static s8 *rules_code[] = {
+      "country == 7 && score > 0.8",
+      "score > 0.5",
+      "0.3 >= score",
+      "amount < 100 && country == 3",
+      "country != 2",
+      "age >= 18 || vip",
+      "3 == country && (score < 0.2 || amount > 1000)",
+      "country == 7 && score >= 0.8 && amount <= 10",
+      "amount == 5 && country == 7 && age == 16"};
+  static u32 expected[ENGINE_RULES];
+  u32 matches[ENGINE_RULES];
+  f64 vars[ARITLEX_ENGINE_VARS_CAPACITY];
+  u32 i, j, matches_size, mismatches = 0, evaluated = 0;
+
+  assert(aritlex_engine_init(&engine, rules, ENGINE_RULES, code, ENGINE_RULES * 16, postings, ENGINE_RULES * 2, table, 8192, ranges, ENGINE_RULES) == 1);
+
+  for (i = 0; i < sizeof(rules_code) / sizeof(rules_code[0]); ++i)
+  {
+    assert(aritlex_tokenize(rules_code[i], aritlex_strlen(rules_code[i]), tokens, TOKENS_CAPACITY, &tokens_size) == 1);
+    assert(aritlex_engine_add(&engine, tokens, tokens_size) == 1);
+  }
+
+  assert(engine.vars_size == 5);
+  assert(engine.ranges_size == 2);   /* score > 0.5, 0.3 >= score */
+  assert(engine.postings_size == 7); /* one per equality conjunct */
+  assert(aritlex_engine_match(&engine, vars, matches, ENGINE_RULES, &matches_size) == 0); /* not built */
+  aritlex_engine_build(&engine);
+
+  vars[aritlex_engine_slot(&engine, "country")] = 7.0;
+  vars[aritlex_engine_slot(&engine, "score")] = aritlex_test_literal("0.8");
+  vars[aritlex_engine_slot(&engine, "amount")] = 5.0;
+  vars[aritlex_engine_slot(&engine, "age")] = 16.0;
+  vars[aritlex_engine_slot(&engine, "vip")] = 0.0;
+
+  assert(aritlex_engine_match(&engine, vars, matches, ENGINE_RULES, &matches_size) == 1);
+  assert(matches_size == 4); /* score > 0.5, country != 2, score >= 0.8 && amount <= 10, all three equalities */
+  assert(engine.evaluated == 6); /* 2 scanned, 2 by country == 7, 1 by score > 0.5, 1 with three hits */
+  assert(engine.hits == 5);      /* country == 7 three times, amount == 5, age == 16 */
+
+  for (i = 0; i < matches_size; ++i)
+  {
+    mismatches += matches[i] != 1 && matches[i] != 4 && matches[i] != 7 && matches[i] != 8;
+  }
+
+  assert(mismatches == 0);
+
+  /* The rule with three equalities is not evaluated while one of them misses */
+  vars[aritlex_engine_slot(&engine, "age")] = 17.0;
+  assert(aritlex_engine_match(&engine, vars, matches, ENGINE_RULES, &matches_size) == 1);
+  assert(matches_size == 3);
+  assert(engine.evaluated == 5);
+
+  vars[aritlex_engine_slot(&engine, "country")] = 3.0;
+  vars[aritlex_engine_slot(&engine, "score")] = 0.1;
+  assert(aritlex_engine_match(&engine, vars, matches, ENGINE_RULES, &matches_size) == 1);
+  assert(matches_size == 4); /* 0.3 >= score, amount < 100 && country == 3, country != 2, 3 == country && score < 0.2 */
+  assert(aritlex_engine_match(&engine, vars, matches, 2, &matches_size) == 0);
+
+  /* Random rules agree with evaluating every rule, while evaluating fewer of them */
+  assert(aritlex_engine_init(&engine, rules, ENGINE_RULES, code, ENGINE_RULES * 16, postings, ENGINE_RULES * 2, table, 8192, ranges, ENGINE_RULES) == 1);
+
+  for (i = 0; i < ENGINE_RULES; ++i)
+  {
+    s8 rule[128];
+    u32 first = aritlex_test_random() % 4, second = aritlex_test_random() % 4;
+
+    sprintf(rule, "%s %s %u && (%s %s %u.5 || %s > 9)",
+            names[first], ops[aritlex_test_random() % 10], aritlex_test_random() % 10,
+            names[second], ops[aritlex_test_random() % 6], aritlex_test_random() % 10, names[(first + 1) % 4]);
+
+    if (aritlex_test_random() % 4 == 0)
+    {
+      sprintf(rule, "%u %s %s", aritlex_test_random() % 10, ops[aritlex_test_random() % 5], names[first]);
+    }
+    else if (aritlex_test_random() % 3 == 0)
+    {
+      sprintf(rule, "%s == %u && %u == %s && %s %s %u", names[first], aritlex_test_random() % 10, aritlex_test_random() % 10,
+              names[second], names[(first + 1) % 4], ops[aritlex_test_random() % 10], aritlex_test_random() % 10);
+    }
+
+    assert(aritlex_tokenize(rule, aritlex_strlen(rule), tokens, TOKENS_CAPACITY, &tokens_size) == 1);
+    mismatches += aritlex_engine_add(&engine, tokens, tokens_size) != 1;
+  }
+
+  assert(mismatches == 0);
+  aritlex_engine_build(&engine);
+
+  for (j = 0; j < 200; ++j)
+  {
+    for (i = 0; i < engine.vars_size; ++i)
+    {
+      vars[i] = (f64)(aritlex_test_random() % 22) / 2.0;
+    }
+
+    for (i = 0; i < ENGINE_RULES; ++i)
+    {
+      expected[i] = aritlex_value_truth(aritlex_eval_code(code + rules[i].code_begin, rules[i].code_size, vars)) != 0;
+    }
+
+    if (!aritlex_engine_match(&engine, vars, matches, ENGINE_RULES, &matches_size))
+    {
+      mismatches++;
+      continue;
+    }
+
+    for (i = 0; i < matches_size; ++i)
+    {
+      mismatches += expected[matches[i]] != 1;
+      expected[matches[i]] = 2;
+    }
+
+    for (i = 0; i < ENGINE_RULES; ++i)
+    {
+      mismatches += expected[i] == 1;
+    }
+
+    evaluated += engine.evaluated;
+  }
+
+  assert(mismatches == 0);
+  assert(evaluated < 200 * ENGINE_RULES / 2);
+}
+
+#ifdef ARITLEX_THREADS_ENABLE
+static void aritlex_test_pipeline(void)
+{
+  static aritlex_pipeline pipeline;
+  static s8 fits[ARITLEX_PIPELINE_TOKENS_CAPACITY];
+  static s8 too_long[ARITLEX_PIPELINE_TOKENS_CAPACITY + 1];
+  static s8 overflow[4 * ARITLEX_PIPELINE_TOKENS_CAPACITY];
+  aritlex_binding bindings[1];
+  aritlex_pipeline_request requests[5];
+  aritlex_pipeline_result results[5];
+  u32 i, received = 0;
+
+  /* "1+1+...+1" with one token per byte, the longest expression that fits */
+  for (i = 0; i < ARITLEX_PIPELINE_TOKENS_CAPACITY - 1; ++i)
+  {
+    fits[i] = i % 2 ? '+' : '1';
+  }
+
+  /* One byte more: rejected before lexing even though it would still tokenize */
+  too_long[0] = ' ';
+
+  for (i = 1; i < ARITLEX_PIPELINE_TOKENS_CAPACITY; ++i)
+  {
+    too_long[i] = fits[i - 1];
+  }
+
+  /* Far more tokens than the lexed item holds */
+  for (i = 0; i < sizeof(overflow) - 1; ++i)
+  {
+    overflow[i] = i % 2 ? '+' : '1';
+  }
+
+  bindings[0].name = "a";
+  bindings[0].value = 4.0;
+
+  for (i = 0; i < 5; ++i)
+  {
+    requests[i].id = i;
+    requests[i].bindings = bindings;
+    requests[i].bindings_size = 1;
+  }
+
+  requests[0].code = "a * 2 + 1";
+  requests[1].code = fits;
+  requests[2].code = too_long;
+  requests[3].code = overflow;
+  requests[4].code = "a + b"; /* b is not bound */
+
+  assert(aritlex_pipeline_init(&pipeline) == 1);
+  assert(aritlex_pipeline_submit(&pipeline, requests, 5) == 5);
+
+  while (received < 5)
+  {
+    received += aritlex_pipeline_poll(&pipeline, results + received, 5 - received);
+  }
+
+  aritlex_pipeline_free(&pipeline);
+
+  for (i = 0; i < 5; ++i)
+  {
+    assert(results[i].id == i);
+  }
+
+  assert(results[0].ok == 1);
+  assert(aritlex_value_to_f64(results[0].value) == 9.0);
+  assert(results[1].ok == 1);
+  assert(aritlex_value_to_f64(results[1].value) == (f64)(ARITLEX_PIPELINE_TOKENS_CAPACITY / 2));
+  assert(results[2].ok == 0);
+  assert(results[3].ok == 0);
+  assert(results[4].ok == 0);
+}
+#endif
+
 int main(void)
 {
   aritlex_test();
@@ -269,6 +1551,21 @@ int main(void)
   aritlex_test_bitwise_ops();
   aritlex_test_inc_dec();
   aritlex_test_symbols();
+  aritlex_test_compile_expression();
+  aritlex_test_eval_semantics();
+  aritlex_test_eval_batch();
+  aritlex_test_jit();
+  aritlex_test_ruleset();
+  aritlex_test_sheet();
+  aritlex_test_filter_aggregate();
+  aritlex_test_specialize();
+  aritlex_test_infer();
+  aritlex_test_fixed();
+  aritlex_test_image();
+  aritlex_test_engine();
+#ifdef ARITLEX_THREADS_ENABLE
+  aritlex_test_pipeline();
+#endif
 
   return 0;
 }
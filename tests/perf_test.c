@@ -0,0 +1,569 @@
+/* perf.h - v0.5 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) simple performance profiler.
+
+This Test class defines cases to verify that the profiler extensions of the vendored deps/perf.h keep working.
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define PERF_STATS_ENABLE
+#define PERF_COUNTERS_ENABLE
+#define PERF_TRACE_ENABLE
+#define PERF_TRACE_CAPACITY 64
+#define PERF_DEFERRED_PRINT
+#include "../deps/perf.h" /* Simple Performance profiler */
+#include "../deps/test.h" /* Simple Testing framework    */
+
+static perf_histogram perf_test_a;
+static perf_histogram perf_test_b;
+
+static void perf_test_histogram(void)
+{
+  unsigned long value, index, mismatches = 0;
+
+  /* Buckets are contiguous and every value lies within 1 / PERF_HISTOGRAM_SUB_BUCKETS of the highest value of its bucket */
+  for (value = 0; value < 1000000; value += 1 + value / 64)
+  {
+    unsigned long highest = perf_histogram_highest(perf_histogram_index(value));
+
+    mismatches += highest < value || (double)(highest - value) > (double)value / (double)PERF_HISTOGRAM_SUB_BUCKETS;
+  }
+
+  for (index = 1; index < PERF_HISTOGRAM_BUCKETS; ++index)
+  {
+    mismatches += perf_histogram_index(perf_histogram_highest(index - 1) + 1) != index;
+  }
+
+  assert(mismatches == 0);
+  assert(perf_histogram_index(~0UL) == PERF_HISTOGRAM_BUCKETS - 1);
+  assert(perf_histogram_highest(PERF_HISTOGRAM_BUCKETS - 1) == ~0UL);
+  assert(sizeof(perf_histogram) <= 2048);
+
+  /* 1..1000 uniformly: exact below 32, within 6.25% above */
+  perf_histogram_reset(&perf_test_a);
+  assert(perf_histogram_percentile(&perf_test_a, 50.0) == 0);
+
+  for (value = 1; value <= 1000; ++value)
+  {
+    perf_histogram_record(&perf_test_a, value);
+  }
+
+  assert(perf_test_a.count == 1000);
+  assert(perf_test_a.max == 1000);
+  assert(perf_histogram_percentile(&perf_test_a, 0.0) == 1);
+  assert(perf_histogram_percentile(&perf_test_a, 2.0) == 20);
+  assert(perf_histogram_percentile(&perf_test_a, 50.0) >= 500 && perf_histogram_percentile(&perf_test_a, 50.0) <= 531);
+  assert(perf_histogram_percentile(&perf_test_a, 99.0) >= 990 && perf_histogram_percentile(&perf_test_a, 99.0) <= 1000);
+  assert(perf_histogram_percentile(&perf_test_a, 100.0) == 1000);
+
+  /* Merging is the same as recording everything into one histogram */
+  perf_histogram_reset(&perf_test_b);
+
+  for (value = 1; value <= 1000; ++value)
+  {
+    perf_histogram_record(&perf_test_b, value * 1000);
+  }
+
+  perf_histogram_merge(&perf_test_a, &perf_test_b);
+
+  assert(perf_test_a.count == 2000);
+  assert(perf_test_a.max == 1000000);
+  assert(perf_histogram_percentile(&perf_test_a, 50.0) >= 1000 && perf_histogram_percentile(&perf_test_a, 50.0) <= 1063);
+  assert(perf_histogram_percentile(&perf_test_a, 99.9) >= 998000);
+
+  /* Values past the range share the last bucket and report the max */
+  perf_histogram_reset(&perf_test_b);
+  perf_histogram_record(&perf_test_b, 1UL << (PERF_HISTOGRAM_VALUE_BITS - 1));
+  perf_histogram_record(&perf_test_b, ~0UL);
+  assert(perf_histogram_percentile(&perf_test_b, 100.0) == ~0UL);
+  assert(perf_histogram_percentile(&perf_test_b, 50.0) < perf_histogram_percentile(&perf_test_b, 100.0));
+}
+
+static void perf_test_stats(void)
+{
+  perf_stats_entry merged;
+  perf_stats_entry *e;
+  volatile unsigned long sink = 0;
+  unsigned long i, j;
+
+  for (i = 0; i < 200; ++i)
+  {
+    PERF_PROFILE_WITH_NAME(for (j = 0; j < (i % 10) * 100; ++j) { sink += j; }, "loop");
+  }
+
+  assert(perf_stats_entry_count == 1);
+  e = &perf_stats_entries[0];
+  assert(e->count == 200);
+  assert(e->calls == 200);
+  assert(e->cycles.count == 200);
+  assert(e->cycles.max == e->cycles_max);
+  assert(perf_histogram_percentile(&e->cycles, 50.0) <= perf_histogram_percentile(&e->cycles, 99.0));
+  assert(perf_histogram_percentile(&e->cycles, 99.0) <= e->cycles_max);
+
+  merged = *e;
+  perf_stats_merge_entry(&merged, e);
+  assert(merged.count == 400);
+  assert(merged.cycles.count == 400);
+  assert(merged.cycles_sum == 2 * e->cycles_sum);
+  assert(perf_histogram_percentile(&merged.cycles, 50.0) == perf_histogram_percentile(&e->cycles, 50.0));
+
+  perf_print_stats();
+}
+
+static perf_stats_context perf_test_main;
+static perf_stats_context perf_test_worker;
+
+static void perf_test_contexts(void)
+{
+  unsigned long i;
+  unsigned long count = perf_stats_entry_count;
+
+  perf_stats_context_init(&perf_test_worker, "worker");
+  perf_stats_thread_begin(&perf_test_main, "main");
+
+  /* The thread context receives PERF_PROFILE, an explicit context is passed to PERF_PROFILE_WITH_CONTEXT */
+  for (i = 0; i < 30; ++i)
+  {
+    PERF_PROFILE_WITH_NAME((void)i, "context");
+    PERF_PROFILE_WITH_CONTEXT(&perf_test_worker, (void)i, "context");
+  }
+
+  for (i = 0; i < 30; ++i)
+  {
+    PERF_PROFILE_WITH_CONTEXT(&perf_test_worker, (void)i, "context");
+  }
+
+  perf_stats_thread_end();
+
+  /* Every call site owns one entry, the global counters stay untouched until the merge */
+  assert(perf_stats_entry_count == count + 3);
+  assert(perf_stats_entries[count].count == 0);
+  assert(perf_stats_entries[count + 1].count == 0);
+  assert(perf_test_main.entries[count].count == 30);
+  assert(perf_test_main.entries[count + 1].count == 0);
+  assert(perf_test_worker.entries[count].count == 0);
+  assert(perf_test_worker.entries[count + 1].count == 30);
+  assert(perf_test_worker.entries[count + 2].count == 30);
+
+  perf_print_stats_context(&perf_test_main);
+  perf_print_stats_context(&perf_test_worker);
+
+  perf_stats_merge();
+
+  assert(perf_stats_entries[count].count == 30);
+  assert(perf_stats_entries[count].cycles.count == 30);
+  assert(perf_stats_entries[count + 1].count == 30);
+  assert(perf_stats_entries[count + 2].count == 30);
+  assert(perf_test_main.entries[count].count == 0);
+  assert(perf_test_worker.entries[count + 1].count == 0);
+
+  /* Recording on a site without a thread context goes to the global entries */
+  for (i = 0; i < 2; ++i)
+  {
+    PERF_PROFILE_WITH_NAME((void)i, "context");
+  }
+
+  assert(perf_stats_entries[count + 3].count == 2);
+}
+
+static void perf_test_counters(void)
+{
+  perf_counters_set set = perf_counters_open();
+  unsigned long task_clock = set == PERF_COUNTERS_HARDWARE ? 3 : 0;
+  unsigned long count = perf_stats_entry_count;
+  volatile unsigned long sink = 0;
+  unsigned long i, j;
+  perf_stats_entry *e;
+
+  for (i = 0; i < 20; ++i)
+  {
+    PERF_PROFILE_WITH_NAME(for (j = 0; j < 100000; ++j) { sink += j; }, "counted");
+  }
+
+  e = &perf_stats_entries[count];
+  assert(e->count == 20);
+
+  if (set == PERF_COUNTERS_UNAVAILABLE)
+  {
+    /* e.g. perf_event_paranoid > 2, the regions are still timed */
+    assert(e->counters_sum[0] == 0 && e->counters_sum[task_clock] == 0);
+    return;
+  }
+
+  /* task-clock counts the nanoseconds the thread ran */
+  assert(e->counters_sum[task_clock] > 0);
+  assert(set == PERF_COUNTERS_SOFTWARE || e->counters_sum[0] >= 20 * 100000);
+  assert(perf_counters_name(set, task_clock)[0] == 't');
+
+  perf_print_stats();
+
+  perf_counters_close();
+  assert(perf_counters_open() == set);
+
+  /* The software task-clock leads a group of its own next to the hardware events */
+  assert(perf_counters_thread.leaders[0] == 1);
+  assert(perf_counters_thread.leaders[task_clock] == 1);
+  assert(set == PERF_COUNTERS_SOFTWARE || perf_counters_thread.leaders[1] == 0);
+
+  /* Ending the thread context closes its events */
+  perf_stats_thread_end();
+  assert(perf_counters_thread.set == PERF_COUNTERS_NONE);
+  assert(perf_counters_thread.fds[0] == -1 && perf_counters_thread.fds[task_clock] == -1);
+}
+
+static char perf_test_json[8192];
+
+static unsigned long perf_test_occurrences(char *text, char *pattern)
+{
+  unsigned long found = 0;
+  unsigned long i, j;
+
+  for (i = 0; text[i]; ++i)
+  {
+    for (j = 0; pattern[j] && text[i + j] == pattern[j]; ++j)
+    {
+    }
+
+    found += pattern[j] == '\0';
+  }
+
+  return found;
+}
+
+static void perf_test_trace(void)
+{
+  unsigned long size;
+  unsigned long i;
+
+  perf_trace_reset();
+
+  PERF_TRACE_BEGIN("batch");
+
+  for (i = 0; i < 3; ++i)
+  {
+    PERF_TRACE_BEGIN("lex \"quoted\"");
+    PERF_TRACE_END("lex \"quoted\"");
+  }
+
+  PERF_TRACE_END("batch");
+
+  size = perf_trace_json(perf_test_json, sizeof(perf_test_json));
+  assert(size == perf_strlen(perf_test_json));
+  assert(perf_test_occurrences(perf_test_json, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[") == 1);
+  assert(perf_test_occurrences(perf_test_json, "\"ph\":\"B\"") == 4);
+  assert(perf_test_occurrences(perf_test_json, "\"ph\":\"E\"") == 4);
+  assert(perf_test_occurrences(perf_test_json, "\"name\":\"batch\"") == 2);
+  assert(perf_test_occurrences(perf_test_json, "\"name\":\"lex \\\"quoted\\\"\"") == 6);
+  assert(perf_test_occurrences(perf_test_json, "\n]}\n") == 1);
+  assert(perf_test_json[size - 1] == '\n');
+
+  /* A full ring keeps the most recent PERF_TRACE_CAPACITY events */
+  for (i = 0; i < PERF_TRACE_CAPACITY; ++i)
+  {
+    PERF_TRACE_BEGIN("recent");
+    PERF_TRACE_END("recent");
+  }
+
+  perf_trace_json(perf_test_json, sizeof(perf_test_json));
+  assert(perf_test_occurrences(perf_test_json, "\"name\":\"recent\"") == PERF_TRACE_CAPACITY);
+  assert(perf_test_occurrences(perf_test_json, "\"name\":\"batch\"") == 0);
+
+  /* Events that do not fit are left out, the JSON is still closed */
+  size = perf_trace_json(perf_test_json, 400);
+  assert(size < 400);
+  assert(perf_test_occurrences(perf_test_json, "\"ph\"") >= 1);
+  assert(perf_test_occurrences(perf_test_json, "\"ph\"") < PERF_TRACE_CAPACITY);
+  assert(perf_test_occurrences(perf_test_json, "}\n]}\n") == 1);
+  assert(perf_trace_json(perf_test_json, 8) == 0);
+}
+
+static void perf_test_deferred(void)
+{
+  unsigned long count = perf_stats_entry_count;
+  unsigned long i;
+
+  /* Results of the earlier tests are not needed */
+  perf_deferred_count = 0;
+
+  perf_calibrate();
+  assert(perf_calibrated == 1);
+  assert(perf_overhead_cycles > 0 && perf_overhead_cycles < 1000000);
+  assert(perf_overhead_ns > 0.0);
+
+  /* Empty regions, the calibrated overhead is their floor */
+  for (i = 0; i < 100; ++i)
+  {
+    PERF_PROFILE_WITH_NAME((void)i, "empty");
+  }
+
+  assert(perf_stats_entries[count].count == 100);
+  assert(perf_stats_entries[count].cycles_min <= perf_overhead_cycles);
+
+  /* Stored, not printed */
+  assert(perf_deferred_count == 100);
+  assert(perf_deferred_results[99].line == perf_stats_entries[count].line);
+  assert(perf_stats_equals(perf_deferred_results[99].name, "empty"));
+
+  perf_flush();
+  assert(perf_deferred_count == 0);
+}
+
+static void perf_test_bench(void)
+{
+  static double samples[41];
+  perf_bench_summary summary;
+  perf_bench bench;
+  volatile unsigned long sink = 0;
+  unsigned long i;
+
+  /* 39 samples around 100 and two outliers */
+  for (i = 0; i < 39; ++i)
+  {
+    samples[i] = 100.0 + (double)(i % 13) - 6.0;
+  }
+
+  samples[39] = 1000.0;
+  samples[40] = 1.0;
+
+  perf_bench_summarize(samples, 41, &summary);
+  assert(summary.samples == 39);
+  assert(summary.outliers == 2);
+  assert(summary.median == 100.0);
+  assert(summary.min == 94.0 && summary.max == 106.0);
+  assert(summary.low <= summary.median && summary.median <= summary.high);
+  assert(summary.low >= 97.0 && summary.high <= 103.0);
+
+  assert(perf_sqrt(16.0) == 4.0);
+  assert(perf_sqrt(2.0) > 1.41421 && perf_sqrt(2.0) < 1.41422);
+
+  /* A short run: warmup, scaling and the samples */
+  perf_bench_init(&bench, "sum 1000");
+  bench.samples_size = 11;
+  bench.warmup_ns = 2000000.0;
+  bench.sample_ns = 200000.0;
+  perf_bench_unit(&bench, 1000.0, "adds");
+  perf_bench_unit(&bench, 8000.0, "B");
+
+  PERF_BENCH(&bench, for (i = 0; i < 1000; ++i) { sink += i; });
+
+  assert(bench.phase == PERF_BENCH_DONE);
+  assert(bench.count == 11);
+  assert(bench.iterations > 1);
+  assert(bench.summary.samples + bench.summary.outliers == 11);
+  assert(bench.summary.median > 0.0);
+  assert(bench.summary.low <= bench.summary.median && bench.summary.median <= bench.summary.high);
+  assert(bench.cycles_median > 0.0);
+  assert(perf_bench_next(&bench) == 0);
+
+  perf_bench_print(&bench);
+
+  /* Machine readable summaries */
+  assert(perf_bench_csv(&bench, 1, perf_test_json, sizeof(perf_test_json)) == perf_strlen(perf_test_json));
+  assert(perf_test_occurrences(perf_test_json, "\n") == 2);
+  assert(perf_test_occurrences(perf_test_json, "\n\"sum 1000\",") == 1);
+  assert(perf_test_occurrences(perf_test_json, ",\"adds\",") == 1);
+  assert(perf_test_occurrences(perf_test_json, ",\"B\",") == 1);
+  assert(perf_test_occurrences(perf_test_json, ",cycles,unit0,per_second0,unit1,per_second1,unit2,per_second2,unit3,per_second3\n") == 1);
+  assert(perf_test_occurrences(perf_test_json, ",") == 2 * (10 - 1 + 2 * PERF_BENCH_UNITS_MAX)); /* same columns in every row */
+  assert(perf_test_occurrences(perf_test_json, ",,,,\n") == 1);                                   /* two units left empty */
+
+  perf_bench_json(&bench, 1, perf_test_json, sizeof(perf_test_json));
+  assert(perf_test_occurrences(perf_test_json, "[\n{\"name\":\"sum 1000\",\"samples\":") == 1);
+  assert(perf_test_occurrences(perf_test_json, "\"per_second\":{\"adds\":") == 1);
+  assert(perf_test_occurrences(perf_test_json, "}}\n]\n") == 1);
+
+  /* Rows that do not fit are left out */
+  assert(perf_bench_csv(&bench, 1, perf_test_json, 200) == perf_strlen("name,samples,outliers,iterations,median_ns,low_ns,high_ns,min_ns,max_ns,cycles,unit0,per_second0,unit1,per_second1,unit2,per_second2,unit3,per_second3\n"));
+  assert(perf_bench_json(&bench, 1, perf_test_json, 64) == 4);
+  assert(perf_test_occurrences(perf_test_json, "[\n]\n") == 1);
+}
+
+static void perf_test_sampling(void)
+{
+  perf_stats_entry *e;
+  unsigned long i, skips = 0, mismatches = 0;
+  unsigned long count = perf_stats_entry_count;
+
+  /* The untimed calls between two samples stay within 0 .. 2 * period - 2 and average period - 1 */
+  for (i = 0; i < 10000; ++i)
+  {
+    unsigned long skip = perf_sample_next_skip(16);
+
+    mismatches += skip > 30;
+    skips += skip;
+  }
+
+  assert(mismatches == 0);
+  assert(skips / 10000 >= 14 && skips / 10000 <= 16);
+  assert(perf_sample_next_skip(1) == 0);
+
+  for (i = 0; i < 1000; ++i)
+  {
+    PERF_PROFILE_SAMPLED_WITH_NAME((void)i, "sampled", 16);
+  }
+
+  /* Every sample stands for the calls since the previous one, only the calls after the last sample are missing */
+  assert(perf_stats_entry_count == count + 1);
+  e = &perf_stats_entries[count];
+  assert(e->count > 1000 / 32 && e->count < 1000 / 8);
+  assert(e->cycles.count == e->count);
+  assert(e->calls <= 1000 && e->calls > 1000 - 31);
+  assert(perf_stats_scale(e) > 8.0 && perf_stats_scale(e) < 32.0);
+
+  /* A period of 1 times every call */
+  for (i = 0; i < 20; ++i)
+  {
+    PERF_PROFILE_SAMPLED_WITH_NAME((void)i, "every", 1);
+  }
+
+  assert(perf_stats_entries[count + 1].count == 20);
+  assert(perf_stats_entries[count + 1].calls == 20);
+
+  perf_print_stats();
+}
+
+static void perf_test_records(void)
+{
+  static char *fields[] = {"2.500", "0.000", "1.00", "12345678901.5", "-3.25", "7"};
+  static double values[] = {2.5, 0.0, 0.999, 12345678901.5, -3.25, 7.4};
+  static int precisions[] = {3, 3, 2, 1, 2, 0};
+  char buffer[64];
+  perf_record r;
+  unsigned long i, mismatches = 0;
+  unsigned long rows = 0;
+
+  for (i = 0; i < sizeof(values) / sizeof(values[0]); ++i)
+  {
+    perf_record_init(&r, buffer, sizeof(buffer));
+    perf_record_double(&r, values[i], precisions[i]);
+    mismatches += !perf_stats_equals(buffer, fields[i]);
+  }
+
+  assert(mismatches == 0);
+
+  perf_record_init(&r, buffer, sizeof(buffer));
+  perf_record_quoted(&r, "a \"b\" \\", 0);
+  assert(perf_stats_equals(buffer, "\"a \"\"b\"\" \\\""));
+
+  perf_record_init(&r, buffer, sizeof(buffer));
+  perf_record_quoted(&r, "a \"b\" \\", 1);
+  assert(perf_stats_equals(buffer, "\"a \\\"b\\\" \\\\\""));
+
+  /* One CSV row per site with samples, the header first */
+  for (i = 0; i < perf_stats_entry_count; ++i)
+  {
+    rows += perf_stats_entries[i].count > 0;
+  }
+
+  assert(perf_stats_csv(perf_test_json, sizeof(perf_test_json)) == perf_strlen(perf_test_json));
+  assert(perf_test_occurrences(perf_test_json, "\n") == rows + 1);
+  assert(perf_test_occurrences(perf_test_json, "\n\"") == rows); /* quoted file name, whatever path __FILE__ has */
+
+  perf_stats_json(perf_test_json, sizeof(perf_test_json));
+  assert(perf_test_occurrences(perf_test_json, "{\"file\":\"") == rows);
+  assert(perf_test_occurrences(perf_test_json, ",\"counters_sum\":[") == rows);
+  assert(perf_test_json[0] == '[');
+  assert(perf_test_occurrences(perf_test_json, "]}\n]\n") == 1);
+}
+
+static void perf_test_lookup(void)
+{
+  static char *names[2] = {"even", "odd"};
+  perf_stats_entry *first;
+  unsigned long i, mismatches = 0;
+  unsigned long count = perf_stats_entry_count;
+
+  /* One call site with alternating names records into two entries */
+  for (i = 0; i < 10; ++i)
+  {
+    PERF_PROFILE_WITH_NAME((void)i, names[i % 2]);
+  }
+
+  assert(perf_stats_entry_count == count + 2);
+  assert(perf_stats_entries[count].count == 5);
+  assert(perf_stats_entries[count + 1].count == 5);
+  assert(perf_stats_get_entry(__FILE__, perf_stats_entries[count].line, "odd") == &perf_stats_entries[count + 1]);
+
+  /* Fill the remaining entries, every lookup finds its own entry again */
+  first = perf_stats_get_entry("site.c", 0, "site");
+
+  for (i = 1; perf_stats_entry_count < PERF_STATS_ENTRIES_MAX; ++i)
+  {
+    mismatches += perf_stats_get_entry("site.c", (int)i, "site") != &perf_stats_entries[perf_stats_entry_count - 1];
+  }
+
+  for (i = 1; i < PERF_STATS_ENTRIES_MAX - count - 3; ++i)
+  {
+    perf_stats_entry *e = perf_stats_get_entry("site.c", (int)i, "site");
+
+    mismatches += !e || e->line != (int)i || e->hash != perf_stats_hash("site.c", (int)i, "site");
+  }
+
+  assert(mismatches == 0);
+  assert(perf_stats_get_entry("site.c", 0, "site") == first);
+  assert(perf_stats_get_entry("site.c", 0, "other") == 0);
+  assert(perf_stats_site("other.c", 0, "site") == 0);
+}
+
+int main(void)
+{
+  perf_test_histogram();
+  perf_test_stats();
+  perf_test_contexts();
+  perf_test_counters();
+  perf_test_trace();
+  perf_test_deferred();
+  perf_test_bench();
+  perf_test_sampling();
+  perf_test_records();
+  perf_test_lookup();
+
+  return 0;
+}
+
+
+/*
+   -----------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+   ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+   WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,315 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Regression gate for the aritlex_tokenize throughput. Runs the tokenizer benchmarks with the
+PERF_BENCH runner of perf.h and writes their summaries as CSV. Given a baseline CSV of an earlier
+run it compares the medians: a benchmark regressed if its median is slower than the baseline by
+more than the threshold AND the 95% confidence intervals of the two medians do not overlap.
+Exits with 1 if any benchmark regressed.
+
+  cc -O2 -o aritlex_bench_compare aritlex_bench_compare.c
+  ./aritlex_bench_compare baseline.csv
+  ./aritlex_bench_compare current.csv [baseline.csv] [threshold percent, 5]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#include "../aritlex.h"   /* Arithmetic Lexer */
+#include "../deps/perf.h" /* Simple Performance profiler */
+#include "stdio.h"        /* printf, fopen */
+#include "stdlib.h"       /* malloc, atof, strtod */
+
+#define BENCHES_SIZE 3
+#define TOKENS_CAPACITY 1024
+#define SOURCE_CAPACITY 4096
+#define CSV_CAPACITY 65536
+#define NAME_CAPACITY 128
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static s8 sources[BENCHES_SIZE][SOURCE_CAPACITY];
+static perf_bench benches[BENCHES_SIZE];
+static char csv[CSV_CAPACITY];
+static char baseline[CSV_CAPACITY];
+
+/* Sums copies of part into source, as many as fit in size bytes (at least one) */
+static void compare_repeat(s8 *source, s8 *part, u32 size)
+{
+  u32 length = 0;
+
+  while (length == 0 || length + aritlex_strlen(part) + 4 < size)
+  {
+    u32 i;
+
+    if (length)
+    {
+      source[length++] = ' ';
+      source[length++] = '+';
+      source[length++] = ' ';
+    }
+
+    for (i = 0; part[i]; ++i)
+    {
+      source[length++] = part[i];
+    }
+  }
+
+  source[length] = '\0';
+}
+
+/* Parses the next CSV field of line into value (numbers) or name (quoted text), returns the rest */
+static char *compare_field(char *line, double *value, char *name)
+{
+  if (*line == '"')
+  {
+    u32 size = 0;
+
+    for (++line; *line && !(line[0] == '"' && line[1] != '"'); ++line)
+    {
+      line += line[0] == '"'; /* "" is a quote */
+
+      if (name && size + 1 < NAME_CAPACITY)
+      {
+        name[size++] = *line;
+      }
+    }
+
+    if (name)
+    {
+      name[size] = '\0';
+    }
+
+    line += *line == '"';
+  }
+  else
+  {
+    char *end;
+    double parsed = strtod(line, &end);
+
+    if (value)
+    {
+      *value = parsed;
+    }
+
+    line = end;
+  }
+
+  return line + (*line == ',');
+}
+
+static u32 compare_names_equal(char *a, char *b)
+{
+  while (*a && *a == *b)
+  {
+    a++;
+    b++;
+  }
+
+  return *a == *b;
+}
+
+/* Compares every benchmark with the row of the same name in the baseline, returns the number of regressions */
+static u32 compare_baseline(char *text, double threshold)
+{
+  u32 regressions = 0;
+  char *line = text;
+  u32 i;
+
+  printf("%-24s %14s %14s %9s  %s\n", "benchmark", "baseline ns", "current ns", "change", "verdict");
+
+  for (i = 0; i < BENCHES_SIZE; ++i)
+  {
+    perf_bench_summary *s = &benches[i].summary;
+    char name[NAME_CAPACITY];
+    double base_median = 0.0, base_low = 0.0, base_high = 0.0;
+    u32 found = 0;
+    char *verdict;
+
+    for (line = text; *line && !found; )
+    {
+      char *next = line;
+
+      while (*next && *next != '\n')
+      {
+        next++;
+      }
+
+      if (*line == '"')
+      {
+        double unused;
+        char *field = compare_field(line, 0, name);
+
+        if (compare_names_equal(name, benches[i].name))
+        {
+          field = compare_field(field, &unused, 0); /* samples */
+          field = compare_field(field, &unused, 0); /* outliers */
+          field = compare_field(field, &unused, 0); /* iterations */
+          field = compare_field(field, &base_median, 0);
+          field = compare_field(field, &base_low, 0);
+          compare_field(field, &base_high, 0);
+          found = 1;
+        }
+      }
+
+      line = next + (*next == '\n');
+    }
+
+    if (!found || base_median <= 0.0)
+    {
+      printf("%-24s %14s %14.2f %9s  new\n", benches[i].name, "-", s->median, "-");
+      continue;
+    }
+
+    if (s->median > base_median * (1.0 + threshold) && s->low > base_high)
+    {
+      verdict = "REGRESSION";
+      regressions++;
+    }
+    else if (s->median < base_median * (1.0 - threshold) && s->high < base_low)
+    {
+      verdict = "faster";
+    }
+    else
+    {
+      verdict = "same";
+    }
+
+    printf("%-24s %14.2f %14.2f %8.1f%%  %s\n", benches[i].name, base_median, s->median,
+           (s->median / base_median - 1.0) * 100.0, verdict);
+  }
+
+  return regressions;
+}
+
+int main(int argc, char **argv)
+{
+  static s8 *names[BENCHES_SIZE] = {"tokenize short", "tokenize arithmetic", "tokenize identifiers"};
+  double threshold = argc > 3 ? atof(argv[3]) / 100.0 : 0.05;
+  unsigned long size;
+  FILE *file;
+  u32 i;
+
+  if (argc < 2)
+  {
+    printf("usage: %s current.csv [baseline.csv] [threshold percent]\n", argv[0]);
+    return 1;
+  }
+
+  compare_repeat(sources[0], "(price * qty - discount) / (qty + 1)", 40);
+  compare_repeat(sources[1], "1.25 * (x - 0x1F) / (y + 3) % 7 << 2", 2048);
+  compare_repeat(sources[2], "(alpha_value >= beta_limit && gamma_rate < delta_cap || epsilon == zeta)", 2048);
+
+  for (i = 0; i < BENCHES_SIZE; ++i)
+  {
+    s8 *source = sources[i];
+    u32 source_size = aritlex_strlen(source);
+    u32 tokens_size = 0;
+
+    if (!aritlex_tokenize(source, source_size, tokens, TOKENS_CAPACITY, &tokens_size))
+    {
+      printf("[aritlex] %s does not tokenize\n", names[i]);
+      return 1;
+    }
+
+    perf_bench_init(&benches[i], names[i]);
+    perf_bench_unit(&benches[i], (double)source_size, "B");
+    perf_bench_unit(&benches[i], (double)tokens_size, "tokens");
+
+    PERF_BENCH(&benches[i], aritlex_tokenize(source, source_size, tokens, TOKENS_CAPACITY, &tokens_size); PERF_BENCH_KEEP(tokens));
+
+    perf_bench_print(&benches[i]);
+  }
+
+  size = perf_bench_csv(benches, BENCHES_SIZE, csv, CSV_CAPACITY);
+  file = fopen(argv[1], "wb");
+
+  if (!file || fwrite(csv, 1, size, file) != size)
+  {
+    printf("[aritlex] can not write %s\n", argv[1]);
+    return 1;
+  }
+
+  fclose(file);
+
+  if (argc < 3)
+  {
+    return 0;
+  }
+
+  file = fopen(argv[2], "rb");
+
+  if (!file)
+  {
+    printf("[aritlex] can not read %s\n", argv[2]);
+    return 1;
+  }
+
+  size = (unsigned long)fread(baseline, 1, CSV_CAPACITY - 1, file);
+  baseline[size] = '\0';
+  fclose(file);
+
+  /* Both files are written by perf_bench_csv, a baseline with other columns is from an older perf.h */
+  for (i = 0; csv[i] != '\n' && csv[i] == baseline[i]; ++i)
+  {
+  }
+
+  if (csv[i] != '\n' || baseline[i] != '\n')
+  {
+    printf("[aritlex] %s has different columns than %s, rerun the baseline\n", argv[2], argv[1]);
+    return 1;
+  }
+
+  if (compare_baseline(baseline, threshold))
+  {
+    printf("[aritlex] aritlex_tokenize regressed more than %.1f%% against %s\n", threshold * 100.0, argv[2]);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,317 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Precompiled expression cache: compiles a rules file (one expression per line) into an image
+file once and on later runs mmaps the image and evaluates the rules in place, as long as the
+source hash of the rules file matches. Prints the cold start time of both paths.
+
+  cc -O2 -o aritlex_cache aritlex_cache.c
+  ./aritlex_cache --generate 50000 rules.txt   (writes synthetic rules)
+  ./aritlex_cache rules.txt rules.alxc
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define _POSIX_C_SOURCE 200112L /* clock_gettime, fstat, mmap */
+#include "../aritlex.h"         /* Arithmetic Lexer */
+#include "stdio.h"              /* printf, fopen */
+#include "stdlib.h"             /* malloc, realloc, atoi */
+#include "time.h"               /* clock_gettime */
+#include "fcntl.h"              /* open */
+#include "unistd.h"             /* close, write */
+#include "sys/mman.h"           /* mmap */
+#include "sys/stat.h"           /* fstat */
+
+#define TOKENS_CAPACITY 1024
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static aritlex_program program;
+static f64 vars[ARITLEX_VARS_CAPACITY];
+
+static f64 cache_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+
+static u8 *cache_map(s8 *path, u32 *size)
+{
+  struct stat info;
+  void *data;
+  int fd = open(path, O_RDONLY);
+
+  if (fd < 0)
+  {
+    return 0;
+  }
+
+  if (fstat(fd, &info) != 0 || info.st_size <= 0 || info.st_size > 0x7FFFFFFF)
+  {
+    close(fd);
+    return 0;
+  }
+
+  data = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+  {
+    return 0;
+  }
+
+  *size = (u32)info.st_size;
+  return (u8 *)data;
+}
+
+static int cache_generate(u32 rules, s8 *path)
+{
+  static s8 *fields[] = {"country", "score", "amount", "age", "region", "risk"};
+  FILE *file = fopen(path, "wb");
+  u32 state = 12345, i;
+
+  if (!file)
+  {
+    return 1;
+  }
+
+  for (i = 0; i < rules; ++i)
+  {
+    u32 a, b, c;
+
+    state = state * 1103515245u + 12345u;
+    a = (state >> 8) % 6;
+    b = (state >> 12) % 6;
+    c = (state >> 16) % 100;
+
+    fprintf(file, "%s == %u && %s > 0.%02u || (%s - %u) * 1.5 >= %s / 2\n", fields[a], c % 10, fields[b], c, fields[(a + 1) % 6], c, fields[(b + 2) % 6]);
+  }
+
+  fclose(file);
+  return 0;
+}
+
+/* Sums every rule once with all variables set to 1 */
+static f64 cache_run(u8 *image)
+{
+  f64 sum = 0.0;
+  u32 i;
+
+  for (i = 0; i < aritlex_image_count(image); ++i)
+  {
+    sum += aritlex_image_eval(aritlex_image_get(image, i), vars);
+  }
+
+  return sum;
+}
+
+static int cache_compile(s8 *source, u32 source_size, u64 hash, s8 *path)
+{
+  aritlex_image_builder builder;
+  u32 capacity = 1u << 24;
+  u32 lines = 0, image_size, i, written = 0;
+  u32 *offsets;
+  u8 *buffer;
+  s8 *line = source;
+  s8 temporary[4096];
+  int fd;
+
+  for (i = 0; i < source_size; ++i)
+  {
+    lines += source[i] == '\n';
+  }
+
+  offsets = (u32 *)malloc(sizeof(u32) * (lines + 1));
+  buffer = (u8 *)malloc(capacity);
+
+  if (!offsets || !buffer || !aritlex_image_begin(&builder, buffer, capacity, offsets, lines + 1, hash))
+  {
+    return 1;
+  }
+
+  while (line < source + source_size)
+  {
+    s8 code[4096];
+    u32 size = 0;
+
+    while (line + size < source + source_size && line[size] != '\n' && size < sizeof(code) - 1)
+    {
+      code[size] = line[size];
+      size++;
+    }
+
+    code[size] = 0;
+    line += size + 1;
+
+    if (size == 0)
+    {
+      continue;
+    }
+
+    if (!aritlex_tokenize(code, size, tokens, TOKENS_CAPACITY, &i) || !aritlex_compile(tokens, i, &program))
+    {
+      printf("[aritlex] can not compile: %s\n", code);
+      return 1;
+    }
+
+    /* Grow the image buffer, the builder only keeps offsets into it */
+    while (!aritlex_image_add(&builder, &program))
+    {
+      capacity *= 2;
+      buffer = (u8 *)realloc(buffer, capacity);
+
+      if (!buffer || capacity < (1u << 24))
+      {
+        return 1;
+      }
+
+      builder.buffer = buffer;
+      builder.capacity = capacity;
+    }
+  }
+
+  while (!aritlex_image_finish(&builder, &image_size))
+  {
+    capacity += 1u << 20;
+    buffer = (u8 *)realloc(buffer, capacity);
+
+    if (!buffer)
+    {
+      return 1;
+    }
+
+    builder.buffer = buffer;
+    builder.capacity = capacity;
+  }
+
+  /* Write to a temporary file and rename it so readers never map a partial image */
+  sprintf(temporary, "%.4000s.tmp", path);
+  fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+  while (fd >= 0 && written < image_size)
+  {
+    ssize_t n = write(fd, buffer + written, image_size - written);
+
+    if (n <= 0)
+    {
+      break;
+    }
+
+    written += (u32)n;
+  }
+
+  if (fd < 0 || close(fd) != 0 || written != image_size || rename(temporary, path) != 0)
+  {
+    printf("[aritlex] can not write %s\n", path);
+    return 1;
+  }
+
+  printf("[aritlex] compiled %u expressions into %u bytes, checksum %.17g\n", aritlex_image_count(buffer), image_size, cache_run(buffer));
+
+  free(buffer);
+  free(offsets);
+  return 0;
+}
+
+int main(int argc, char **argv)
+{
+  u8 *source, *image;
+  u32 source_size, image_size = 0, i;
+  u64 hash;
+  f64 start, elapsed;
+
+  if (argc == 4 && aritlex_strcmp(argv[1], "--generate", 10) && argv[1][10] == 0)
+  {
+    return cache_generate((u32)atoi(argv[2]), argv[3]);
+  }
+
+  if (argc != 3)
+  {
+    printf("usage: %s <rules> <cache>\n       %s --generate <count> <rules>\n", argv[0], argv[0]);
+    return 1;
+  }
+
+  for (i = 0; i < ARITLEX_VARS_CAPACITY; ++i)
+  {
+    vars[i] = 1.0;
+  }
+
+  start = cache_seconds();
+  source = cache_map(argv[1], &source_size);
+
+  if (!source)
+  {
+    printf("[aritlex] can not read %s\n", argv[1]);
+    return 1;
+  }
+
+  hash = aritlex_image_hash((s8 *)source, source_size);
+  image = cache_map(argv[2], &image_size);
+
+  if (image && aritlex_image_open(image, image_size, hash))
+  {
+    elapsed = cache_seconds() - start;
+    printf("[aritlex] cache hit: %u expressions ready after %.3f ms, checksum %.17g\n", aritlex_image_count(image), elapsed * 1e3, cache_run(image));
+    return 0;
+  }
+
+  if (image)
+  {
+    munmap(image, image_size);
+  }
+
+  if (cache_compile((s8 *)source, source_size, hash, argv[2]))
+  {
+    return 1;
+  }
+
+  printf("[aritlex] cache miss: compiled after %.3f ms\n", (cache_seconds() - start) * 1e3);
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,379 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Load generator for tools/aritlex_server.c: opens a number of connections, keeps a fixed number of
+requests in flight on each and reports the throughput and the p50 / p99 / p99.9 latency. The first
+requests send the expression text, later ones the expression id the server answered with. Every
+response is checked against aritlex_eval in this process.
+
+  cc -O2 -o aritlex_client aritlex_client.c
+  ./aritlex_client /tmp/aritlex.sock [connections] [requests per connection] [in flight per connection]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define _POSIX_C_SOURCE 200809L /* clock_gettime, MSG_NOSIGNAL */
+#include "../aritlex.h"         /* Arithmetic Lexer */
+#include "stdio.h"              /* printf */
+#include "stdlib.h"             /* malloc, atoi, qsort */
+#include "string.h"             /* memcpy, memset */
+#include "errno.h"              /* errno */
+#include "time.h"               /* clock_gettime */
+#include "fcntl.h"              /* fcntl */
+#include "unistd.h"             /* close, read */
+#include "poll.h"               /* poll */
+#include "sys/socket.h"         /* socket, connect, send */
+#include "sys/un.h"             /* sockaddr_un */
+
+#define CLIENT_CONNECTIONS 64
+#define CLIENT_BUFFER 65536
+#define CLIENT_RESPONSE 24
+#define CLIENT_NONE 0xFFFFFFFFu
+#define EXPRESSIONS_SIZE 5
+
+typedef struct client_connection
+{
+  int fd;
+  u32 expressions[EXPRESSIONS_SIZE]; /* server ids, CLIENT_NONE until known */
+  u32 sent;
+  u32 received;
+  u8 in[CLIENT_BUFFER];
+  u32 in_size;
+  u8 out[CLIENT_BUFFER];
+  u32 out_begin;
+  u32 out_end;
+
+} client_connection;
+
+static s8 *expressions[EXPRESSIONS_SIZE] = {
+    "(price * qty - discount) / (qty + 1)",
+    "price > 50 ? price * 0.9 : price",
+    "(qty * 3 + 7) % 5 << 2",
+    "price * price - 2 * price * discount + discount * discount",
+    "qty >= 10 && discount < 5 || price == 0"};
+
+static s8 *names[3] = {"price", "qty", "discount"};
+static aritlex_program programs[EXPRESSIONS_SIZE];
+static aritlex_token tokens[256];
+static client_connection connections[CLIENT_CONNECTIONS];
+
+static f64 client_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+
+static int client_compare(const void *a, const void *b)
+{
+  f64 x = *(const f64 *)a;
+  f64 y = *(const f64 *)b;
+  return x < y ? -1 : x > y;
+}
+
+static void client_values(u32 id, f64 *values)
+{
+  values[0] = (f64)((id * 2654435761u) % 10000u) / 100.0;
+  values[1] = (f64)((id * 40503u) % 20u);
+  values[2] = (f64)(id % 7u);
+}
+
+static void client_put(u8 *data, u32 *size, void *value, u32 value_size)
+{
+  memcpy(data + *size, value, value_size);
+  *size += value_size;
+}
+
+/* Appends request id for expression to the output buffer of c */
+static void client_request(client_connection *c, u32 id, u32 expression)
+{
+  u8 *data = c->out + c->out_end;
+  u32 size = 16;
+  u32 text_size = c->expressions[expression] == CLIENT_NONE ? aritlex_strlen(expressions[expression]) : 0;
+  f64 values[3];
+  u32 i;
+
+  client_values(id, values);
+
+  data[12] = (u8)(text_size & 0xFF);
+  data[13] = (u8)(text_size >> 8);
+  data[14] = 3;
+  data[15] = 0;
+  client_put(data, &size, expressions[expression], text_size);
+
+  for (i = 0; i < 3; ++i)
+  {
+    data[size++] = (u8)aritlex_strlen(names[i]);
+    client_put(data, &size, names[i], aritlex_strlen(names[i]));
+    client_put(data, &size, &values[i], sizeof(f64));
+  }
+
+  memcpy(data, &size, 4);
+  memcpy(data + 4, &id, 4);
+  memcpy(data + 8, &c->expressions[expression], 4);
+  c->out_end += size;
+}
+
+static u32 client_flush(client_connection *c)
+{
+  while (c->out_begin < c->out_end)
+  {
+    ssize_t sent = send(c->fd, c->out + c->out_begin, c->out_end - c->out_begin, MSG_NOSIGNAL);
+
+    if (sent < 0)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    c->out_begin += (u32)sent;
+  }
+
+  c->out_begin = c->out_end = 0;
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  struct sockaddr_un address;
+  struct pollfd fds[CLIENT_CONNECTIONS];
+  u32 connections_size = argc > 2 ? (u32)atoi(argv[2]) : 8u;
+  u32 requests = argc > 3 ? (u32)atoi(argv[3]) : 100000u;
+  u32 depth = argc > 4 ? (u32)atoi(argv[4]) : 16u;
+  u32 total, done = 0, failed = 0, i, j;
+  f64 *sent_at, *latencies;
+  f64 start, elapsed;
+
+  if (argc < 2 || aritlex_strlen(argv[1]) >= sizeof(address.sun_path) ||
+      connections_size < 1 || connections_size > CLIENT_CONNECTIONS || requests < 1 || depth < 1 || depth > 256)
+  {
+    printf("usage: %s socket [connections] [requests per connection] [in flight per connection]\n", argv[0]);
+    return 1;
+  }
+
+  total = connections_size * requests;
+  sent_at = (f64 *)malloc(sizeof(f64) * total);
+  latencies = (f64 *)malloc(sizeof(f64) * total);
+
+  if (!sent_at || !latencies)
+  {
+    return 1;
+  }
+
+  for (i = 0; i < EXPRESSIONS_SIZE; ++i)
+  {
+    u32 tokens_size = 0;
+
+    if (!aritlex_tokenize(expressions[i], aritlex_strlen(expressions[i]), tokens, 256, &tokens_size) ||
+        !aritlex_compile(tokens, tokens_size, &programs[i]))
+    {
+      return 1;
+    }
+  }
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, argv[1], aritlex_strlen(argv[1]));
+
+  for (i = 0; i < connections_size; ++i)
+  {
+    client_connection *c = &connections[i];
+
+    c->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (c->fd < 0 || connect(c->fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+      printf("[aritlex] can not connect to %s\n", argv[1]);
+      return 1;
+    }
+
+    fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+
+    for (j = 0; j < EXPRESSIONS_SIZE; ++j)
+    {
+      c->expressions[j] = CLIENT_NONE;
+    }
+  }
+
+  start = client_seconds();
+
+  while (done < total)
+  {
+    f64 now = client_seconds();
+
+    for (i = 0; i < connections_size; ++i)
+    {
+      client_connection *c = &connections[i];
+
+      while (c->sent < requests && c->sent - c->received < depth)
+      {
+        u32 id = i * requests + c->sent;
+
+        client_request(c, id, id % EXPRESSIONS_SIZE);
+        sent_at[id] = now;
+        c->sent++;
+      }
+
+      if (!client_flush(c))
+      {
+        printf("[aritlex] connection %u lost\n", i);
+        return 1;
+      }
+
+      fds[i].fd = c->fd;
+      fds[i].events = (short)(POLLIN | (c->out_end > c->out_begin ? POLLOUT : 0));
+      fds[i].revents = 0;
+    }
+
+    if (poll(fds, connections_size, 1000) <= 0)
+    {
+      printf("[aritlex] no response for 1 s\n");
+      return 1;
+    }
+
+    now = client_seconds();
+
+    for (i = 0; i < connections_size; ++i)
+    {
+      client_connection *c = &connections[i];
+      ssize_t received;
+      u32 offset = 0;
+
+      if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+      {
+        continue;
+      }
+
+      received = read(c->fd, c->in + c->in_size, CLIENT_BUFFER - c->in_size);
+
+      if (received <= 0)
+      {
+        if (received < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+          continue;
+        }
+
+        printf("[aritlex] connection %u closed by the server\n", i);
+        return 1;
+      }
+
+      c->in_size += (u32)received;
+
+      for (; c->in_size - offset >= CLIENT_RESPONSE; offset += CLIENT_RESPONSE)
+      {
+        u8 *response = c->in + offset;
+        u32 id, expression, status;
+        f64 value, expected;
+        f64 values[3];
+        f64 vars[ARITLEX_VARS_CAPACITY];
+
+        memcpy(&id, response, 4);
+        memcpy(&expression, response + 4, 4);
+        memcpy(&status, response + 8, 4);
+        memcpy(&value, response + 16, 8);
+
+        if (id != i * requests + c->received)
+        {
+          printf("[aritlex] response %u out of order on connection %u\n", id, i);
+          return 1;
+        }
+
+        client_values(id, values);
+
+        for (j = 0; j < 3; ++j)
+        {
+          u32 slot = aritlex_program_slot(&programs[id % EXPRESSIONS_SIZE], names[j]);
+
+          if (slot != ARITLEX_SLOT_INVALID)
+          {
+            vars[slot] = values[j];
+          }
+        }
+
+        expected = aritlex_eval(&programs[id % EXPRESSIONS_SIZE], vars);
+        failed += status != 0 || (value != expected && (value == value || expected == expected));
+
+        c->expressions[id % EXPRESSIONS_SIZE] = expression;
+        latencies[done++] = now - sent_at[id];
+        c->received++;
+      }
+
+      memmove(c->in, c->in + offset, c->in_size - offset);
+      c->in_size -= offset;
+    }
+  }
+
+  elapsed = client_seconds() - start;
+
+  for (i = 0; i < connections_size; ++i)
+  {
+    close(connections[i].fd);
+  }
+
+  qsort(latencies, total, sizeof(f64), client_compare);
+
+  printf("[aritlex] %u connections, %u requests, %u in flight per connection\n", connections_size, total, depth);
+  printf("[aritlex] %.4g requests/s, latency p50 %.1f us, p99 %.1f us, p99.9 %.1f us, max %.1f us\n",
+         (f64)total / elapsed,
+         latencies[total / 2] * 1e6,
+         latencies[(u32)((f64)total * 0.99)] * 1e6,
+         latencies[(u32)((f64)total * 0.999)] * 1e6,
+         latencies[total - 1] * 1e6);
+
+  free(sent_at);
+  free(latencies);
+
+  if (failed)
+  {
+    printf("[aritlex] %u responses differ from aritlex_eval\n", failed);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
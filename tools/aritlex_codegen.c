@@ -0,0 +1,400 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+This tool generates C89 source code for expressions that are known at build time.
+
+  aritlex_codegen <name> <expression> [<name> <expression> ...] > expressions.h
+
+Each expression is lexed with aritlex_tokenize, compiled with aritlex_compile and written as
+
+  static f64 expr_<name>(const f64 *vars)
+
+where vars is indexed by the variable slots listed in the comment above each function.
+The generated code has the exact semantics of aritlex_eval (s32 wrapping, division by zero
+yields 0, ...) but runs as plain native code without any parsing or interpretation at runtime.
+It does not depend on aritlex.h. If f64 is not already defined (by aritlex.h or by an earlier
+generated file) it is typedef'd to double.
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#include "../aritlex.h" /* Arithmetic Lexer */
+#include "stdio.h"      /* printf, sprintf, fprintf */
+
+#define TOKENS_CAPACITY 1024
+#define OPERAND_CAPACITY 128
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static aritlex_program program;
+
+typedef struct codegen_operand
+{
+  u32 temp; /* emitted as t<temp> */
+  aritlex_type type;
+
+} codegen_operand;
+
+static u32 codegen_is_identifier(s8 *name)
+{
+  u32 i;
+
+  for (i = 0; name[i]; ++i)
+  {
+    if (!(aritlex_is_alpha(name[i]) || name[i] == '_' || (i > 0 && aritlex_is_digit(name[i]))))
+    {
+      return 0;
+    }
+  }
+
+  return i > 0;
+}
+
+static void codegen_f64_literal(f64 value)
+{
+  s8 buffer[64];
+  u32 i, exact = 0;
+
+  if (value > 1.7976931348623157e308)
+  {
+    printf("(1.0 / 0.0)");
+    return;
+  }
+
+  /* 17 significant digits always round trip to the same double */
+  sprintf(buffer, "%.17g", value);
+
+  for (i = 0; buffer[i]; ++i)
+  {
+    exact |= buffer[i] == '.' || buffer[i] == 'e';
+  }
+
+  printf(exact ? "%s" : "%s.0", buffer);
+}
+
+/* Expression of an operand converted to double */
+static void codegen_f64(codegen_operand a, s8 *out)
+{
+  sprintf(out, a.type == ARITLEX_TYPE_S32 ? "(double)t%u" : "t%u", a.temp);
+}
+
+/* Same truncation as aritlex_f64_to_s32 (NaN and out of range values become INT_MIN) */
+static void codegen_s32(codegen_operand a, s8 *out)
+{
+  if (a.type == ARITLEX_TYPE_S32)
+  {
+    sprintf(out, "t%u", a.temp);
+  }
+  else
+  {
+    sprintf(out, "(t%u > -2147483649.0 && t%u < 2147483648.0 ? (int)t%u : (-2147483647 - 1))", a.temp, a.temp, a.temp);
+  }
+}
+
+static void codegen_truth(codegen_operand a, s8 *out)
+{
+  sprintf(out, a.type == ARITLEX_TYPE_S32 ? "(t%u != 0)" : "(t%u != 0.0)", a.temp);
+}
+
+static s8 *codegen_operator(aritlex_token_type op)
+{
+  switch (op)
+  {
+  case TOK_PLUS:
+    return "+";
+  case TOK_MINUS:
+    return "-";
+  case TOK_MUL:
+    return "*";
+  case TOK_DIV:
+    return "/";
+  case TOK_AND:
+    return "&";
+  case TOK_OR:
+    return "|";
+  case TOK_XOR:
+    return "^";
+  case TOK_EQ:
+    return "==";
+  case TOK_NEQ:
+    return "!=";
+  case TOK_LT:
+    return "<";
+  case TOK_LE:
+    return "<=";
+  case TOK_GT:
+    return ">";
+  case TOK_GE:
+    return ">=";
+  case TOK_AND_AND:
+    return "&&";
+  default:
+    return "||";
+  }
+}
+
+static void codegen_binary(aritlex_token_type op, codegen_operand a, codegen_operand b, u32 temp)
+{
+  s8 x[OPERAND_CAPACITY];
+  s8 y[OPERAND_CAPACITY];
+  u32 both_s32 = a.type == ARITLEX_TYPE_S32 && b.type == ARITLEX_TYPE_S32;
+
+  if ((op == TOK_PLUS || op == TOK_MINUS || op == TOK_MUL || op == TOK_DIV) && !both_s32)
+  {
+    codegen_f64(a, x);
+    codegen_f64(b, y);
+    printf("  double t%u = %s %s %s;\n", temp, x, codegen_operator(op), y);
+    return;
+  }
+
+  if (aritlex_is_compare(op))
+  {
+    if (both_s32)
+    {
+      sprintf(x, "t%u", a.temp);
+      sprintf(y, "t%u", b.temp);
+    }
+    else
+    {
+      codegen_f64(a, x);
+      codegen_f64(b, y);
+    }
+    printf("  int t%u = %s %s %s;\n", temp, x, codegen_operator(op), y);
+    return;
+  }
+
+  if (op == TOK_AND_AND || op == TOK_OR_OR)
+  {
+    codegen_truth(a, x);
+    codegen_truth(b, y);
+    printf("  int t%u = %s %s %s;\n", temp, x, codegen_operator(op), y);
+    return;
+  }
+
+  /* Integer operators: operands that are not s32 yet are truncated into their own temporaries first */
+  codegen_s32(a, x);
+  codegen_s32(b, y);
+  printf("  int t%ua = %s;\n", temp, x);
+  printf("  int t%ub = %s;\n", temp, y);
+
+  switch (op)
+  {
+  case TOK_PLUS:
+  case TOK_MINUS:
+  case TOK_MUL:
+    printf("  int t%u = (int)((unsigned int)t%ua %s (unsigned int)t%ub);\n", temp, temp, codegen_operator(op), temp);
+    break;
+  case TOK_DIV:
+    printf("  int t%u = t%ub == 0 ? 0 : (t%ub == -1 ? (int)(0u - (unsigned int)t%ua) : t%ua / t%ub);\n", temp, temp, temp, temp, temp, temp);
+    break;
+  case TOK_MOD:
+    printf("  int t%u = (t%ub == 0 || t%ub == -1) ? 0 : t%ua %% t%ub;\n", temp, temp, temp, temp, temp);
+    break;
+  case TOK_SHL:
+    printf("  int t%u = (int)((unsigned int)t%ua << ((unsigned int)t%ub & 31u));\n", temp, temp, temp);
+    break;
+  case TOK_SHR:
+    printf("  int t%u = t%ua >> (t%ub & 31);\n", temp, temp, temp);
+    break;
+  default:
+    printf("  int t%u = t%ua %s t%ub;\n", temp, temp, codegen_operator(op), temp);
+    break;
+  }
+}
+
+static u32 codegen_function(s8 *name, s8 *expression)
+{
+  codegen_operand stack[ARITLEX_STACK_CAPACITY];
+  s8 x[OPERAND_CAPACITY];
+  s8 y[OPERAND_CAPACITY];
+  s8 z[OPERAND_CAPACITY];
+  u32 tokens_size = 0;
+  u32 sp = 0;
+  u32 i;
+
+  if (!codegen_is_identifier(name))
+  {
+    fprintf(stderr, "[aritlex_codegen] invalid function name: %s\n", name);
+    return 0;
+  }
+
+  if (!aritlex_tokenize(expression, aritlex_strlen(expression), tokens, TOKENS_CAPACITY, &tokens_size) ||
+      !aritlex_compile(tokens, tokens_size, &program))
+  {
+    fprintf(stderr, "[aritlex_codegen] can not compile expr_%s: %s\n", name, expression);
+    return 0;
+  }
+
+  printf("\n/* %s\n", expression);
+  for (i = 0; i < program.vars_size; ++i)
+  {
+    printf(" * vars[%u] = %s\n", i, program.vars[i]);
+  }
+  printf(" */\nstatic f64 expr_%s(const f64 *vars)\n{\n", name);
+
+  for (i = 0; i < program.code_size; ++i)
+  {
+    aritlex_instruction *instruction = &program.code[i];
+    aritlex_token_type op = instruction->type;
+    aritlex_type type = ARITLEX_TYPE_S32;
+
+    if (instruction->arity == 0)
+    {
+      type = aritlex_result_type(op, 0, type, type, type);
+
+      if (op == TOK_VAR)
+      {
+        printf("  double t%u = vars[%u];\n", i, instruction->val.slot);
+      }
+      else if (op == TOK_NUM_FLOAT)
+      {
+        printf("  double t%u = ", i);
+        codegen_f64_literal(instruction->val.number_floating);
+        printf(";\n");
+      }
+      else if (instruction->val.number_integer == -2147483647 - 1)
+      {
+        printf("  int t%u = (-2147483647 - 1);\n", i);
+      }
+      else
+      {
+        printf("  int t%u = %d;\n", i, instruction->val.number_integer);
+      }
+    }
+    else if (instruction->arity == 1)
+    {
+      codegen_operand a = stack[--sp];
+      type = aritlex_result_type(op, 1, a.type, a.type, a.type);
+
+      if (op == TOK_MINUS && a.type == ARITLEX_TYPE_F64)
+      {
+        printf("  double t%u = -t%u;\n", i, a.temp);
+      }
+      else if (op == TOK_MINUS)
+      {
+        printf("  int t%u = (int)(0u - (unsigned int)t%u);\n", i, a.temp);
+      }
+      else if (op == TOK_NOT)
+      {
+        codegen_truth(a, x);
+        printf("  int t%u = !%s;\n", i, x);
+      }
+      else
+      {
+        codegen_s32(a, x);
+        printf("  int t%u = ~%s;\n", i, x);
+      }
+    }
+    else if (instruction->arity == 2)
+    {
+      codegen_operand b = stack[--sp];
+      codegen_operand a = stack[--sp];
+      type = aritlex_result_type(op, 2, a.type, b.type, b.type);
+
+      codegen_binary(op, a, b, i);
+    }
+    else
+    {
+      codegen_operand c = stack[--sp];
+      codegen_operand b = stack[--sp];
+      codegen_operand a = stack[--sp];
+      type = aritlex_result_type(op, 3, a.type, b.type, c.type);
+
+      codegen_truth(a, x);
+      if (type == ARITLEX_TYPE_F64)
+      {
+        codegen_f64(b, y);
+        codegen_f64(c, z);
+        printf("  double t%u = %s ? %s : %s;\n", i, x, y, z);
+      }
+      else
+      {
+        printf("  int t%u = %s ? t%u : t%u;\n", i, x, b.temp, c.temp);
+      }
+    }
+
+    stack[sp].temp = i;
+    stack[sp].type = type;
+    sp++;
+  }
+
+  if (program.vars_size == 0)
+  {
+    printf("  (void)vars;\n");
+  }
+
+  codegen_f64(stack[0], x);
+  printf("  return %s;\n}\n", x);
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  s32 i;
+
+  if (argc < 3 || (argc % 2) == 0)
+  {
+    fprintf(stderr, "usage: %s <name> <expression> [<name> <expression> ...]\n", argv[0]);
+    return 1;
+  }
+
+  printf("/* Generated by aritlex_codegen, do not edit. */\n");
+  printf("#ifndef ARITLEX_H\n#ifndef ARITLEX_CODEGEN_F64\n#define ARITLEX_CODEGEN_F64\ntypedef double f64;\n#endif\n#endif\n");
+
+  for (i = 1; i + 1 < argc; i += 2)
+  {
+    if (!codegen_function(argv[i], argv[i + 1]))
+    {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,587 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Streaming CSV evaluation: applies an expression to every row of a CSV file whose header names
+the expression variables, and writes one result per line. The input is mmapped window by window
+and the output goes through a fixed buffer, so memory use does not depend on the file size.
+Numeric fields are parsed with aritlex_strtod, rows are evaluated in blocks with aritlex_eval_batch.
+File access uses raw Linux x86_64 syscalls, the throughput is reported on stderr.
+
+  cc -O2 -o aritlex_csv aritlex_csv.c
+  ./aritlex_csv --generate 1000000 data.csv    (writes a synthetic file)
+  ./aritlex_csv "(price * qty - discount) / qty" data.csv [results.csv]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#include "../aritlex.h" /* Arithmetic Lexer */
+
+#if !defined(__linux__) || !defined(__x86_64__) || !defined(__GNUC__)
+#error "aritlex_csv uses raw Linux x86_64 syscalls"
+#endif
+
+#define CSV_SYS_WRITE 1
+#define CSV_SYS_OPEN 2
+#define CSV_SYS_CLOSE 3
+#define CSV_SYS_FSTAT 5
+#define CSV_SYS_MMAP 9
+#define CSV_SYS_MUNMAP 11
+#define CSV_SYS_MADVISE 28
+#define CSV_SYS_CLOCK_GETTIME 228
+
+#ifndef CSV_WINDOW
+#define CSV_WINDOW (64L << 20) /* bytes of the input mapped at once */
+#endif
+#define CSV_PAGE 4096L                      /* mmap offsets must be page aligned */
+#define CSV_BLOCK (ARITLEX_BATCH_SIZE * 16) /* rows evaluated at once */
+#define CSV_OUTPUT (1 << 20)                /* output buffer flushed with one write */
+#define TOKENS_CAPACITY 256
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static aritlex_program program;
+static aritlex_batch_scratch scratch;
+static f64 columns_data[ARITLEX_VARS_CAPACITY][CSV_BLOCK];
+static f64 results[CSV_BLOCK];
+static s8 output[CSV_OUTPUT];
+static u32 output_size;
+static int output_fd = 1;
+
+static long csv_syscall(long number, long a1, long a2, long a3, long a4, long a5, long a6)
+{
+  long result;
+  register long r10 __asm__("r10") = a4;
+  register long r8 __asm__("r8") = a5;
+  register long r9 __asm__("r9") = a6;
+
+  __asm__ __volatile__("syscall"
+                       : "=a"(result)
+                       : "a"(number), "D"(a1), "S"(a2), "d"(a3), "r"(r10), "r"(r8), "r"(r9)
+                       : "rcx", "r11", "memory");
+
+  return result;
+}
+
+static u32 csv_write_all(int fd, s8 *data, u32 size)
+{
+  while (size > 0)
+  {
+    long n = csv_syscall(CSV_SYS_WRITE, fd, (long)data, (long)size, 0, 0, 0);
+
+    if (n <= 0)
+    {
+      return 0;
+    }
+
+    data += n;
+    size -= (u32)n;
+  }
+
+  return 1;
+}
+
+static void csv_print(s8 *text)
+{
+  csv_write_all(2, text, aritlex_strlen(text));
+}
+
+static f64 csv_seconds(void)
+{
+  long now[2]; /* struct timespec */
+  csv_syscall(CSV_SYS_CLOCK_GETTIME, 1 /* CLOCK_MONOTONIC */, (long)now, 0, 0, 0, 0);
+  return (f64)now[0] + (f64)now[1] * 1e-9;
+}
+
+static u32 csv_format_u64(u64 value, s8 *out)
+{
+  s8 digits[20];
+  u32 n = 0, size = 0;
+
+  do
+  {
+    digits[n++] = (s8)('0' + (s32)(value % 10));
+    value /= 10;
+  } while (value);
+
+  while (n)
+  {
+    out[size++] = digits[--n];
+  }
+
+  return size;
+}
+
+/* Integers exactly, other values with up to 6 decimals */
+static u32 csv_format(f64 value, s8 *out)
+{
+  u32 size = 0;
+  u64 integer, fraction;
+
+  if (value != value)
+  {
+    out[0] = 'n';
+    out[1] = 'a';
+    out[2] = 'n';
+    return 3;
+  }
+
+  if (value < 0.0)
+  {
+    out[size++] = '-';
+    value = -value;
+  }
+
+  if (value > 1.7976931348623157e308)
+  {
+    out[size] = 'i';
+    out[size + 1] = 'n';
+    out[size + 2] = 'f';
+    return size + 3;
+  }
+
+  if (value >= 9e15)
+  {
+    u64 exponent = 0;
+
+    while (value >= 1e15)
+    {
+      value /= 10.0;
+      exponent++;
+    }
+
+    size += csv_format_u64((u64)(value + 0.5), out + size);
+    out[size++] = 'e';
+    return size + csv_format_u64(exponent, out + size);
+  }
+
+  integer = (u64)value;
+  fraction = (u64)((value - (f64)integer) * 1e6 + 0.5);
+
+  if (fraction >= 1000000)
+  {
+    integer++;
+    fraction -= 1000000;
+  }
+
+  size += csv_format_u64(integer, out + size);
+
+  if (fraction)
+  {
+    u32 i;
+
+    out[size++] = '.';
+
+    for (i = 0; i < 6; ++i)
+    {
+      out[size + 5 - i] = (s8)('0' + (s32)(fraction % 10));
+      fraction /= 10;
+    }
+
+    size += 6;
+
+    while (out[size - 1] == '0')
+    {
+      size--;
+    }
+  }
+
+  return size;
+}
+
+static void csv_append(s8 *out, u32 *size, s8 *text)
+{
+  while (*text)
+  {
+    out[(*size)++] = *text++;
+  }
+}
+
+static u32 csv_flush(void)
+{
+  u32 ok = csv_write_all(output_fd, output, output_size);
+  output_size = 0;
+  return ok;
+}
+
+static u32 csv_emit(f64 **columns, u32 rows)
+{
+  u32 i;
+
+  if (!aritlex_eval_batch(&program, columns, rows, results, &scratch))
+  {
+    return 0;
+  }
+
+  for (i = 0; i < rows; ++i)
+  {
+    if (output_size > CSV_OUTPUT - 64 && !csv_flush())
+    {
+      return 0;
+    }
+
+    output_size += csv_format(results[i], output + output_size);
+    output[output_size++] = '\n';
+  }
+
+  return 1;
+}
+
+static int csv_generate(u32 rows, s8 *path)
+{
+  int fd = (int)csv_syscall(CSV_SYS_OPEN, (long)path, 01 | 0100 | 01000 /* O_WRONLY | O_CREAT | O_TRUNC */, 0644, 0, 0, 0);
+  u32 state = 12345, row;
+  s8 *header = "id,name,price,qty,discount,region\n";
+
+  if (fd < 0)
+  {
+    return 1;
+  }
+
+  output_fd = fd;
+
+  while (*header)
+  {
+    output[output_size++] = *header++;
+  }
+
+  for (row = 0; row < rows; ++row)
+  {
+    if (output_size > CSV_OUTPUT - 128 && !csv_flush())
+    {
+      return 1;
+    }
+
+    state = state * 1103515245u + 12345u;
+    output_size += csv_format_u64(row, output + output_size);
+    output[output_size++] = ',';
+    output[output_size++] = '"';
+    output[output_size++] = 'i';
+    output[output_size++] = 't';
+    output[output_size++] = 'e';
+    output[output_size++] = 'm';
+    output[output_size++] = ',';
+    output_size += csv_format_u64(state % 97, output + output_size);
+    output[output_size++] = '"';
+    output[output_size++] = ',';
+    output_size += csv_format((f64)((state >> 8) % 100000) / 100.0, output + output_size);
+    output[output_size++] = ',';
+    output_size += csv_format_u64((state >> 4) % 50 + 1, output + output_size);
+    output[output_size++] = ',';
+    output_size += csv_format((f64)((state >> 12) % 1000) / 10.0, output + output_size);
+    output[output_size++] = ',';
+    output_size += csv_format_u64((state >> 20) % 8, output + output_size);
+    output[output_size++] = '\n';
+  }
+
+  return !csv_flush() || csv_syscall(CSV_SYS_CLOSE, fd, 0, 0, 0, 0, 0) != 0;
+}
+
+/* End of the field starting at p, quoted fields may contain commas */
+static s8 *csv_field_end(s8 *p, s8 *end)
+{
+  if (p < end && *p == '"')
+  {
+    for (p++; p < end && *p != '"'; ++p)
+    {
+    }
+    p += p < end;
+  }
+
+  while (p < end && *p != ',' && *p != '\n' && *p != '\r')
+  {
+    p++;
+  }
+
+  return p;
+}
+
+/* Parses the number in [p, end) through a NUL terminated copy, aritlex_strtod has no end bound */
+static u32 csv_field_number(s8 *p, s8 *end, f64 *value)
+{
+  s8 field[64];
+  u32 size, i;
+
+  if (p < end && *p == '"')
+  {
+    p++;
+    end -= end > p && end[-1] == '"';
+  }
+
+  size = (u32)(end - p);
+
+  if (size >= sizeof(field))
+  {
+    return 0;
+  }
+
+  for (i = 0; i < size; ++i)
+  {
+    field[i] = p[i];
+  }
+
+  field[size] = 0;
+  *value = aritlex_strtod(field, 0);
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  u32 fields_slot[256]; /* CSV column -> program slot or ARITLEX_SLOT_INVALID */
+  f64 *columns[ARITLEX_VARS_CAPACITY];
+  long stat[18]; /* struct stat, st_size at byte 48 */
+  long file_size, offset = 0;
+  u32 tokens_size = 0, fields_size = 0, fields_needed = 0, found = 0, rows = 0, i;
+  u64 total_rows = 0;
+  f64 start, elapsed;
+  s8 report[256];
+  u32 report_size = 0;
+  int fd;
+
+  if (argc == 4 && aritlex_strcmp(argv[1], "--generate", 10) && argv[1][10] == 0)
+  {
+    u32 count = 0;
+
+    for (i = 0; argv[2][i] >= '0' && argv[2][i] <= '9'; ++i)
+    {
+      count = count * 10 + (u32)(argv[2][i] - '0');
+    }
+
+    return csv_generate(count, argv[3]);
+  }
+
+  if (argc < 3)
+  {
+    csv_print("usage: aritlex_csv <expression> <input.csv> [output]\n       aritlex_csv --generate <rows> <output.csv>\n");
+    return 1;
+  }
+
+  if (!aritlex_tokenize(argv[1], aritlex_strlen(argv[1]), tokens, TOKENS_CAPACITY, &tokens_size) ||
+      !aritlex_compile(tokens, tokens_size, &program))
+  {
+    csv_print("[aritlex] can not compile the expression\n");
+    return 1;
+  }
+
+  fd = (int)csv_syscall(CSV_SYS_OPEN, (long)argv[2], 0 /* O_RDONLY */, 0, 0, 0, 0);
+
+  if (fd < 0 || csv_syscall(CSV_SYS_FSTAT, fd, (long)stat, 0, 0, 0, 0) != 0)
+  {
+    csv_print("[aritlex] can not open the input\n");
+    return 1;
+  }
+
+  file_size = stat[6];
+
+  if (argc > 3)
+  {
+    output_fd = (int)csv_syscall(CSV_SYS_OPEN, (long)argv[3], 01 | 0100 | 01000, 0644, 0, 0, 0);
+
+    if (output_fd < 0)
+    {
+      csv_print("[aritlex] can not open the output\n");
+      return 1;
+    }
+  }
+
+  for (i = 0; i < ARITLEX_VARS_CAPACITY; ++i)
+  {
+    columns[i] = columns_data[i];
+  }
+
+  aritlex_batch_init(&scratch);
+  start = csv_seconds();
+
+  /* Each window ends at the last complete line inside it and the next one starts at the page holding the next line */
+  while (offset < file_size)
+  {
+    long aligned = offset & ~(CSV_PAGE - 1);
+    long length = file_size - aligned < CSV_WINDOW ? file_size - aligned : CSV_WINDOW;
+    long mapped = csv_syscall(CSV_SYS_MMAP, 0, length, 1 /* PROT_READ */, 2 /* MAP_PRIVATE */, fd, aligned);
+    s8 *base, *p, *end, *last;
+
+    if (mapped < 0 && mapped > -4096)
+    {
+      csv_print("[aritlex] mmap failed\n");
+      return 1;
+    }
+
+    csv_syscall(CSV_SYS_MADVISE, mapped, length, 2 /* MADV_SEQUENTIAL */, 0, 0, 0);
+
+    base = (s8 *)mapped;
+    p = base + (offset - aligned);
+    end = base + length;
+    last = end;
+
+    if (aligned + length < file_size)
+    {
+      while (last > p && last[-1] != '\n')
+      {
+        last--;
+      }
+
+      if (last == p)
+      {
+        csv_print("[aritlex] line longer than the mapping window\n");
+        return 1;
+      }
+    }
+
+    /* Header: map the column names to the program slots */
+    if (offset == 0)
+    {
+      while (p < last && *p != '\n')
+      {
+        s8 name[32];
+        s8 *field_end = csv_field_end(p, last);
+        u32 size = (u32)(field_end - p) < 31 ? (u32)(field_end - p) : 31;
+
+        for (i = 0; i < size; ++i)
+        {
+          name[i] = p[i];
+        }
+
+        name[size] = 0;
+
+        if (fields_size < 256)
+        {
+          fields_slot[fields_size] = aritlex_program_slot(&program, name);
+          found += fields_slot[fields_size] != ARITLEX_SLOT_INVALID;
+          fields_size++;
+          fields_needed = fields_slot[fields_size - 1] != ARITLEX_SLOT_INVALID ? fields_size : fields_needed;
+        }
+
+        p = field_end + (field_end < last && *field_end == ',');
+        p += p < last && *p == '\r';
+      }
+
+      p += p < last;
+
+      if (found != program.vars_size)
+      {
+        csv_print("[aritlex] the header does not name every variable of the expression\n");
+        return 1;
+      }
+    }
+
+    while (p < last)
+    {
+      u32 field = 0;
+
+      if (*p == '\n' || *p == '\r')
+      {
+        p++; /* empty line */
+        continue;
+      }
+
+      while (p < last && *p != '\n')
+      {
+        s8 *field_end = csv_field_end(p, last);
+
+        if (field < fields_size && fields_slot[field] != ARITLEX_SLOT_INVALID &&
+            !csv_field_number(p, field_end, &columns_data[fields_slot[field]][rows]))
+        {
+          csv_print("[aritlex] numeric field longer than 63 characters\n");
+          return 1;
+        }
+
+        field++;
+        p = field_end;
+        p += p < last && *p == '\r';
+        p += p < last && *p == ',';
+      }
+
+      /* A short row would evaluate the values of the previous block */
+      if (field < fields_needed)
+      {
+        csv_print("[aritlex] row without a field for every variable of the expression\n");
+        return 1;
+      }
+
+      p++;
+      rows++;
+
+      if (rows == CSV_BLOCK)
+      {
+        if (!csv_emit(columns, rows))
+        {
+          return 1;
+        }
+
+        total_rows += rows;
+        rows = 0;
+      }
+    }
+
+    offset = aligned + (last - base);
+    csv_syscall(CSV_SYS_MUNMAP, mapped, length, 0, 0, 0, 0);
+  }
+
+  if ((rows && !csv_emit(columns, rows)) || !csv_flush())
+  {
+    return 1;
+  }
+
+  total_rows += rows;
+  elapsed = csv_seconds() - start;
+
+  /* "[aritlex] <rows> rows, <MB> MB in <seconds> s, <MB/s> MB/s" */
+  csv_append(report, &report_size, "[aritlex] ");
+  report_size += csv_format_u64(total_rows, report + report_size);
+  csv_append(report, &report_size, " rows, ");
+  report_size += csv_format((f64)(u64)((f64)file_size / 1e5) / 10.0, report + report_size);
+  csv_append(report, &report_size, " MB in ");
+  report_size += csv_format((f64)(u64)(elapsed * 1e3) / 1e3, report + report_size);
+  csv_append(report, &report_size, " s, ");
+  report_size += csv_format((f64)(u64)((f64)file_size / elapsed / 1e5) / 10.0, report + report_size);
+  csv_append(report, &report_size, " MB/s\n");
+  csv_write_all(2, report, report_size);
+
+  return csv_syscall(CSV_SYS_CLOSE, fd, 0, 0, 0, 0, 0) != 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
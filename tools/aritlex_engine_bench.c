@@ -0,0 +1,218 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Rule engine benchmark: matches random events against growing sets of rules like
+"country == 7 && score > 0.8" with the predicate indexed aritlex_engine_match and with
+evaluating every rule, and prints the events per second and the rules evaluated and matched
+per event. The rules are keyed on one or two equalities whose constants are drawn from a set
+that grows with the rule count (like customer or product ids), so the postings per key and the
+rules evaluated per event stay about the same while the rule count grows 20x.
+
+  cc -O2 -o aritlex_engine_bench aritlex_engine_bench.c
+  ./aritlex_engine_bench [max rules]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#include "../aritlex.h"         /* Arithmetic Lexer */
+#include "stdio.h"              /* printf, sprintf */
+#include "stdlib.h"             /* malloc, atoi */
+#include "time.h"               /* clock_gettime */
+
+#define TOKENS_CAPACITY 256
+#define EVENTS 2000
+#define PASSES 20 /* the indexed match is fast, it is timed over the events this many times */
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static aritlex_engine engine;
+static f64 events[EVENTS][ARITLEX_ENGINE_VARS_CAPACITY];
+static u32 state = 12345;
+
+static u32 bench_random(void)
+{
+  state = state * 1103515245u + 12345u;
+  return state >> 8;
+}
+
+static f64 bench_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  static s8 *fields[] = {"country", "device", "channel", "segment"};
+  u32 max_rules = argc > 1 ? (u32)atoi(argv[1]) : 20000u;
+  u32 table_capacity = 1, rules, i, j;
+  aritlex_engine_rule *rule_memory;
+  aritlex_instruction *code;
+  aritlex_engine_posting *postings;
+  aritlex_engine_key *table;
+  aritlex_engine_range *ranges;
+  u32 *matches;
+
+  while (table_capacity <= max_rules * 2)
+  {
+    table_capacity *= 2;
+  }
+
+  rule_memory = (aritlex_engine_rule *)malloc(sizeof(aritlex_engine_rule) * max_rules);
+  code = (aritlex_instruction *)malloc(sizeof(aritlex_instruction) * max_rules * 16);
+  postings = (aritlex_engine_posting *)malloc(sizeof(aritlex_engine_posting) * max_rules * 2);
+  table = (aritlex_engine_key *)malloc(sizeof(aritlex_engine_key) * table_capacity);
+  ranges = (aritlex_engine_range *)malloc(sizeof(aritlex_engine_range) * max_rules);
+  matches = (u32 *)malloc(sizeof(u32) * max_rules);
+
+  if (!rule_memory || !code || !postings || !table || !ranges || !matches)
+  {
+    return 1;
+  }
+
+  printf("%8s %14s %14s %10s %12s %10s %10s\n", "rules", "indexed ev/s", "scan ev/s", "hits", "evaluated", "matched", "speedup");
+
+  for (rules = 1000; rules <= max_rules; rules = rules * 2 > max_rules && rules != max_rules ? max_rules : rules * 2)
+  {
+    f64 start, indexed, scan;
+    u32 keys = rules / 50; /* distinct constants per field */
+    u32 hits = 0, evaluated = 0, matched = 0, scanned = 0;
+
+    if (!aritlex_engine_init(&engine, rule_memory, rules, code, rules * 16, postings, rules * 2, table, table_capacity, ranges, rules))
+    {
+      return 1;
+    }
+
+    state = 12345;
+
+    /* 60% of the rules key on two equalities, the rest on one */
+    for (i = 0; i < rules; ++i)
+    {
+      s8 text[128];
+      u32 tokens_size = 0;
+
+      if (bench_random() % 10 < 6)
+      {
+        u32 first = bench_random() % 4;
+
+        sprintf(text, "%s == %u && %s == %u && score > 0.%u", fields[first], bench_random() % keys,
+                fields[(first + 1 + bench_random() % 3) % 4], bench_random() % keys, bench_random() % 10);
+      }
+      else
+      {
+        sprintf(text, "%s == %u && score > 0.%u && amount < %u", fields[bench_random() % 4], bench_random() % keys,
+                bench_random() % 10, bench_random() % 1000);
+      }
+
+      if (!aritlex_tokenize(text, aritlex_strlen(text), tokens, TOKENS_CAPACITY, &tokens_size) ||
+          !aritlex_engine_add(&engine, tokens, tokens_size))
+      {
+        printf("[aritlex] can not add rule: %s\n", text);
+        return 1;
+      }
+    }
+
+    aritlex_engine_build(&engine);
+
+    for (i = 0; i < EVENTS; ++i)
+    {
+      for (j = 0; j < engine.vars_size; ++j)
+      {
+        events[i][j] = (f64)(bench_random() % keys);
+      }
+
+      events[i][aritlex_engine_slot(&engine, "score")] = (f64)(bench_random() % 1000) / 1000.0;
+    }
+
+    start = bench_seconds();
+    for (i = 0; i < EVENTS * PASSES; ++i)
+    {
+      u32 matches_size;
+
+      if (!aritlex_engine_match(&engine, events[i % EVENTS], matches, rules, &matches_size))
+      {
+        return 1;
+      }
+
+      hits += engine.hits;
+      evaluated += engine.evaluated;
+      matched += matches_size;
+    }
+    indexed = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (i = 0; i < EVENTS; ++i)
+    {
+      for (j = 0; j < rules; ++j)
+      {
+        scanned += aritlex_value_truth(aritlex_eval_code(code + rule_memory[j].code_begin, rule_memory[j].code_size, events[i])) != 0;
+      }
+    }
+    scan = bench_seconds() - start;
+
+    if (scanned * PASSES != matched)
+    {
+      printf("[aritlex] %u matches indexed, %u when evaluating every rule\n", matched / PASSES, scanned);
+      return 1;
+    }
+
+    printf("%8u %14.4g %14.4g %10.1f %12.1f %10.1f %10.1f\n", rules, (f64)(EVENTS * PASSES) / indexed, (f64)EVENTS / scan,
+           (f64)hits / (f64)(EVENTS * PASSES), (f64)evaluated / (f64)(EVENTS * PASSES), (f64)matched / (f64)(EVENTS * PASSES),
+           scan / (indexed / PASSES));
+
+    if (rules == max_rules)
+    {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,155 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Throughput of the fixed point evaluator (aritlex_eval_fixed, Qm.n in s32) against aritlex_eval
+on the same compiled expressions and inputs, results are checked against each other.
+aritlex_eval runs on the hardware FPU of the host, so the ratio is what fixed point costs on a
+core with a FPU. It is not a soft float comparison, the gain on cores without a FPU has to be
+measured on such a core.
+
+  cc -O2 -DARITLEX_FIXED_POINT -o aritlex_fixed_bench aritlex_fixed_bench.c
+  ./aritlex_fixed_bench [evaluations]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#include "../aritlex.h"         /* Arithmetic Lexer */
+#include "stdio.h"              /* printf */
+#include "stdlib.h"             /* atoi */
+#include "time.h"               /* clock_gettime */
+
+#define TOKENS_CAPACITY 256
+#define ROWS 4096
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static aritlex_program program;
+static aritlex_fixed fixed_rows[ROWS][ARITLEX_VARS_CAPACITY];
+static f64 f64_rows[ROWS][ARITLEX_VARS_CAPACITY];
+
+static f64 bench_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  static s8 *codes[] = {
+      "(price * qty - discount) / (qty + 1.0) + (price > 50.0 ? 1.5 : -0.25) * qty",
+      "price * 0.5 + qty * 0.25 - discount * 0.125",
+      "price > qty && qty < discount ? price - qty : discount / 4.0",
+      "(price + qty) * (price - qty) / (discount + 1.0)"};
+  u32 evaluations = argc > 1 ? (u32)atoi(argv[1]) : 4000000u;
+  f64 checksum[2] = {0.0, 0.0};
+  u32 c, i, j, row;
+
+  printf("[aritlex] Q%d.%d, %u evaluations per expression\n", 31 - ARITLEX_FIXED_FRACTION_BITS, ARITLEX_FIXED_FRACTION_BITS, evaluations);
+  printf("%-78s %12s %12s %10s\n", "expression", "fixed ev/s", "f64 ev/s", "f64/fixed");
+
+  for (c = 0; c < sizeof(codes) / sizeof(codes[0]); ++c)
+  {
+    u32 tokens_size = 0, mismatches = 0;
+    f64 start, seconds[2];
+
+    if (!aritlex_tokenize(codes[c], aritlex_strlen(codes[c]), tokens, TOKENS_CAPACITY, &tokens_size) ||
+        !aritlex_compile(tokens, tokens_size, &program))
+    {
+      printf("[aritlex] can not compile: %s\n", codes[c]);
+      return 1;
+    }
+
+    for (row = 0; row < ROWS; ++row)
+    {
+      for (i = 0; i < program.vars_size; ++i)
+      {
+        /* Values with an exact fixed point representation so both evaluators see the same inputs */
+        fixed_rows[row][i] = (aritlex_fixed)((row * 2654435761u + i * 40503u) % 6400u) * (ARITLEX_FIXED_ONE / 64) + ARITLEX_FIXED_ONE / 4;
+        f64_rows[row][i] = aritlex_fixed_to_f64(fixed_rows[row][i]);
+      }
+    }
+
+    for (row = 0; row < ROWS; ++row)
+    {
+      f64 fixed = aritlex_fixed_to_f64(aritlex_eval_fixed(&program, fixed_rows[row]));
+      f64 expected = aritlex_eval(&program, f64_rows[row]);
+      f64 tolerance = 0.01 + (expected < 0.0 ? -expected : expected) * 1e-3; /* rounding of the Qm.n steps */
+
+      mismatches += fixed - expected > tolerance || expected - fixed > tolerance;
+    }
+
+    if (mismatches)
+    {
+      printf("[aritlex] %u rows differ between the evaluators: %s\n", mismatches, codes[c]);
+      return 1;
+    }
+
+    start = bench_seconds();
+    for (j = 0; j < evaluations; ++j)
+    {
+      checksum[0] += (f64)aritlex_eval_fixed(&program, fixed_rows[j % ROWS]);
+    }
+    seconds[0] = bench_seconds() - start;
+
+    start = bench_seconds();
+    for (j = 0; j < evaluations; ++j)
+    {
+      checksum[1] += aritlex_eval(&program, f64_rows[j % ROWS]);
+    }
+    seconds[1] = bench_seconds() - start;
+
+    printf("%-78s %12.4g %12.4g %10.2f\n", codes[c], (f64)evaluations / seconds[0], (f64)evaluations / seconds[1], seconds[1] / seconds[0]);
+  }
+
+  printf("[aritlex] checksums %.6g %.6g\n", checksum[0] / (f64)ARITLEX_FIXED_ONE, checksum[1]);
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
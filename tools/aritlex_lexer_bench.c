@@ -0,0 +1,384 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Lexer benchmark suite: generates a deterministic synthetic corpus for each token mix
+(identifier, float, hex/binary, operator, string and whitespace heavy) and streams it
+through aritlex_tokenize in chunks, so the corpus can be far larger than memory. Prints the
+median MB/s with its 95% confidence interval (perf.h), tokens/s, cycles/byte, input bytes
+per token and bytes of aritlex_token output per token of every profile.
+
+  cc -O2 -o aritlex_lexer_bench aritlex_lexer_bench.c
+  ./aritlex_lexer_bench [megabytes per profile, 16] [profile]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#include "../aritlex.h"   /* Arithmetic Lexer */
+#include "../deps/perf.h" /* Simple Performance profiler */
+#include "stdio.h"        /* printf, sprintf */
+#include "stdlib.h"       /* atof */
+
+#define CHUNK_CAPACITY 65536
+#define ITEM_MAX 256 /* longest item and separator a generator writes */
+#define SAMPLES 31
+
+/* aritlex_tokenize writes at most one token per byte plus TOK_EOF */
+static aritlex_token tokens[CHUNK_CAPACITY + 1];
+static s8 chunk[CHUNK_CAPACITY + 1];
+static u32 state;
+
+/* xorshift32, every profile starts from the same seed so the corpus only depends on its size */
+static u32 lexer_random(void)
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static u32 lexer_range(u32 low, u32 high)
+{
+  return low + lexer_random() % (high - low + 1);
+}
+
+static u32 lexer_append(s8 *out, s8 *text)
+{
+  u32 i;
+
+  for (i = 0; text[i]; ++i)
+  {
+    out[i] = text[i];
+  }
+
+  return i;
+}
+
+static u32 lexer_digits(s8 *out, u32 count)
+{
+  u32 i;
+
+  for (i = 0; i < count; ++i)
+  {
+    out[i] = (s8)('0' + lexer_random() % 10);
+  }
+
+  return count;
+}
+
+static u32 lexer_integer(s8 *out)
+{
+  return lexer_digits(out, lexer_range(1, 4));
+}
+
+static u32 lexer_identifier(s8 *out)
+{
+  static s8 first[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_";
+  static s8 rest[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789";
+  u32 length = lexer_range(1, 24);
+  u32 i;
+
+  out[0] = first[lexer_random() % (sizeof(first) - 1)];
+
+  for (i = 1; i < length; ++i)
+  {
+    out[i] = rest[lexer_random() % (sizeof(rest) - 1)];
+  }
+
+  return length;
+}
+
+static u32 lexer_operator(s8 *out)
+{
+  static s8 *operators[] = {
+      "+", "-", "*", "/", "%", "(", ")", "?", ":", "==", "!=", "<", "<=", ">", ">=", "=", "+=", "-=", "*=", "/=", "%=",
+      "&&", "||", "!", "&", "|", "^", "~", "<<", ">>", "++", "--", "<<=", ">>=", "&=", "|=", "^="};
+
+  return lexer_append(out, operators[lexer_random() % (sizeof(operators) / sizeof(operators[0]))]);
+}
+
+static u32 lexer_float(s8 *out)
+{
+  u32 length = lexer_digits(out, lexer_range(1, 6));
+
+  out[length++] = '.';
+  length += lexer_digits(out + length, lexer_range(1, 8));
+
+  switch (lexer_random() % 4)
+  {
+  case 0:
+    length += lexer_append(out + length, lexer_random() % 2 ? "e-" : "e+");
+    length += lexer_digits(out + length, lexer_range(1, 2));
+    break;
+  case 1:
+    out[length++] = 'f';
+    break;
+  default:
+    break;
+  }
+
+  return length;
+}
+
+static u32 lexer_hex_binary(s8 *out)
+{
+  static s8 hex[] = "0123456789abcdefABCDEF";
+  u32 binary = lexer_random() % 2;
+  u32 digits = binary ? lexer_range(1, 32) : lexer_range(1, 8);
+  u32 length = lexer_append(out, binary ? "0b" : "0x");
+  u32 i;
+
+  for (i = 0; i < digits; ++i)
+  {
+    if (i && i % 4 == 0 && lexer_random() % 2)
+    {
+      out[length++] = '_';
+    }
+
+    out[length++] = binary ? (s8)('0' + lexer_random() % 2) : hex[lexer_random() % (sizeof(hex) - 1)];
+  }
+
+  return length;
+}
+
+static u32 lexer_string(s8 *out)
+{
+  static s8 escapes[] = "ntr\"\\";
+  u32 size = lexer_range(0, 100);
+  u32 length = 0;
+  u32 i;
+
+  out[length++] = '"';
+
+  for (i = 0; i < size; ++i)
+  {
+    if (lexer_random() % 16 == 0)
+    {
+      out[length++] = '\\';
+      out[length++] = escapes[lexer_random() % (sizeof(escapes) - 1)];
+    }
+    else
+    {
+      s8 c = (s8)lexer_range(' ', '~');
+
+      out[length++] = c == '"' || c == '\\' ? '_' : c; /* quotes and backslashes only escaped */
+    }
+  }
+
+  out[length++] = '"';
+
+  return length;
+}
+
+static u32 lexer_whitespace(s8 *out)
+{
+  static s8 spaces[] = " \t\r\n";
+  u32 length = lexer_range(1, 32);
+  u32 i;
+
+  for (i = 0; i < length; ++i)
+  {
+    out[i] = spaces[lexer_random() % (sizeof(spaces) - 1)];
+  }
+
+  return length;
+}
+
+typedef u32 (*lexer_item)(s8 *out);
+
+typedef struct lexer_profile
+{
+  s8 *name;
+  lexer_item main;  /* token class that dominates the mix */
+  u32 main_percent; /* share of main items, the rest alternates operators and integers */
+  u32 spaced;       /* runs of whitespace between the items instead of single spaces */
+
+} lexer_profile;
+
+/* Writes one item and its separator, returns its size (at most ITEM_MAX) */
+static u32 lexer_generate_item(lexer_profile *profile, s8 *out)
+{
+  u32 roll = lexer_random() % 100;
+  u32 length;
+
+  if (roll < profile->main_percent)
+  {
+    length = profile->main(out);
+  }
+  else
+  {
+    length = roll % 2 ? lexer_operator(out) : lexer_integer(out);
+  }
+
+  if (profile->spaced)
+  {
+    return length + lexer_whitespace(out + length);
+  }
+
+  out[length] = ' ';
+
+  return length + 1;
+}
+
+/* Fills chunk with whole items while fewer than limit bytes, returns the size */
+static u32 lexer_generate_chunk(lexer_profile *profile, u32 limit)
+{
+  u32 size = 0;
+
+  while (size < limit)
+  {
+    size += lexer_generate_item(profile, chunk + size);
+  }
+
+  chunk[size] = '\0';
+
+  return size;
+}
+
+static u32 lexer_equals(s8 *a, s8 *b)
+{
+  while (*a && *a == *b)
+  {
+    a++;
+    b++;
+  }
+
+  return *a == *b;
+}
+
+int main(int argc, char **argv)
+{
+  static lexer_profile profiles[] = {
+      {"identifiers", lexer_identifier, 75, 0},
+      {"floats", lexer_float, 75, 0},
+      {"hex/binary", lexer_hex_binary, 75, 0},
+      {"operators", lexer_operator, 90, 0},
+      {"strings", lexer_string, 75, 0},
+      {"whitespace", lexer_identifier, 50, 1}};
+  f64 megabytes = argc > 1 ? atof(argv[1]) : 16.0;
+  f64 target = megabytes * 1000000.0;
+  f64 chunks = target / (f64)(CHUNK_CAPACITY - ITEM_MAX);
+  u32 p;
+
+  if (megabytes <= 0.0)
+  {
+    printf("usage: %s [megabytes per profile, 16] [profile]\n", argv[0]);
+    return 1;
+  }
+
+  printf("%-12s %9s %12s %20s %10s %9s %8s %8s\n", "profile", "MB", "tokens", "MB/s (95% CI)", "Mtokens/s", "cycles/B", "B/token", "out/tok");
+
+  for (p = 0; p < sizeof(profiles) / sizeof(profiles[0]); ++p)
+  {
+    lexer_profile *profile = &profiles[p];
+    f64 sample_bytes[SAMPLES] = {0};
+    f64 sample_ns[SAMPLES] = {0};
+    f64 samples[SAMPLES];
+    f64 bytes = 0.0, token_count = 0.0, cycles = 0.0, chunk_index = 0.0;
+    perf_bench_summary summary;
+    char interval[64];
+    u32 s, samples_size = 0;
+
+    if (argc > 2 && !lexer_equals(argv[2], profile->name))
+    {
+      continue;
+    }
+
+    state = 2463534242u;
+
+    /* Generating is untimed, each chunk is tokenized once and adds to one of SAMPLES consecutive samples */
+    while (bytes < target)
+    {
+      f64 left = target - bytes;
+      u32 size = lexer_generate_chunk(profile, left < (f64)(CHUNK_CAPACITY - ITEM_MAX) ? (u32)left + 1 : CHUNK_CAPACITY - ITEM_MAX);
+      u32 tokens_size = 0;
+      unsigned long start_cycles, end_cycles;
+      f64 start_ns, end_ns;
+
+      start_ns = perf_platform_current_time_nanoseconds();
+      start_cycles = perf_bench_cycles_begin();
+
+      if (!aritlex_tokenize(chunk, size, tokens, CHUNK_CAPACITY + 1, &tokens_size))
+      {
+        printf("[aritlex] %s chunk does not tokenize\n", profile->name);
+        return 1;
+      }
+
+      end_cycles = perf_bench_cycles_end();
+      end_ns = perf_platform_current_time_nanoseconds();
+
+      s = (u32)(chunk_index * (f64)SAMPLES / chunks);
+      s = s < SAMPLES ? s : SAMPLES - 1;
+
+      sample_bytes[s] += (f64)size;
+      sample_ns[s] += end_ns - start_ns;
+      bytes += (f64)size;
+      token_count += (f64)(tokens_size - 1); /* without TOK_EOF */
+      cycles += (f64)(end_cycles - start_cycles);
+      chunk_index += 1.0;
+    }
+
+    /* ns per byte of every sample, perf_bench_summarize rejects outliers like preempted chunks */
+    for (s = 0; s < SAMPLES; ++s)
+    {
+      if (sample_bytes[s] > 0.0)
+      {
+        samples[samples_size++] = sample_ns[s] / sample_bytes[s];
+      }
+    }
+
+    perf_bench_summarize(samples, samples_size, &summary);
+    sprintf(interval, "%.1f (%.1f-%.1f)", 1000.0 / summary.median, 1000.0 / summary.high, 1000.0 / summary.low);
+
+    printf("%-12s %9.2f %12.0f %20s %10.2f %9.2f %8.2f %8lu\n", profile->name, bytes / 1000000.0, token_count, interval,
+           token_count / bytes * 1000.0 / summary.median, cycles / bytes, bytes / token_count, (unsigned long)sizeof(aritlex_token));
+  }
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
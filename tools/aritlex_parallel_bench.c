@@ -0,0 +1,208 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Strong scaling benchmark of the parallel evaluator: one expression over a fixed number of rows
+is evaluated with 1, 2, 4, ... threads, up to the online cores (or the thread count given as
+second argument). Every run is checked against the single threaded result.
+
+  cc -O2 -pthread -o aritlex_parallel_bench aritlex_parallel_bench.c
+  ./aritlex_parallel_bench [rows] [max threads]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#define ARITLEX_THREADS_ENABLE
+#define ARITLEX_SIMD            /* SSE2 / AVX2 column kernels */
+#include "../aritlex.h" /* Arithmetic Lexer */
+#include "stdio.h"      /* printf */
+#include "stdlib.h"     /* malloc, atoi */
+#include "time.h"       /* clock_gettime */
+#include "unistd.h"     /* sysconf */
+
+#define TOKENS_CAPACITY 256
+#define REPEATS 5
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static aritlex_program program;
+static aritlex_parallel pool;
+
+static f64 bench_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+  s8 *code = "(price * qty - discount) / (qty + 1) + (price > 50 ? 1.5 : 0.5)";
+  u32 rows = argc > 1 ? (u32)atoi(argv[1]) : 50000000u;
+  u32 threads_max = argc > 2 ? (u32)atoi(argv[2]) : (u32)sysconf(_SC_NPROCESSORS_ONLN);
+  u32 tokens_size = 0;
+  u32 threads, i, j, row;
+  f64 *columns[3];
+  f64 *out, *expected;
+  f64 expected_sum = 0.0, base = 0.0;
+
+  if (!aritlex_tokenize(code, aritlex_strlen(code), tokens, TOKENS_CAPACITY, &tokens_size) ||
+      !aritlex_compile(tokens, tokens_size, &program))
+  {
+    printf("[aritlex] can not compile: %s\n", code);
+    return 1;
+  }
+
+  threads_max = threads_max < 1 ? 1 : (threads_max > ARITLEX_THREADS_CAPACITY ? ARITLEX_THREADS_CAPACITY : threads_max);
+
+  out = (f64 *)malloc(sizeof(f64) * rows);
+  expected = (f64 *)malloc(sizeof(f64) * rows);
+
+  for (i = 0; i < program.vars_size; ++i)
+  {
+    columns[i] = (f64 *)malloc(sizeof(f64) * rows);
+
+    if (!columns[i])
+    {
+      return 1;
+    }
+
+    for (row = 0; row < rows; ++row)
+    {
+      columns[i][row] = (f64)((row * 2654435761u + i * 40503u) % 10000u) / 100.0;
+    }
+  }
+
+  if (!out || !expected)
+  {
+    return 1;
+  }
+
+  printf("[aritlex] %s\n", code);
+  printf("[aritlex] %u rows, simd level %u\n", rows, aritlex_simd_detect());
+  printf("%8s %12s %12s %10s %10s %8s\n", "threads", "rows/s", "sum rows/s", "speedup", "efficiency", "steals");
+
+  for (threads = 1;; threads = threads * 2 > threads_max ? threads_max : threads * 2)
+  {
+    f64 best = 1e30, best_sum = 1e30, sum = 0.0;
+    u32 steals = 0;
+
+    if (!aritlex_parallel_init(&pool, threads))
+    {
+      return 1;
+    }
+
+    for (j = 0; j < REPEATS; ++j)
+    {
+      f64 start = bench_seconds();
+      f64 elapsed;
+
+      if (!aritlex_parallel_eval(&pool, &program, columns, rows, out, ARITLEX_REDUCE_NONE, 0))
+      {
+        return 1;
+      }
+
+      elapsed = bench_seconds() - start;
+      best = elapsed < best ? elapsed : best;
+
+      start = bench_seconds();
+
+      if (!aritlex_parallel_eval(&pool, &program, columns, rows, 0, ARITLEX_REDUCE_SUM, &sum))
+      {
+        return 1;
+      }
+
+      elapsed = bench_seconds() - start;
+      best_sum = elapsed < best_sum ? elapsed : best_sum;
+    }
+
+    for (i = 0; i < pool.threads_size; ++i)
+    {
+      steals += pool.workers[i].steals;
+    }
+
+    if (threads == 1)
+    {
+      base = best;
+      expected_sum = sum;
+
+      for (row = 0; row < rows; ++row)
+      {
+        expected[row] = out[row];
+      }
+    }
+
+    for (row = 0; row < rows; ++row)
+    {
+      if (out[row] != expected[row])
+      {
+        printf("[aritlex] mismatch at row %u with %u threads\n", row, threads);
+        return 1;
+      }
+    }
+
+    if ((sum - expected_sum) > 1e-9 * expected_sum || (expected_sum - sum) > 1e-9 * expected_sum)
+    {
+      printf("[aritlex] sum mismatch with %u threads: %.17g != %.17g\n", threads, sum, expected_sum);
+      return 1;
+    }
+
+    printf("%8u %12.4g %12.4g %10.2f %9.0f%% %8u\n",
+           pool.threads_size, (f64)rows / best, (f64)rows / best_sum, base / best, 100.0 * base / best / (f64)pool.threads_size, steals);
+
+    aritlex_parallel_free(&pool);
+
+    if (threads == threads_max)
+    {
+      break;
+    }
+  }
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,239 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Throughput of the lex / compile / evaluate pipeline on a stream of expressions with changing
+bindings, compared to doing the three steps one after the other on the calling thread. Every
+pipeline result is checked against the sequential one and the per stage counters are printed.
+
+  cc -O2 -pthread -o aritlex_pipeline_bench aritlex_pipeline_bench.c
+  ./aritlex_pipeline_bench [requests]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+#define ARITLEX_THREADS_ENABLE
+#include "../aritlex.h" /* Arithmetic Lexer */
+#include "stdio.h"      /* printf */
+#include "stdlib.h"     /* malloc, atoi */
+#include "time.h"       /* clock_gettime */
+
+#define EXPRESSIONS_SIZE 6
+#define POLL_CAPACITY 64
+
+static s8 *expressions[EXPRESSIONS_SIZE] = {
+    "(price * qty - discount) / (qty + 1)",
+    "price > 50 ? price * 0.9 : price",
+    "(qty * 3 + 7) % 5 << 2",
+    "price * price - 2 * price * discount + discount * discount",
+    "qty >= 10 && discount < 5 || price == 0",
+    "(price + qty) * (price - qty) / (discount + 0.5"}; /* does not compile */
+
+static aritlex_pipeline pipeline;
+static aritlex_token tokens[ARITLEX_PIPELINE_TOKENS_CAPACITY];
+static aritlex_program program;
+
+static f64 bench_seconds(void)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (f64)now.tv_sec + (f64)now.tv_nsec * 1e-9;
+}
+
+static aritlex_pipeline_result bench_sequential(aritlex_pipeline_request *request)
+{
+  aritlex_pipeline_result out;
+  u32 tokens_size = 0;
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  u32 i, j;
+
+  out.id = request->id;
+  out.ok = aritlex_tokenize(request->code, aritlex_strlen(request->code), tokens, ARITLEX_PIPELINE_TOKENS_CAPACITY, &tokens_size) &&
+           aritlex_compile(tokens, tokens_size, &program);
+  out.value.type = ARITLEX_TYPE_F64;
+  out.value.val.number_floating = 0.0;
+
+  if (!out.ok)
+  {
+    return out;
+  }
+
+  for (i = 0; i < program.vars_size; ++i)
+  {
+    for (j = 0; j < request->bindings_size; ++j)
+    {
+      if (aritlex_name_equals(program.vars[i], request->bindings[j].name))
+      {
+        vars[i] = request->bindings[j].value;
+      }
+    }
+  }
+
+  out.value = aritlex_eval_value(&program, vars);
+
+  return out;
+}
+
+static u32 bench_same(aritlex_pipeline_result *a, aritlex_pipeline_result *b)
+{
+  if (a->id != b->id || a->ok != b->ok || a->value.type != b->value.type)
+  {
+    return 0;
+  }
+
+  return !a->ok ||
+         (a->value.type == ARITLEX_TYPE_S32 ? a->value.val.number_integer == b->value.val.number_integer
+                                            : a->value.val.number_floating == b->value.val.number_floating);
+}
+
+int main(int argc, char **argv)
+{
+  static s8 *stage_names[ARITLEX_PIPELINE_STAGES] = {"lex", "compile", "eval"};
+  u32 requests_size = argc > 1 ? (u32)atoi(argv[1]) : 2000000u;
+  aritlex_pipeline_request *requests;
+  aritlex_pipeline_result *expected;
+  aritlex_binding *bindings;
+  aritlex_pipeline_result polled[POLL_CAPACITY];
+  u32 submitted = 0, received = 0, failed = 0;
+  f64 start, sequential, pipelined;
+  u32 i;
+
+  requests = (aritlex_pipeline_request *)malloc(sizeof(aritlex_pipeline_request) * requests_size);
+  expected = (aritlex_pipeline_result *)malloc(sizeof(aritlex_pipeline_result) * requests_size);
+  bindings = (aritlex_binding *)malloc(sizeof(aritlex_binding) * 3 * requests_size);
+
+  if (!requests || !expected || !bindings)
+  {
+    return 1;
+  }
+
+  for (i = 0; i < requests_size; ++i)
+  {
+    aritlex_binding *b = &bindings[3 * i];
+
+    b[0].name = "price";
+    b[0].value = (f64)((i * 2654435761u) % 10000u) / 100.0;
+    b[1].name = "qty";
+    b[1].value = (f64)((i * 40503u) % 20u);
+    b[2].name = "discount";
+    b[2].value = (f64)(i % 7u);
+
+    requests[i].id = i;
+    requests[i].code = expressions[(i * 7u) % EXPRESSIONS_SIZE];
+    requests[i].bindings = b;
+    requests[i].bindings_size = 3;
+  }
+
+  start = bench_seconds();
+
+  for (i = 0; i < requests_size; ++i)
+  {
+    expected[i] = bench_sequential(&requests[i]);
+  }
+
+  sequential = bench_seconds() - start;
+
+  if (!aritlex_pipeline_init(&pipeline))
+  {
+    printf("[aritlex] can not start the pipeline threads\n");
+    return 1;
+  }
+
+  start = bench_seconds();
+
+  while (received < requests_size)
+  {
+    u32 n;
+
+    submitted += aritlex_pipeline_submit(&pipeline, requests + submitted, requests_size - submitted);
+    n = aritlex_pipeline_poll(&pipeline, polled, POLL_CAPACITY);
+
+    for (i = 0; i < n; ++i)
+    {
+      failed += !bench_same(&polled[i], &expected[received + i]);
+    }
+
+    received += n;
+
+    if (n == 0)
+    {
+      sched_yield();
+    }
+  }
+
+  pipelined = bench_seconds() - start;
+
+  printf("[aritlex] %u requests, %u expressions\n", requests_size, EXPRESSIONS_SIZE);
+  printf("[aritlex] sequential %10.4g requests/s\n", (f64)requests_size / sequential);
+  printf("[aritlex] pipeline   %10.4g requests/s (%.2fx)\n", (f64)requests_size / pipelined, sequential / pipelined);
+  printf("%8s %10s %10s %10s %10s %10s %10s\n", "stage", "items", "batches", "avg depth", "max depth", "empty", "full");
+
+  for (i = 0; i < ARITLEX_PIPELINE_STAGES; ++i)
+  {
+    aritlex_pipeline_stats stats;
+
+    aritlex_pipeline_stats_get(&pipeline, (aritlex_pipeline_stage_index)i, &stats);
+
+    printf("%8s %10u %10u %10.2f %10u %10u %10u\n",
+           stage_names[i], stats.items, stats.batches,
+           stats.batches ? (f64)stats.depth_sum / (f64)stats.batches : 0.0,
+           stats.depth_max, stats.stalls_empty, stats.stalls_full);
+  }
+
+  aritlex_pipeline_free(&pipeline);
+
+  if (failed)
+  {
+    printf("[aritlex] %u pipeline results differ from the sequential ones\n", failed);
+    return 1;
+  }
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,632 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Local evaluation server: listens on a Unix domain socket and evaluates expressions for other
+processes on the host, so they share one warm compiled expression cache. An epoll loop reads
+every ready connection, the complete requests of one wakeup are coalesced into a batch, and the
+requests of a batch that use the same expression are evaluated together with aritlex_eval_batch.
+tools/aritlex_client.c is a load generator for it.
+
+  cc -O2 -o aritlex_server aritlex_server.c
+  ./aritlex_server /tmp/aritlex.sock
+
+Protocol (host byte order, every request gets exactly one response, in request order per connection,
+a request that does not add up closes the connection):
+
+  request   u32 size           bytes of the whole request
+            u32 id             echoed in the response
+            u32 expression     id from an earlier response, or 0xFFFFFFFF if the text follows
+            u16 text_size      0 if expression is given
+            u16 bindings_size
+            text_size bytes    expression text
+            bindings_size x    u8 name_size, name_size bytes name, f64 value
+
+  response  u32 id
+            u32 expression     id to send instead of the text from now on (0xFFFFFFFF if not cached)
+            u32 status         SERVER_OK, SERVER_SYNTAX, SERVER_UNKNOWN or SERVER_UNBOUND
+            u32 reserved
+            f64 value          as aritlex_eval returns it
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define _POSIX_C_SOURCE 200809L /* MSG_NOSIGNAL */
+#include "../aritlex.h"         /* Arithmetic Lexer */
+#include "stdio.h"              /* printf */
+#include "string.h"             /* memcpy, memmove */
+#include "errno.h"              /* errno */
+#include "fcntl.h"              /* fcntl */
+#include "unistd.h"             /* close, read, unlink */
+#include "sys/socket.h"         /* socket, bind, listen, accept, send */
+#include "sys/un.h"             /* sockaddr_un */
+#include "sys/epoll.h"          /* epoll_create, epoll_ctl, epoll_wait */
+
+#define SERVER_CONNECTIONS 64
+#define SERVER_BUFFER 65536
+#define SERVER_BATCH 1024
+#define SERVER_CACHE 1024 /* Cached expressions, power of two */
+#define SERVER_TEXT 256
+#define SERVER_EVENTS 64
+#define SERVER_HEADER 16
+#define SERVER_RESPONSE 24
+#define SERVER_NONE 0xFFFFFFFFu
+
+#define SERVER_OK 0
+#define SERVER_SYNTAX 1  /* the text does not tokenize, compile or is longer than SERVER_TEXT - 1 */
+#define SERVER_UNKNOWN 2 /* no cached expression with that id */
+#define SERVER_UNBOUND 3 /* a variable of the expression has no binding */
+
+typedef struct server_connection
+{
+  int fd; /* -1 if unused */
+  u32 events;
+  u8 in[SERVER_BUFFER];
+  u32 in_size;
+  u8 out[SERVER_BUFFER];
+  u32 out_begin;
+  u32 out_end;
+
+} server_connection;
+
+typedef struct server_expression
+{
+  u32 used;
+  u32 text_size;
+  u64 hash;
+  s8 text[SERVER_TEXT];
+  aritlex_program program;
+
+} server_expression;
+
+typedef struct server_request
+{
+  u32 connection;
+  u32 id;
+  u32 expression;
+  u32 status;
+  f64 vars[ARITLEX_VARS_CAPACITY];
+  f64 value;
+  u32 done;
+
+} server_request;
+
+static server_connection connections[SERVER_CONNECTIONS];
+static server_expression cache[SERVER_CACHE];
+static server_request batch[SERVER_BATCH];
+static aritlex_token tokens[SERVER_TEXT];
+static aritlex_program uncached;
+static aritlex_batch_scratch scratch;
+static f64 columns_data[ARITLEX_VARS_CAPACITY][SERVER_BATCH];
+static f64 out[SERVER_BATCH];
+static u32 batch_rows[SERVER_BATCH];
+static u32 cache_size;
+
+static u32 server_u32(u8 *data)
+{
+  u32 value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static u32 server_u16(u8 *data)
+{
+  return (u32)data[0] | (u32)data[1] << 8;
+}
+
+/* Cache id of text, compiling and inserting it on a miss. Returns SERVER_NONE with status set if it can not be cached. */
+static u32 server_lookup(s8 *text, u32 text_size, u32 *status)
+{
+  u64 hash = aritlex_image_hash(text, text_size);
+  s8 source[SERVER_TEXT];
+  u32 index = (u32)hash & (SERVER_CACHE - 1);
+  u32 tokens_size = 0;
+  u32 probes;
+
+  *status = SERVER_OK;
+
+  for (probes = 0; probes < SERVER_CACHE && cache[index].used; ++probes)
+  {
+    if (cache[index].hash == hash && cache[index].text_size == text_size && memcmp(cache[index].text, text, text_size) == 0)
+    {
+      return index;
+    }
+
+    index = (index + 1) & (SERVER_CACHE - 1);
+  }
+
+  /* The tokenizer stops at the terminating zero, the text in the request is followed by the bindings */
+  if (text_size >= SERVER_TEXT)
+  {
+    *status = SERVER_SYNTAX;
+    return SERVER_NONE;
+  }
+
+  memcpy(source, text, text_size);
+  source[text_size] = 0;
+
+  if (!aritlex_tokenize(source, text_size, tokens, SERVER_TEXT, &tokens_size) || !aritlex_compile(tokens, tokens_size, &uncached))
+  {
+    *status = SERVER_SYNTAX;
+    return SERVER_NONE;
+  }
+
+  /* Keep the table at most three quarters full so that misses stay short */
+  if (cache_size >= SERVER_CACHE / 4 * 3)
+  {
+    return SERVER_NONE;
+  }
+
+  cache[index].used = 1;
+  cache[index].text_size = text_size;
+  cache[index].hash = hash;
+  memcpy(cache[index].text, text, text_size);
+  cache[index].program = uncached;
+  cache_size++;
+
+  return index;
+}
+
+/* Resolves the expression and binds the variables of one request. Returns the request size or 0 if it is malformed. */
+static u32 server_decode(u8 *data, u32 size, server_request *request)
+{
+  u32 frame_size = server_u32(data);
+  u32 text_size = server_u16(data + 12);
+  u32 bindings_size = server_u16(data + 14);
+  u8 *binding = data + SERVER_HEADER + text_size;
+  u8 *end = data + frame_size;
+  aritlex_program *program;
+  u8 bound[ARITLEX_VARS_CAPACITY];
+  u32 i, slot;
+
+  if (frame_size < SERVER_HEADER + text_size || frame_size > size)
+  {
+    return 0;
+  }
+
+  request->id = server_u32(data + 4);
+  request->expression = server_u32(data + 8);
+  request->status = SERVER_OK;
+  request->value = 0.0;
+  request->done = 0;
+
+  if (text_size)
+  {
+    request->expression = server_lookup((s8 *)data + SERVER_HEADER, text_size, &request->status);
+  }
+  else if (request->expression >= SERVER_CACHE || !cache[request->expression].used)
+  {
+    request->status = SERVER_UNKNOWN;
+    request->expression = SERVER_NONE;
+  }
+
+  if (request->status != SERVER_OK)
+  {
+    request->done = 1;
+    return frame_size;
+  }
+
+  program = request->expression == SERVER_NONE ? &uncached : &cache[request->expression].program;
+
+  for (slot = 0; slot < program->vars_size; ++slot)
+  {
+    bound[slot] = 0;
+  }
+
+  for (i = 0; i < bindings_size; ++i)
+  {
+    s8 name[ARITLEX_VARS_CAPACITY];
+    u32 name_size;
+
+    if (binding + 1 > end || binding + 1 + binding[0] + sizeof(f64) > end || binding[0] >= ARITLEX_VARS_CAPACITY)
+    {
+      return 0;
+    }
+
+    name_size = binding[0];
+    memcpy(name, binding + 1, name_size);
+    name[name_size] = 0;
+
+    for (slot = 0; slot < program->vars_size; ++slot)
+    {
+      if (aritlex_name_equals(program->vars[slot], name))
+      {
+        memcpy(&request->vars[slot], binding + 1 + name_size, sizeof(f64));
+        bound[slot] = 1;
+      }
+    }
+
+    binding += 1 + name_size + sizeof(f64);
+  }
+
+  for (slot = 0; slot < program->vars_size; ++slot)
+  {
+    if (!bound[slot])
+    {
+      request->status = SERVER_UNBOUND;
+      request->done = 1;
+    }
+  }
+
+  /* A compiled but uncached program is only valid until the next miss, so evaluate it right away */
+  if (!request->done && request->expression == SERVER_NONE)
+  {
+    request->value = aritlex_eval(&uncached, request->vars);
+    request->done = 1;
+  }
+
+  return frame_size;
+}
+
+/* Evaluates the open requests of the batch, one aritlex_eval_batch call per distinct expression */
+static void server_evaluate(u32 batch_size)
+{
+  u32 i, j, slot;
+
+  for (i = 0; i < batch_size; ++i)
+  {
+    aritlex_program *program;
+    f64 *columns[ARITLEX_VARS_CAPACITY];
+    u32 rows = 0;
+
+    if (batch[i].done)
+    {
+      continue;
+    }
+
+    program = &cache[batch[i].expression].program;
+
+    for (j = i; j < batch_size; ++j)
+    {
+      if (!batch[j].done && batch[j].expression == batch[i].expression)
+      {
+        for (slot = 0; slot < program->vars_size; ++slot)
+        {
+          columns_data[slot][rows] = batch[j].vars[slot];
+        }
+
+        batch_rows[rows++] = j;
+      }
+    }
+
+    for (slot = 0; slot < program->vars_size; ++slot)
+    {
+      columns[slot] = columns_data[slot];
+    }
+
+    aritlex_eval_batch(program, columns, rows, out, &scratch);
+
+    for (j = 0; j < rows; ++j)
+    {
+      batch[batch_rows[j]].value = out[j];
+      batch[batch_rows[j]].done = 1;
+    }
+  }
+}
+
+static void server_respond(server_request *request)
+{
+  server_connection *c = &connections[request->connection];
+  u8 *response = c->out + c->out_end;
+  u32 reserved = 0;
+
+  memcpy(response, &request->id, 4);
+  memcpy(response + 4, &request->expression, 4);
+  memcpy(response + 8, &request->status, 4);
+  memcpy(response + 12, &reserved, 4);
+  memcpy(response + 16, &request->value, 8);
+  c->out_end += SERVER_RESPONSE;
+}
+
+static void server_close(int epoll, u32 index)
+{
+  epoll_ctl(epoll, EPOLL_CTL_DEL, connections[index].fd, 0);
+  close(connections[index].fd);
+  connections[index].fd = -1;
+}
+
+/* Sends what is pending. Returns 0 if the peer is gone. */
+static u32 server_flush(server_connection *c)
+{
+  while (c->out_begin < c->out_end)
+  {
+    ssize_t sent = send(c->fd, c->out + c->out_begin, c->out_end - c->out_begin, MSG_NOSIGNAL);
+
+    if (sent < 0)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    c->out_begin += (u32)sent;
+  }
+
+  c->out_begin = c->out_end = 0;
+  return 1;
+}
+
+/* Reads what fits into the input buffer. Returns 0 on end of stream or errors. */
+static u32 server_read(server_connection *c)
+{
+  while (c->in_size < SERVER_BUFFER)
+  {
+    ssize_t received = read(c->fd, c->in + c->in_size, SERVER_BUFFER - c->in_size);
+
+    if (received == 0)
+    {
+      return 0;
+    }
+
+    if (received < 0)
+    {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    c->in_size += (u32)received;
+  }
+
+  return 1;
+}
+
+/* Moves the complete requests of connection index into the batch, as far as the batch and the output buffer have room */
+static u32 server_parse(u32 index, u32 *batch_size)
+{
+  server_connection *c = &connections[index];
+  u32 offset = 0, frames = 0;
+
+  while (*batch_size < SERVER_BATCH && c->in_size - offset >= SERVER_HEADER &&
+         c->out_end + SERVER_RESPONSE * (frames + 1) <= SERVER_BUFFER)
+  {
+    u32 frame_size = server_u32(c->in + offset);
+    server_request *request = &batch[*batch_size];
+
+    if (frame_size > SERVER_BUFFER || frame_size < SERVER_HEADER)
+    {
+      return 0;
+    }
+
+    if (frame_size > c->in_size - offset)
+    {
+      break;
+    }
+
+    request->connection = index;
+
+    if (!server_decode(c->in + offset, frame_size, request))
+    {
+      return 0;
+    }
+
+    offset += frame_size;
+    frames++;
+    (*batch_size)++;
+  }
+
+  memmove(c->in, c->in + offset, c->in_size - offset);
+  c->in_size -= offset;
+
+  return 1;
+}
+
+static u32 server_backlog(server_connection *c)
+{
+  return c->fd >= 0 && c->in_size >= SERVER_HEADER && server_u32(c->in) <= c->in_size;
+}
+
+/* Only waits for input while there is room for it and for output while some is pending */
+static void server_interest(int epoll, u32 index)
+{
+  server_connection *c = &connections[index];
+  struct epoll_event event;
+
+  event.events = (c->in_size < SERVER_BUFFER ? (u32)EPOLLIN : 0u) | (c->out_end > c->out_begin ? (u32)EPOLLOUT : 0u);
+  event.data.u32 = index;
+
+  if (event.events != c->events)
+  {
+    c->events = event.events;
+    epoll_ctl(epoll, EPOLL_CTL_MOD, c->fd, &event);
+  }
+}
+
+static void server_accept(int epoll, int listener)
+{
+  int fd;
+
+  while ((fd = accept(listener, 0, 0)) >= 0)
+  {
+    struct epoll_event event;
+    u32 i;
+
+    for (i = 0; i < SERVER_CONNECTIONS && connections[i].fd >= 0; ++i)
+    {
+    }
+
+    if (i == SERVER_CONNECTIONS)
+    {
+      close(fd);
+      continue;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    connections[i].fd = fd;
+    connections[i].in_size = 0;
+    connections[i].out_begin = connections[i].out_end = 0;
+    connections[i].events = (u32)EPOLLIN;
+
+    event.events = (u32)EPOLLIN;
+    event.data.u32 = i;
+    epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  struct sockaddr_un address;
+  struct epoll_event events[SERVER_EVENTS];
+  struct epoll_event event;
+  u32 requests = 0, batches = 0, open = 0, backlog = 0, start = 0;
+  u32 i;
+  int listener, epoll;
+
+  if (argc != 2 || aritlex_strlen(argv[1]) >= sizeof(address.sun_path))
+  {
+    printf("usage: %s socket\n", argv[0]);
+    return 1;
+  }
+
+  for (i = 0; i < SERVER_CONNECTIONS; ++i)
+  {
+    connections[i].fd = -1;
+  }
+
+  aritlex_batch_init(&scratch);
+
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  memcpy(address.sun_path, argv[1], aritlex_strlen(argv[1]));
+  unlink(argv[1]);
+
+  listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  epoll = epoll_create(SERVER_EVENTS);
+
+  if (listener < 0 || epoll < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(listener, SERVER_CONNECTIONS) != 0)
+  {
+    printf("[aritlex] can not listen on %s\n", argv[1]);
+    return 1;
+  }
+
+  fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) | O_NONBLOCK);
+  event.events = (u32)EPOLLIN;
+  event.data.u32 = SERVER_CONNECTIONS;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+
+  printf("[aritlex] listening on %s\n", argv[1]);
+  fflush(stdout);
+
+  for (;;)
+  {
+    /* Requests left over from a full batch are already buffered, so do not block on new ones */
+    int ready = epoll_wait(epoll, events, SERVER_EVENTS, backlog ? 0 : -1);
+    u32 batch_size = 0;
+
+    for (i = 0; ready > 0 && i < (u32)ready; ++i)
+    {
+      u32 index = events[i].data.u32;
+
+      if (index == SERVER_CONNECTIONS)
+      {
+        server_accept(epoll, listener);
+      }
+      else if (connections[index].fd >= 0 &&
+               (!server_flush(&connections[index]) || ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !server_read(&connections[index]))))
+      {
+        server_close(epoll, index);
+      }
+    }
+
+    /* Rotate the first connection so a busy one can not keep the others out of full batches */
+    for (i = 0; i < SERVER_CONNECTIONS; ++i)
+    {
+      u32 index = (start + i) % SERVER_CONNECTIONS;
+
+      if (connections[index].fd >= 0 && !server_parse(index, &batch_size))
+      {
+        server_close(epoll, index);
+      }
+    }
+
+    start = (start + 1) % SERVER_CONNECTIONS;
+
+    if (batch_size)
+    {
+      server_evaluate(batch_size);
+
+      for (i = 0; i < batch_size; ++i)
+      {
+        if (connections[batch[i].connection].fd >= 0)
+        {
+          server_respond(&batch[i]);
+        }
+      }
+
+      requests += batch_size;
+      batches++;
+    }
+
+    backlog = 0;
+    open = 0;
+
+    for (i = 0; i < SERVER_CONNECTIONS; ++i)
+    {
+      if (connections[i].fd < 0)
+      {
+        continue;
+      }
+
+      if (!server_flush(&connections[i]))
+      {
+        server_close(epoll, i);
+        continue;
+      }
+
+      server_interest(epoll, i);
+      backlog |= server_backlog(&connections[i]);
+      open++;
+    }
+
+    if (open == 0 && requests)
+    {
+      printf("[aritlex] %u requests in %u batches (%.1f per batch), %u cached expressions\n",
+             requests, batches, (f64)requests / (f64)batches, cache_size);
+      fflush(stdout);
+      requests = batches = 0;
+    }
+  }
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/
@@ -0,0 +1,196 @@
+/* aritlex.h - v0.2 - public domain data structures - nickscha 2025
+
+A C89 standard compliant, single header, nostdlib (no C Standard Library) Arithmetic Lexer (ARITLEX).
+
+Timeline of batches of expressions going through tokenize, compile and evaluate, recorded with
+the perf.h trace zones and written as Chrome trace JSON. Open the file in chrome://tracing or
+ui.perfetto.dev. Prints the cost of one trace event first.
+
+  cc -O2 -o aritlex_trace aritlex_trace.c
+  ./aritlex_trace [batches] [aritlex_trace.json]
+
+LICENSE
+
+  Placed in the public domain and also MIT licensed.
+  See end of file for detailed license information.
+
+*/
+#define PERF_TRACE_ENABLE
+#define PERF_TRACE_CAPACITY 65536
+#include "../aritlex.h"   /* Arithmetic Lexer */
+#include "../deps/perf.h" /* Simple Performance profiler */
+#include "stdio.h"        /* printf, fopen */
+#include "stdlib.h"       /* malloc, atoi */
+
+#define EXPRESSIONS_SIZE 5
+#define BATCH_SIZE 32
+#define ROWS 256
+#define TOKENS_CAPACITY 64
+#define OVERHEAD_EVENTS 1000000
+
+static s8 *expressions[EXPRESSIONS_SIZE] = {
+    "(price * qty - discount) / (qty + 1)",
+    "price > 50 ? price * 0.9 : price",
+    "(qty * 3 + 7) % 5 << 2",
+    "price * price - 2 * price * discount + discount * discount",
+    "qty >= 10 && discount < 5 || price == 0"};
+
+static aritlex_token tokens[TOKENS_CAPACITY];
+static aritlex_program program;
+
+/* One batch, every expression lexed, compiled and evaluated on ROWS rows inside its own zones */
+static u32 trace_batch(u32 batch, f64 *sum)
+{
+  u32 i, row, slot;
+
+  PERF_TRACE_BEGIN("batch");
+
+  for (i = 0; i < BATCH_SIZE; ++i)
+  {
+    s8 *code = expressions[(batch + i) % EXPRESSIONS_SIZE];
+    f64 vars[ARITLEX_VARS_CAPACITY];
+    u32 tokens_size = 0;
+    u32 ok;
+
+    PERF_TRACE_BEGIN("expression");
+
+    PERF_TRACE_BEGIN("tokenize");
+    ok = aritlex_tokenize(code, aritlex_strlen(code), tokens, TOKENS_CAPACITY, &tokens_size);
+    PERF_TRACE_END("tokenize");
+
+    PERF_TRACE_BEGIN("compile");
+    ok = ok && aritlex_compile(tokens, tokens_size, &program);
+    PERF_TRACE_END("compile");
+
+    if (!ok)
+    {
+      PERF_TRACE_END("expression");
+      PERF_TRACE_END("batch");
+      return 0;
+    }
+
+    PERF_TRACE_BEGIN("eval");
+
+    for (row = 0; row < ROWS; ++row)
+    {
+      for (slot = 0; slot < program.vars_size; ++slot)
+      {
+        vars[slot] = (f64)((row * 2654435761u + slot * 40503u) % 1000u) / 10.0;
+      }
+
+      *sum += aritlex_eval(&program, vars);
+    }
+
+    PERF_TRACE_END("eval");
+
+    PERF_TRACE_END("expression");
+  }
+
+  PERF_TRACE_END("batch");
+
+  return 1;
+}
+
+int main(int argc, char **argv)
+{
+  u32 batches = argc > 1 ? (u32)atoi(argv[1]) : 64u;
+  char *path = argc > 2 ? argv[2] : "aritlex_trace.json";
+  unsigned long capacity = PERF_TRACE_CAPACITY * 128ul;
+  char *json = (char *)malloc(capacity);
+  unsigned long size;
+  double start, overhead_ns;
+  f64 sum = 0.0;
+  FILE *file;
+  u32 i;
+
+  if (!json)
+  {
+    return 1;
+  }
+
+  /* Cost of one marker, the ring wraps many times */
+  perf_trace_reset();
+  start = perf_platform_current_time_nanoseconds();
+
+  for (i = 0; i < OVERHEAD_EVENTS / 2; ++i)
+  {
+    PERF_TRACE_BEGIN("overhead");
+    PERF_TRACE_END("overhead");
+  }
+
+  overhead_ns = (perf_platform_current_time_nanoseconds() - start) / (double)OVERHEAD_EVENTS;
+
+  perf_trace_reset();
+
+  for (i = 0; i < batches; ++i)
+  {
+    if (!trace_batch(i, &sum))
+    {
+      printf("[aritlex] expression does not compile\n");
+      return 1;
+    }
+  }
+
+  size = perf_trace_json(json, capacity);
+  file = fopen(path, "wb");
+
+  if (!file || fwrite(json, 1, size, file) != size)
+  {
+    printf("[aritlex] can not write %s\n", path);
+    return 1;
+  }
+
+  fclose(file);
+
+  printf("[aritlex] %.1f ns per trace event\n", overhead_ns);
+  printf("[aritlex] %u batches, %ld events (%u kept), checksum %g\n", batches, perf_trace_count,
+         perf_trace_count < PERF_TRACE_CAPACITY ? (u32)perf_trace_count : PERF_TRACE_CAPACITY, sum);
+  printf("[aritlex] %lu bytes of trace JSON written to %s\n", size, path);
+
+  free(json);
+
+  return 0;
+}
+
+/*
+   ------------------------------------------------------------------------------
+   This software is available under 2 licenses -- choose whichever you prefer.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE A - MIT License
+   Copyright (c) 2025 nickscha
+   Permission is hereby granted, free of charge, to any person obtaining a copy of
+   this software and associated documentation files (the "Software"), to deal in
+   the Software without restriction, including without limitation the rights to
+   use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+   of the Software, and to permit persons to whom the Software is furnished to do
+   so, subject to the following conditions:
+   The above copyright notice and this permission notice shall be included in all
+   copies or substantial portions of the Software.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+   ALTERNATIVE B - Public Domain (www.unlicense.org)
+   This is free and unencumbered software released into the public domain.
+   Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+   software, either in source code form or as a compiled binary, for any purpose,
+   commercial or non-commercial, and by any means.
+   In jurisdictions that recognize copyright laws, the author or authors of this
+   software dedicate any and all copyright interest in the software to the public
+   domain. We make this dedication for the benefit of the public at large and to
+   the detriment of our heirs and successors. We intend this dedication to be an
+   overt act of relinquishment in perpetuity of all present and future rights to
+   this software under copyright law.
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+   OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+   SOFTWARE.
+   ------------------------------------------------------------------------------
+*/